@@ -0,0 +1,595 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic.h>
+#include <static_assert.h>
+#include <loki/Typelist.h>
+#include <priority_queue.h>
+#include <ring_buffer.h>
+#include "ioreg.h"
+#include "stm32f10x.h"
+#include "clock.h"
+
+namespace HAL
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// CAN frame. Identifier is 11 bit, or 29 bit with Extended flag; Remote flag
+	// marks remote frames. Filter is the filter match index of received frames.
+	////////////////////////////////////////////////////////////////////////////////
+
+	struct CanFrame
+	{
+		enum
+		{
+			Extended = 0x80000000u,
+			Remote = 0x40000000u,
+			IdMask = 0x1fffffff
+		};
+		uint32_t id;
+		uint8_t length;
+		uint8_t filter;
+		uint16_t time;
+		uint8_t data[8];
+	};
+
+	class CanBase
+	{
+	public:
+		enum Mode
+		{
+			Normal = 0,
+			Loopback = CAN_BTR_LBKM,
+			Silent = CAN_BTR_SILM,
+			SilentLoopback = CAN_BTR_LBKM | CAN_BTR_SILM
+		};
+
+		// BTR value for bitrate with sample point near 87.5%,
+		// 0 if clock can not be divided to a bitrate with 8..16 time quanta
+		static uint32_t BitTiming(uint32_t clock, uint32_t bitrate)
+		{
+			for(uint32_t quanta = 16; quanta >= 8; quanta--)
+			{
+				uint32_t prescaler = clock / (bitrate * quanta);
+				if(prescaler == 0 || prescaler > 1024 || prescaler * bitrate * quanta != clock)
+					continue;
+				uint32_t seg2 = (quanta + 4) / 8;
+				uint32_t seg1 = quanta - 1 - seg2;
+				return (seg2 - 1) << 20 | (seg1 - 1) << 16 | (prescaler - 1);
+			}
+			return 0;
+		}
+	};
+
+	namespace CanPrivate
+	{
+		// Identifier register (TIR/RIR) and 16 bit filter formats
+		template<uint32_t ID>
+		struct Id32
+		{
+			static const uint32_t value = ((ID & CanFrame::Extended) ? (ID & CanFrame::IdMask) << 3 | CAN_TI0R_IDE : (ID & 0x7ff) << 21) |
+				((ID & CanFrame::Remote) ? CAN_TI0R_RTR : 0);
+		};
+
+		template<uint32_t ID, uint32_t MASK>
+		struct Mask32
+		{
+			static const uint32_t value = ((ID & CanFrame::Extended) ? (MASK & CanFrame::IdMask) << 3 : (MASK & 0x7ff) << 21) |
+				CAN_TI0R_IDE | ((MASK & CanFrame::Remote) ? CAN_TI0R_RTR : 0);
+		};
+
+		template<uint32_t ID>
+		struct Id16
+		{
+			static const uint32_t value = ((ID & CanFrame::Extended) ? ((ID >> 18) & 0x7ff) << 5 | 0x08 | ((ID >> 15) & 7) : (ID & 0x7ff) << 5) |
+				((ID & CanFrame::Remote) ? 0x10 : 0);
+		};
+
+		template<uint32_t ID, uint32_t MASK>
+		struct Mask16
+		{
+			static const uint32_t value = ((ID & CanFrame::Extended) ? ((MASK >> 18) & 0x7ff) << 5 | ((MASK >> 15) & 7) : (MASK & 0x7ff) << 5) |
+				0x08 | ((MASK & CanFrame::Remote) ? 0x10 : 0);
+		};
+
+		inline uint32_t EncodeId(uint32_t id)
+		{
+			uint32_t result = (id & CanFrame::Extended) ? (id & CanFrame::IdMask) << 3 | CAN_TI0R_IDE : (id & 0x7ff) << 21;
+			return (id & CanFrame::Remote) ? result | CAN_TI0R_RTR : result;
+		}
+
+		inline uint32_t DecodeId(uint32_t ir)
+		{
+			uint32_t id = (ir & CAN_RI0R_IDE) ? ir >> 3 | CanFrame::Extended : ir >> 21;
+			return (ir & CAN_RI0R_RTR) ? id | CanFrame::Remote : id;
+		}
+
+		// Frame in mailbox register format, ordered by bus priority
+		// (lower identifier register value wins arbitration),
+		// frames with the same identifier in order of sending
+		struct TxEntry
+		{
+			uint32_t ir;
+			uint32_t dtr;
+			uint32_t dlr;
+			uint32_t dhr;
+			uint16_t sequence;
+		};
+
+		struct TxBefore
+		{
+			bool operator()(const TxEntry &a, const TxEntry &b)const
+			{
+				return a.ir < b.ir || (a.ir == b.ir && int16_t(a.sequence - b.sequence) < 0);
+			}
+		};
+
+		template<class Filters, unsigned Bank = 0>
+		struct FilterBanks;
+
+		template<unsigned Bank>
+		struct FilterBanks<Loki::NullType, Bank>
+		{
+			static const uint32_t Banks = 0;
+			static const uint32_t ListBanks = 0;
+			static const uint32_t WideBanks = 0;
+			static const uint32_t Fifo1Banks = 0;
+			template<class Regs>
+			static void Write()
+			{}
+		};
+
+		template<class Head, class Tail, unsigned Bank>
+		struct FilterBanks<Loki::Typelist<Head, Tail>, Bank>
+		{
+			typedef FilterBanks<Tail, Bank + 1> Next;
+			static const uint32_t Bit = 1ul << Bank;
+			static const uint32_t Banks = Bit | Next::Banks;
+			static const uint32_t ListBanks = (Head::List ? Bit : 0) | Next::ListBanks;
+			static const uint32_t WideBanks = (Head::Wide ? Bit : 0) | Next::WideBanks;
+			static const uint32_t Fifo1Banks = (Head::Fifo ? Bit : 0) | Next::Fifo1Banks;
+
+			template<class Regs>
+			static void Write()
+			{
+				Regs()->sFilterRegister[Bank].FR1 = Head::FR1;
+				Regs()->sFilterRegister[Bank].FR2 = Head::FR2;
+				Next::template Write<Regs>();
+			}
+		};
+
+		// Filter numbers are counted per FIFO in bank order
+		template<class Filters, class Filter>
+		struct MatchIndex;
+
+		template<class Filter, class Tail>
+		struct MatchIndex<Loki::Typelist<Filter, Tail>, Filter>
+		{
+			enum { value = 0 };
+		};
+
+		template<class Head, class Tail, class Filter>
+		struct MatchIndex<Loki::Typelist<Head, Tail>, Filter>
+		{
+			enum { value = (int(Head::Fifo) == int(Filter::Fifo) ? Head::Numbers : 0) + MatchIndex<Tail, Filter>::value };
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Filter banks. Identifiers and masks take CanFrame::Extended and
+	// CanFrame::Remote flags. A mask has 1 for identifier bits that must match,
+	// Remote flag in a mask makes RTR bit matched too; the frame format
+	// (standard/extended) is always matched. 16 bit filters match standard
+	// identifiers and the upper 14 bits of extended ones.
+	// Numbers is the count of filter numbers (match indexes) the bank takes.
+	////////////////////////////////////////////////////////////////////////////////
+
+	template<uint32_t ID, uint32_t MASK, unsigned FIFO = 0>
+	struct CanMask32
+	{
+		enum { List = 0, Wide = 1, Fifo = FIFO, Numbers = 1 };
+		static const uint32_t FR1 = CanPrivate::Id32<ID>::value;
+		static const uint32_t FR2 = CanPrivate::Mask32<ID, MASK>::value;
+	};
+
+	template<uint32_t ID1, uint32_t ID2, unsigned FIFO = 0>
+	struct CanList32
+	{
+		enum { List = 1, Wide = 1, Fifo = FIFO, Numbers = 2 };
+		static const uint32_t FR1 = CanPrivate::Id32<ID1>::value;
+		static const uint32_t FR2 = CanPrivate::Id32<ID2>::value;
+	};
+
+	template<uint32_t ID1, uint32_t MASK1, uint32_t ID2, uint32_t MASK2, unsigned FIFO = 0>
+	struct CanMask16
+	{
+		enum { List = 0, Wide = 0, Fifo = FIFO, Numbers = 2 };
+		static const uint32_t FR1 = CanPrivate::Id16<ID1>::value | CanPrivate::Mask16<ID1, MASK1>::value << 16;
+		static const uint32_t FR2 = CanPrivate::Id16<ID2>::value | CanPrivate::Mask16<ID2, MASK2>::value << 16;
+	};
+
+	template<uint32_t ID1, uint32_t ID2, uint32_t ID3, uint32_t ID4, unsigned FIFO = 0>
+	struct CanList16
+	{
+		enum { List = 1, Wide = 0, Fifo = FIFO, Numbers = 4 };
+		static const uint32_t FR1 = CanPrivate::Id16<ID1>::value | CanPrivate::Id16<ID2>::value << 16;
+		static const uint32_t FR2 = CanPrivate::Id16<ID3>::value | CanPrivate::Id16<ID4>::value << 16;
+	};
+
+	namespace Private
+	{
+		////////////////////////////////////////////////////////////////////////////////
+		// class template BxCan
+		// Interrupt driven bxCAN driver.
+		// Regs is a register block wrapper (IO_STRUCT_WRAPPER), ClockCtrl enables
+		// the peripheral clock. Filters is a typelist of filter banks
+		// (CanMask32, CanList32, CanMask16, CanList16) loaded to banks 0, 1, ...
+		// by Init; FilterIndex<Bank>::value is the match index of the first filter
+		// of the bank, CanFrame::filter of received frames tells the filter that
+		// accepted the frame.
+		//
+		// Send puts frames to a priority queue of TX_SIZE entries, ordered like
+		// the bus arbitration does, frames with equal identifiers keep their
+		// order. The three hardware mailboxes are loaded from the queue top; a
+		// frame with the same identifier as a pending mailbox waits, so the
+		// hardware can not reorder them. If all mailboxes are busy and the queue
+		// top outranks a pending frame, the lowest priority mailbox is aborted
+		// and its frame goes back to the queue; Send keeps a queue entry free
+		// for it until the abort completes.
+		// RX FIFO interrupts drain both hardware FIFOs (3 frames deep) into a
+		// ring of RX_SIZE frames, Receive reads them from the main loop. The two
+		// RX interrupts may have different priorities, the ring is written with
+		// interrupts disabled.
+		//
+		// Usage:
+		//		typedef Loki::TL::MakeTypelist<
+		//			CanMask32<0x080, 0x7ff>,				// SYNC
+		//			CanMask16<0x600 | NODE, 0x7ff, 0x000, 0x7ff, 1>	// SDO, NMT
+		//			>::Result Filters;
+		//		typedef HAL::Can1<Filters> Can;
+		//		Can::Init(Can::BitTiming(36000000, 500000));
+		//		enable USB_HP_CAN1_TX, USB_LP_CAN1_RX0 and CAN1_RX1 interrupts in NVIC
+		//		USB_HP_CAN1_TX_IRQHandler:	Can::TxHandler();
+		//		USB_LP_CAN1_RX0_IRQHandler:	Can::Rx0Handler();
+		//		CAN1_RX1_IRQHandler:		Can::Rx1Handler();
+		////////////////////////////////////////////////////////////////////////////////
+
+		template<class Regs, class ClockCtrl, class Filters, unsigned RX_SIZE = 16, unsigned TX_SIZE = 16>
+		class BxCan :public CanBase
+		{
+			typedef CanPrivate::FilterBanks<Filters> Banks;
+			typedef CanPrivate::TxEntry TxEntry;
+		public:
+			enum { Mailboxes = 3 };
+
+			template<class Bank>
+			struct FilterIndex :public CanPrivate::MatchIndex<Filters, Bank>
+			{};
+
+			// Returns false if the controller does not leave initialization
+			// mode, i.e. the bus is not recessive.
+			static bool Init(uint32_t bitTiming, Mode mode = Normal)
+			{
+				ClockCtrl::Enable();
+				// wake up, automatic bus-off recovery, transmit by identifier priority
+				Regs()->MCR = CAN_MCR_INRQ | CAN_MCR_ABOM | CAN_MCR_AWUM;
+				if(!WaitInit(true))
+					return false;
+				Regs()->BTR = bitTiming | mode;
+
+				Regs()->FMR |= CAN_FMR_FINIT;
+				Regs()->FA1R = Regs()->FA1R & ~Banks::Banks;
+				Regs()->FM1R = (Regs()->FM1R & ~Banks::Banks) | Banks::ListBanks;
+				Regs()->FS1R = (Regs()->FS1R & ~Banks::Banks) | Banks::WideBanks;
+				Regs()->FFA1R = (Regs()->FFA1R & ~Banks::Banks) | Banks::Fifo1Banks;
+				Banks::template Write<Regs>();
+				Regs()->FA1R = Regs()->FA1R | Banks::Banks;
+				Regs()->FMR &= ~CAN_FMR_FINIT;
+
+				_queue.Clear();
+				_rx.Clear();
+				_busy = 0;
+				_aborting = 0;
+				_sequence = 0;
+				_rxOverruns = 0;
+				_fifoOverruns = 0;
+				_txErrors = 0;
+				Regs()->IER = CAN_IER_TMEIE | CAN_IER_FMPIE0 | CAN_IER_FMPIE1;
+				Regs()->MCR &= ~CAN_MCR_INRQ;
+				return WaitInit(false);
+			}
+
+			// Returns false if the transmit queue is full, entries reserved for
+			// aborted frames count as taken
+			static bool Send(const CanFrame &frame)
+			{
+				uint8_t length = frame.length > 8 ? 8 : frame.length;
+				TxEntry entry;
+				entry.ir = CanPrivate::EncodeId(frame.id);
+				entry.dtr = length;
+				memcpy(&entry.dlr, frame.data, 4);
+				memcpy(&entry.dhr, frame.data + 4, 4);
+				ATOMIC
+				{
+					entry.sequence = _sequence++;
+					// fast path: nothing waits, a mailbox is free
+					int mailbox = FreeMailbox();
+					if(_queue.IsEmpty() && mailbox >= 0 && !IsPending(entry.ir))
+					{
+						Load(mailbox, entry);
+						return true;
+					}
+					if(_queue.Count() + Aborting() >= TX_SIZE || !_queue.Push(entry))
+						return false;
+					Schedule();
+				}
+				return true;
+			}
+
+			static bool Receive(CanFrame &frame)
+			{
+				return _rx.Read(frame);
+			}
+
+			static unsigned RxCount()
+			{
+				// RingBuffer::Count wraps to 0 when the ring is full
+				return _rx.IsFull() ? RX_SIZE : _rx.Count();
+			}
+
+			// Frames queued or in mailboxes
+			static unsigned TxPending()
+			{
+				unsigned count;
+				ATOMIC
+				{
+					count = _queue.Count() + (_busy & 1) + (_busy >> 1 & 1) + (_busy >> 2);
+				}
+				return count;
+			}
+
+			// Transmit mailbox empty interrupt
+			static void TxHandler()
+			{
+				uint32_t tsr = Regs()->TSR;
+				for(unsigned mailbox = 0; mailbox < Mailboxes; mailbox++)
+				{
+					uint32_t shift = mailbox * 8;
+					if(!(tsr & CAN_TSR_RQCP0 << shift))
+						continue;
+					// clears TXOK, ALST and TERR too
+					Regs()->TSR = CAN_TSR_RQCP0 << shift;
+					uint8_t bit = uint8_t(1 << mailbox);
+					// aborted frames go back to the queue, Send reserved their entries
+					if(!(tsr & CAN_TSR_TXOK0 << shift) && !((_aborting & bit) && _queue.Push(_mailbox[mailbox])))
+						_txErrors++;
+					_busy &= uint8_t(~bit);
+					_aborting &= uint8_t(~bit);
+				}
+				Schedule();
+			}
+
+			// FIFO 0 message pending interrupt
+			static void Rx0Handler()
+			{
+				while(Regs()->RF0R & CAN_RF0R_FMP0)
+				{
+					ReadFifo(0);
+					Regs()->RF0R = CAN_RF0R_RFOM0;
+				}
+				if(Regs()->RF0R & CAN_RF0R_FOVR0)
+				{
+					ATOMIC
+					{
+						_fifoOverruns++;
+					}
+					Regs()->RF0R = CAN_RF0R_FOVR0;
+				}
+			}
+
+			// FIFO 1 message pending interrupt
+			static void Rx1Handler()
+			{
+				while(Regs()->RF1R & CAN_RF1R_FMP1)
+				{
+					ReadFifo(1);
+					Regs()->RF1R = CAN_RF1R_RFOM1;
+				}
+				if(Regs()->RF1R & CAN_RF1R_FOVR1)
+				{
+					ATOMIC
+					{
+						_fifoOverruns++;
+					}
+					Regs()->RF1R = CAN_RF1R_FOVR1;
+				}
+			}
+
+			// Frames lost because the receive ring was full
+			static unsigned RxOverruns()
+			{
+				return _rxOverruns;
+			}
+
+			// Frames lost in hardware FIFOs, interrupts came too late
+			static unsigned FifoOverruns()
+			{
+				return _fifoOverruns;
+			}
+
+			// Frames not transmitted without abort request
+			static unsigned TxErrors()
+			{
+				return _txErrors;
+			}
+
+			static uint8_t TxErrorCounter()
+			{
+				return uint8_t(Regs()->ESR >> 16);
+			}
+
+			static uint8_t RxErrorCounter()
+			{
+				return uint8_t(Regs()->ESR >> 24);
+			}
+
+			static bool IsBusOff()
+			{
+				return (Regs()->ESR & CAN_ESR_BOFF) != 0;
+			}
+
+		private:
+			BOOST_STATIC_ASSERT(Loki::TL::Length<Filters>::value <= 14);
+			BOOST_STATIC_ASSERT((RX_SIZE & (RX_SIZE - 1)) == 0);
+
+			static bool WaitInit(bool init)
+			{
+				for(uint32_t i = 0; i < 0x100000; i++)
+					if(((Regs()->MSR & CAN_MSR_INAK) != 0) == init)
+						return true;
+				return false;
+			}
+
+			static unsigned Aborting()
+			{
+				return (_aborting & 1) + (_aborting >> 1 & 1) + (_aborting >> 2);
+			}
+
+			static int FreeMailbox()
+			{
+				for(unsigned mailbox = 0; mailbox < Mailboxes; mailbox++)
+					if(!(_busy & 1 << mailbox))
+						return int(mailbox);
+				return -1;
+			}
+
+			static bool IsPending(uint32_t ir)
+			{
+				for(unsigned mailbox = 0; mailbox < Mailboxes; mailbox++)
+					if((_busy & 1 << mailbox) && _mailbox[mailbox].ir == ir)
+						return true;
+				return false;
+			}
+
+			static void Load(unsigned mailbox, const TxEntry &entry)
+			{
+				_mailbox[mailbox] = entry;
+				_busy |= uint8_t(1 << mailbox);
+				Regs()->sTxMailBox[mailbox].TDTR = entry.dtr;
+				Regs()->sTxMailBox[mailbox].TDLR = entry.dlr;
+				Regs()->sTxMailBox[mailbox].TDHR = entry.dhr;
+				Regs()->sTxMailBox[mailbox].TIR = entry.ir | CAN_TI0R_TXRQ;
+			}
+
+			// Runs with TX interrupt disabled
+			static void Schedule()
+			{
+				while(!_queue.IsEmpty())
+				{
+					const TxEntry &next = _queue.Top();
+					if(IsPending(next.ir))
+						return;
+					int mailbox = FreeMailbox();
+					if(mailbox < 0)
+					{
+						AbortLowest(next.ir);
+						return;
+					}
+					Load(unsigned(mailbox), next);
+					_queue.Pop();
+				}
+			}
+
+			static void AbortLowest(uint32_t ir)
+			{
+				if(_queue.IsFull())
+					return;
+				int lowest = -1;
+				for(unsigned mailbox = 0; mailbox < Mailboxes; mailbox++)
+				{
+					if(_aborting & 1 << mailbox)
+						return;
+					if(lowest < 0 || _mailbox[mailbox].ir > _mailbox[lowest].ir)
+						lowest = int(mailbox);
+				}
+				if(_mailbox[lowest].ir <= ir)
+					return;
+				_aborting |= uint8_t(1 << lowest);
+				Regs()->TSR = CAN_TSR_ABRQ0 << (lowest * 8);
+			}
+
+			static void ReadFifo(unsigned fifo)
+			{
+				CanFrame frame;
+				uint32_t dtr = Regs()->sFIFOMailBox[fifo].RDTR;
+				uint32_t low = Regs()->sFIFOMailBox[fifo].RDLR;
+				uint32_t high = Regs()->sFIFOMailBox[fifo].RDHR;
+				frame.id = CanPrivate::DecodeId(Regs()->sFIFOMailBox[fifo].RIR);
+				frame.length = uint8_t(dtr & CAN_RDT0R_DLC);
+				if(frame.length > 8)
+					frame.length = 8;
+				frame.filter = uint8_t(dtr >> 8);
+				frame.time = uint16_t(dtr >> 16);
+				memcpy(frame.data, &low, 4);
+				memcpy(frame.data + 4, &high, 4);
+				// FIFO 0 and 1 interrupts both write the ring
+				ATOMIC
+				{
+					if(!_rx.Write(frame))
+						_rxOverruns++;
+				}
+			}
+
+			static PriorityQueue<TxEntry, TX_SIZE, CanPrivate::TxBefore> _queue;
+			static RingBuffer<RX_SIZE, CanFrame> _rx;
+			static TxEntry _mailbox[Mailboxes];
+			static uint8_t _busy;
+			static uint8_t _aborting;
+			static uint16_t _sequence;
+			static unsigned _rxOverruns;
+			static unsigned _fifoOverruns;
+			static unsigned _txErrors;
+		};
+
+#define BXCAN_TEMPLATE_ARGS template<class Regs, class ClockCtrl, class Filters, unsigned RX_SIZE, unsigned TX_SIZE>
+#define BXCAN_CLASS BxCan<Regs, ClockCtrl, Filters, RX_SIZE, TX_SIZE>
+
+		BXCAN_TEMPLATE_ARGS
+		PriorityQueue<CanPrivate::TxEntry, TX_SIZE, CanPrivate::TxBefore> BXCAN_CLASS::_queue;
+
+		BXCAN_TEMPLATE_ARGS
+		RingBuffer<RX_SIZE, CanFrame> BXCAN_CLASS::_rx;
+
+		BXCAN_TEMPLATE_ARGS
+		CanPrivate::TxEntry BXCAN_CLASS::_mailbox[BXCAN_CLASS::Mailboxes];
+
+		BXCAN_TEMPLATE_ARGS
+		uint8_t BXCAN_CLASS::_busy;
+
+		BXCAN_TEMPLATE_ARGS
+		uint8_t BXCAN_CLASS::_aborting;
+
+		BXCAN_TEMPLATE_ARGS
+		uint16_t BXCAN_CLASS::_sequence;
+
+		BXCAN_TEMPLATE_ARGS
+		unsigned BXCAN_CLASS::_rxOverruns;
+
+		BXCAN_TEMPLATE_ARGS
+		unsigned BXCAN_CLASS::_fifoOverruns;
+
+		BXCAN_TEMPLATE_ARGS
+		unsigned BXCAN_CLASS::_txErrors;
+
+#undef BXCAN_CLASS
+#undef BXCAN_TEMPLATE_ARGS
+
+		IO_STRUCT_WRAPPER(CAN1, Can1Regs, CAN_TypeDef);
+	}
+
+#if !defined (STM32F10X_LD_VL) && !defined (STM32F10X_MD_VL) && !defined (STM32F10X_HD_VL)
+	template<class Filters, unsigned RX_SIZE = 16, unsigned TX_SIZE = 16>
+	class Can1 :public Private::BxCan<Private::Can1Regs, Clock::Can1Clock, Filters, RX_SIZE, TX_SIZE>
+	{};
+#endif
+}
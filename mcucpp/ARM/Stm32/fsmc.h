@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stddef.h>
+#include <iopins.h>
+#include <static_assert.h>
+#include <select_size.h>
+#include "stm32f10x.h"
+#include "clock.h"
+
+#if defined (STM32F10X_HD) || defined (STM32F10X_XL)
+
+namespace HAL
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// class template FsmcBus8080
+	// 8080 display bus on FSMC NOR/SRAM bank (STM32F10x high and XL density).
+	// The controller is mapped to memory: D/C line is driven by address line
+	// DC_ADDRESS_LINE, so commands are written to the bank base and data one
+	// address line higher. Strobes are generated by hardware, a write is a
+	// single store, WR timing is set by ADDRESS_SETUP and DATA_SETUP in HCLK
+	// cycles (ILI9341 at 72 MHz needs ADDRESS_SETUP = 1, DATA_SETUP = 2).
+	// Same interface as Bus8080, chip select is driven by FSMC.
+	//
+	// Init configures D0..D7 (D0..D15 for 16 bit bus), NOE, NWE, CsPin (NE of
+	// BANK: Pd7, Pg9, Pg10 or Pg12) and DcPin (the pin of the address line,
+	// e.g. Pd11 for A16) for alternate function, so USE_PORTD and USE_PORTE
+	// (and USE_PORTG for NE2..NE4) have to be defined.
+	////////////////////////////////////////////////////////////////////////////////
+
+	template<class CsPin = IO::Pd7, class DcPin = IO::Pd11, unsigned BANK = 1, unsigned DC_ADDRESS_LINE = 16,
+		bool WIDE = true, unsigned ADDRESS_SETUP = 1, unsigned DATA_SETUP = 2>
+	class FsmcBus8080
+	{
+	public:
+		typedef typename SelectSize<WIDE ? 16 : 8>::Result DataType;
+		static const unsigned Width = WIDE ? 16 : 8;
+
+		static void Init()
+		{
+			Clock::FsmcClock::Enable();
+			// D0..D3, NOE, NWE, D13..D15 on port D, D4..D12 on port E
+			IO::Portd::SetConfiguration<WIDE ? 0xc733 : 0xc033, IO::Portd::AltOut50Mhz>();
+			IO::Porte::SetConfiguration<WIDE ? 0xff80 : 0x0780, IO::Porte::AltOut50Mhz>();
+			CsPin::SetConfiguration(CsPin::Port::AltOut50Mhz);
+			DcPin::SetConfiguration(DcPin::Port::AltOut50Mhz);
+			FSMC_Bank1->BTCR[(BANK - 1) * 2 + 1] =
+				ADDRESS_SETUP * FSMC_BTR1_ADDSET_0 | DATA_SETUP * FSMC_BTR1_DATAST_0;
+			FSMC_Bank1->BTCR[(BANK - 1) * 2] =
+				FSMC_BCR1_WREN | (WIDE ? FSMC_BCR1_MWID_0 : 0) | FSMC_BCR1_MBKEN;
+		}
+
+		static void Select()
+		{}
+
+		static void Deselect()
+		{}
+
+		static void WriteCommand(DataType command)
+		{
+			*Command() = command;
+		}
+
+		static void WriteData(DataType value)
+		{
+			*Data() = value;
+		}
+
+		static void WriteRepeat(DataType value, uint32_t count)
+		{
+			volatile DataType *data = Data();
+			for(; count >= 4; count -= 4)
+			{
+				*data = value;
+				*data = value;
+				*data = value;
+				*data = value;
+			}
+			while(count--)
+				*data = value;
+		}
+
+		static void WriteData(const DataType *values, size_t count)
+		{
+			volatile DataType *data = Data();
+			while(count--)
+				*data = *values++;
+		}
+
+		static void FillPixels(uint16_t color, uint32_t count)
+		{
+			if(WIDE)
+			{
+				WriteRepeat(DataType(color), count);
+				return;
+			}
+			volatile DataType *data = Data();
+			while(count--)
+			{
+				*data = DataType(color >> 8);
+				*data = DataType(color);
+			}
+		}
+
+		static void WritePixels(const uint16_t *pixels, size_t count)
+		{
+			volatile DataType *data = Data();
+			while(count--)
+			{
+				uint16_t color = *pixels++;
+				if(!WIDE)
+					*data = DataType(color >> 8);
+				*data = DataType(color);
+			}
+		}
+
+		static void ReadData(DataType *values, size_t count)
+		{
+			volatile DataType *data = Data();
+			while(count--)
+				*values++ = *data;
+		}
+
+	private:
+		BOOST_STATIC_ASSERT(BANK >= 1 && BANK <= 4 && DC_ADDRESS_LINE <= 25);
+		BOOST_STATIC_ASSERT(ADDRESS_SETUP <= 15 && DATA_SETUP >= 1 && DATA_SETUP <= 255);
+
+		static const uint32_t BankBase = 0x60000000 + (BANK - 1) * 0x04000000;
+		// on 16 bit bus address lines are shifted by one
+		static const uint32_t DataOffset = 1ul << (DC_ADDRESS_LINE + (WIDE ? 1 : 0));
+
+		static volatile DataType *Command()
+		{
+			return reinterpret_cast<volatile DataType *>(BankBase);
+		}
+
+		static volatile DataType *Data()
+		{
+			return reinterpret_cast<volatile DataType *>(BankBase + DataOffset);
+		}
+	};
+}
+
+#endif
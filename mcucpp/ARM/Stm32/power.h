@@ -0,0 +1,66 @@
+#pragma once
+
+#include "stm32f10x.h"
+
+namespace Power
+{
+	// Ordered from the lightest to the deepest. Standby is not used: it
+	// wakes through reset, not through interrupts.
+	enum SleepMode
+	{
+		NoSleep,
+		// Core clock stopped, peripherals running
+		Idle,
+		// All 1.8 V domain clocks stopped, regulator in low power mode;
+		// woken by EXTI lines only (pins, RTC alarm, USB and Ethernet wake up)
+		Stop,
+		Deepest = Stop
+	};
+
+	class Sleep
+	{
+	public:
+		// Has to be called with interrupts disabled, returns with interrupts
+		// disabled once woken up. WFI wakes on a pending interrupt even with
+		// PRIMASK set, the handler runs when interrupts get enabled again.
+		// The part wakes from Stop on HSI, HSE, PLL and the system clock
+		// switch are restored as they were.
+		static void Enter(SleepMode mode)
+		{
+			if(mode == NoSleep)
+				return;
+			if(mode == Idle)
+			{
+				__WFI();
+				return;
+			}
+			uint32_t cr = RCC->CR;
+			uint32_t cfgr = RCC->CFGR;
+			PWR->CR = (PWR->CR & ~PWR_CR_PDDS) | PWR_CR_LPDS;
+			SCB->SCR |= SCB_SCR_SLEEPDEEP;
+			__WFI();
+			SCB->SCR &= ~SCB_SCR_SLEEPDEEP;
+			RestoreClock(cr, cfgr);
+		}
+
+	private:
+		static void RestoreClock(uint32_t cr, uint32_t cfgr)
+		{
+			if(cr & RCC_CR_HSEON)
+			{
+				RCC->CR |= RCC_CR_HSEON;
+				while(!(RCC->CR & RCC_CR_HSERDY))
+					;
+			}
+			if(cr & RCC_CR_PLLON)
+			{
+				RCC->CR |= RCC_CR_PLLON;
+				while(!(RCC->CR & RCC_CR_PLLRDY))
+					;
+			}
+			RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | (cfgr & RCC_CFGR_SW);
+			while((RCC->CFGR & RCC_CFGR_SWS) != (cfgr & RCC_CFGR_SWS))
+				;
+		}
+	};
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <static_assert.h>
+#include "stm32f10x.h"
+#include "clock.h"
+
+namespace HAL
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// class template Rtc
+	// STM32F10x RTC clocked from 32768 Hz LSE as a TimeService time source.
+	// The 32 bit counter runs at TICKS_PER_SECOND and keeps counting on VBAT,
+	// the epoch base is kept in backup registers DR2..DR5, DR1 marks them valid.
+	// Init returns true if RTC was already running and configured, false if it
+	// was (re)started from zero, i.e. after power loss with no battery.
+	//
+	// Usage:
+	//		typedef TimeService<HAL::Rtc<> > Time;
+	////////////////////////////////////////////////////////////////////////////////
+
+	template<unsigned long TICKS_PER_SECOND = 1024, unsigned long LSE_FREQ = 32768>
+	class Rtc
+	{
+		BOOST_STATIC_ASSERT(LSE_FREQ % TICKS_PER_SECOND == 0);
+		static const uint16_t Magic = 0x5ac3;
+		static const uint32_t Prescaler = LSE_FREQ / TICKS_PER_SECOND - 1;
+	public:
+		static const unsigned long TicksPerSecond = TICKS_PER_SECOND;
+
+		static bool Init()
+		{
+			Clock::PowerClock::Enable();
+			Clock::BackupClock::Enable();
+			PWR->CR |= PWR_CR_DBP;
+
+			if((RCC->BDCR & RCC_BDCR_RTCEN) && BKP->DR1 == Magic)
+			{
+				WaitForSync();
+				return true;
+			}
+
+			RCC->BDCR |= RCC_BDCR_BDRST;
+			RCC->BDCR &= ~RCC_BDCR_BDRST;
+			RCC->BDCR |= RCC_BDCR_LSEON;
+			while(!(RCC->BDCR & RCC_BDCR_LSERDY))
+				;
+			RCC->BDCR |= RCC_BDCR_RTCSEL_LSE | RCC_BDCR_RTCEN;
+			WaitForSync();
+
+			WaitForWrite();
+			RTC->CRL |= RTC_CRL_CNF;
+			RTC->PRLH = uint16_t(Prescaler >> 16);
+			RTC->PRLL = uint16_t(Prescaler);
+			RTC->CNTH = 0;
+			RTC->CNTL = 0;
+			RTC->CRL &= ~RTC_CRL_CNF;
+			WaitForWrite();
+
+			BKP->DR1 = Magic;
+			return false;
+		}
+
+		// Counter halves are read separately, the low one again if the high one
+		// changed in between
+		static uint32_t Counter()
+		{
+			uint16_t high = RTC->CNTH;
+			uint16_t low = RTC->CNTL;
+			uint16_t high2 = RTC->CNTH;
+			if(high != high2)
+				low = RTC->CNTL;
+			return uint32_t(high2) << 16 | low;
+		}
+
+		static bool LoadBase(int64_t &base)
+		{
+			if(BKP->DR1 != Magic)
+				return false;
+			uint64_t value = uint64_t(BKP->DR2) | uint64_t(BKP->DR3) << 16 |
+				uint64_t(BKP->DR4) << 32 | uint64_t(BKP->DR5) << 48;
+			if(value == 0)
+				return false;
+			base = int64_t(value);
+			return true;
+		}
+
+		static void StoreBase(int64_t base)
+		{
+			uint64_t value = uint64_t(base);
+			BKP->DR2 = uint16_t(value);
+			BKP->DR3 = uint16_t(value >> 16);
+			BKP->DR4 = uint16_t(value >> 32);
+			BKP->DR5 = uint16_t(value >> 48);
+		}
+
+	private:
+		// Registers read after reset or wake up are valid after APB1 resync
+		static void WaitForSync()
+		{
+			RTC->CRL &= ~RTC_CRL_RSF;
+			while(!(RTC->CRL & RTC_CRL_RSF))
+				;
+		}
+
+		static void WaitForWrite()
+		{
+			while(!(RTC->CRL & RTC_CRL_RTOFF))
+				;
+		}
+	};
+}
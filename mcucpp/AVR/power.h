@@ -0,0 +1,66 @@
+#pragma once
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+namespace Power
+{
+	// Ordered from the lightest to the deepest. Modes the part lacks fall
+	// back to the next lighter one.
+	enum SleepMode
+	{
+		NoSleep,
+		Idle,
+		AdcNoiseReduction,
+		PowerSave,
+		PowerDown,
+		Deepest = PowerDown
+	};
+
+	class Sleep
+	{
+	public:
+		// Has to be called with interrupts disabled, returns with interrupts
+		// disabled once woken up. The instruction following sei is always
+		// executed, so an interrupt pending on entry wakes the part at once
+		// instead of being serviced before sleep.
+		static void Enter(SleepMode mode)
+		{
+			switch(mode)
+			{
+			case NoSleep:
+				return;
+			case Idle:
+				set_sleep_mode(SLEEP_MODE_IDLE);
+				break;
+			case AdcNoiseReduction:
+				set_sleep_mode(AdcMode);
+				break;
+			case PowerSave:
+				set_sleep_mode(PowerSaveMode);
+				break;
+			case PowerDown:
+				set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+				break;
+			}
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			cli();
+			sleep_disable();
+		}
+
+	private:
+#ifdef SLEEP_MODE_ADC
+		static const uint8_t AdcMode = SLEEP_MODE_ADC;
+#else
+		static const uint8_t AdcMode = SLEEP_MODE_IDLE;
+#endif
+#ifdef SLEEP_MODE_PWR_SAVE
+		static const uint8_t PowerSaveMode = SLEEP_MODE_PWR_SAVE;
+#else
+		static const uint8_t PowerSaveMode = AdcMode;
+#endif
+	};
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+// Host side counterpart of AVR/atomic.h and ARM/Stm32/atomic.h.
+// There are no interrupts on the host, so the ATOMIC section only keeps track
+// of nesting to let tests check that code runs inside a critical section.
+
+namespace Atomic
+{
+	class DisableInterrupts
+	{
+	public:
+		DisableInterrupts()
+		{
+			Depth()++;
+		}
+		DisableInterrupts(const DisableInterrupts &)
+		{
+			Depth()++;
+		}
+		~DisableInterrupts()
+		{
+			Depth()--;
+		}
+		operator bool()
+		{return false;}
+
+		static bool IsActive()
+		{return Depth() != 0;}
+	private:
+		static unsigned &Depth()
+		{
+			static unsigned depth = 0;
+			return depth;
+		}
+	};
+
+#define ATOMIC if(Atomic::DisableInterrupts di = Atomic::DisableInterrupts()){}else
+
+#define DECLARE_OP(OPERATION, OP_NAME) \
+	template<class T, class T2>\
+	T FetchAnd ## OP_NAME (volatile T * ptr, T2 value)\
+	{\
+		ATOMIC \
+		{\
+			T tmp = *ptr;\
+			*ptr = tmp OPERATION value;\
+			return tmp;\
+		}\
+	}\
+	template<class T, class T2>\
+	T OP_NAME ## AndFetch(volatile T * ptr, T2 value)\
+	{\
+		ATOMIC \
+		{\
+			T tmp = *ptr OPERATION value;\
+			*ptr = tmp;\
+			return tmp;\
+		}\
+	}
+
+	DECLARE_OP(+, Add)
+	DECLARE_OP(-, Sub)
+	DECLARE_OP(|, Or)
+	DECLARE_OP(&, And)
+	DECLARE_OP(^, Xor)
+
+	template<class T, class T2>
+	bool CompareExchange(T * ptr, T2 oldValue, T2 newValue)
+	{
+		ATOMIC
+		{
+			if(*ptr != oldValue)
+				return false;
+			*ptr = newValue;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,485 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace IO
+{
+	namespace Test
+	{
+		////////////////////////////////////////////////////////////////////////////////
+		// class template CanSim
+		// Host model of STM32 bxCAN for driver tests. RegisterBlock has the
+		// member names of CAN_TypeDef, so a driver taking a register block wrapper
+		// works with it:
+		//		IO_STRUCT_WRAPPER(CanSim<>::Registers(), SimCanRegs, CanSim<>::RegisterBlock);
+		// Register writes act as on the hardware: initialization and sleep
+		// requests, transmit requests and aborts, FIFO release and write 1 to
+		// clear flags. Writes the hardware ignores or forbids (pending mailboxes,
+		// filters outside filter init mode, bit timing outside init mode, FIFO
+		// mailboxes) are counted as violations.
+		// Transmit sends one pending mailbox to the bus in priority order
+		// (identifier, or request order with TXFP). In loopback mode it is received
+		// back through the filters, Inject receives a frame from another node.
+		// Filters follow the hardware rules: filter numbers per FIFO in bank
+		// order, 32 bit before 16 bit, list before mask, then the lower number.
+		// Interrupts are not asynchronous: ServiceInterrupts calls the driver
+		// handlers while their conditions are set; a handler leaving its
+		// condition set is counted as a violation.
+		////////////////////////////////////////////////////////////////////////////////
+
+		template<unsigned ID = 0>
+		class CanSim
+		{
+		public:
+			enum { Banks = 14 };
+
+			struct Message
+			{
+				uint32_t id;
+				bool extended;
+				bool remote;
+				uint8_t length;
+				uint8_t data[8];
+			};
+
+			class Register
+			{
+			public:
+				operator uint32_t()const
+				{
+					return _value;
+				}
+				Register &operator=(uint32_t value)
+				{
+					CanSim::Write(*this, value);
+					return *this;
+				}
+				Register &operator|=(uint32_t value)
+				{
+					return *this = _value | value;
+				}
+				Register &operator&=(uint32_t value)
+				{
+					return *this = _value & value;
+				}
+			private:
+				friend class CanSim;
+				uint32_t _value;
+			};
+
+			struct TxMailbox
+			{
+				Register TIR, TDTR, TDLR, TDHR;
+			};
+
+			struct FifoMailbox
+			{
+				Register RIR, RDTR, RDLR, RDHR;
+			};
+
+			struct FilterRegister
+			{
+				Register FR1, FR2;
+			};
+
+			struct RegisterBlock
+			{
+				Register MCR, MSR, TSR, RF0R, RF1R, IER, ESR, BTR;
+				TxMailbox sTxMailBox[3];
+				FifoMailbox sFIFOMailBox[2];
+				Register FMR, FM1R, FS1R, FFA1R, FA1R;
+				FilterRegister sFilterRegister[Banks];
+			};
+
+			static RegisterBlock *Registers()
+			{
+				return &State().regs;
+			}
+
+			// Power on state
+			static void Reset()
+			{
+				SimState &state = State();
+				memset(&state.regs, 0, sizeof(state.regs));
+				memset(state.fifo, 0, sizeof(state.fifo));
+				memset(state.fifoMatch, 0, sizeof(state.fifoMatch));
+				memset(state.fifoCount, 0, sizeof(state.fifoCount));
+				memset(state.request, 0, sizeof(state.request));
+				state.requests = 0;
+				state.violations = 0;
+				state.filtered = 0;
+				state.bus.clear();
+				state.regs.MCR._value = 0x00010002;
+				state.regs.MSR._value = 0x00000c02;
+				state.regs.TSR._value = TmeAll;
+				state.regs.FMR._value = 0x2a1c0e01;
+			}
+
+			// Frames sent to the bus
+			static const std::vector<Message> &Bus()
+			{
+				return State().bus;
+			}
+
+			static void ClearBus()
+			{
+				State().bus.clear();
+			}
+
+			static unsigned Violations()
+			{
+				return State().violations;
+			}
+
+			// Received frames no filter accepted
+			static unsigned Filtered()
+			{
+				return State().filtered;
+			}
+
+			static void SetErrorCounters(uint8_t tec, uint8_t rec, bool busOff)
+			{
+				State().regs.ESR._value = uint32_t(rec) << 24 | uint32_t(tec) << 16 | (busOff ? 4 : 0);
+			}
+
+			// Sends the highest priority pending mailbox, false if none
+			static bool Transmit()
+			{
+				SimState &state = State();
+				RegisterBlock &regs = state.regs;
+				if(regs.MSR._value & (Inak | Slak))
+					return false;
+				int next = -1;
+				for(int i = 0; i < 3; i++)
+				{
+					if(regs.TSR._value & TmeBit(i))
+						continue;
+					if(next < 0 || Before(i, next))
+						next = i;
+				}
+				if(next < 0)
+					return false;
+				TxMailbox &mailbox = regs.sTxMailBox[next];
+				Message message;
+				uint32_t ir = mailbox.TIR._value;
+				message.extended = (ir & 4) != 0;
+				message.remote = (ir & 2) != 0;
+				message.id = message.extended ? ir >> 3 : ir >> 21;
+				message.length = uint8_t(mailbox.TDTR._value & 0x0f);
+				memcpy(message.data, &mailbox.TDLR._value, 4);
+				memcpy(message.data + 4, &mailbox.TDHR._value, 4);
+				mailbox.TIR._value &= ~1u;
+				regs.TSR._value |= TmeBit(next) | 3u << (next * 8);
+				state.bus.push_back(message);
+				if(regs.BTR._value & Lbkm)
+					Receive(message);
+				return true;
+			}
+
+			// Frame from another node
+			static void Inject(const Message &message)
+			{
+				RegisterBlock &regs = State().regs;
+				if(regs.MSR._value & (Inak | Slak) || regs.BTR._value & Lbkm)
+					return;
+				Receive(message);
+			}
+
+			template<class Driver>
+			static void ServiceInterrupts()
+			{
+				// a handler may start something that raises its interrupt again
+				for(unsigned i = 0; i < 16; i++)
+				{
+					bool serviced = false;
+					if(TxInterrupt())
+					{
+						Driver::TxHandler();
+						serviced = true;
+					}
+					if(RxInterrupt(0))
+					{
+						Driver::Rx0Handler();
+						serviced = true;
+					}
+					if(RxInterrupt(1))
+					{
+						Driver::Rx1Handler();
+						serviced = true;
+					}
+					if(!serviced)
+						return;
+				}
+				// handlers do not clear their conditions
+				if(TxInterrupt() || RxInterrupt(0) || RxInterrupt(1))
+					State().violations++;
+			}
+
+			// Transmits all pending frames serving interrupts after each one
+			template<class Driver>
+			static unsigned Run()
+			{
+				unsigned frames = 0;
+				ServiceInterrupts<Driver>();
+				while(Transmit())
+				{
+					frames++;
+					ServiceInterrupts<Driver>();
+				}
+				return frames;
+			}
+
+		private:
+			enum
+			{
+				Inrq = 1, Sleep = 2, Txfp = 4, Rflm = 8, SoftwareReset = 0x8000,
+				Inak = 1, Slak = 2,
+				TmeAll = 0x1c000000,
+				Finit = 1,
+				Fmp = 3, Full = 8, Fovr = 0x10, Rfom = 0x20,
+				Tmeie = 1, Fmpie0 = 2, Fovie0 = 8, Fmpie1 = 0x10, Fovie1 = 0x40
+			};
+			static const uint32_t Lbkm = 0x40000000;
+
+			struct SimState
+			{
+				RegisterBlock regs;
+				Message fifo[2][3];
+				uint8_t fifoMatch[2][3];
+				unsigned fifoCount[2];
+				unsigned request[3];
+				unsigned requests;
+				unsigned violations;
+				unsigned filtered;
+				std::vector<Message> bus;
+			};
+
+			static SimState &State()
+			{
+				static SimState state;
+				return state;
+			}
+
+			static uint32_t TmeBit(int mailbox)
+			{
+				return 0x04000000u << mailbox;
+			}
+
+			static bool Before(int a, int b)
+			{
+				SimState &state = State();
+				if(state.regs.MCR._value & Txfp)
+					return state.request[a] < state.request[b];
+				uint32_t irA = state.regs.sTxMailBox[a].TIR._value & ~1u;
+				uint32_t irB = state.regs.sTxMailBox[b].TIR._value & ~1u;
+				return irA < irB || (irA == irB && a < b);
+			}
+
+			static bool TxInterrupt()
+			{
+				RegisterBlock &regs = State().regs;
+				return (regs.IER._value & Tmeie) && (regs.TSR._value & 0x00010101);
+			}
+
+			static bool RxInterrupt(unsigned fifo)
+			{
+				RegisterBlock &regs = State().regs;
+				uint32_t rfr = fifo ? regs.RF1R._value : regs.RF0R._value;
+				uint32_t ier = fifo ? regs.IER._value >> 3 : regs.IER._value;
+				return ((ier & Fmpie0) && (rfr & Fmp)) || ((ier & Fovie0) && (rfr & Fovr));
+			}
+
+			static void Write(Register &reg, uint32_t value)
+			{
+				SimState &state = State();
+				RegisterBlock &regs = state.regs;
+				if(&reg == &regs.MCR)
+				{
+					if(value & SoftwareReset)
+					{
+						CanSim::Reset();
+						return;
+					}
+					reg._value = value & 0x000100ff;
+					regs.MSR._value = (regs.MSR._value & ~uint32_t(Inak | Slak)) |
+						((value & Inrq) ? Inak : ((value & Sleep) ? Slak : 0));
+				}
+				else if(&reg == &regs.TSR)
+					WriteTsr(value);
+				else if(&reg == &regs.RF0R || &reg == &regs.RF1R)
+					WriteRfr(&reg == &regs.RF0R ? 0 : 1, value);
+				else if(&reg == &regs.MSR || &reg == &regs.ESR)
+					;	// status, flags are not modeled
+				else if(&reg == &regs.BTR)
+				{
+					if(!(regs.MSR._value & Inak))
+						state.violations++;
+					else
+						reg._value = value;
+				}
+				else if(&reg == &regs.FMR || &reg == &regs.FA1R || &reg == &regs.IER)
+					reg._value = value;
+				else if(&reg == &regs.FM1R || &reg == &regs.FS1R || &reg == &regs.FFA1R || IsFilterRegister(reg))
+				{
+					if(!(regs.FMR._value & Finit))
+						state.violations++;
+					else
+						reg._value = value;
+				}
+				else
+				{
+					for(int i = 0; i < 3; i++)
+					{
+						TxMailbox &mailbox = regs.sTxMailBox[i];
+						if(&reg != &mailbox.TIR && &reg != &mailbox.TDTR && &reg != &mailbox.TDLR && &reg != &mailbox.TDHR)
+							continue;
+						if(!(regs.TSR._value & TmeBit(i)))
+						{
+							state.violations++;
+							return;
+						}
+						reg._value = value;
+						if(&reg == &mailbox.TIR && (value & 1))
+						{
+							regs.TSR._value &= ~TmeBit(i);
+							state.request[i] = state.requests++;
+						}
+						return;
+					}
+					// FIFO mailboxes are read only
+					state.violations++;
+				}
+			}
+
+			static bool IsFilterRegister(const Register &reg)
+			{
+				for(int i = 0; i < Banks; i++)
+					if(&reg == &State().regs.sFilterRegister[i].FR1 || &reg == &State().regs.sFilterRegister[i].FR2)
+						return true;
+				return false;
+			}
+
+			static void WriteTsr(uint32_t value)
+			{
+				RegisterBlock &regs = State().regs;
+				for(int i = 0; i < 3; i++)
+				{
+					unsigned shift = i * 8;
+					// RQCP clears TXOK, ALST and TERR
+					if(value & 1u << shift)
+						regs.TSR._value &= ~(0x0fu << shift);
+					if((value & 0x80u << shift) && !(regs.TSR._value & TmeBit(i)))
+					{
+						regs.sTxMailBox[i].TIR._value &= ~1u;
+						regs.TSR._value = (regs.TSR._value & ~(0x0fu << shift)) | 1u << shift | TmeBit(i);
+					}
+				}
+			}
+
+			static void WriteRfr(unsigned fifo, uint32_t value)
+			{
+				SimState &state = State();
+				if((value & Rfom) && state.fifoCount[fifo])
+				{
+					for(unsigned i = 1; i < state.fifoCount[fifo]; i++)
+						state.fifo[fifo][i - 1] = state.fifo[fifo][i];
+					state.fifoCount[fifo]--;
+				}
+				Register &rfr = fifo ? state.regs.RF1R : state.regs.RF0R;
+				rfr._value &= ~(value & uint32_t(Full | Fovr));
+				UpdateFifo(fifo);
+			}
+
+			static void UpdateFifo(unsigned fifo)
+			{
+				SimState &state = State();
+				Register &rfr = fifo ? state.regs.RF1R : state.regs.RF0R;
+				rfr._value = (rfr._value & ~uint32_t(Fmp)) | state.fifoCount[fifo];
+				if(!state.fifoCount[fifo])
+					return;
+				const Message &front = state.fifo[fifo][0];
+				FifoMailbox &mailbox = state.regs.sFIFOMailBox[fifo];
+				mailbox.RIR._value = Encode32(front);
+				mailbox.RDTR._value = front.length | uint32_t(state.fifoMatch[fifo][0]) << 8;
+				memcpy(&mailbox.RDLR._value, front.data, 4);
+				memcpy(&mailbox.RDHR._value, front.data + 4, 4);
+			}
+
+			static uint32_t Encode32(const Message &message)
+			{
+				return (message.extended ? (message.id & 0x1fffffff) << 3 | 4 : (message.id & 0x7ff) << 21) | (message.remote ? 2 : 0);
+			}
+
+			static uint32_t Encode16(const Message &message)
+			{
+				uint32_t ir = Encode32(message);
+				return (ir >> 21) << 5 | (message.remote ? 0x10 : 0) | (message.extended ? 8 : 0) | ((ir >> 18) & 7);
+			}
+
+			static void Receive(const Message &message)
+			{
+				SimState &state = State();
+				RegisterBlock &regs = state.regs;
+				uint32_t ir32 = Encode32(message);
+				uint32_t ir16 = Encode16(message);
+				int bestRank = -1;
+				unsigned bestFifo = 0, bestIndex = 0;
+				unsigned numbers[2] = {0, 0};
+				for(int bank = 0; bank < Banks; bank++)
+				{
+					bool list = (regs.FM1R._value >> bank & 1) != 0;
+					bool wide = (regs.FS1R._value >> bank & 1) != 0;
+					unsigned fifo = regs.FFA1R._value >> bank & 1;
+					unsigned count = wide ? (list ? 2 : 1) : (list ? 4 : 2);
+					uint32_t fr1 = regs.sFilterRegister[bank].FR1._value;
+					uint32_t fr2 = regs.sFilterRegister[bank].FR2._value;
+					for(unsigned i = 0; i < count && (regs.FA1R._value >> bank & 1); i++)
+					{
+						bool match;
+						if(wide && list)
+							match = ((i ? fr2 : fr1) & ~1u) == ir32;
+						else if(wide)
+							match = ((ir32 ^ fr1) & fr2 & ~1u) == 0;
+						else if(list)
+							match = (((i < 2 ? fr1 : fr2) >> (i & 1) * 16) & 0xffff) == ir16;
+						else
+						{
+							uint32_t fr = i ? fr2 : fr1;
+							match = ((ir16 ^ fr) & fr >> 16 & 0xffff) == 0;
+						}
+						// 32 bit before 16 bit, list before mask, then filter number
+						int rank = (wide ? 0 : 2) + (list ? 0 : 1);
+						if(match && (bestRank < 0 || rank < bestRank))
+						{
+							bestRank = rank;
+							bestFifo = fifo;
+							bestIndex = numbers[fifo] + i;
+						}
+					}
+					numbers[fifo] += count;
+				}
+				if(bestRank < 0)
+				{
+					state.filtered++;
+					return;
+				}
+				unsigned &count = state.fifoCount[bestFifo];
+				Register &rfr = bestFifo ? regs.RF1R : regs.RF0R;
+				if(count == 3)
+				{
+					rfr._value |= Fovr;
+					if(regs.MCR._value & Rflm)
+						return;
+					count--;
+				}
+				state.fifo[bestFifo][count] = message;
+				state.fifoMatch[bestFifo][count] = uint8_t(bestIndex);
+				count++;
+				if(count == 3)
+					rfr._value |= Full;
+				UpdateFifo(bestFifo);
+			}
+		};
+	}
+}
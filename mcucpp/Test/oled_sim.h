@@ -0,0 +1,314 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace IO
+{
+	namespace Test
+	{
+		////////////////////////////////////////////////////////////////////////////////
+		// class template OledSim
+		// Host model of SSD1306 (SH1106 = false) or SH1106 (SH1106 = true) OLED
+		// controller for Ssd1306 driver tests. It provides both interfaces of
+		// the controller:
+		//		4-wire SPI: ReadWrite with Cs and Dc pins (OledSpi<Sim, Sim::Cs, Sim::Dc>),
+		//		I2C at address 0x3c: Start, Write, Stop (OledI2c<Sim>).
+		// Commands are decoded: column/page addresses, addressing modes (SSD1306
+		// horizontal, vertical and page; SH1106 page only), display on/off,
+		// contrast and inversion; other commands are skipped with their
+		// parameters. Display RAM is 128 (SSD1306) or 132 (SH1106) columns wide.
+		// Statistics count every byte on the bus, including I2C address and
+		// control bytes.
+		////////////////////////////////////////////////////////////////////////////////
+
+		template<bool SH1106 = false, unsigned ID = 0>
+		class OledSim
+		{
+		public:
+			static const unsigned Columns = SH1106 ? 132 : 128;
+			static const unsigned Pages = 8;
+			static const uint8_t Address = 0x3c;
+
+			struct Stats
+			{
+				unsigned long bytes;
+				unsigned long commandBytes;
+				unsigned long dataBytes;
+				unsigned transfers;
+			};
+
+			struct Cs
+			{
+				static void SetDirWrite()
+				{}
+				static void Set()
+				{
+					State().selected = false;
+				}
+				static void Clear()
+				{
+					State().selected = true;
+					State().stats.transfers++;
+				}
+			};
+
+			// Data/command select, low for commands
+			struct Dc
+			{
+				static void SetDirWrite()
+				{}
+				static void Set()
+				{
+					State().data = true;
+				}
+				static void Clear()
+				{
+					State().data = false;
+				}
+			};
+
+			// Power on state
+			static void Reset()
+			{
+				SimState &state = State();
+				memset(&state, 0, sizeof(state));
+				state.mode = PageMode;
+				state.columnEnd = Columns - 1;
+				state.pageEnd = Pages - 1;
+				state.contrast = 0x7f;
+				uint8_t *ram = &state.ram[0][0];
+				for(unsigned i = 0; i < sizeof(state.ram); i++)
+					ram[i] = uint8_t(i * 73 + 11);
+			}
+
+			static void ResetStats()
+			{
+				memset(&State().stats, 0, sizeof(Stats));
+			}
+
+			static const Stats &Statistics()
+			{
+				return State().stats;
+			}
+
+			// RAM byte at RAM column and page
+			static uint8_t Ram(unsigned column, unsigned page)
+			{
+				return State().ram[page][column];
+			}
+
+			static bool IsOn()
+			{
+				return State().on;
+			}
+
+			static bool IsInverted()
+			{
+				return State().inverted;
+			}
+
+			static uint8_t Contrast()
+			{
+				return State().contrast;
+			}
+
+			// Commands the model does not know
+			static unsigned UnknownCommands()
+			{
+				return State().unknown;
+			}
+
+			// SPI
+			static uint8_t ReadWrite(uint8_t value)
+			{
+				SimState &state = State();
+				if(!state.selected)
+					return 0xff;
+				Receive(value, state.data);
+				return 0xff;
+			}
+
+			// I2C
+			static bool Start(uint8_t address)
+			{
+				SimState &state = State();
+				state.stats.bytes++;
+				state.stats.transfers++;
+				state.i2cActive = address == Address;
+				state.control = true;
+				return state.i2cActive;
+			}
+
+			static void Write(const uint8_t *data, size_t count)
+			{
+				SimState &state = State();
+				for(size_t i = 0; i < count; i++)
+				{
+					if(!state.i2cActive)
+						return;
+					if(state.control)
+					{
+						// Co = 0: the rest of the transfer has the type given by D/C bit
+						state.stats.bytes++;
+						state.single = (data[i] & 0x80) != 0;
+						state.data = (data[i] & 0x40) != 0;
+						state.control = false;
+						continue;
+					}
+					Receive(data[i], state.data);
+					if(state.single)
+						state.control = true;
+				}
+			}
+
+			static void Stop()
+			{
+				State().i2cActive = false;
+			}
+
+		private:
+			enum Mode { HorizontalMode = 0, VerticalMode = 1, PageMode = 2 };
+
+			struct SimState
+			{
+				uint8_t ram[Pages][Columns];
+				Stats stats;
+				bool selected;
+				bool data;
+				bool i2cActive;
+				bool control;
+				bool single;
+				bool on;
+				bool inverted;
+				uint8_t contrast;
+				Mode mode;
+				unsigned column;
+				unsigned page;
+				unsigned columnStart;
+				unsigned columnEnd;
+				unsigned pageStart;
+				unsigned pageEnd;
+				uint8_t command[3];
+				unsigned commandLength;
+				unsigned unknown;
+			};
+
+			static SimState &State()
+			{
+				static SimState state;
+				return state;
+			}
+
+			static void Receive(uint8_t value, bool data)
+			{
+				SimState &state = State();
+				state.stats.bytes++;
+				if(data)
+				{
+					state.stats.dataBytes++;
+					WriteRam(value);
+				}
+				else
+				{
+					state.stats.commandBytes++;
+					state.command[state.commandLength++] = value;
+					if(state.commandLength == CommandLength(state.command[0]))
+					{
+						Execute();
+						state.commandLength = 0;
+					}
+				}
+			}
+
+			static void WriteRam(uint8_t value)
+			{
+				SimState &state = State();
+				if(state.page < Pages && state.column < Columns)
+					state.ram[state.page][state.column] = value;
+				if(SH1106 || state.mode == PageMode)
+				{
+					// SH1106 stops at the last column, SSD1306 wraps in the page
+					if(state.column < Columns - 1)
+						state.column++;
+					else if(!SH1106)
+						state.column = state.columnStart;
+					return;
+				}
+				if(state.mode == HorizontalMode)
+				{
+					if(state.column++ == state.columnEnd)
+					{
+						state.column = state.columnStart;
+						state.page = state.page == state.pageEnd ? state.pageStart : state.page + 1;
+					}
+				}
+				else if(state.page++ == state.pageEnd)
+				{
+					state.page = state.pageStart;
+					state.column = state.column == state.columnEnd ? state.columnStart : state.column + 1;
+				}
+			}
+
+			static unsigned CommandLength(uint8_t command)
+			{
+				switch(command)
+				{
+				case 0x21:
+				case 0x22:
+					return SH1106 ? 1 : 3;
+				case 0x20:
+					return SH1106 ? 1 : 2;
+				case 0x81:
+				case 0x8d:
+				case 0xa8:
+				case 0xad:
+				case 0xd3:
+				case 0xd5:
+				case 0xd9:
+				case 0xda:
+				case 0xdb:
+					return 2;
+				default:
+					return 1;
+				}
+			}
+
+			static void Execute()
+			{
+				SimState &state = State();
+				const uint8_t *command = state.command;
+				uint8_t code = command[0];
+				if(code <= 0x0f)
+					state.column = (state.column & 0xf0) | code;
+				else if(code <= 0x1f)
+					state.column = (state.column & 0x0f) | (code & 0x0f) << 4;
+				else if(code >= 0x40 && code <= 0x7f)
+					return;
+				else if(code >= 0xb0 && code <= 0xb7)
+					state.page = code & 7;
+				else if(!SH1106 && code == 0x20)
+					state.mode = Mode(command[1] & 3);
+				else if(!SH1106 && code == 0x21)
+				{
+					state.columnStart = state.column = command[1] & 0x7f;
+					state.columnEnd = command[2] & 0x7f;
+				}
+				else if(!SH1106 && code == 0x22)
+				{
+					state.pageStart = state.page = command[1] & 7;
+					state.pageEnd = command[2] & 7;
+				}
+				else if(code == 0x81)
+					state.contrast = command[1];
+				else if(code == 0xae || code == 0xaf)
+					state.on = code == 0xaf;
+				else if(code == 0xa6 || code == 0xa7)
+					state.inverted = code == 0xa7;
+				else if(CommandLength(code) == 1 && !(code == 0xa0 || code == 0xa1 || code == 0xa4 ||
+					code == 0xa5 || code == 0xc0 || code == 0xc8 || code == 0xe3))
+					state.unknown++;
+			}
+		};
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include "sim_clock.h"
+
+#ifndef F_CPU
+#error F_CPU must be defined to proper cpu frequency
+#endif
+
+// Host delay loops don't spin, they advance the simulated clock by the
+// number of cycles the delay would take on target.
+enum
+{
+	PlatformCyslesPerDelayLoop32 = 1,
+	PlatformCyslesPerDelayLoop16 = 1,
+	PlatformCyslesPerDelayLoop8 = 1
+};
+
+inline void PlatformDelayCycle32(uint32_t delayLoops)
+{
+	IO::Test::SimClock::AdvanceCycles(delayLoops, F_CPU);
+}
+
+inline void PlatformDelayCycle16(uint16_t delayLoops)
+{
+	IO::Test::SimClock::AdvanceCycles(delayLoops, F_CPU);
+}
+
+inline void PlatformDelayCycle8(uint8_t delayLoops)
+{
+	IO::Test::SimClock::AdvanceCycles(delayLoops, F_CPU);
+}
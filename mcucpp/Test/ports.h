@@ -62,9 +62,33 @@ namespace IO
 
 	namespace Test
 	{
+		// Receives TestPort output and direction register changes made
+		// through port methods. Direct writes to the registers from tests
+		// are not reported.
+		class PortObserver
+		{
+		public:
+			virtual void PortChanged(unsigned id, unsigned width, uint32_t out, uint32_t dir) = 0;
+
+			static PortObserver *&Current()
+			{
+				static PortObserver *observer = 0;
+				return observer;
+			}
+		protected:
+			~PortObserver()
+			{}
+		};
+
 		template<class DataType, unsigned Identity>
 		class TestPort :public TestPortBase
 		{
+			static void Changed()
+			{
+				PortObserver *observer = PortObserver::Current();
+				if(observer)
+					observer->PortChanged(Id, Width, uint32_t(OutReg), uint32_t(DirReg));
+			}
 			public:
 
             typedef DataType DataT;
@@ -77,6 +101,7 @@ namespace IO
 					DirReg |= 1 << pin;
 				else
 					DirReg &= ~(1 << pin);
+				Changed();
 			}
 
 			static void SetConfiguration(DataT mask, Configuration configuration)
@@ -85,6 +110,7 @@ namespace IO
 					DirReg |= mask;
 				else
 					DirReg &= ~mask;
+				Changed();
 			}
 
 			template<DataT mask, Configuration configuration>
@@ -94,16 +120,19 @@ namespace IO
 					DirReg |= mask;
 				else
 					DirReg &= ~mask;
+				Changed();
 			}
 
 			static void Write(DataT value)
 			{
 				OutReg = value;
+				Changed();
 			}
 			static void ClearAndSet(DataT clearMask, DataT value)
 			{
 				OutReg &= ~clearMask;
 				OutReg |= value;
+				Changed();
 			}
 			static DataT Read()
 			{
@@ -112,14 +141,17 @@ namespace IO
 			static void Set(DataT value)
 			{
 				OutReg |= value;
+				Changed();
 			}
 			static void Clear(DataT value)
 			{
 				OutReg &= ~value;
+				Changed();
 			}
 			static void Toggle(DataT value)
 			{
 				OutReg ^= value;
+				Changed();
 			}
 			static DataT PinRead()
 			{
@@ -130,6 +162,7 @@ namespace IO
 			static void Write()
 			{
 				OutReg = value;
+				Changed();
 			}
 
 			template<DataT clearMask, DataT value>
@@ -137,6 +170,7 @@ namespace IO
 			{
 				OutReg &= ~clearMask;
 				OutReg |= value;
+				Changed();
 			}
 
 
@@ -144,18 +178,21 @@ namespace IO
 			static void Set()
 			{
 				OutReg |= value;
+				Changed();
 			}
 
 			template<DataT value>
 			static void Clear()
 			{
 				OutReg &= ~value;
+				Changed();
 			}
 
 			template<DataT value>
 			static void Toggle()
 			{
 				OutReg ^= value;
+				Changed();
 			}
 
 			enum{Id = Identity};
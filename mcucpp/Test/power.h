@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic.h>
+
+// Host side counterpart of AVR/power.h and ARM/Stm32/power.h.
+// There is nothing to sleep on the host: Enter waits for the wake event, a
+// function set by the test that stands for the interrupts waking the part
+// (advances simulated time, calls timer handlers, posts tasks). Entered
+// modes and whether interrupts were disabled on entry are recorded.
+
+namespace Power
+{
+	// Ordered from the lightest to the deepest
+	enum SleepMode
+	{
+		NoSleep,
+		Idle,
+		PowerDown,
+		Deepest = PowerDown
+	};
+
+	class Sleep
+	{
+	public:
+		typedef void (*WakeEvent)();
+
+		// Has to be called with interrupts disabled, returns with interrupts
+		// disabled once woken up
+		static void Enter(SleepMode mode)
+		{
+			State &state = GetState();
+			state.lastMode = mode;
+			state.count[mode]++;
+			if(!Atomic::DisableInterrupts::IsActive())
+				state.unsafeEntries++;
+			if(state.wakeEvent)
+				state.wakeEvent();
+		}
+
+		static void SetWakeEvent(WakeEvent event)
+		{
+			GetState().wakeEvent = event;
+		}
+
+		static SleepMode LastMode()
+		{
+			return GetState().lastMode;
+		}
+
+		static unsigned long Count(SleepMode mode)
+		{
+			return GetState().count[mode];
+		}
+
+		// Entries with interrupts enabled, an interrupt might have been lost
+		static unsigned long UnsafeEntries()
+		{
+			return GetState().unsafeEntries;
+		}
+
+		static void Reset()
+		{
+			State &state = GetState();
+			state.wakeEvent = 0;
+			state.lastMode = NoSleep;
+			for(unsigned i = 0; i <= Deepest; i++)
+				state.count[i] = 0;
+			state.unsafeEntries = 0;
+		}
+
+	private:
+		struct State
+		{
+			WakeEvent wakeEvent;
+			SleepMode lastMode;
+			unsigned long count[Deepest + 1];
+			unsigned long unsafeEntries;
+		};
+
+		static State &GetState()
+		{
+			static State state;
+			return state;
+		}
+	};
+}
@@ -0,0 +1,608 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+#include "sim_clock.h"
+
+namespace IO
+{
+	namespace Test
+	{
+		////////////////////////////////////////////////////////////////////////////////
+		// class template SdCardSim
+		// Host model of an SD card in SPI mode with BLOCKS 512 byte blocks,
+		// backed by an image file. It provides the Spi interface (ReadWrite,
+		// Write) and a chip select pin (Cs, active low) for SdCard driver tests,
+		// benchmarks and fuzzing without cards.
+		// HIGH_CAPACITY selects SDHC (block addressing, CSD version 2), otherwise
+		// it is a standard capacity card (byte addressing, CSD version 1).
+		//
+		// Commands: CMD0, CMD8, CMD9, CMD12, CMD16, CMD17, CMD18, CMD24, CMD25,
+		// CMD55, CMD58, ACMD23, ACMD41.
+		// Every transferred byte advances SimClock by byte time. Reads wait for
+		// read latency before the data token. After every written block the card
+		// is busy (holds data out low) for the block program time, which is
+		// shorter for multi-block writes and shorter still for blocks pre-erased
+		// with ACMD23; the block is stored when programming completes.
+		// Bytes other than 0xff sent while the card is busy are counted as
+		// violations. PowerCut interrupts programming leaving a torn block and
+		// keeps the card unpowered (data out reads 0xff) until PowerOn, then it
+		// has to be initialized again. PowerCutAt schedules the cut at a given
+		// transferred byte count, e.g. in the middle of a multi-block write.
+		////////////////////////////////////////////////////////////////////////////////
+
+		template<uint32_t BLOCKS, bool HIGH_CAPACITY = true, unsigned ID = 0>
+		class SdCardSim
+		{
+		public:
+			static const uint32_t Blocks = BLOCKS;
+			static const unsigned BlockSize = 512;
+
+			struct Timing
+			{
+				uint32_t byteTime;
+				uint32_t readLatency;
+				uint32_t writeTime;
+				uint32_t blockWriteTime;
+				uint32_t erasedBlockWriteTime;
+				uint32_t stopTime;
+				unsigned initPolls;
+			};
+
+			struct Stats
+			{
+				unsigned commands;
+				unsigned singleReads;
+				unsigned multipleReads;
+				unsigned singleWrites;
+				unsigned multipleWrites;
+				unsigned eraseHints;
+				unsigned long blocksRead;
+				unsigned long blocksWritten;
+				unsigned violations;
+				unsigned long bytes;
+			};
+
+			// Chip select, active low
+			struct Cs
+			{
+				static void SetDirWrite()
+				{}
+				static void Set()
+				{
+					State().selected = false;
+					State().framePosition = 0;
+				}
+				static void Clear()
+				{
+					State().selected = true;
+				}
+			};
+
+			// Opens or creates image file
+			static bool Open(const char *fileName)
+			{
+				Close();
+				SimState &state = State();
+				state.memory.assign(size_t(BLOCKS) * BlockSize, 0xff);
+				state.file = fopen(fileName, "r+b");
+				if(state.file)
+				{
+					size_t read = fread(&state.memory[0], 1, state.memory.size(), state.file);
+					if(read < state.memory.size())
+						Store(read, state.memory.size() - read);
+				}
+				else
+				{
+					state.file = fopen(fileName, "w+b");
+					if(!state.file)
+						return false;
+					Store(0, state.memory.size());
+				}
+				Reset();
+				ResetStats();
+				state.powered = true;
+				state.cutAt = 0;
+				return true;
+			}
+
+			static void Close()
+			{
+				SimState &state = State();
+				Update();
+				if(state.file)
+					fclose(state.file);
+				state.file = 0;
+			}
+
+			static void SetTiming(const Timing &timing)
+			{
+				State().timing = timing;
+			}
+
+			static const Stats &Statistics()
+			{
+				return State().stats;
+			}
+
+			static void ResetStats()
+			{
+				memset(&State().stats, 0, sizeof(Stats));
+			}
+
+			static bool IsBusy()
+			{
+				Update();
+				return SimClock::Now() < State().busyEnd;
+			}
+
+			// Direct access to card content for test checks
+			static const uint8_t *Memory()
+			{
+				Update();
+				return &State().memory[0];
+			}
+
+			// Next data block is rejected with write error response
+			static void InjectWriteError()
+			{
+				State().writeError = true;
+			}
+
+			// Interrupts programming, the block gets partly new and partly old data
+			static void PowerCut(unsigned seed = 1)
+			{
+				SimState &state = State();
+				Update();
+				if(state.pending)
+				{
+					size_t length = (seed * 1103515245u + 12345u) >> 16 & (BlockSize - 1);
+					memcpy(&state.memory[state.pendingBlock * BlockSize], state.pendingData, length);
+					Store(state.pendingBlock * BlockSize, BlockSize);
+				}
+				Reset();
+				state.powered = false;
+				state.cutAt = 0;
+			}
+
+			// Cuts power when total transferred byte count reaches 'bytes'
+			static void PowerCutAt(unsigned long bytes, unsigned seed = 1)
+			{
+				State().cutAt = bytes;
+				State().cutSeed = seed;
+			}
+
+			static void PowerOn()
+			{
+				State().powered = true;
+			}
+
+			static bool IsPowered()
+			{
+				return State().powered;
+			}
+
+			static void Write(uint8_t value)
+			{
+				ReadWrite(value);
+			}
+
+			static uint8_t ReadWrite(uint8_t value)
+			{
+				SimState &state = State();
+				SimClock::Advance(state.timing.byteTime);
+				state.stats.bytes++;
+				Update();
+				if(state.cutAt && state.stats.bytes >= state.cutAt)
+					PowerCut(state.cutSeed);
+				if(!state.selected || !state.powered)
+					return 0xff;
+				if(SimClock::Now() < state.busyEnd)
+				{
+					if(value != 0xff)
+						state.stats.violations++;
+					return 0x00;
+				}
+				// host waits for the next block of multi-block read, card has read it ahead
+				if(state.mode == ReadMultiple && state.output.empty() && value == 0xff && state.framePosition == 0)
+					QueueBlock(state.block++, false);
+
+				uint8_t result = 0xff;
+				if(!state.output.empty() && SimClock::Now() >= state.outputReady)
+				{
+					uint16_t output = state.output.front();
+					state.output.pop_front();
+					if(output == Wait)
+						state.outputReady = SimClock::Now() + state.timing.readLatency;
+					else
+						result = uint8_t(output);
+					// busy starts after data response
+					if(state.output.empty() && state.programTime)
+					{
+						state.busyEnd = SimClock::Now() + state.programTime;
+						state.programTime = 0;
+					}
+				}
+
+				switch(state.mode)
+				{
+				case Command:
+				case ReadMultiple:
+					if(state.framePosition == 0 && (value & 0xc0) != 0x40)
+						break;
+					state.frame[state.framePosition++] = value;
+					if(state.framePosition == 6)
+					{
+						state.framePosition = 0;
+						Execute();
+					}
+					break;
+				case WriteSingle:
+				case WriteMultiple:
+					if(value == (state.mode == WriteSingle ? 0xfe : 0xfc))
+					{
+						state.mode = state.mode == WriteSingle ? DataSingle : DataMultiple;
+						state.dataPosition = 0;
+					}
+					else if(value == 0xfd && state.mode == WriteMultiple)
+					{
+						state.mode = Command;
+						state.output.push_back(0xff);
+						state.programTime = state.timing.stopTime;
+					}
+					else if(value != 0xff)
+						state.stats.violations++;
+					break;
+				case DataSingle:
+				case DataMultiple:
+					// data and two CRC bytes
+					if(state.dataPosition < BlockSize)
+						state.data[state.dataPosition] = value;
+					if(++state.dataPosition == BlockSize + 2)
+						Receive();
+					break;
+				}
+				return result;
+			}
+
+		private:
+			// Output queue entry that delays following entries by read latency
+			enum {Wait = 0x100};
+
+			enum Mode
+			{
+				Command,
+				ReadMultiple,
+				WriteSingle,
+				WriteMultiple,
+				DataSingle,
+				DataMultiple
+			};
+
+			struct SimState
+			{
+				SimState()
+					:file(0), selected(false), powered(true), cutAt(0), cutSeed(0)
+				{
+					Timing defaultTiming = {400, 100000, 1000000, 300000, 150000, 500000, 10};
+					timing = defaultTiming;
+					memset(&stats, 0, sizeof(stats));
+					Reset();
+				}
+				void Reset()
+				{
+					idle = true;
+					appCommand = false;
+					writeError = false;
+					pending = false;
+					initPolls = 0;
+					mode = Command;
+					framePosition = 0;
+					dataPosition = 0;
+					block = 0;
+					preErased = 0;
+					busyEnd = 0;
+					outputReady = 0;
+					programTime = 0;
+					output.clear();
+				}
+				std::vector<uint8_t> memory;
+				FILE *file;
+				Timing timing;
+				Stats stats;
+				bool selected;
+				bool powered;
+				unsigned long cutAt;
+				unsigned cutSeed;
+				bool idle;
+				bool appCommand;
+				bool writeError;
+				bool pending;
+				unsigned initPolls;
+				Mode mode;
+				unsigned framePosition;
+				uint8_t frame[6];
+				unsigned dataPosition;
+				uint8_t data[BlockSize];
+				uint32_t block;
+				uint32_t preErased;
+				uint32_t pendingBlock;
+				uint8_t pendingData[BlockSize];
+				uint64_t busyEnd;
+				uint64_t outputReady;
+				uint32_t programTime;
+				std::deque<uint16_t> output;
+			};
+
+			static SimState &State()
+			{
+				static SimState state;
+				return state;
+			}
+
+			static void Reset()
+			{
+				State().Reset();
+				State().selected = false;
+			}
+
+			static void Store(size_t offset, size_t length)
+			{
+				SimState &state = State();
+				if(!state.file)
+					return;
+				fseek(state.file, long(offset), SEEK_SET);
+				fwrite(&state.memory[offset], 1, length, state.file);
+				fflush(state.file);
+			}
+
+			// Stores block when programming is complete
+			static void Update()
+			{
+				SimState &state = State();
+				if(!state.pending || SimClock::Now() < state.busyEnd || state.programTime)
+					return;
+				memcpy(&state.memory[state.pendingBlock * BlockSize], state.pendingData, BlockSize);
+				Store(state.pendingBlock * BlockSize, BlockSize);
+				state.pending = false;
+				state.stats.blocksWritten++;
+			}
+
+			static void Respond(uint8_t r1)
+			{
+				// one byte command response time
+				State().output.push_back(0xff);
+				State().output.push_back(r1);
+			}
+
+			static void QueueData(const uint8_t *data, unsigned length, bool wait)
+			{
+				SimState &state = State();
+				if(wait)
+					state.output.push_back(uint16_t(Wait));
+				state.output.push_back(0xfe);
+				state.output.insert(state.output.end(), data, data + length);
+				// CRC is not checked by the host
+				state.output.push_back(0xff);
+				state.output.push_back(0xff);
+			}
+
+			static void QueueBlock(uint32_t block, bool wait)
+			{
+				SimState &state = State();
+				if(block >= BLOCKS)
+				{
+					// out of range data error token
+					state.output.push_back(0x08);
+					return;
+				}
+				QueueData(&state.memory[block * BlockSize], BlockSize, wait);
+				state.stats.blocksRead++;
+			}
+
+			static void Csd(uint8_t *csd)
+			{
+				memset(csd, 0, 16);
+				if(HIGH_CAPACITY)
+				{
+					uint32_t size = BLOCKS / 1024 - 1;
+					csd[0] = 0x40;
+					csd[7] = uint8_t(size >> 16 & 0x3f);
+					csd[8] = uint8_t(size >> 8);
+					csd[9] = uint8_t(size);
+				}
+				else
+				{
+					// READ_BL_LEN 512, C_SIZE_MULT 512
+					uint32_t size = BLOCKS / 512 - 1;
+					const uint8_t multiplier = 7;
+					csd[5] = 0x09;
+					csd[6] = uint8_t(size >> 10 & 0x03);
+					csd[7] = uint8_t(size >> 2);
+					csd[8] = uint8_t(size << 6);
+					csd[9] = multiplier >> 1;
+					csd[10] = uint8_t(multiplier << 7);
+				}
+			}
+
+			// Returns false and responds with address error if the address is not valid
+			static bool Block(uint32_t argument, uint32_t &block)
+			{
+				block = HIGH_CAPACITY ? argument : argument / BlockSize;
+				if((!HIGH_CAPACITY && argument % BlockSize) || block >= BLOCKS)
+				{
+					Respond(0x20);
+					return false;
+				}
+				return true;
+			}
+
+			static void Execute()
+			{
+				SimState &state = State();
+				uint8_t command = state.frame[0] & 0x3f;
+				uint32_t argument = uint32_t(state.frame[1]) << 24 | uint32_t(state.frame[2]) << 16 |
+					uint32_t(state.frame[3]) << 8 | state.frame[4];
+				bool app = state.appCommand;
+				state.appCommand = false;
+				state.stats.commands++;
+				state.output.clear();
+
+				if(command == 12)
+				{
+					if(state.mode == ReadMultiple)
+					{
+						// stuff byte, then R1
+						state.mode = Command;
+						state.output.push_back(0x3c);
+						state.output.push_back(0x00);
+					}
+					else
+						Respond(0x04);
+					return;
+				}
+				if(state.idle && command != 0 && command != 8 && command != 55 && command != 58 && !(app && command == 41))
+				{
+					Respond(0x05);
+					return;
+				}
+				uint8_t idle = state.idle ? 0x01 : 0x00;
+				uint32_t block;
+				switch(command)
+				{
+				case 0:
+					if(state.frame[5] != 0x95)
+					{
+						Respond(0x09);
+						break;
+					}
+					Reset();
+					state.selected = true;
+					Respond(0x01);
+					break;
+				case 8:
+					if(state.frame[5] != 0x87)
+					{
+						Respond(0x09);
+						break;
+					}
+					Respond(idle);
+					state.output.push_back(0x00);
+					state.output.push_back(0x00);
+					state.output.push_back(uint8_t(argument >> 8 & 0x0f));
+					state.output.push_back(uint8_t(argument));
+					break;
+				case 9:
+				{
+					uint8_t csd[16];
+					Csd(csd);
+					Respond(0x00);
+					QueueData(csd, sizeof(csd), true);
+					break;
+				}
+				case 16:
+					Respond(argument == BlockSize ? 0x00 : 0x40);
+					break;
+				case 17:
+					if(!Block(argument, block))
+						break;
+					Respond(0x00);
+					QueueBlock(block, true);
+					state.stats.singleReads++;
+					break;
+				case 18:
+					if(!Block(argument, block))
+						break;
+					Respond(0x00);
+					QueueBlock(block, true);
+					state.mode = ReadMultiple;
+					state.block = block + 1;
+					state.stats.multipleReads++;
+					break;
+				case 23:
+					if(!app)
+					{
+						Respond(0x04);
+						break;
+					}
+					state.preErased = argument;
+					state.stats.eraseHints++;
+					Respond(0x00);
+					break;
+				case 24:
+				case 25:
+					if(!Block(argument, block))
+						break;
+					Respond(0x00);
+					state.block = block;
+					if(command == 24)
+					{
+						state.mode = WriteSingle;
+						state.stats.singleWrites++;
+					}
+					else
+					{
+						state.mode = WriteMultiple;
+						state.stats.multipleWrites++;
+					}
+					break;
+				case 41:
+					if(!app)
+					{
+						Respond(0x04);
+						break;
+					}
+					if(++state.initPolls >= state.timing.initPolls)
+						state.idle = false;
+					Respond(state.idle ? 0x01 : 0x00);
+					break;
+				case 55:
+					state.appCommand = true;
+					Respond(idle);
+					break;
+				case 58:
+					Respond(idle);
+					state.output.push_back(uint8_t((state.idle ? 0 : 0x80) | (HIGH_CAPACITY ? 0x40 : 0)));
+					state.output.push_back(0xff);
+					state.output.push_back(0x80);
+					state.output.push_back(0x00);
+					break;
+				default:
+					Respond(0x04 | idle);
+				}
+				// pre-erase count applies to the next write command only
+				if(command != 23 && command != 55 && command != 25)
+					state.preErased = 0;
+			}
+
+			// Complete data block received
+			static void Receive()
+			{
+				SimState &state = State();
+				bool multiple = state.mode == DataMultiple;
+				state.mode = multiple ? WriteMultiple : Command;
+				if(state.writeError || state.block >= BLOCKS)
+				{
+					state.writeError = false;
+					state.output.push_back(0x0d);
+					return;
+				}
+				state.output.push_back(0x05);
+				state.pending = true;
+				state.pendingBlock = state.block++;
+				memcpy(state.pendingData, state.data, BlockSize);
+				if(!multiple)
+					state.programTime = state.timing.writeTime;
+				else if(state.preErased)
+				{
+					state.preErased--;
+					state.programTime = state.timing.erasedBlockWriteTime;
+				}
+				else
+					state.programTime = state.timing.blockWriteTime;
+			}
+		};
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+
+namespace IO
+{
+	namespace Test
+	{
+		// Simulated time for host tests in nanoseconds.
+		// It is advanced by host delay loops (see platform_dalay.h), by
+		// explicit Advance calls and optionally by a fixed time per TestPort
+		// access, which models instruction timing of bit banged protocols.
+		class SimClock
+		{
+		public:
+			static uint64_t Now()
+			{
+				return Time();
+			}
+
+			static void Advance(uint64_t ns)
+			{
+				Time() += ns;
+			}
+
+			static void AdvanceCycles(uint64_t cycles, unsigned long cpuFreq)
+			{
+				Time() += cycles * 1000000000ull / cpuFreq;
+			}
+
+			static void Reset()
+			{
+				Time() = 0;
+			}
+
+			// Time added on every TestPort register change, 0 by default
+			static void SetPortAccessTime(uint32_t ns)
+			{
+				AccessTime() = ns;
+			}
+
+			static uint32_t PortAccessTime()
+			{
+				return AccessTime();
+			}
+		private:
+			static uint64_t &Time()
+			{
+				static uint64_t time = 0;
+				return time;
+			}
+			static uint32_t &AccessTime()
+			{
+				static uint32_t accessTime = 0;
+				return accessTime;
+			}
+		};
+	}
+}
@@ -0,0 +1,359 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "sim_clock.h"
+
+namespace IO
+{
+	namespace Test
+	{
+		////////////////////////////////////////////////////////////////////////////////
+		// class template SpiFlashSim
+		// Host model of a W25Qxx style SPI NOR flash of SIZE bytes, backed by
+		// an image file. It provides the Spi interface (ReadWrite, Write) and
+		// a chip select pin (Cs, active low) for SpiFlash driver tests.
+		//
+		// Command set: 0x9f JEDEC id, 0x05 status, 0x06/0x04 write enable/disable,
+		// 0x03 read, 0x0b fast read, 0x02 page program, 0x20 sector erase,
+		// 0xd8 block erase, 0xc7 chip erase.
+		// Program only clears bits and wraps inside the 256 byte page, program
+		// and erase require write enable, as on the real chip.
+		// Every transferred byte advances SimClock by byte time; program and
+		// erase keep the chip busy for their typical times and take effect
+		// when they complete. Commands other than status read sent while the
+		// chip is busy are ignored and counted as violations.
+		// PowerCut interrupts the running operation, leaving the page partly
+		// programmed or the sector partly erased.
+		////////////////////////////////////////////////////////////////////////////////
+
+		template<uint32_t SIZE, unsigned ID = 0>
+		class SpiFlashSim
+		{
+		public:
+			static const uint32_t Size = SIZE;
+			static const uint32_t PageSize = 256;
+			static const uint32_t SectorSize = 4096;
+			static const uint32_t BlockSize = 65536;
+
+			struct Timing
+			{
+				uint32_t byteTime;
+				uint32_t pageProgram;
+				uint32_t sectorErase;
+				uint32_t blockErase;
+				uint32_t chipErase;
+			};
+
+			struct Stats
+			{
+				unsigned commands;
+				unsigned programs;
+				unsigned erases;
+				unsigned statusPolls;
+				unsigned violations;
+				unsigned long bytes;
+			};
+
+			// Chip select, active low
+			struct Cs
+			{
+				static void SetDirWrite()
+				{}
+				static void Set()
+				{
+					State().selected = false;
+					Deselect();
+				}
+				static void Clear()
+				{
+					Update();
+					State().selected = true;
+					State().position = 0;
+				}
+			};
+
+			// Opens or creates erased image file
+			static bool Open(const char *fileName)
+			{
+				Close();
+				SimState &state = State();
+				state.memory.assign(SIZE, 0xff);
+				state.file = fopen(fileName, "r+b");
+				if(state.file)
+				{
+					size_t read = fread(&state.memory[0], 1, SIZE, state.file);
+					if(read < SIZE)
+						Store(uint32_t(read), SIZE - uint32_t(read));
+				}
+				else
+				{
+					state.file = fopen(fileName, "w+b");
+					if(!state.file)
+						return false;
+					Store(0, SIZE);
+				}
+				state.selected = false;
+				state.writeEnable = false;
+				state.pending = Idle;
+				ResetStats();
+				return true;
+			}
+
+			static void Close()
+			{
+				SimState &state = State();
+				Update();
+				if(state.file)
+					fclose(state.file);
+				state.file = 0;
+			}
+
+			static void SetTiming(const Timing &timing)
+			{
+				State().timing = timing;
+			}
+
+			static const Stats &Statistics()
+			{
+				return State().stats;
+			}
+
+			static void ResetStats()
+			{
+				memset(&State().stats, 0, sizeof(Stats));
+			}
+
+			static bool IsBusy()
+			{
+				Update();
+				return State().pending != Idle;
+			}
+
+			// Direct access to memory content for test checks
+			static const uint8_t *Memory()
+			{
+				Update();
+				return &State().memory[0];
+			}
+
+			// Interrupts running program or erase operation
+			static void PowerCut(unsigned seed = 1)
+			{
+				SimState &state = State();
+				Update();
+				// part of the bytes are programmed or erased
+				for(uint32_t i = 0; i < state.pendingLength && state.pending != Idle; i++)
+				{
+					seed = seed * 1103515245 + 12345;
+					if(!(seed >> 16 & 1))
+						continue;
+					if(state.pending == Program)
+						state.memory[state.pendingAddress + i] &= state.pendingData[i];
+					else
+						state.memory[state.pendingAddress + i] = 0xff;
+				}
+				if(state.pending != Idle)
+					Store(state.pendingAddress, state.pendingLength);
+				state.pending = Idle;
+				state.writeEnable = false;
+				state.selected = false;
+			}
+
+			static void Write(uint8_t value)
+			{
+				ReadWrite(value);
+			}
+
+			static uint8_t ReadWrite(uint8_t value)
+			{
+				SimState &state = State();
+				SimClock::Advance(state.timing.byteTime);
+				state.stats.bytes++;
+				Update();
+				if(!state.selected)
+					return 0xff;
+				uint32_t position = state.position++;
+				if(position == 0)
+				{
+					state.command = value;
+					state.address = 0;
+					state.stats.commands++;
+					if(state.pending != Idle && value != 0x05)
+						state.stats.violations++;
+					if(value == 0x05)
+						state.stats.statusPolls++;
+					if(value == 0x02 && state.pending == Idle)
+						memset(state.pendingData, 0xff, PageSize);
+					return 0xff;
+				}
+				if(state.pending != Idle && state.command != 0x05)
+					return 0xff;
+				switch(state.command)
+				{
+				case 0x9f:
+				{
+					const uint8_t id[3] = {0xef, 0x40, Log2(SIZE)};
+					return position <= 3 ? id[position - 1] : 0xff;
+				}
+				case 0x05:
+					return uint8_t((state.pending != Idle ? 0x01 : 0) | (state.writeEnable ? 0x02 : 0));
+				case 0x03:
+				case 0x0b:
+				{
+					uint32_t dataStart = state.command == 0x0b ? 5 : 4;
+					if(position < 4)
+					{
+						state.address = state.address << 8 | value;
+						return 0xff;
+					}
+					if(position < dataStart)
+						return 0xff;
+					uint32_t address = (state.address + position - dataStart) % SIZE;
+					return state.memory[address];
+				}
+				case 0x02:
+					if(position < 4)
+						state.address = state.address << 8 | value;
+					else
+					{
+						// data past the page end wraps around
+						state.pendingData[(state.address + position - 4) % PageSize] = value;
+					}
+					return 0xff;
+				case 0x20:
+				case 0xd8:
+					if(position < 4)
+						state.address = state.address << 8 | value;
+					return 0xff;
+				}
+				return 0xff;
+			}
+
+		private:
+			enum Operation
+			{
+				Idle,
+				Program,
+				Erase
+			};
+
+			struct SimState
+			{
+				SimState()
+					:file(0), selected(false), writeEnable(false), position(0), command(0),
+					address(0), pending(Idle), pendingAddress(0), pendingLength(0), pendingEnd(0)
+				{
+					Timing defaultTiming = {400, 700000, 45000000, 150000000, 2000000000};
+					timing = defaultTiming;
+					memset(&stats, 0, sizeof(stats));
+				}
+				std::vector<uint8_t> memory;
+				FILE *file;
+				Timing timing;
+				Stats stats;
+				bool selected;
+				bool writeEnable;
+				uint32_t position;
+				uint8_t command;
+				uint32_t address;
+				Operation pending;
+				uint32_t pendingAddress;
+				uint32_t pendingLength;
+				uint64_t pendingEnd;
+				uint8_t pendingData[PageSize];
+			};
+
+			static SimState &State()
+			{
+				static SimState state;
+				return state;
+			}
+
+			static uint8_t Log2(uint32_t value)
+			{
+				uint8_t result = 0;
+				while(value >>= 1)
+					result++;
+				return result;
+			}
+
+			static void Store(uint32_t address, uint32_t length)
+			{
+				SimState &state = State();
+				if(!state.file)
+					return;
+				fseek(state.file, long(address), SEEK_SET);
+				fwrite(&state.memory[address], 1, length, state.file);
+				fflush(state.file);
+			}
+
+			// Completes running operation when its time has passed
+			static void Update()
+			{
+				SimState &state = State();
+				if(state.pending == Idle || SimClock::Now() < state.pendingEnd)
+					return;
+				for(uint32_t i = 0; i < state.pendingLength; i++)
+				{
+					if(state.pending == Program)
+						state.memory[state.pendingAddress + i] &= state.pendingData[i];
+					else
+						state.memory[state.pendingAddress + i] = 0xff;
+				}
+				Store(state.pendingAddress, state.pendingLength);
+				state.pending = Idle;
+			}
+
+			static void Start(Operation operation, uint32_t address, uint32_t length, uint32_t time)
+			{
+				SimState &state = State();
+				state.pending = operation;
+				state.pendingAddress = address;
+				state.pendingLength = length;
+				state.pendingEnd = SimClock::Now() + time;
+				state.writeEnable = false;
+				if(operation == Program)
+					state.stats.programs++;
+				else
+					state.stats.erases++;
+			}
+
+			static void Deselect()
+			{
+				SimState &state = State();
+				uint32_t length = state.position;
+				state.position = 0;
+				if(!length || state.pending != Idle)
+					return;
+				uint32_t address = state.address % SIZE;
+				switch(state.command)
+				{
+				case 0x06:
+					state.writeEnable = true;
+					break;
+				case 0x04:
+					state.writeEnable = false;
+					break;
+				case 0x02:
+					if(state.writeEnable && length > 4)
+						Start(Program, address & ~(PageSize - 1), PageSize, state.timing.pageProgram);
+					break;
+				case 0x20:
+					if(state.writeEnable && length == 4)
+						Start(Erase, address & ~(SectorSize - 1), SectorSize, state.timing.sectorErase);
+					break;
+				case 0xd8:
+					if(state.writeEnable && length == 4)
+						Start(Erase, address & ~(BlockSize - 1), BlockSize, state.timing.blockErase);
+					break;
+				case 0xc7:
+					if(state.writeEnable)
+						Start(Erase, 0, SIZE, state.timing.chipErase);
+					break;
+				}
+			}
+		};
+	}
+}
@@ -0,0 +1,311 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <ioports.h>
+#include "sim_clock.h"
+
+namespace IO
+{
+	namespace Test
+	{
+		////////////////////////////////////////////////////////////////////////////////
+		// class WaveRecorder
+		// Records TestPort output and direction register changes with SimClock
+		// timestamps for host simulation of bit banged protocols.
+		// Only ports added with AddPort or through AddPin are recorded. If port
+		// access time is set in SimClock, it is added before every change, so
+		// successive pin writes get distinct timestamps and protocol timing
+		// and throughput can be measured.
+		// Recording can be exported to VCD to view it in GTKWave.
+		//
+		// Usage:
+		//		WaveRecorder recorder;
+		//		recorder.AddPin<Pa0>("clk");
+		//		recorder.AddPort<Portb>("data");
+		//		recorder.Start();
+		//		... run driver ...
+		//		recorder.Stop();
+		//		std::vector<uint64_t> edges = recorder.Edges<Pa0>(true);
+		//		std::ofstream file("trace.vcd");
+		//		recorder.WriteVcd(file);
+		////////////////////////////////////////////////////////////////////////////////
+
+		class WaveRecorder :public PortObserver
+		{
+		public:
+			struct Change
+			{
+				uint64_t time;
+				unsigned port;
+				uint32_t out;
+				uint32_t dir;
+			};
+
+			WaveRecorder()
+				:_previous(0), _started(false), _startTime(0)
+			{}
+
+			~WaveRecorder()
+			{
+				Stop();
+			}
+
+			// Records port outputs and direction as 'name' and 'name_dir' vectors
+			template<class Port>
+			void AddPort(const std::string &name)
+			{
+				unsigned port = FindPort(Port::Id, Port::Width, &ReadPort<Port>);
+				Signal signal = {name, port, 0, Port::Width, false};
+				_signals.push_back(signal);
+				Signal dirSignal = {name + "_dir", port, 0, Port::Width, true};
+				_signals.push_back(dirSignal);
+			}
+
+			// Records one pin output as 'name' wire
+			template<class Pin>
+			void AddPin(const std::string &name)
+			{
+				typedef typename Pin::Port PinPort;
+				unsigned port = FindPort(PinPort::Id, PinPort::Width, &ReadPort<PinPort>);
+				Signal signal = {name, port, Pin::Number, 1, false};
+				_signals.push_back(signal);
+			}
+
+			// Starts recording, current register values become initial state
+			void Start()
+			{
+				for(unsigned i = 0; i < _ports.size(); i++)
+				{
+					PortState &port = _ports[i];
+					port.read(port.out, port.dir);
+					port.initialOut = port.out;
+					port.initialDir = port.dir;
+				}
+				_changes.clear();
+				_startTime = SimClock::Now();
+				if(!_started)
+				{
+					_previous = Current();
+					Current() = this;
+					_started = true;
+				}
+			}
+
+			void Stop()
+			{
+				if(_started && Current() == this)
+					Current() = _previous;
+				_started = false;
+			}
+
+			virtual void PortChanged(unsigned id, unsigned width, uint32_t out, uint32_t dir)
+			{
+				SimClock::Advance(SimClock::PortAccessTime());
+				for(unsigned i = 0; i < _ports.size(); i++)
+				{
+					PortState &port = _ports[i];
+					if(port.id != id || port.width != width)
+						continue;
+					if(port.out != out || port.dir != dir)
+					{
+						port.out = out;
+						port.dir = dir;
+						Change change = {SimClock::Now(), i, out, dir};
+						_changes.push_back(change);
+					}
+					return;
+				}
+			}
+
+			const std::vector<Change> &Changes()const
+			{
+				return _changes;
+			}
+
+			uint64_t StartTime()const
+			{
+				return _startTime;
+			}
+
+			// Timestamps of output level changes of a pin: rising, falling or both
+			template<class Pin>
+			std::vector<uint64_t> Edges(bool rising, bool falling = false)const
+			{
+				typedef typename Pin::Port PinPort;
+				std::vector<uint64_t> result;
+				unsigned port = PortIndex(PinPort::Id, PinPort::Width);
+				if(port == NoPort)
+					return result;
+				bool level = (_ports[port].initialOut >> Pin::Number) & 1;
+				for(unsigned i = 0; i < _changes.size(); i++)
+				{
+					if(_changes[i].port != port)
+						continue;
+					bool newLevel = (_changes[i].out >> Pin::Number) & 1;
+					if(newLevel != level && (newLevel ? rising : falling))
+						result.push_back(_changes[i].time);
+					level = newLevel;
+				}
+				return result;
+			}
+
+			// Output level of a pin at given time
+			template<class Pin>
+			bool Level(uint64_t time)const
+			{
+				typedef typename Pin::Port PinPort;
+				unsigned port = PortIndex(PinPort::Id, PinPort::Width);
+				if(port == NoPort)
+					return false;
+				uint32_t out = _ports[port].initialOut;
+				for(unsigned i = 0; i < _changes.size() && _changes[i].time <= time; i++)
+					if(_changes[i].port == port)
+						out = _changes[i].out;
+				return (out >> Pin::Number) & 1;
+			}
+
+			// Writes recording in Value Change Dump format with 1 ns timescale
+			void WriteVcd(std::ostream &out, const std::string &module = "mcucpp")const
+			{
+				out << "$timescale 1ns $end\n";
+				out << "$scope module " << module << " $end\n";
+				for(unsigned i = 0; i < _signals.size(); i++)
+					out << "$var wire " << _signals[i].width << " " << Code(i) << " " << _signals[i].name << " $end\n";
+				out << "$upscope $end\n";
+				out << "$enddefinitions $end\n";
+				out << "#" << _startTime << "\n$dumpvars\n";
+				for(unsigned i = 0; i < _signals.size(); i++)
+				{
+					const PortState &port = _ports[_signals[i].port];
+					WriteValue(out, i, _signals[i].dir ? port.initialDir : port.initialOut);
+				}
+				out << "$end\n";
+
+				// port values as of the last written change
+				std::vector<PortState> state(_ports);
+				for(unsigned i = 0; i < state.size(); i++)
+				{
+					state[i].out = state[i].initialOut;
+					state[i].dir = state[i].initialDir;
+				}
+				uint64_t time = _startTime;
+				for(unsigned c = 0; c < _changes.size(); c++)
+				{
+					const Change &change = _changes[c];
+					if(change.time != time)
+					{
+						time = change.time;
+						out << "#" << time << "\n";
+					}
+					PortState &port = state[change.port];
+					for(unsigned i = 0; i < _signals.size(); i++)
+					{
+						const Signal &signal = _signals[i];
+						if(signal.port != change.port)
+							continue;
+						uint32_t oldValue = signal.dir ? port.dir : port.out;
+						uint32_t newValue = signal.dir ? change.dir : change.out;
+						if(Extract(signal, oldValue) != Extract(signal, newValue))
+							WriteValue(out, i, newValue);
+					}
+					port.out = change.out;
+					port.dir = change.dir;
+				}
+			}
+
+		private:
+			static const unsigned NoPort = ~0u;
+
+			typedef void (*PortReader)(uint32_t &out, uint32_t &dir);
+
+			struct PortState
+			{
+				PortReader read;
+				unsigned id;
+				unsigned width;
+				uint32_t out;
+				uint32_t dir;
+				uint32_t initialOut;
+				uint32_t initialDir;
+			};
+
+			struct Signal
+			{
+				std::string name;
+				unsigned port;
+				unsigned bit;
+				unsigned width;
+				bool dir;
+			};
+
+			unsigned PortIndex(unsigned id, unsigned width)const
+			{
+				for(unsigned i = 0; i < _ports.size(); i++)
+					if(_ports[i].id == id && _ports[i].width == width)
+						return i;
+				return NoPort;
+			}
+
+			template<class Port>
+			static void ReadPort(uint32_t &out, uint32_t &dir)
+			{
+				out = uint32_t(Port::OutReg);
+				dir = uint32_t(Port::DirReg);
+			}
+
+			unsigned FindPort(unsigned id, unsigned width, PortReader read)
+			{
+				unsigned index = PortIndex(id, width);
+				if(index != NoPort)
+					return index;
+				uint32_t out, dir;
+				read(out, dir);
+				PortState port = {read, id, width, out, dir, out, dir};
+				_ports.push_back(port);
+				return unsigned(_ports.size() - 1);
+			}
+
+			static uint32_t Extract(const Signal &signal, uint32_t value)
+			{
+				if(signal.width == 1)
+					return (value >> signal.bit) & 1;
+				return value;
+			}
+
+			// VCD identifier codes are strings of printable characters '!' - '~'
+			static std::string Code(unsigned index)
+			{
+				std::string code;
+				do
+				{
+					code += char('!' + index % 94);
+					index /= 94;
+				}while(index);
+				return code;
+			}
+
+			void WriteValue(std::ostream &out, unsigned index, uint32_t value)const
+			{
+				const Signal &signal = _signals[index];
+				if(signal.width == 1)
+				{
+					out << ((value >> signal.bit) & 1) << Code(index) << "\n";
+					return;
+				}
+				out << "b";
+				for(unsigned bit = signal.width; bit > 0; bit--)
+					out << ((value >> (bit - 1)) & 1);
+				out << " " << Code(index) << "\n";
+			}
+
+			PortObserver *_previous;
+			bool _started;
+			uint64_t _startTime;
+			std::vector<PortState> _ports;
+			std::vector<Signal> _signals;
+			std::vector<Change> _changes;
+		};
+	}
+}
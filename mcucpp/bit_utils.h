@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+#include "template_utils.h"
+
+namespace Util
+{
+	namespace Private
+	{
+		enum BitIntrinsicsKind
+		{
+			GenericBits,
+			IntBits,
+			LongBits,
+			LongLongBits
+		};
+
+		template<class T>
+		struct SelectBitIntrinsics
+		{
+#if defined(__GNUC__)
+			static const BitIntrinsicsKind value =
+				sizeof(T) <= sizeof(unsigned) ? IntBits :
+				sizeof(T) <= sizeof(unsigned long) ? LongBits :
+				sizeof(T) <= sizeof(unsigned long long) ? LongLongBits : GenericBits;
+#else
+			static const BitIntrinsicsKind value = GenericBits;
+#endif
+		};
+
+		// portable fallback
+		template<BitIntrinsicsKind kind>
+		struct BitIntrinsics
+		{
+			template<class T>
+			static unsigned PopCount(T value)
+			{
+				unsigned result = 0;
+				for(; value; value &= value - 1)
+					result++;
+				return result;
+			}
+
+			template<class T>
+			static unsigned CountTrailingZeros(T value)
+			{
+				unsigned result = 0;
+				for(; (value & 1) == 0; value >>= 1)
+					result++;
+				return result;
+			}
+		};
+
+#if defined(__GNUC__)
+		template<>
+		struct BitIntrinsics<IntBits>
+		{
+			template<class T>
+			static unsigned PopCount(T value)
+			{	return __builtin_popcount(value);	}
+
+			template<class T>
+			static unsigned CountTrailingZeros(T value)
+			{	return __builtin_ctz(value);	}
+		};
+
+		template<>
+		struct BitIntrinsics<LongBits>
+		{
+			template<class T>
+			static unsigned PopCount(T value)
+			{	return __builtin_popcountl(value);	}
+
+			template<class T>
+			static unsigned CountTrailingZeros(T value)
+			{	return __builtin_ctzl(value);	}
+		};
+
+		template<>
+		struct BitIntrinsics<LongLongBits>
+		{
+			template<class T>
+			static unsigned PopCount(T value)
+			{	return __builtin_popcountll(value);	}
+
+			template<class T>
+			static unsigned CountTrailingZeros(T value)
+			{	return __builtin_ctzll(value);	}
+		};
+#endif
+	}
+
+	// Number of bits set in value.
+	template<class T>
+	inline unsigned PopCount(T value)
+	{
+		typedef typename Unsigned<T>::Result UT;
+		return Private::BitIntrinsics<Private::SelectBitIntrinsics<T>::value>::PopCount(UT(value));
+	}
+
+	// Zero based index of the least significant bit set. Value must not be zero.
+	template<class T>
+	inline unsigned CountTrailingZeros(T value)
+	{
+		typedef typename Unsigned<T>::Result UT;
+		return Private::BitIntrinsics<Private::SelectBitIntrinsics<T>::value>::CountTrailingZeros(UT(value));
+	}
+
+	// One based index of the least significant bit set, zero if value is zero.
+	template<class T>
+	inline unsigned FindFirstSet(T value)
+	{
+		return value ? CountTrailingZeros(value) + 1 : 0;
+	}
+
+	// Clears the least significant bit set and returns its zero based index.
+	// Value must not be zero.
+	template<class T>
+	inline unsigned ExtractLowestBit(T &value)
+	{
+		unsigned index = CountTrailingZeros(value);
+		value &= value - 1;
+		return index;
+	}
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "static_assert.h"
+#include "select_size.h"
+#include "bit_utils.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// class template BitSet
+// Fixed size set of bits packed into an array of machine words.
+// FindFirst/FindNext skip zero words and use CountTrailingZeros intrinsics,
+// so iterating over set bits costs one step per set bit plus one per word.
+// Use uint8_t as WordT on 8-bit targets.
+////////////////////////////////////////////////////////////////////////////////
+
+template<unsigned SIZE, class WordT = unsigned>
+class BitSet
+{
+public:
+	typedef WordT WordType;
+	typedef typename SelectSizeForLength<SIZE>::Result INDEX_T;
+
+	static const unsigned WordBits = sizeof(WordT) * 8;
+	static const unsigned Words = (SIZE + WordBits - 1) / WordBits;
+	// returned by FindFirst/FindNext when no more bits are set
+	static const INDEX_T NotFound = SIZE;
+
+	BitSet()
+	{
+		ClearAll();
+	}
+
+	inline void Set(INDEX_T bit)
+	{
+		_words[bit / WordBits] |= Mask(bit);
+	}
+
+	inline void Set(INDEX_T bit, bool value)
+	{
+		if(value)
+			Set(bit);
+		else
+			Clear(bit);
+	}
+
+	inline void Clear(INDEX_T bit)
+	{
+		_words[bit / WordBits] &= WordT(~Mask(bit));
+	}
+
+	inline void Toggle(INDEX_T bit)
+	{
+		_words[bit / WordBits] ^= Mask(bit);
+	}
+
+	inline bool Test(INDEX_T bit)const
+	{
+		return (_words[bit / WordBits] & Mask(bit)) != 0;
+	}
+
+	void SetAll()
+	{
+		for(unsigned i = 0; i < Words; ++i)
+			_words[i] = WordT(~WordT(0));
+		_words[Words - 1] &= LastWordMask;
+	}
+
+	void ClearAll()
+	{
+		for(unsigned i = 0; i < Words; ++i)
+			_words[i] = 0;
+	}
+
+	INDEX_T Count()const
+	{
+		INDEX_T result = 0;
+		for(unsigned i = 0; i < Words; ++i)
+			result += Util::PopCount(_words[i]);
+		return result;
+	}
+
+	bool Any()const
+	{
+		for(unsigned i = 0; i < Words; ++i)
+			if(_words[i])
+				return true;
+		return false;
+	}
+
+	inline bool None()const
+	{
+		return !Any();
+	}
+
+	inline INDEX_T FindFirst()const
+	{
+		return FindFromWord(0);
+	}
+
+	// Returns index of the first set bit after 'bit'
+	INDEX_T FindNext(INDEX_T bit)const
+	{
+		++bit;
+		if(bit >= SIZE)
+			return NotFound;
+		unsigned word = bit / WordBits;
+		WordT rest = _words[word] & WordT(WordT(~WordT(0)) << (bit % WordBits));
+		if(rest)
+			return INDEX_T(word * WordBits + Util::CountTrailingZeros(rest));
+		return FindFromWord(word + 1);
+	}
+
+	BitSet& operator&=(const BitSet &other)
+	{
+		for(unsigned i = 0; i < Words; ++i)
+			_words[i] &= other._words[i];
+		return *this;
+	}
+
+	BitSet& operator|=(const BitSet &other)
+	{
+		for(unsigned i = 0; i < Words; ++i)
+			_words[i] |= other._words[i];
+		return *this;
+	}
+
+	BitSet& operator^=(const BitSet &other)
+	{
+		for(unsigned i = 0; i < Words; ++i)
+			_words[i] ^= other._words[i];
+		return *this;
+	}
+
+	bool operator==(const BitSet &other)const
+	{
+		for(unsigned i = 0; i < Words; ++i)
+			if(_words[i] != other._words[i])
+				return false;
+		return true;
+	}
+
+	bool operator!=(const BitSet &other)const
+	{
+		return !(*this == other);
+	}
+
+	inline WordT Word(unsigned index)const
+	{
+		return _words[index];
+	}
+
+	inline unsigned Size()const
+	{return SIZE;}
+
+private:
+	static const WordT LastWordMask = SIZE % WordBits ?
+			WordT((WordT(1) << (SIZE % WordBits)) - 1) : WordT(~WordT(0));
+
+	static inline WordT Mask(INDEX_T bit)
+	{
+		return WordT(WordT(1) << (bit % WordBits));
+	}
+
+	INDEX_T FindFromWord(unsigned word)const
+	{
+		for(; word < Words; ++word)
+		{
+			if(_words[word])
+				return INDEX_T(word * WordBits + Util::CountTrailingZeros(_words[word]));
+		}
+		return NotFound;
+	}
+
+	BOOST_STATIC_ASSERT(SIZE > 0);
+	WordT _words[Words];
+};
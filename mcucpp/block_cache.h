@@ -0,0 +1,290 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "static_assert.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// class template BlockCache
+// Write-back cache of LINES blocks in front of a block device (e.g. SdCard).
+// Device is a class with static functions:
+//		BlockSize, BlockCount(),
+//		ReadBlocks(block, data, count), WriteBlocks(block, data, count),
+//		WriteStart(block, count), WriteNext(data), WriteStop(), Sync()
+// BlockCache provides the same interface, so it can be used in place of
+// the device.
+//
+// Single block reads and writes go through the cache with LRU replacement.
+// Written blocks are only marked dirty. When a dirty block has to be evicted,
+// or on Sync, all dirty blocks are written back in ascending order, runs of
+// consecutive blocks in one multi-block write. So sequential single block
+// writes reach the device as multi-block writes of up to LINES blocks.
+// Multi-block reads and writes go directly to the device, cached copies of
+// the blocks are kept coherent.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Device, unsigned LINES = 4>
+class BlockCache
+{
+public:
+	static const unsigned BlockSize = Device::BlockSize;
+
+	// Drops cached data, call after device Init
+	static void Init()
+	{
+		for(unsigned i = 0; i < LINES; i++)
+		{
+			_tags[i] = NoBlock;
+			_age[i] = uint8_t(i);
+		}
+		_dirty = 0;
+		_hits = 0;
+		_misses = 0;
+		_writeBacks = 0;
+	}
+
+	static uint32_t BlockCount()
+	{
+		return Device::BlockCount();
+	}
+
+	static bool ReadBlocks(uint32_t block, void *data, size_t count)
+	{
+		uint8_t *dest = static_cast<uint8_t *>(data);
+		if(count == 1)
+		{
+			int line = Find(block);
+			if(line < 0)
+			{
+				_misses++;
+				line = Allocate(block);
+				if(line < 0 || !Device::ReadBlocks(block, _lines[line], 1))
+				{
+					if(line >= 0)
+						_tags[line] = NoBlock;
+					return false;
+				}
+			}
+			else
+				_hits++;
+			Touch(unsigned(line));
+			memcpy(dest, _lines[line], BlockSize);
+			return true;
+		}
+		if(!Device::ReadBlocks(block, dest, count))
+			return false;
+		// dirty cached blocks are newer than the device content
+		for(unsigned i = 0; i < LINES; i++)
+			if((_dirty & Bit(i)) && _tags[i] - block < count)
+				memcpy(dest + (_tags[i] - block) * BlockSize, _lines[i], BlockSize);
+		return true;
+	}
+
+	static bool WriteBlocks(uint32_t block, const void *data, size_t count)
+	{
+		const uint8_t *src = static_cast<const uint8_t *>(data);
+		if(count == 1)
+		{
+			if(block >= Device::BlockCount())
+				return false;
+			int line = Find(block);
+			if(line < 0)
+			{
+				// whole block is overwritten, nothing to read
+				line = Allocate(block);
+				if(line < 0)
+					return false;
+			}
+			memcpy(_lines[line], src, BlockSize);
+			_dirty |= Bit(unsigned(line));
+			Touch(unsigned(line));
+			return true;
+		}
+		if(!Device::WriteBlocks(block, src, count))
+			return false;
+		for(uint32_t i = 0; i < count; i++)
+			Update(block + i, src + i * BlockSize);
+		return true;
+	}
+
+	static bool WriteStart(uint32_t block, size_t count)
+	{
+		_streamBlock = block;
+		return Device::WriteStart(block, count);
+	}
+
+	static bool WriteNext(const void *data)
+	{
+		if(!Device::WriteNext(data))
+			return false;
+		Update(_streamBlock++, static_cast<const uint8_t *>(data));
+		return true;
+	}
+
+	static bool WriteStop()
+	{
+		return Device::WriteStop();
+	}
+
+	// Writes all dirty blocks and waits for the device
+	static bool Sync()
+	{
+		return Flush() && Device::Sync();
+	}
+
+	// Writes all dirty blocks back
+	static bool Flush()
+	{
+		while(_dirty)
+		{
+			// the lowest dirty block starts a run
+			unsigned first = LINES;
+			for(unsigned i = 0; i < LINES; i++)
+				if((_dirty & Bit(i)) && (first == LINES || _tags[i] < _tags[first]))
+					first = i;
+			unsigned run[LINES];
+			unsigned length = 0;
+			int line = int(first);
+			while(line >= 0 && (_dirty & Bit(unsigned(line))))
+			{
+				run[length++] = unsigned(line);
+				line = Find(_tags[first] + length);
+			}
+			if(!Device::WriteStart(_tags[first], length))
+				return false;
+			for(unsigned i = 0; i < length; i++)
+			{
+				if(!Device::WriteNext(_lines[run[i]]))
+					return false;
+				_dirty &= ~Bit(run[i]);
+			}
+			_writeBacks += length;
+			if(!Device::WriteStop())
+				return false;
+		}
+		return true;
+	}
+
+	// Drops cached blocks without writing them back
+	static void Invalidate()
+	{
+		Init();
+	}
+
+	static bool IsDirty()
+	{
+		return _dirty != 0;
+	}
+
+	static uint32_t Hits()
+	{
+		return _hits;
+	}
+
+	static uint32_t Misses()
+	{
+		return _misses;
+	}
+
+	// Blocks written back to device
+	static uint32_t WriteBacks()
+	{
+		return _writeBacks;
+	}
+
+private:
+	BOOST_STATIC_ASSERT(LINES > 0 && LINES <= 32);
+	static const uint32_t NoBlock = 0xffffffff;
+
+	static uint32_t Bit(unsigned line)
+	{
+		return uint32_t(1) << line;
+	}
+
+	static int Find(uint32_t block)
+	{
+		for(unsigned i = 0; i < LINES; i++)
+			if(_tags[i] == block)
+				return int(i);
+		return -1;
+	}
+
+	// Takes least recently used line for block, writes back dirty blocks if it is dirty
+	static int Allocate(uint32_t block)
+	{
+		unsigned victim = 0;
+		for(unsigned i = 0; i < LINES; i++)
+		{
+			if(_tags[i] == NoBlock)
+			{
+				victim = i;
+				break;
+			}
+			if(_age[i] > _age[victim])
+				victim = i;
+		}
+		if((_dirty & Bit(victim)) && !Flush())
+			return -1;
+		_tags[victim] = block;
+		return int(victim);
+	}
+
+	// Line becomes the most recently used one
+	static void Touch(unsigned line)
+	{
+		for(unsigned i = 0; i < LINES; i++)
+			if(_age[i] < _age[line])
+				_age[i]++;
+		_age[line] = 0;
+	}
+
+	// Keeps cached copy of block written directly to device
+	static void Update(uint32_t block, const uint8_t *data)
+	{
+		int line = Find(block);
+		if(line < 0)
+			return;
+		memcpy(_lines[line], data, BlockSize);
+		_dirty &= ~Bit(unsigned(line));
+	}
+
+	static uint32_t _tags[LINES];
+	static uint8_t _age[LINES];
+	static uint32_t _dirty;
+	static uint8_t _lines[LINES][Device::BlockSize];
+	static uint32_t _streamBlock;
+	static uint32_t _hits;
+	static uint32_t _misses;
+	static uint32_t _writeBacks;
+};
+
+#define BLOCK_CACHE_TEMPLATE_ARGS template<class Device, unsigned LINES>
+#define BLOCK_CACHE_CLASS BlockCache<Device, LINES>
+
+	BLOCK_CACHE_TEMPLATE_ARGS
+	uint32_t BLOCK_CACHE_CLASS::_tags[LINES];
+
+	BLOCK_CACHE_TEMPLATE_ARGS
+	uint8_t BLOCK_CACHE_CLASS::_age[LINES];
+
+	BLOCK_CACHE_TEMPLATE_ARGS
+	uint32_t BLOCK_CACHE_CLASS::_dirty;
+
+	BLOCK_CACHE_TEMPLATE_ARGS
+	uint8_t BLOCK_CACHE_CLASS::_lines[LINES][Device::BlockSize];
+
+	BLOCK_CACHE_TEMPLATE_ARGS
+	uint32_t BLOCK_CACHE_CLASS::_streamBlock;
+
+	BLOCK_CACHE_TEMPLATE_ARGS
+	uint32_t BLOCK_CACHE_CLASS::_hits;
+
+	BLOCK_CACHE_TEMPLATE_ARGS
+	uint32_t BLOCK_CACHE_CLASS::_misses;
+
+	BLOCK_CACHE_TEMPLATE_ARGS
+	uint32_t BLOCK_CACHE_CLASS::_writeBacks;
+
+#undef BLOCK_CACHE_CLASS
+#undef BLOCK_CACHE_TEMPLATE_ARGS
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Proleptic Gregorian calendar and Unix time (seconds since 1970-01-01
+// 00:00:00 UTC, no leap seconds) conversions.
+// Day conversions follow Neri and Schneider, "Euclidean affine functions and
+// their application to calendar algorithms": March based years, dates shifted
+// by 82 eras of 400 years so all intermediate values are unsigned, month and
+// day from one multiply-add. There are no branches and no loops; divisions
+// are by constants, so compilers turn them into multiplications and shifts.
+////////////////////////////////////////////////////////////////////////////////
+
+struct DateTime
+{
+	int16_t year;
+	uint8_t month;		// 1..12
+	uint8_t day;		// 1..31
+	uint8_t hour;
+	uint8_t minute;
+	uint8_t second;
+	uint8_t weekday;	// 0 is Sunday
+};
+
+namespace Calendar
+{
+	namespace Private
+	{
+		// 82 eras of 400 years
+		const uint32_t YearShift = 400 * 82;
+		// days from 0000-03-01 of the shifted calendar to 1970-01-01
+		const uint32_t DayShift = 719468 + 146097 * 82;
+		// days from 0000-03-01 to 1970-01-01
+		const uint32_t EpochDays = 719468;
+	}
+
+	// Days since 1970-01-01, years -32767..32767
+	inline int32_t DaysFromCivil(int32_t year, unsigned month, unsigned day)
+	{
+		using namespace Private;
+		// January and February belong to the previous March based year
+		uint32_t january = month <= 2;
+		uint32_t y = uint32_t(year) + YearShift - january;
+		uint32_t m = month + 12 * january;
+		uint32_t century = y / 100;
+		uint32_t yearDays = 1461 * y / 4 - century + century / 4;
+		uint32_t monthDays = (979 * m - 2919) / 32;
+		return int32_t(yearDays + monthDays + day - 1 - DayShift);
+	}
+
+	// Date of the day 'days' since 1970-01-01, years -32767..32767
+	inline void CivilFromDays(int32_t days, DateTime &date)
+	{
+		using namespace Private;
+		uint32_t n = uint32_t(days) + DayShift;
+		// century and day of century
+		uint32_t n1 = 4 * n + 3;
+		uint32_t century = n1 / 146097;
+		uint32_t centuryDay = n1 % 146097 / 4;
+		// year of century and day of year
+		uint32_t n2 = 4 * centuryDay + 3;
+		uint64_t p2 = uint64_t(2939745) * n2;
+		uint32_t year = 100 * century + uint32_t(p2 >> 32);
+		uint32_t yearDay = uint32_t(p2) / 2939745 / 4;
+		// month and day of March based year
+		uint32_t n3 = 2141 * yearDay + 197913;
+		uint32_t month = n3 >> 16;
+		uint32_t day = (n3 & 0xffff) / 2141;
+		// back to January based year
+		uint32_t january = yearDay >= 306;
+		date.year = int16_t(year - YearShift + january);
+		date.month = uint8_t(month - 12 * january);
+		date.day = uint8_t(day + 1);
+		// 1970-01-01 was Thursday
+		date.weekday = uint8_t((n + 3) % 7);
+	}
+
+	// Day of week of the day 'days' since 1970-01-01, 0 is Sunday
+	inline unsigned Weekday(int32_t days)
+	{
+		return (uint32_t(days) + Private::DayShift + 3) % 7;
+	}
+
+	inline bool IsLeapYear(int32_t year)
+	{
+		return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+	}
+
+	inline unsigned DaysInMonth(int32_t year, unsigned month)
+	{
+		static const uint8_t days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+		return month == 2 && IsLeapYear(year) ? 29 : days[month - 1];
+	}
+
+	// Unix time of date and time, weekday is ignored
+	inline int64_t ToSeconds(const DateTime &time)
+	{
+		return int64_t(DaysFromCivil(time.year, time.month, time.day)) * 86400 +
+			uint32_t(time.hour) * 3600 + uint32_t(time.minute) * 60 + time.second;
+	}
+
+	// Date and time of Unix time, years 0..9999
+	inline void FromSeconds(int64_t seconds, DateTime &time)
+	{
+		using namespace Private;
+		// shifted by one era before 0000-03-01: non negative from year 0, below
+		// 2^39 up to year 9999, so divided by 128 it fits 32 bits: 86400 = 128 * 675
+		const uint32_t shift = EpochDays + 146097;
+		uint64_t shifted = uint64_t(seconds + int64_t(shift) * 86400);
+		uint32_t days = uint32_t(shifted >> 7) / 675;
+		uint32_t daySeconds = uint32_t(shifted - uint64_t(days) * 86400);
+		CivilFromDays(int32_t(days - shift), time);
+		uint32_t hour = daySeconds / 3600;
+		uint32_t rest = daySeconds - hour * 3600;
+		uint32_t minute = rest / 60;
+		time.hour = uint8_t(hour);
+		time.minute = uint8_t(minute);
+		time.second = uint8_t(rest - minute * 60);
+	}
+}
@@ -32,6 +32,7 @@
 
 
 
+#include <stdint.h>
 #include "static_assert.h"
 
 template<bool Short> struct SelectSizeT;
@@ -134,11 +135,12 @@ template<int SIZE, class DATA_T=unsigned char>
 class Queue :public RingBuffer<SIZE, DATA_T>
 {
 	using typename RingBuffer<SIZE, DATA_T>::INDEX_T;
-	using RingBuffer<SIZE, DATA_T>::IsFull;
-	using RingBuffer<SIZE, DATA_T>::IsEmpty;
 	
 
 public:
+	using RingBuffer<SIZE, DATA_T>::IsEmpty;
+	using RingBuffer<SIZE, DATA_T>::IsFull;
+
 	inline bool Write(DATA_T c)
 	{
 		if(IsFull())
@@ -218,10 +220,11 @@ public:
 	unsigned Size()
 	{return SIZE;}
 
-	void Push(T value)
+	bool Push(T value)
 	{
-		if(_index>=Size()) return;
+		if(_index>=Size()) return false;
 		_data[_index++] = value;
+		return true;
 	}
 
 	T Pop()
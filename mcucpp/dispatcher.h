@@ -38,7 +38,17 @@ typedef struct
 	uint16_t period;
 } TimerData;
 
-template<uint8_t TasksLenght, uint8_t TimersLenght>
+// Idle policy that never sleeps: Poll returns at once when no task is ready.
+// See Power::LowPowerIdle in low_power_idle.h.
+struct NoIdle
+{
+	static const bool Enabled = false;
+
+	static void Sleep()
+	{}
+};
+
+template<uint8_t TasksLenght, uint8_t TimersLenght, class Idle = NoIdle>
 class Dispatcher
 {
 public:
@@ -53,9 +63,12 @@ public:
 		}
 	}
 
-	static void SetTask(task_t task)
+	// Returns false if the task queue is full
+	static bool SetTask(task_t task)
 	{
-		ATOMIC{	_tasks.Write(task);}
+		bool result;
+		ATOMIC{	result = _tasks.Write(task);}
+		return result;
 	}
 
 	static void SetTimer(task_t task, uint16_t period) __attribute__ ((noinline))
@@ -104,8 +117,19 @@ public:
 		{
 		//	sei();
 			task();
+			return;
 		}
 		//sei();
+		if(Idle::Enabled)
+		{
+			// A task posted by an interrupt since the read above has to be seen
+			// before sleeping, the sleep itself is left with interrupts disabled
+			ATOMIC
+			{
+				if(_tasks.IsEmpty())
+					Idle::Sleep();
+			}
+		}
 	}
 
 	static void TimerHandler()
@@ -125,11 +149,11 @@ private:
 	static Array<TimersLenght, TimerData> _timers;
 };
 
-template<uint8_t TasksLenght, uint8_t TimersLenght>
-Array<TimersLenght, TimerData> Dispatcher<TasksLenght, TimersLenght>::_timers;
+template<uint8_t TasksLenght, uint8_t TimersLenght, class Idle>
+Array<TimersLenght, TimerData> Dispatcher<TasksLenght, TimersLenght, Idle>::_timers;
 
-template<uint8_t TasksLenght, uint8_t TimersLenght>
-Queue<TasksLenght, task_t> Dispatcher<TasksLenght, TimersLenght>::_tasks;
+template<uint8_t TasksLenght, uint8_t TimersLenght, class Idle>
+Queue<TasksLenght, task_t> Dispatcher<TasksLenght, TimersLenght, Idle>::_tasks;
 
 
 
@@ -0,0 +1,175 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <static_assert.h>
+#include <iopins.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// class template Bus8080
+// Intel 8080 style parallel display bus (ILI9341, ST7789, SSD1963 and
+// similar controllers) over GPIO. Data is a PinList of 8 or 16 lines, which
+// may be spread over several ports; Cs, Dc (low for commands), Wr and Rd are
+// TPins, Rd may be NullPin for write-only wiring. The controller latches data
+// on the rising edge of WR.
+//
+// Writing a PinList spread over ports takes a read-modify-write of every port,
+// while a WR strobe is two single pin writes. So WriteRepeat sets data lines
+// once and then only strobes WR (fills), and writes from a buffer skip
+// setting data lines when the word does not change.
+// Pixel functions take RGB565 colors; an 8 bit bus sends the high byte first.
+//
+// Bus8080 has the same interface as HAL::FsmcBus8080 for STM32 parts with
+// FSMC, so display drivers work with either.
+//
+// Usage:
+//		typedef IO::PinList<Pa0, Pa1, Pa2, Pa3, Pb4, Pb5, Pb6, Pb7> Data;
+//		typedef Bus8080<Data, Pc0, Pc1, Pc2, Pc3> Bus;
+//		Bus::Init();
+//		Bus::Select();
+//		Bus::WriteCommand(0x2c);		// memory write
+//		Bus::FillPixels(0xf800, 320 * 240);
+//		Bus::Deselect();
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Data, class Cs, class Dc, class Wr, class Rd = IO::NullPin>
+class Bus8080
+{
+public:
+	typedef typename Data::DataType DataType;
+	static const unsigned Width = Data::Length;
+
+	static void Init()
+	{
+		Cs::Set();
+		Dc::Set();
+		Wr::Set();
+		Rd::Set();
+		Cs::SetDirWrite();
+		Dc::SetDirWrite();
+		Wr::SetDirWrite();
+		Rd::SetDirWrite();
+		Data::SetConfiguration(Data::Out);
+	}
+
+	static void Select()
+	{
+		Cs::Clear();
+	}
+
+	static void Deselect()
+	{
+		Cs::Set();
+	}
+
+	static void WriteCommand(DataType command)
+	{
+		Dc::Clear();
+		Data::Write(command);
+		Strobe();
+		Dc::Set();
+	}
+
+	static void WriteData(DataType value)
+	{
+		Data::Write(value);
+		Strobe();
+	}
+
+	// Writes the same word count times, data lines are set only once
+	static void WriteRepeat(DataType value, uint32_t count)
+	{
+		if(!count)
+			return;
+		Data::Write(value);
+		for(; count >= 4; count -= 4)
+		{
+			Strobe();
+			Strobe();
+			Strobe();
+			Strobe();
+		}
+		while(count--)
+			Strobe();
+	}
+
+	static void WriteData(const DataType *data, size_t count)
+	{
+		if(!count)
+			return;
+		DataType last = *data;
+		Data::Write(last);
+		Strobe();
+		while(--count)
+		{
+			DataType value = *++data;
+			if(value != last)
+			{
+				last = value;
+				Data::Write(value);
+			}
+			Strobe();
+		}
+	}
+
+	static void FillPixels(uint16_t color, uint32_t count)
+	{
+		uint8_t high = uint8_t(color >> 8);
+		uint8_t low = uint8_t(color);
+		if(Width >= 16 || high == low)
+		{
+			WriteRepeat(DataType(color), Width >= 16 ? count : count * 2);
+			return;
+		}
+		while(count--)
+		{
+			WriteData(high);
+			WriteData(low);
+		}
+	}
+
+	static void WritePixels(const uint16_t *pixels, size_t count)
+	{
+		if(!count)
+			return;
+		// differs from the first word, so data lines are set for it
+		DataType last = DataType(~(Width >= 16 ? *pixels : *pixels >> 8));
+		while(count--)
+		{
+			uint16_t color = *pixels++;
+			if(Width < 16)
+				last = WriteNext(DataType(color >> 8), last);
+			last = WriteNext(DataType(color), last);
+		}
+	}
+
+	// Reads count words, the caller issues a command (and a dummy read if
+	// the controller needs it) first
+	static void ReadData(DataType *data, size_t count)
+	{
+		Data::SetConfiguration(Data::In);
+		while(count--)
+		{
+			Rd::Clear();
+			*data++ = Data::PinRead();
+			Rd::Set();
+		}
+		Data::SetConfiguration(Data::Out);
+	}
+
+private:
+	BOOST_STATIC_ASSERT(Data::Length == 8 || Data::Length == 16);
+
+	static void Strobe()
+	{
+		Wr::Clear();
+		Wr::Set();
+	}
+
+	static DataType WriteNext(DataType value, DataType last)
+	{
+		if(value != last)
+			Data::Write(value);
+		Strobe();
+		return value;
+	}
+};
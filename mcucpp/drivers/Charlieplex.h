@@ -0,0 +1,302 @@
+#pragma once
+#include <stdint.h>
+#include <static_assert.h>
+#include <bitset.h>
+#include <select_size.h>
+#include <loki/Typelist.h>
+#include <loki/TypeManip.h>
+
+namespace IO
+{
+	namespace CharlieplexPrivate
+	{
+		////////////////////////////////////////////////////////////////////////////////
+		// class template CharlieplexPortWriter
+		// Applies precomputed pin state of one charlieplex step to a port.
+		// 'mask' has all charlieplexed pins of the port, Step holds the pins
+		// to drive and the output value. Other pins of the port are not touched.
+		// Generic version goes through port interface, platforms with known
+		// register layout are specialized below.
+		////////////////////////////////////////////////////////////////////////////////
+		template<class Port>
+		struct CharlieplexPortWriter
+		{
+			typedef typename Port::DataT DataT;
+			struct Step
+			{
+				DataT dir;
+				DataT out;
+			};
+
+			template<DataT mask, DataT dir, DataT out>
+			static Step Make()
+			{
+				Step step = {dir, out};
+				return step;
+			}
+
+			template<DataT mask>
+			static void Write(const Step &step)
+			{
+				Port::SetConfiguration(mask, Port::In);
+				Port::ClearAndSet(mask, step.out);
+				Port::SetConfiguration(step.dir, Port::Out);
+			}
+		};
+
+#if defined(AVR_PORTS_H)
+		template<class Out, class Dir, class In, int ID>
+		struct CharlieplexPortWriter<PortImplimentation<Out, Dir, In, ID> >
+		{
+			typedef uint8_t DataT;
+			struct Step
+			{
+				DataT dir;
+				DataT out;
+			};
+
+			template<DataT mask, DataT dir, DataT out>
+			static Step Make()
+			{
+				Step step = {dir, out};
+				return step;
+			}
+
+			template<DataT mask>
+			static void Write(const Step &step)
+			{
+				ATOMIC
+				{
+					Dir::And(DataT(~mask));
+					Out::AndOr(DataT(~mask), step.out);
+					Dir::Or(step.dir);
+				}
+			}
+		};
+#endif
+
+#if defined(STM32_PORTS_H)
+		template<class CRL, class CRH, class IDR, class ODR, class BSRR, class BRR, class LCKR, uint32_t ClkEnMask, int ID>
+		struct CharlieplexPortWriter<Private::PortImplementation<CRL, CRH, IDR, ODR, BSRR, BRR, LCKR, ClkEnMask, ID> >
+		{
+			typedef uint16_t DataT;
+			struct Step
+			{
+				uint32_t crl;
+				uint32_t crh;
+				uint32_t bsrr;
+			};
+
+			template<unsigned mask, unsigned dir>
+			struct ConfigWord
+			{
+				static const uint32_t value =
+					Private::ConfigurationMask<dir>::value * NativePortBase::Out |
+					Private::ConfigurationMask<mask & ~dir>::value * NativePortBase::In;
+			};
+
+			template<DataT mask, DataT dir, DataT out>
+			static Step Make()
+			{
+				Step step =
+				{
+					ConfigWord<mask & 0xff, dir & 0xff>::value,
+					ConfigWord<(mask >> 8), (dir >> 8)>::value,
+					out | uint32_t(mask & ~out) << 16
+				};
+				return step;
+			}
+
+			template<DataT mask>
+			static void Write(const Step &step)
+			{
+				const uint32_t crlMask = Private::ConfigurationMask<mask & 0xff>::value * 0x0f;
+				const uint32_t crhMask = Private::ConfigurationMask<(mask >> 8)>::value * 0x0f;
+				// Release all pins first: new levels on pins still driving from
+				// the previous step would light a neighbouring LED
+				if(crlMask)
+					CRL::AndOr(~crlMask, ConfigWord<mask & 0xff, 0>::value);
+				if(crhMask)
+					CRH::AndOr(~crhMask, ConfigWord<(mask >> 8), 0>::value);
+				BSRR::Set(step.bsrr);
+				if(crlMask)
+					CRL::AndOr(~crlMask, step.crl);
+				if(crhMask)
+					CRH::AndOr(~crhMask, step.crh);
+			}
+		};
+#endif
+
+		// Port bit of pin 'index' in Pins if it belongs to Port, 0 otherwise
+		template<class Pins, unsigned index, class Port, bool valid = (index < Pins::Length)>
+		struct PinBit
+		{
+			typedef typename Pins::template Pin<index> Pin;
+			static const unsigned value = Loki::IsSameType<typename Pin::Port, Port>::value ? (1u << Pin::Number) : 0;
+		};
+
+		template<class Pins, unsigned index, class Port>
+		struct PinBit<Pins, index, Port, false>
+		{
+			static const unsigned value = 0;
+		};
+
+		template<class Pins, class Port, unsigned index = 0, bool last = (index == Pins::Length)>
+		struct PortMask
+		{
+			static const unsigned value = PinBit<Pins, index, Port>::value | PortMask<Pins, Port, index + 1>::value;
+		};
+
+		template<class Pins, class Port, unsigned index>
+		struct PortMask<Pins, Port, index, true>
+		{
+			static const unsigned value = 0;
+		};
+
+		// Per port tables of precomputed steps
+		template<class PortList, class Pins, unsigned Steps>
+		struct PortTable;
+
+		template<class Pins, unsigned Steps>
+		struct PortTable<Loki::NullType, Pins, Steps>
+		{
+			template<unsigned step, unsigned anode, unsigned cathode>
+			void Fill()
+			{}
+
+			void Write(unsigned)
+			{}
+		};
+
+		template<class Port, class Tail, class Pins, unsigned Steps>
+		struct PortTable<Loki::Typelist<Port, Tail>, Pins, Steps>
+		{
+			typedef CharlieplexPortWriter<Port> Writer;
+			typedef typename Writer::DataT DataT;
+			static const DataT Mask = DataT(PortMask<Pins, Port>::value);
+
+			template<unsigned step, unsigned anode, unsigned cathode>
+			void Fill()
+			{
+				const DataT out = DataT(PinBit<Pins, anode, Port>::value);
+				const DataT dir = DataT(out | PinBit<Pins, cathode, Port>::value);
+				steps[step] = Writer::template Make<Mask, dir, out>();
+				next.template Fill<step, anode, cathode>();
+			}
+
+			inline void Write(unsigned step)
+			{
+				Writer::template Write<Mask>(steps[step]);
+				next.Write(step);
+			}
+
+			typename Writer::Step steps[Steps + 1];
+			PortTable<Tail, Pins, Steps> next;
+		};
+
+		template<class Table, unsigned PinsCount, unsigned step>
+		struct FillSteps
+		{
+			static const unsigned anode = step / (PinsCount - 1);
+			static const unsigned k = step % (PinsCount - 1);
+			static const unsigned cathode = k < anode ? k : k + 1;
+
+			static void Run(Table &table)
+			{
+				table.template Fill<step, anode, cathode>();
+				FillSteps<Table, PinsCount, step - 1>::Run(table);
+			}
+		};
+
+		template<class Table, unsigned PinsCount>
+		struct FillSteps<Table, PinsCount, unsigned(-1)>
+		{
+			static void Run(Table &)
+			{}
+		};
+	}
+
+////////////////////////////////////////////////////////////////////////////////
+// class template Charlieplex
+// Charlieplexed LED driver. N pins drive N*(N-1) LEDs, one LED per step.
+// LED number anode * (N - 1) + k, where k is the cathode index skipping the
+// anode, is lit when pin 'anode' drives high and pin 'cathode' drives low,
+// all other pins are inputs.
+// Port direction and output words for every step are computed at compile
+// time and stored to a table by Init, so TimerHandler only applies a couple of
+// prepared words per port (DDR/PORT on AVR, BSRR/CRL/CRH on Stm32).
+// Each LED gets 1/LedCount duty, unlit LEDs keep their time slot with all
+// pins released.
+////////////////////////////////////////////////////////////////////////////////
+
+	template<class Pins>
+	class Charlieplex
+	{
+		typedef typename Pins::Ports Ports;
+	public:
+		static const unsigned PinsCount = Pins::Length;
+		static const unsigned LedCount = PinsCount * (PinsCount - 1);
+		typedef BitSet<LedCount, uint8_t> LedSet;
+		typedef typename SelectSizeForLength<LedCount>::Result StepType;
+
+		static unsigned LedIndex(unsigned anode, unsigned cathode)
+		{
+			return anode * (PinsCount - 1) + (cathode < anode ? cathode : cathode - 1);
+		}
+
+		static void Init()
+		{
+			CharlieplexPrivate::FillSteps<Table, PinsCount, LedCount - 1>::Run(_table);
+			_table.template Fill<LedCount, PinsCount, PinsCount>();
+			_step = 0;
+			_leds.ClearAll();
+			_table.Write(LedCount);
+		}
+
+		static void TimerHandler()
+		{
+			StepType step = _step;
+			_table.Write(_leds.Test(step) ? step : LedCount);
+			if(++step == LedCount)
+				step = 0;
+			_step = step;
+		}
+
+		// Releases all pins
+		static void Off()
+		{
+			_table.Write(LedCount);
+		}
+
+		static void Set(unsigned led, bool value = true)
+		{	_leds.Set(led, value);	}
+
+		static void Clear(unsigned led)
+		{	_leds.Clear(led);	}
+
+		static bool Test(unsigned led)
+		{	return _leds.Test(led);	}
+
+		static void ClearAll()
+		{	_leds.ClearAll();	}
+
+		static LedSet& Leds()
+		{	return _leds;	}
+
+	private:
+		BOOST_STATIC_ASSERT(PinsCount >= 2);
+		typedef CharlieplexPrivate::PortTable<Ports, Pins, LedCount> Table;
+		static Table _table;
+		static LedSet _leds;
+		static volatile StepType _step;
+	};
+
+	template<class Pins>
+	typename Charlieplex<Pins>::Table Charlieplex<Pins>::_table;
+
+	template<class Pins>
+	typename Charlieplex<Pins>::LedSet Charlieplex<Pins>::_leds;
+
+	template<class Pins>
+	volatile typename Charlieplex<Pins>::StepType Charlieplex<Pins>::_step;
+}
@@ -0,0 +1,363 @@
+#pragma once
+#include <stdint.h>
+#include <static_assert.h>
+#include <ring_buffer.h>
+
+#if defined(__AVR__)
+#include <flashptr.h>
+#define DDS_FLASH PROGMEM
+#else
+#define DDS_FLASH
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Wavetables for Dds: one period in 256 signed samples, placed in flash.
+// Tables are static members of a class template, so only the used ones are
+// linked. Any other 256 byte table declared with DDS_FLASH can be used too.
+////////////////////////////////////////////////////////////////////////////////
+
+template<int Dummy = 0>
+struct DdsWaveTables
+{
+	static const int8_t Sine[256];
+	static const int8_t Triangle[256];
+	static const int8_t Sawtooth[256];
+	static const int8_t Square[256];
+};
+
+typedef DdsWaveTables<> DdsWaves;
+
+namespace DdsPrivate
+{
+	inline int8_t ReadWave(const int8_t *table, uint8_t index)
+	{
+#if defined(__AVR__)
+		return *ProgmemPtr<int8_t>(const_cast<int8_t *>(table) + index);
+#else
+		return table[index];
+#endif
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Dds output policies, Write takes unsigned 8 bit sample (128 is zero).
+////////////////////////////////////////////////////////////////////////////////
+
+// R-2R ladder (or any parallel DAC) on a PinList, the most significant
+// sample bits go to the pins.
+template<class Pins>
+struct DdsPinListOutput
+{
+	BOOST_STATIC_ASSERT(Pins::Length > 0 && Pins::Length <= 8);
+
+	static void Init()
+	{
+		Pins::Write(typename Pins::DataType(0x80 >> (8 - Pins::Length)));
+		Pins::SetConfiguration(Pins::Out);
+	}
+
+	static void Write(uint8_t sample)
+	{
+		Pins::Write(typename Pins::DataType(sample >> (8 - Pins::Length)));
+	}
+};
+
+// PWM duty on a timer output compare channel, e.g. Timer0::OutputCompare<0>.
+// SHIFT scales the sample to wider compare registers.
+template<class Compare, unsigned SHIFT = 0>
+struct DdsPwmOutput
+{
+	static void Init()
+	{
+		Compare::Set(0x80u << SHIFT);
+	}
+
+	static void Write(uint8_t sample)
+	{
+		Compare::Set(unsigned(sample) << SHIFT);
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template Dds
+// Direct digital synthesis with VOICES summed voices.
+// Each voice has a 32 bit phase accumulator: on each sample phase is advanced
+// by increment = frequency * 2^32 / sample rate and its upper 8 bits index the
+// wavetable, so frequency resolution is sample rate / 2^32.
+// Voice samples are scaled by voice amplitude (0 - 255) and summed, the sum
+// is clipped to the 8 bit range, amplitudes summing up to 255 never clip.
+//
+// Samples are rendered in blocks of BLOCK samples by the main loop into a
+// ring buffer of BUFFER samples, so per voice state is loaded once per block
+// and the sample interrupt does only one buffer read and one output write.
+//
+// Usage:
+//		typedef Dds<DdsPinListOutput<PinList<...> >, 2> Synth;
+//		Synth::Init(32000);
+//		Synth::SetWave(0, DdsWaves::Sine);
+//		Synth::SetFrequency(0, 440);
+//		sample rate timer ISR:	Synth::SampleHandler();
+//		main loop:				Synth::Fill();
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Output, unsigned VOICES = 1, int BUFFER = 64, unsigned BLOCK = 16>
+class Dds
+{
+public:
+	static const unsigned Voices = VOICES;
+	static const unsigned BlockSize = BLOCK;
+
+	static void Init(uint32_t sampleRate)
+	{
+		_sampleRate = sampleRate;
+		for(unsigned i = 0; i < VOICES; i++)
+		{
+			_phase[i] = 0;
+			_increment[i] = 0;
+			_wave[i] = DdsWaves::Sine;
+			_amplitude[i] = uint8_t(255 / VOICES);
+		}
+		_buffer.Clear();
+		_underruns = 0;
+		_last = 0x80;
+		Output::Init();
+	}
+
+	static uint32_t SampleRate()
+	{
+		return _sampleRate;
+	}
+
+	// Phase increment for frequency in Hz divided by 'scale', e.g. scale 100
+	// sets frequency in 0.01 Hz units
+	static uint32_t Increment(uint32_t frequency, uint32_t scale = 1)
+	{
+		return uint32_t((uint64_t(frequency) << 32) / (uint64_t(_sampleRate) * scale));
+	}
+
+	// Phase is kept, so frequency changes are glitch free
+	static void SetFrequency(unsigned voice, uint32_t frequency, uint32_t scale = 1)
+	{
+		_increment[voice] = Increment(frequency, scale);
+	}
+
+	static void SetIncrement(unsigned voice, uint32_t increment)
+	{
+		_increment[voice] = increment;
+	}
+
+	static void SetPhase(unsigned voice, uint32_t phase)
+	{
+		_phase[voice] = phase;
+	}
+
+	static void SetWave(unsigned voice, const int8_t *table)
+	{
+		_wave[voice] = table;
+	}
+
+	static void SetAmplitude(unsigned voice, uint8_t amplitude)
+	{
+		_amplitude[voice] = amplitude;
+	}
+
+	// Renders next BLOCK samples to 'dest'
+	static void Render(uint8_t *dest)
+	{
+		int16_t sum[BLOCK];
+		for(unsigned i = 0; i < BLOCK; i++)
+			sum[i] = 0;
+		for(unsigned voice = 0; voice < VOICES; voice++)
+		{
+			uint8_t amplitude = _amplitude[voice];
+			if(!amplitude)
+				continue;
+			const int8_t *wave = _wave[voice];
+			uint32_t phase = _phase[voice];
+			uint32_t increment = _increment[voice];
+			for(unsigned i = 0; i < BLOCK; i++)
+			{
+				sum[i] += int16_t(DdsPrivate::ReadWave(wave, uint8_t(phase >> 24)) * amplitude) >> 8;
+				phase += increment;
+			}
+			_phase[voice] = phase;
+		}
+		for(unsigned i = 0; i < BLOCK; i++)
+		{
+			int16_t value = sum[i];
+			if(value > 127)
+				value = 127;
+			if(value < -128)
+				value = -128;
+			dest[i] = uint8_t(value + 128);
+		}
+	}
+
+	// Renders blocks while the buffer has room for them, returns number of
+	// rendered blocks
+	static unsigned Fill()
+	{
+		unsigned blocks = 0;
+		while(!_buffer.IsFull() && unsigned(BUFFER - _buffer.Count()) >= BLOCK)
+		{
+			uint8_t block[BLOCK];
+			Render(block);
+			for(unsigned i = 0; i < BLOCK; i++)
+				_buffer.Write(block[i]);
+			blocks++;
+		}
+		return blocks;
+	}
+
+	// Call from sample rate timer interrupt. On underrun repeats the last
+	// sample and returns false.
+	static bool SampleHandler()
+	{
+		uint8_t sample;
+		if(!_buffer.Read(sample))
+		{
+			_underruns++;
+			return false;
+		}
+		Output::Write(sample);
+		_last = sample;
+		return true;
+	}
+
+	static uint8_t LastSample()
+	{
+		return _last;
+	}
+
+	static uint16_t Underruns()
+	{
+		return _underruns;
+	}
+
+private:
+	BOOST_STATIC_ASSERT(VOICES > 0);
+	BOOST_STATIC_ASSERT(BLOCK > 0 && BLOCK <= unsigned(BUFFER));
+
+	static uint32_t _sampleRate;
+	static uint32_t _phase[VOICES];
+	static uint32_t _increment[VOICES];
+	static const int8_t *_wave[VOICES];
+	static uint8_t _amplitude[VOICES];
+	static RingBuffer<BUFFER, uint8_t> _buffer;
+	static volatile uint16_t _underruns;
+	static volatile uint8_t _last;
+};
+
+#define DDS_TEMPLATE_ARGS template<class Output, unsigned VOICES, int BUFFER, unsigned BLOCK>
+#define DDS_CLASS Dds<Output, VOICES, BUFFER, BLOCK>
+
+	DDS_TEMPLATE_ARGS
+	uint32_t DDS_CLASS::_sampleRate;
+
+	DDS_TEMPLATE_ARGS
+	uint32_t DDS_CLASS::_phase[VOICES];
+
+	DDS_TEMPLATE_ARGS
+	uint32_t DDS_CLASS::_increment[VOICES];
+
+	DDS_TEMPLATE_ARGS
+	const int8_t *DDS_CLASS::_wave[VOICES];
+
+	DDS_TEMPLATE_ARGS
+	uint8_t DDS_CLASS::_amplitude[VOICES];
+
+	DDS_TEMPLATE_ARGS
+	RingBuffer<BUFFER, uint8_t> DDS_CLASS::_buffer;
+
+	DDS_TEMPLATE_ARGS
+	volatile uint16_t DDS_CLASS::_underruns;
+
+	DDS_TEMPLATE_ARGS
+	volatile uint8_t DDS_CLASS::_last;
+
+#undef DDS_CLASS
+#undef DDS_TEMPLATE_ARGS
+
+	template<int Dummy>
+	const int8_t DdsWaveTables<Dummy>::Sine[256] DDS_FLASH =
+	{
+		0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34, 37, 40, 43, 46,
+		49, 51, 54, 57, 60, 63, 65, 68, 71, 73, 76, 78, 81, 83, 85, 88,
+		90, 92, 94, 96, 98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+		117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127,
+		127, 127, 127, 127, 126, 126, 126, 125, 125, 124, 123, 122, 122, 121, 120, 118,
+		117, 116, 115, 113, 112, 111, 109, 107, 106, 104, 102, 100, 98, 96, 94, 92,
+		90, 88, 85, 83, 81, 78, 76, 73, 71, 68, 65, 63, 60, 57, 54, 51,
+		49, 46, 43, 40, 37, 34, 31, 28, 25, 22, 19, 16, 12, 9, 6, 3,
+		0, -3, -6, -9, -12, -16, -19, -22, -25, -28, -31, -34, -37, -40, -43, -46,
+		-49, -51, -54, -57, -60, -63, -65, -68, -71, -73, -76, -78, -81, -83, -85, -88,
+		-90, -92, -94, -96, -98, -100, -102, -104, -106, -107, -109, -111, -112, -113, -115, -116,
+		-117, -118, -120, -121, -122, -122, -123, -124, -125, -125, -126, -126, -126, -127, -127, -127,
+		-127, -127, -127, -127, -126, -126, -126, -125, -125, -124, -123, -122, -122, -121, -120, -118,
+		-117, -116, -115, -113, -112, -111, -109, -107, -106, -104, -102, -100, -98, -96, -94, -92,
+		-90, -88, -85, -83, -81, -78, -76, -73, -71, -68, -65, -63, -60, -57, -54, -51,
+		-49, -46, -43, -40, -37, -34, -31, -28, -25, -22, -19, -16, -12, -9, -6, -3
+	};
+
+	template<int Dummy>
+	const int8_t DdsWaveTables<Dummy>::Triangle[256] DDS_FLASH =
+	{
+		0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30,
+		32, 34, 36, 38, 40, 42, 44, 46, 48, 50, 52, 54, 56, 58, 60, 62,
+		64, 66, 68, 70, 72, 74, 76, 78, 80, 82, 84, 86, 88, 90, 92, 94,
+		96, 98, 100, 102, 104, 106, 108, 110, 112, 114, 116, 118, 120, 122, 124, 126,
+		127, 126, 124, 122, 120, 118, 116, 114, 112, 110, 108, 106, 104, 102, 100, 98,
+		96, 94, 92, 90, 88, 86, 84, 82, 80, 78, 76, 74, 72, 70, 68, 66,
+		64, 62, 60, 58, 56, 54, 52, 50, 48, 46, 44, 42, 40, 38, 36, 34,
+		32, 30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2,
+		0, -2, -4, -6, -8, -10, -12, -14, -16, -18, -20, -22, -24, -26, -28, -30,
+		-32, -34, -36, -38, -40, -42, -44, -46, -48, -50, -52, -54, -56, -58, -60, -62,
+		-64, -66, -68, -70, -72, -74, -76, -78, -80, -82, -84, -86, -88, -90, -92, -94,
+		-96, -98, -100, -102, -104, -106, -108, -110, -112, -114, -116, -118, -120, -122, -124, -126,
+		-127, -126, -124, -122, -120, -118, -116, -114, -112, -110, -108, -106, -104, -102, -100, -98,
+		-96, -94, -92, -90, -88, -86, -84, -82, -80, -78, -76, -74, -72, -70, -68, -66,
+		-64, -62, -60, -58, -56, -54, -52, -50, -48, -46, -44, -42, -40, -38, -36, -34,
+		-32, -30, -28, -26, -24, -22, -20, -18, -16, -14, -12, -10, -8, -6, -4, -2
+	};
+
+	template<int Dummy>
+	const int8_t DdsWaveTables<Dummy>::Sawtooth[256] DDS_FLASH =
+	{
+		-127, -127, -126, -125, -124, -123, -122, -121, -120, -119, -118, -117, -116, -115, -114, -113,
+		-112, -111, -110, -109, -108, -107, -106, -105, -104, -103, -102, -101, -100, -99, -98, -97,
+		-96, -95, -94, -93, -92, -91, -90, -89, -88, -87, -86, -85, -84, -83, -82, -81,
+		-80, -79, -78, -77, -76, -75, -74, -73, -72, -71, -70, -69, -68, -67, -66, -65,
+		-64, -63, -62, -61, -60, -59, -58, -57, -56, -55, -54, -53, -52, -51, -50, -49,
+		-48, -47, -46, -45, -44, -43, -42, -41, -40, -39, -38, -37, -36, -35, -34, -33,
+		-32, -31, -30, -29, -28, -27, -26, -25, -24, -23, -22, -21, -20, -19, -18, -17,
+		-16, -15, -14, -13, -12, -11, -10, -9, -8, -7, -6, -5, -4, -3, -2, -1,
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+		32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+		48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,
+		64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79,
+		80, 81, 82, 83, 84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95,
+		96, 97, 98, 99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111,
+		112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127
+	};
+
+	template<int Dummy>
+	const int8_t DdsWaveTables<Dummy>::Square[256] DDS_FLASH =
+	{
+		127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+		127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+		127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+		127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+		127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+		127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+		127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+		127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127,
+		-127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127,
+		-127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127,
+		-127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127,
+		-127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127,
+		-127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127,
+		-127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127,
+		-127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127,
+		-127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127, -127
+	};
@@ -0,0 +1,172 @@
+#pragma once
+#include <stdint.h>
+#include <atomic.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// class template Debouncer
+// Debounces all inputs of a PinList at once.
+// TimerHandler samples the list with one PinRead and runs a 2 bit vertical
+// counter for every input: counter bit 0 and bit 1 of all inputs are kept in
+// two words, so all inputs are processed with a few bitwise operations and
+// the cost doesn't depend on number of inputs up to the word width.
+// Debounced state of an input changes after it has differed from the state
+// for 4 consecutive ticks; shorter glitches reset the counter.
+//
+// State changes are collected in pressed/released masks, which stay set
+// until taken by the main loop. If LONG_TICKS is not zero, inputs held
+// pressed for LONG_TICKS ticks with no other input changing are reported
+// once in long press mask. One hold counter is shared by all inputs to keep
+// the tick cost constant.
+//
+// Usage: call TimerHandler every 5 - 10 ms,
+//		typedef Debouncer<PinList<Pa0, Pa1, Pb4>, true, 100> Buttons;
+//		Buttons::Init();
+//		if(Buttons::TakePressed() & 0x01) ...
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Pins, bool ACTIVE_LOW = true, uint16_t LONG_TICKS = 0>
+class Debouncer
+{
+public:
+	typedef typename Pins::DataType DataType;
+	static const unsigned Inputs = Pins::Length;
+
+	// Takes current inputs as the initial state, so no events are generated
+	// for inputs that are active at startup
+	static void Init()
+	{
+		Pins::SetConfiguration(Pins::In);
+		ATOMIC
+		{
+			_state = Sample();
+			_count0 = DataType(-1);
+			_count1 = DataType(-1);
+			_pressed = 0;
+			_released = 0;
+			_long = 0;
+			_hold = 0;
+		}
+	}
+
+	static void TimerHandler()
+	{
+		DataType toggle = DataType(Sample() ^ _state);
+		// count down inputs differing from state, reset the others to 3
+		DataType count0 = DataType(~(_count0 & toggle));
+		DataType count1 = DataType(count0 ^ (_count1 & toggle));
+		_count0 = count0;
+		_count1 = count1;
+		// counter rolled over from 0 to 3
+		toggle &= DataType(count0 & count1);
+
+		DataType state = DataType(_state ^ toggle);
+		_state = state;
+		_pressed |= DataType(toggle & state);
+		_released |= DataType(toggle & ~state);
+
+		if(LONG_TICKS)
+		{
+			if(toggle)
+				_hold = 0;
+			else if(state && _hold < LONG_TICKS && ++_hold == LONG_TICKS)
+				_long |= state;
+		}
+	}
+
+	// Debounced state, bit is set for active input
+	static DataType State()
+	{
+		return _state;
+	}
+
+	static bool IsActive(unsigned input)
+	{
+		return (_state >> input) & 1;
+	}
+
+	// Return and clear inputs that became active since the last call
+	static DataType TakePressed(DataType mask = DataType(-1))
+	{
+		return Take(_pressed, mask);
+	}
+
+	// Return and clear inputs that became inactive since the last call
+	static DataType TakeReleased(DataType mask = DataType(-1))
+	{
+		return Take(_released, mask);
+	}
+
+	// Return and clear both pressed and released inputs
+	static DataType TakeChanged(DataType mask = DataType(-1))
+	{
+		DataType result;
+		ATOMIC
+		{
+			result = DataType((_pressed | _released) & mask);
+			_pressed &= DataType(~mask);
+			_released &= DataType(~mask);
+		}
+		return result;
+	}
+
+	// Return and clear inputs held for LONG_TICKS
+	static DataType TakeLongPressed(DataType mask = DataType(-1))
+	{
+		return Take(_long, mask);
+	}
+
+private:
+	static DataType Sample()
+	{
+		DataType value = Pins::PinRead();
+		return ACTIVE_LOW ? DataType(~value & Mask) : value;
+	}
+
+	static DataType Take(volatile DataType &events, DataType mask)
+	{
+		DataType result;
+		ATOMIC
+		{
+			result = DataType(events & mask);
+			events &= DataType(~mask);
+		}
+		return result;
+	}
+
+	static const DataType Mask = DataType(DataType(~DataType(0)) >> (sizeof(DataType) * 8 - Pins::Length));
+
+	static DataType _state;
+	static DataType _count0;
+	static DataType _count1;
+	static volatile DataType _pressed;
+	static volatile DataType _released;
+	static volatile DataType _long;
+	static uint16_t _hold;
+};
+
+#define DEBOUNCER_TEMPLATE_ARGS template<class Pins, bool ACTIVE_LOW, uint16_t LONG_TICKS>
+#define DEBOUNCER_CLASS Debouncer<Pins, ACTIVE_LOW, LONG_TICKS>
+
+	DEBOUNCER_TEMPLATE_ARGS
+	typename Pins::DataType DEBOUNCER_CLASS::_state;
+
+	DEBOUNCER_TEMPLATE_ARGS
+	typename Pins::DataType DEBOUNCER_CLASS::_count0;
+
+	DEBOUNCER_TEMPLATE_ARGS
+	typename Pins::DataType DEBOUNCER_CLASS::_count1;
+
+	DEBOUNCER_TEMPLATE_ARGS
+	volatile typename Pins::DataType DEBOUNCER_CLASS::_pressed;
+
+	DEBOUNCER_TEMPLATE_ARGS
+	volatile typename Pins::DataType DEBOUNCER_CLASS::_released;
+
+	DEBOUNCER_TEMPLATE_ARGS
+	volatile typename Pins::DataType DEBOUNCER_CLASS::_long;
+
+	DEBOUNCER_TEMPLATE_ARGS
+	uint16_t DEBOUNCER_CLASS::_hold;
+
+#undef DEBOUNCER_CLASS
+#undef DEBOUNCER_TEMPLATE_ARGS
@@ -0,0 +1,164 @@
+#pragma once
+#include <stdint.h>
+#include <atomic.h>
+#include <bit_utils.h>
+#include <ring_buffer.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// class template EdgeDetector
+// Edge detection for PinList/PinSet inputs.
+// Handler reads the list with one PinRead and compares it to the previous
+// sample, so it can be called from any sampling source: pin change interrupt
+// (AVR, MSP430), EXTI interrupt (STM32) or a periodic timer poll.
+// RISING and FALLING are compile time masks of PinList bits, which edges of
+// which inputs are reported. Edges are collected in rising/falling masks
+// and, each with a timestamp, in a queue of QUEUE_SIZE events; events that
+// don't fit the queue are counted as lost, masks are updated anyway.
+// Mask (RISING | FALLING) is the set of inputs to enable in pin change or
+// EXTI mask registers.
+//
+// Usage:
+//		typedef EdgeDetector<PinList<Pb0, Pb1, Pb2>, 0x03, 0x04> Edges;
+//		Edges::Init();
+//		pin change ISR:		Edges::Handler(Timer1::Get());
+//		main loop:
+//			Edges::Event event;
+//			while(Edges::Read(event)) ...
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Pins, uint32_t RISING = 0xffffffff, uint32_t FALLING = 0xffffffff,
+	int QUEUE_SIZE = 16, class TimeT = uint16_t>
+class EdgeDetector
+{
+public:
+	typedef typename Pins::DataType DataType;
+
+	struct Event
+	{
+		TimeT time;
+		uint8_t pin;
+		bool rising;
+	};
+
+	static const DataType PinsMask = DataType(DataType(~DataType(0)) >> (sizeof(DataType) * 8 - Pins::Length));
+	static const DataType RisingMask = DataType(RISING & PinsMask);
+	static const DataType FallingMask = DataType(FALLING & PinsMask);
+	static const DataType Mask = DataType(RisingMask | FallingMask);
+
+	// Takes current input levels as reference, no edges are reported for them
+	static void Init()
+	{
+		ATOMIC
+		{
+			_level = Pins::PinRead();
+			_rising = 0;
+			_falling = 0;
+			_lost = 0;
+			_events.Clear();
+		}
+	}
+
+	// Call from sampling source, returns mask of reported edges
+	static DataType Handler(TimeT time)
+	{
+		DataType value = Pins::PinRead();
+		DataType changed = DataType(value ^ _level);
+		_level = value;
+		DataType rising = DataType(changed & value & RisingMask);
+		DataType falling = DataType(changed & ~value & FallingMask);
+		DataType edges = DataType(rising | falling);
+		if(!edges)
+			return 0;
+		_rising |= rising;
+		_falling |= falling;
+		for(DataType pending = edges; pending; )
+		{
+			Event event;
+			event.time = time;
+			event.pin = uint8_t(Util::ExtractLowestBit(pending));
+			event.rising = (rising >> event.pin) & 1;
+			if(!_events.Write(event))
+				_lost++;
+		}
+		return edges;
+	}
+
+	// Input levels at the last Handler call
+	static DataType Level()
+	{
+		return _level;
+	}
+
+	// Return and clear inputs with rising edges since the last call
+	static DataType TakeRising(DataType mask = DataType(-1))
+	{
+		return Take(_rising, mask);
+	}
+
+	// Return and clear inputs with falling edges since the last call
+	static DataType TakeFalling(DataType mask = DataType(-1))
+	{
+		return Take(_falling, mask);
+	}
+
+	// Takes next event from the queue
+	static bool Read(Event &event)
+	{
+		bool result;
+		ATOMIC
+		{
+			result = _events.Read(event);
+		}
+		return result;
+	}
+
+	static bool IsEmpty()
+	{
+		return _events.IsEmpty();
+	}
+
+	// Number of events lost due to full queue
+	static uint16_t Lost()
+	{
+		return _lost;
+	}
+
+private:
+	static DataType Take(volatile DataType &edges, DataType mask)
+	{
+		DataType result;
+		ATOMIC
+		{
+			result = DataType(edges & mask);
+			edges &= DataType(~mask);
+		}
+		return result;
+	}
+
+	static DataType _level;
+	static volatile DataType _rising;
+	static volatile DataType _falling;
+	static volatile uint16_t _lost;
+	static RingBuffer<QUEUE_SIZE, Event> _events;
+};
+
+#define EDGE_DETECTOR_TEMPLATE_ARGS template<class Pins, uint32_t RISING, uint32_t FALLING, int QUEUE_SIZE, class TimeT>
+#define EDGE_DETECTOR_CLASS EdgeDetector<Pins, RISING, FALLING, QUEUE_SIZE, TimeT>
+
+	EDGE_DETECTOR_TEMPLATE_ARGS
+	typename Pins::DataType EDGE_DETECTOR_CLASS::_level;
+
+	EDGE_DETECTOR_TEMPLATE_ARGS
+	volatile typename Pins::DataType EDGE_DETECTOR_CLASS::_rising;
+
+	EDGE_DETECTOR_TEMPLATE_ARGS
+	volatile typename Pins::DataType EDGE_DETECTOR_CLASS::_falling;
+
+	EDGE_DETECTOR_TEMPLATE_ARGS
+	volatile uint16_t EDGE_DETECTOR_CLASS::_lost;
+
+	EDGE_DETECTOR_TEMPLATE_ARGS
+	RingBuffer<QUEUE_SIZE, typename EDGE_DETECTOR_CLASS::Event> EDGE_DETECTOR_CLASS::_events;
+
+#undef EDGE_DETECTOR_CLASS
+#undef EDGE_DETECTOR_TEMPLATE_ARGS
@@ -0,0 +1,183 @@
+#pragma once
+#include <stdint.h>
+#include <static_assert.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// class template LedMatrix
+// Multiplexed LED matrix driver with binary code modulation (BCM) brightness.
+// Rows and Columns are PinLists, one row is lit at a time (one-hot row select).
+// Each row is shown BITS times, once per bit plane, and bit plane N stays
+// on for 2^N base periods. So a frame takes Rows * BITS interrupts instead
+// of Rows * 2^BITS needed by software PWM, while giving 2^BITS levels.
+//
+// Usage: call TimerHandler from a timer compare interrupt and load the timer
+// period with the returned number of base periods:
+//		ISR(TIMER1_COMPA_vect)
+//		{
+//			OCR1A = Matrix::TimerHandler() * BasePeriod;
+//		}
+// Drawing goes to the back buffer, Swap makes it visible at the end of the
+// current frame (vsync), IsSwapPending tells when the back buffer is free.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Rows, class Columns, unsigned BITS = 4, bool ROWS_ACTIVE_LOW = false, bool COLUMNS_ACTIVE_LOW = false>
+class LedMatrix
+{
+public:
+	typedef typename Rows::DataType RowType;
+	typedef typename Columns::DataType ColumnType;
+	static const unsigned Width = Columns::Length;
+	static const unsigned Height = Rows::Length;
+	static const unsigned Bits = BITS;
+	static const unsigned MaxLevel = (1u << BITS) - 1;
+	// ISR invocations per frame
+	static const unsigned StepsPerFrame = Height * BITS;
+	// Base periods per frame
+	static const unsigned PeriodsPerFrame = Height * MaxLevel;
+
+	static void Init()
+	{
+		Rows::Write(RowsOff);
+		Columns::Write(ColumnsOff);
+		Rows::SetConfiguration(Rows::Out);
+		Columns::SetConfiguration(Columns::Out);
+		_row = 0;
+		_bit = 0;
+		_front = 0;
+		_swapPending = false;
+		_frames = 0;
+		for(unsigned i = 0; i < 2; i++)
+		{
+			_back = i;
+			Clear();
+		}
+		_back = 1;
+	}
+
+	// Shows the next bit plane, returns how long it should stay on in base periods
+	static uint8_t TimerHandler()
+	{
+		uint8_t bit = _bit;
+		uint8_t row = _row;
+		uint8_t duration = uint8_t(1u << bit);
+		Rows::Write(RowsOff);
+		Columns::Write(ColumnType(_planes[_front][bit][row] ^ ColumnsOff));
+		Rows::Write(RowType((RowType(1) << row) ^ RowsOff));
+
+		if(++bit == BITS)
+		{
+			bit = 0;
+			if(++row == Height)
+			{
+				row = 0;
+				_frames++;
+				if(_swapPending)
+				{
+					_back = _front;
+					_front ^= 1;
+					_swapPending = false;
+				}
+			}
+			_row = row;
+		}
+		_bit = bit;
+		return duration;
+	}
+
+	// Back buffer drawing
+	static void SetPixel(unsigned x, unsigned y, uint8_t level)
+	{
+		ColumnType mask = ColumnType(1) << x;
+		for(unsigned bit = 0; bit < BITS; bit++)
+		{
+			if(level & (1 << bit))
+				_planes[_back][bit][y] |= mask;
+			else
+				_planes[_back][bit][y] &= ColumnType(~mask);
+		}
+	}
+
+	static uint8_t GetPixel(unsigned x, unsigned y)
+	{
+		uint8_t level = 0;
+		for(unsigned bit = 0; bit < BITS; bit++)
+			if(_planes[_back][bit][y] & (ColumnType(1) << x))
+				level |= 1 << bit;
+		return level;
+	}
+
+	// Sets all pixels of the row with bit set in 'pixels' to 'level', others to 0
+	static void SetRow(unsigned y, ColumnType pixels, uint8_t level = MaxLevel)
+	{
+		for(unsigned bit = 0; bit < BITS; bit++)
+			_planes[_back][bit][y] = (level & (1 << bit)) ? pixels : ColumnType(0);
+	}
+
+	static void Clear()
+	{
+		for(unsigned bit = 0; bit < BITS; bit++)
+			for(unsigned y = 0; y < Height; y++)
+				_planes[_back][bit][y] = 0;
+	}
+
+	// Copies front buffer to back buffer for incremental drawing.
+	// Call when no swap is pending.
+	static void CopyFront()
+	{
+		for(unsigned bit = 0; bit < BITS; bit++)
+			for(unsigned y = 0; y < Height; y++)
+				_planes[_back][bit][y] = _planes[_front][bit][y];
+	}
+
+	// Shows back buffer from the next frame
+	static void Swap()
+	{
+		_swapPending = true;
+	}
+
+	static bool IsSwapPending()
+	{
+		return _swapPending;
+	}
+
+	static uint16_t Frames()
+	{
+		return _frames;
+	}
+
+private:
+	static const RowType RowsOff = ROWS_ACTIVE_LOW ? RowType(~RowType(0)) : RowType(0);
+	static const ColumnType ColumnsOff = COLUMNS_ACTIVE_LOW ? ColumnType(~ColumnType(0)) : ColumnType(0);
+
+	BOOST_STATIC_ASSERT(BITS > 0 && BITS <= 8);
+
+	// [buffer][bit plane][row] -> column bits
+	static ColumnType _planes[2][BITS][Rows::Length];
+	static volatile uint8_t _row;
+	static volatile uint8_t _bit;
+	static volatile uint8_t _front;
+	static volatile uint8_t _back;
+	static volatile bool _swapPending;
+	static volatile uint16_t _frames;
+};
+
+	template<class Rows, class Columns, unsigned BITS, bool ROWS_ACTIVE_LOW, bool COLUMNS_ACTIVE_LOW>
+	typename Columns::DataType LedMatrix<Rows, Columns, BITS, ROWS_ACTIVE_LOW, COLUMNS_ACTIVE_LOW>::_planes[2][BITS][Rows::Length];
+
+	template<class Rows, class Columns, unsigned BITS, bool ROWS_ACTIVE_LOW, bool COLUMNS_ACTIVE_LOW>
+	volatile uint8_t LedMatrix<Rows, Columns, BITS, ROWS_ACTIVE_LOW, COLUMNS_ACTIVE_LOW>::_row;
+
+	template<class Rows, class Columns, unsigned BITS, bool ROWS_ACTIVE_LOW, bool COLUMNS_ACTIVE_LOW>
+	volatile uint8_t LedMatrix<Rows, Columns, BITS, ROWS_ACTIVE_LOW, COLUMNS_ACTIVE_LOW>::_bit;
+
+	template<class Rows, class Columns, unsigned BITS, bool ROWS_ACTIVE_LOW, bool COLUMNS_ACTIVE_LOW>
+	volatile uint8_t LedMatrix<Rows, Columns, BITS, ROWS_ACTIVE_LOW, COLUMNS_ACTIVE_LOW>::_front;
+
+	template<class Rows, class Columns, unsigned BITS, bool ROWS_ACTIVE_LOW, bool COLUMNS_ACTIVE_LOW>
+	volatile uint8_t LedMatrix<Rows, Columns, BITS, ROWS_ACTIVE_LOW, COLUMNS_ACTIVE_LOW>::_back;
+
+	template<class Rows, class Columns, unsigned BITS, bool ROWS_ACTIVE_LOW, bool COLUMNS_ACTIVE_LOW>
+	volatile bool LedMatrix<Rows, Columns, BITS, ROWS_ACTIVE_LOW, COLUMNS_ACTIVE_LOW>::_swapPending;
+
+	template<class Rows, class Columns, unsigned BITS, bool ROWS_ACTIVE_LOW, bool COLUMNS_ACTIVE_LOW>
+	volatile uint16_t LedMatrix<Rows, Columns, BITS, ROWS_ACTIVE_LOW, COLUMNS_ACTIVE_LOW>::_frames;
@@ -0,0 +1,438 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// class template SdSpiTransfer
+// Blocking data block transfer over Spi::ReadWrite.
+// SdCard moves 512 byte data blocks through its Transfer class only, so a
+// class with the same static Read and Write functions that starts DMA and
+// waits for its completion can be used to offload block transfers.
+// Read must send 0xff bytes while receiving.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Spi>
+struct SdSpiTransfer
+{
+	static void Read(uint8_t *data, size_t length)
+	{
+		for(size_t i = 0; i < length; i++)
+			data[i] = Spi::ReadWrite(0xff);
+	}
+
+	static void Write(const uint8_t *data, size_t length)
+	{
+		for(size_t i = 0; i < length; i++)
+			Spi::ReadWrite(data[i]);
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template SdCard
+// SD/SDHC/MMC card driver in SPI mode.
+// Spi is a class with static ReadWrite, CsPin is active low chip select.
+// Spi clock must be 100 - 400 kHz during Init, it may be raised afterwards.
+//
+// Block device interface (also provided by BlockCache):
+//		BlockSize, BlockCount(),
+//		ReadBlocks(block, data, count), WriteBlocks(block, data, count),
+//		WriteStart(block, count), WriteNext(data), WriteStop(), Sync()
+// All functions return false on error, LastError() tells the reason.
+//
+// Transfers of several blocks use CMD18/CMD25, multi-block writes to SD cards
+// are preceded by ACMD23 (pre-erase block count), so the card can erase the
+// whole area at once. WriteStart/WriteNext/WriteStop stream a multi-block
+// write block by block without holding all data in RAM.
+// Writes return without waiting for the card to finish programming; the
+// busy wait is done before the next command or in Sync.
+//
+// Usage:
+//		typedef SdCard<Spi1, Pa4> Card;
+//		if(Card::Init())
+//			Card::WriteBlocks(0, buffer, 4);
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Spi, class CsPin, class Transfer = SdSpiTransfer<Spi> >
+class SdCard
+{
+public:
+	static const unsigned BlockSize = 512;
+
+	enum CardType
+	{
+		NoCard,
+		Mmc,
+		SdV1,
+		SdV2,
+		Sdhc
+	};
+
+	enum Error
+	{
+		Ok,
+		Timeout,
+		CommandError,
+		ReadError,
+		WriteError,
+		OutOfRange
+	};
+
+	enum Command
+	{
+		CmdGoIdle = 0,
+		CmdSendOpCond = 1,
+		CmdSendIfCond = 8,
+		CmdSendCsd = 9,
+		CmdStopTransmission = 12,
+		CmdSetBlockLength = 16,
+		CmdReadSingle = 17,
+		CmdReadMultiple = 18,
+		CmdWriteSingle = 24,
+		CmdWriteMultiple = 25,
+		CmdAppCommand = 55,
+		CmdReadOcr = 58,
+		AcmdSetWriteEraseCount = 23,
+		AcmdSendOpCond = 41
+	};
+
+	enum
+	{
+		R1Idle = 0x01,
+		R1IllegalCommand = 0x04,
+		TokenStartBlock = 0xfe,
+		TokenStartMultiWrite = 0xfc,
+		TokenStopMultiWrite = 0xfd,
+		DataResponseMask = 0x1f,
+		DataAccepted = 0x05
+	};
+
+	// Resets card to SPI mode and reads its capacity
+	static bool Init()
+	{
+		_type = NoCard;
+		_blocks = 0;
+		_writeBlocks = 0;
+		_error = Ok;
+		CsPin::Set();
+		CsPin::SetDirWrite();
+		// at least 74 clocks with CS high
+		for(uint8_t i = 0; i < 10; i++)
+			Spi::ReadWrite(0xff);
+
+		uint8_t r1 = 0xff;
+		for(uint8_t i = 0; i < 10 && r1 != R1Idle; i++)
+			r1 = SendCommand(CmdGoIdle, 0);
+		if(r1 != R1Idle)
+			return Fail(Timeout);
+
+		bool v2 = false;
+		if(SendCommand(CmdSendIfCond, 0x1aa) == R1Idle)
+		{
+			uint8_t r7[4];
+			Transfer::Read(r7, 4);
+			if((r7[2] & 0x0f) != 0x01 || r7[3] != 0xaa)
+				return Fail(CommandError);
+			v2 = true;
+		}
+
+		bool mmc = false;
+		uint16_t retries = InitRetries;
+		do
+		{
+			if(mmc)
+				r1 = SendCommand(CmdSendOpCond, 0);
+			else
+				r1 = SendAppCommand(AcmdSendOpCond, v2 ? 0x40000000 : 0);
+			if(!v2 && r1 == (R1Idle | R1IllegalCommand))
+				mmc = true;
+		}while(r1 != 0 && --retries);
+		if(r1 != 0)
+			return Fail(Timeout);
+
+		_type = mmc ? Mmc : v2 ? SdV2 : SdV1;
+		if(v2)
+		{
+			uint8_t ocr[4];
+			if(SendCommand(CmdReadOcr, 0) != 0)
+				return Fail(CommandError);
+			Transfer::Read(ocr, 4);
+			// card capacity status
+			if(ocr[0] & 0x40)
+				_type = Sdhc;
+		}
+		if(_type != Sdhc && SendCommand(CmdSetBlockLength, BlockSize) != 0)
+			return Fail(CommandError);
+
+		uint8_t csd[16];
+		if(SendCommand(CmdSendCsd, 0) != 0 || !ReceiveData(csd, sizeof(csd)))
+			return Fail(ReadError);
+		Deselect();
+		_blocks = CsdBlocks(csd);
+		return true;
+	}
+
+	static CardType Type()
+	{
+		return _type;
+	}
+
+	static uint32_t BlockCount()
+	{
+		return _blocks;
+	}
+
+	static Error LastError()
+	{
+		return _error;
+	}
+
+	static bool IsBusy()
+	{
+		Select();
+		bool busy = Spi::ReadWrite(0xff) != 0xff;
+		Deselect();
+		return busy;
+	}
+
+	// Waits until the card has finished programming
+	static bool Sync()
+	{
+		Select();
+		bool ready = WaitReady();
+		Deselect();
+		return ready || Fail(Timeout);
+	}
+
+	static bool ReadBlocks(uint32_t block, void *data, size_t count)
+	{
+		if(!count)
+			return true;
+		if(!CheckRange(block, count))
+			return false;
+		uint8_t *dest = static_cast<uint8_t *>(data);
+		bool multiple = count > 1;
+		if(SendCommand(multiple ? CmdReadMultiple : CmdReadSingle, Address(block)) != 0)
+			return Fail(CommandError);
+		for(; count; count--, dest += BlockSize)
+		{
+			if(!ReceiveData(dest, BlockSize))
+			{
+				if(multiple)
+					SendCommand(CmdStopTransmission, 0);
+				return Fail(ReadError);
+			}
+		}
+		if(multiple)
+			SendCommand(CmdStopTransmission, 0);
+		Deselect();
+		return true;
+	}
+
+	static bool WriteBlocks(uint32_t block, const void *data, size_t count)
+	{
+		if(!count)
+			return true;
+		const uint8_t *src = static_cast<const uint8_t *>(data);
+		if(!WriteStart(block, count))
+			return false;
+		for(; count; count--, src += BlockSize)
+		{
+			if(!WriteNext(src))
+				return false;
+		}
+		return WriteStop();
+	}
+
+	// Starts writing of count blocks, data is sent with WriteNext
+	static bool WriteStart(uint32_t block, size_t count)
+	{
+		if(!count || !CheckRange(block, count))
+			return false;
+		_writeBlocks = count;
+		_writeMultiple = count > 1;
+		if(!_writeMultiple)
+			return SendCommand(CmdWriteSingle, Address(block)) == 0 || Fail(CommandError);
+		if(_type != Mmc && SendAppCommand(AcmdSetWriteEraseCount, uint32_t(count)) != 0)
+			return Fail(CommandError);
+		return SendCommand(CmdWriteMultiple, Address(block)) == 0 || Fail(CommandError);
+	}
+
+	// Sends one block of data, waits while the card programs the previous one
+	static bool WriteNext(const void *data)
+	{
+		if(!_writeBlocks)
+			return Fail(WriteError);
+		if(!WaitReady())
+			return Fail(Timeout);
+		Spi::ReadWrite(_writeMultiple ? TokenStartMultiWrite : TokenStartBlock);
+		Transfer::Write(static_cast<const uint8_t *>(data), BlockSize);
+		// dummy CRC
+		Spi::ReadWrite(0xff);
+		Spi::ReadWrite(0xff);
+		uint8_t response = Spi::ReadWrite(0xff) & DataResponseMask;
+		_writeBlocks--;
+		if(response != DataAccepted)
+		{
+			WriteStop();
+			return Fail(WriteError);
+		}
+		return true;
+	}
+
+	// Finishes writing, does not wait for the card to finish programming
+	static bool WriteStop()
+	{
+		_writeBlocks = 0;
+		if(_writeMultiple)
+		{
+			if(!WaitReady())
+				return Fail(Timeout);
+			Spi::ReadWrite(TokenStopMultiWrite);
+			Spi::ReadWrite(0xff);
+			_writeMultiple = false;
+		}
+		Deselect();
+		return true;
+	}
+
+private:
+	// Busy and data token timeouts in transferred bytes, 250 ms at 16 MHz
+	static const uint32_t ReadyTimeout = 0x80000;
+	static const uint16_t InitRetries = 20000;
+
+	static bool Fail(Error error)
+	{
+		Deselect();
+		_error = error;
+		return false;
+	}
+
+	static bool CheckRange(uint32_t block, size_t count)
+	{
+		if(block >= _blocks || count > _blocks - block)
+			return Fail(OutOfRange);
+		return true;
+	}
+
+	static uint32_t Address(uint32_t block)
+	{
+		return _type == Sdhc ? block : block * BlockSize;
+	}
+
+	static void Select()
+	{
+		CsPin::Clear();
+	}
+
+	// Releases data out line with one more byte
+	static void Deselect()
+	{
+		CsPin::Set();
+		Spi::ReadWrite(0xff);
+	}
+
+	static bool WaitReady()
+	{
+		uint32_t timeout = ReadyTimeout;
+		while(Spi::ReadWrite(0xff) != 0xff)
+			if(!--timeout)
+				return false;
+		return true;
+	}
+
+	// Sends command, card stays selected. Returns R1 response.
+	static uint8_t SendCommand(uint8_t command, uint32_t argument)
+	{
+		if(command != CmdStopTransmission)
+		{
+			Deselect();
+			Select();
+			if(!WaitReady())
+				return 0xff;
+		}
+		Spi::ReadWrite(uint8_t(0x40 | command));
+		Spi::ReadWrite(uint8_t(argument >> 24));
+		Spi::ReadWrite(uint8_t(argument >> 16));
+		Spi::ReadWrite(uint8_t(argument >> 8));
+		Spi::ReadWrite(uint8_t(argument));
+		// CRC is checked for CMD0 and CMD8 only
+		uint8_t crc = command == CmdGoIdle ? 0x95 : command == CmdSendIfCond ? 0x87 : 0x01;
+		Spi::ReadWrite(crc);
+		// skip stuff byte after stop
+		if(command == CmdStopTransmission)
+			Spi::ReadWrite(0xff);
+		uint8_t r1;
+		uint8_t retries = 10;
+		do
+		{
+			r1 = Spi::ReadWrite(0xff);
+		}while((r1 & 0x80) && --retries);
+		return r1;
+	}
+
+	static uint8_t SendAppCommand(uint8_t command, uint32_t argument)
+	{
+		uint8_t r1 = SendCommand(CmdAppCommand, 0);
+		if(r1 > R1Idle)
+			return r1;
+		return SendCommand(command, argument);
+	}
+
+	static bool ReceiveData(uint8_t *data, size_t length)
+	{
+		uint32_t timeout = ReadyTimeout;
+		uint8_t token;
+		while((token = Spi::ReadWrite(0xff)) == 0xff)
+			if(!--timeout)
+				return false;
+		if(token != TokenStartBlock)
+			return false;
+		Transfer::Read(data, length);
+		// CRC
+		Spi::ReadWrite(0xff);
+		Spi::ReadWrite(0xff);
+		return true;
+	}
+
+	static uint32_t CsdBlocks(const uint8_t *csd)
+	{
+		// CSD version 2: C_SIZE [69:48] in 512 KB units
+		if((csd[0] >> 6) == 1)
+		{
+			uint32_t size = uint32_t(csd[7] & 0x3f) << 16 | uint32_t(csd[8]) << 8 | csd[9];
+			return (size + 1) << 10;
+		}
+		// CSD version 1: C_SIZE [73:62], C_SIZE_MULT [49:47], READ_BL_LEN [83:80]
+		uint32_t size = uint32_t(csd[6] & 0x03) << 10 | uint32_t(csd[7]) << 2 | csd[8] >> 6;
+		uint8_t multiplier = uint8_t((csd[9] & 0x03) << 1 | csd[10] >> 7);
+		uint8_t blockLength = csd[5] & 0x0f;
+		return (size + 1) << (multiplier + 2 + blockLength - 9);
+	}
+
+	static CardType _type;
+	static uint32_t _blocks;
+	static Error _error;
+	static size_t _writeBlocks;
+	static bool _writeMultiple;
+};
+
+#define SD_CARD_TEMPLATE_ARGS template<class Spi, class CsPin, class Transfer>
+#define SD_CARD_CLASS SdCard<Spi, CsPin, Transfer>
+
+	SD_CARD_TEMPLATE_ARGS
+	typename SD_CARD_CLASS::CardType SD_CARD_CLASS::_type;
+
+	SD_CARD_TEMPLATE_ARGS
+	uint32_t SD_CARD_CLASS::_blocks;
+
+	SD_CARD_TEMPLATE_ARGS
+	typename SD_CARD_CLASS::Error SD_CARD_CLASS::_error;
+
+	SD_CARD_TEMPLATE_ARGS
+	size_t SD_CARD_CLASS::_writeBlocks;
+
+	SD_CARD_TEMPLATE_ARGS
+	bool SD_CARD_CLASS::_writeMultiple;
+
+#undef SD_CARD_CLASS
+#undef SD_CARD_TEMPLATE_ARGS
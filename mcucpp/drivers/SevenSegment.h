@@ -0,0 +1,296 @@
+#pragma once
+#include <stdint.h>
+#include <static_assert.h>
+#include <util.h>
+#include <loki/TypeManip.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// class template SegmentOrder
+// Describes segment wiring: bit position in Segments PinList for each of
+// segments a, b, c, d, e, f, g and decimal point.
+// Map<glyph>::value converts glyph in standard gfedcba layout (a is bit 0,
+// dp is bit 7) to PinList value at compile time.
+////////////////////////////////////////////////////////////////////////////////
+
+template<unsigned A, unsigned B, unsigned C, unsigned D, unsigned E, unsigned F, unsigned G, unsigned DP = 7>
+struct SegmentOrder
+{
+	template<unsigned glyph>
+	struct Map
+	{
+		static const unsigned value =
+			((glyph & 0x01) ? 1u << A : 0) |
+			((glyph & 0x02) ? 1u << B : 0) |
+			((glyph & 0x04) ? 1u << C : 0) |
+			((glyph & 0x08) ? 1u << D : 0) |
+			((glyph & 0x10) ? 1u << E : 0) |
+			((glyph & 0x20) ? 1u << F : 0) |
+			((glyph & 0x40) ? 1u << G : 0) |
+			((glyph & 0x80) ? 1u << DP : 0);
+	};
+};
+
+typedef SegmentOrder<0, 1, 2, 3, 4, 5, 6, 7> StandardSegmentOrder;
+
+struct SevenSegmentBase
+{
+	// Glyph table indexes, 0 - 15 are hex digits
+	enum Glyph
+	{
+		GlyphMinus = 16,
+		GlyphBlank,
+		GlyphUnderscore,
+		GlyphDegree,
+		GlyphH,
+		GlyphL,
+		GlyphP,
+		GlyphR,
+		GlyphO,
+		GlyphN,
+		GlyphU,
+		GlyphT,
+		GlyphCount
+	};
+
+	static uint8_t GlyphIndex(char c)
+	{
+		if(c >= '0' && c <= '9')
+			return uint8_t(c - '0');
+		if(c >= 'a' && c <= 'f')
+			return uint8_t(c - 'a' + 10);
+		if(c >= 'A' && c <= 'F')
+			return uint8_t(c - 'A' + 10);
+		switch(c)
+		{
+			case '-': return GlyphMinus;
+			case '_': return GlyphUnderscore;
+			case '*': return GlyphDegree;
+			case 'H': case 'h': return GlyphH;
+			case 'L': case 'l': return GlyphL;
+			case 'P': case 'p': return GlyphP;
+			case 'R': case 'r': return GlyphR;
+			case 'O': case 'o': return GlyphO;
+			case 'N': case 'n': return GlyphN;
+			case 'U': case 'u': return GlyphU;
+			case 'T': case 't': return GlyphT;
+		}
+		return GlyphBlank;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template SevenSegment
+// Multiplexed seven segment display driver.
+// Segments and Digits are PinLists, digit 0 is the leftmost one.
+// Glyph table is remapped to segment wiring (Order) and polarity at compile
+// time, so display buffer holds ready PinList values and the scan step is
+// one buffer load and one Segments::Write.
+// Each digit is shown for LEVELS timer ticks and is blanked after
+// 'brightness' ticks, so brightness is set by duty: 0 - off, LEVELS - full.
+// Numbers are converted with divu10 (shift and add division by 10) on 16 bit
+// values for up to 4 digits, on 32 bit otherwise.
+//
+// Usage: call TimerHandler from a timer interrupt at
+// refresh rate * DIGITS * LEVELS, e.g. 100 Hz * 4 * 8 = 3.2 kHz.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Segments, class Digits, class Order = StandardSegmentOrder, unsigned LEVELS = 8,
+	bool SEGMENTS_ACTIVE_LOW = false, bool DIGITS_ACTIVE_LOW = false>
+class SevenSegment :public SevenSegmentBase
+{
+public:
+	typedef typename Segments::DataType SegmentType;
+	typedef typename Digits::DataType DigitType;
+	static const unsigned DigitCount = Digits::Length;
+	static const unsigned Levels = LEVELS;
+	typedef typename Loki::Select<(DigitCount <= 4), uint16_t, uint32_t>::Result NumberType;
+
+	static void Init()
+	{
+		Digits::Write(DigitsOff);
+		Digits::SetConfiguration(Digits::Out);
+		Segments::Write(SegmentsOff);
+		Segments::SetConfiguration(Segments::Out);
+		_digit = 0;
+		_tick = 0;
+		_brightness = LEVELS;
+		Clear();
+	}
+
+	static void TimerHandler()
+	{
+		uint8_t tick = _tick;
+		uint8_t digit = _digit;
+		if(tick == _brightness)
+			Digits::Write(DigitsOff);
+		else if(tick == 0)
+		{
+			Digits::Write(DigitsOff);
+			Segments::Write(_buffer[digit]);
+			Digits::Write(DigitType((DigitType(1) << digit) ^ DigitsOff));
+		}
+		if(++tick == LEVELS)
+		{
+			tick = 0;
+			if(++digit == DigitCount)
+				digit = 0;
+			_digit = digit;
+		}
+		_tick = tick;
+	}
+
+	static void SetBrightness(uint8_t level)
+	{
+		_brightness = level > LEVELS ? LEVELS : level;
+	}
+
+	static uint8_t Brightness()
+	{
+		return _brightness;
+	}
+
+	static void SetGlyph(unsigned position, uint8_t glyph)
+	{
+		_buffer[position] = _glyphs[glyph];
+	}
+
+	static void SetChar(unsigned position, char c)
+	{
+		SetGlyph(position, GlyphIndex(c));
+	}
+
+	// Sets raw PinList value with polarity applied
+	static void SetSegments(unsigned position, SegmentType value)
+	{
+		_buffer[position] = SegmentType(value ^ SegmentsOff);
+	}
+
+	static SegmentType GetSegments(unsigned position)
+	{
+		return SegmentType(_buffer[position] ^ SegmentsOff);
+	}
+
+	static void SetDot(unsigned position, bool on = true)
+	{
+		SegmentType value = GetSegments(position);
+		value = on ? SegmentType(value | DotMask) : SegmentType(value & ~DotMask);
+		SetSegments(position, value);
+	}
+
+	static void Clear()
+	{
+		for(unsigned i = 0; i < DigitCount; i++)
+			_buffer[i] = _glyphs[GlyphBlank];
+	}
+
+	// Right aligned fixed point number, 'decimals' digits after decimal point.
+	// Shows dashes and returns false if value doesn't fit.
+	static bool WriteNumber(long value, uint8_t decimals = 0)
+	{
+		bool negative = value < 0;
+		unsigned long absValue = negative ? 0ul - (unsigned long)value : (unsigned long)value;
+		unsigned position = DigitCount;
+		if(absValue <= MaxNumber && decimals < DigitCount)
+		{
+			NumberType n = NumberType(absValue);
+			do
+			{
+				NumberType q = divu10(n);
+				_buffer[--position] = _glyphs[n - q * 10];
+				n = q;
+			}while(position && (n || DigitCount - position <= decimals));
+
+			bool fits = true;
+			if(negative)
+			{
+				if(position)
+					_buffer[--position] = _glyphs[GlyphMinus];
+				else
+					fits = false;
+			}
+			if(fits)
+			{
+				while(position)
+					_buffer[--position] = _glyphs[GlyphBlank];
+				if(decimals)
+					SetDot(DigitCount - 1 - decimals);
+				return true;
+			}
+		}
+		for(unsigned i = 0; i < DigitCount; i++)
+			_buffer[i] = _glyphs[GlyphMinus];
+		return false;
+	}
+
+	// Zero padded hex number
+	static void WriteHex(uint32_t value)
+	{
+		for(unsigned position = DigitCount; position; value >>= 4)
+			_buffer[--position] = _glyphs[value & 0x0f];
+	}
+
+	// Left aligned text, '.' lights decimal point of the previous digit
+	static void WriteText(const char *str)
+	{
+		unsigned position = 0;
+		for(; *str; str++)
+		{
+			if(*str == '.' && position)
+				SetDot(position - 1);
+			else if(position < DigitCount)
+				SetChar(position++, *str);
+			else
+				break;
+		}
+		while(position < DigitCount)
+			_buffer[position++] = _glyphs[GlyphBlank];
+	}
+
+private:
+	BOOST_STATIC_ASSERT(Segments::Length == 7 || Segments::Length == 8);
+	BOOST_STATIC_ASSERT(LEVELS > 0 && LEVELS < 256);
+	BOOST_STATIC_ASSERT(DigitCount > 0 && DigitCount <= 8);
+
+	static const SegmentType SegmentsOff = SEGMENTS_ACTIVE_LOW ? SegmentType(~SegmentType(0)) : SegmentType(0);
+	static const DigitType DigitsOff = DIGITS_ACTIVE_LOW ? DigitType(~DigitType(0)) : DigitType(0);
+	static const SegmentType DotMask = SegmentType(Order::template Map<0x80>::value);
+	static const unsigned long MaxNumber = (unsigned long)Pow<10, DigitCount>::value - 1;
+
+	static const SegmentType _glyphs[GlyphCount];
+	static SegmentType _buffer[Digits::Length];
+	static volatile uint8_t _digit;
+	static volatile uint8_t _tick;
+	static volatile uint8_t _brightness;
+};
+
+#define SEVEN_SEGMENT_TEMPLATE_ARGS template<class Segments, class Digits, class Order, unsigned LEVELS, bool SEGMENTS_ACTIVE_LOW, bool DIGITS_ACTIVE_LOW>
+#define SEVEN_SEGMENT_CLASS SevenSegment<Segments, Digits, Order, LEVELS, SEGMENTS_ACTIVE_LOW, DIGITS_ACTIVE_LOW>
+#define SEVEN_SEGMENT_GLYPH(glyph) typename Segments::DataType(Order::template Map<glyph>::value ^ SegmentsOff)
+
+	SEVEN_SEGMENT_TEMPLATE_ARGS
+	const typename Segments::DataType SEVEN_SEGMENT_CLASS::_glyphs[SevenSegmentBase::GlyphCount] =
+	{
+		SEVEN_SEGMENT_GLYPH(0x3f), SEVEN_SEGMENT_GLYPH(0x06), SEVEN_SEGMENT_GLYPH(0x5b), SEVEN_SEGMENT_GLYPH(0x4f),	// 0 1 2 3
+		SEVEN_SEGMENT_GLYPH(0x66), SEVEN_SEGMENT_GLYPH(0x6d), SEVEN_SEGMENT_GLYPH(0x7d), SEVEN_SEGMENT_GLYPH(0x07),	// 4 5 6 7
+		SEVEN_SEGMENT_GLYPH(0x7f), SEVEN_SEGMENT_GLYPH(0x6f), SEVEN_SEGMENT_GLYPH(0x77), SEVEN_SEGMENT_GLYPH(0x7c),	// 8 9 A b
+		SEVEN_SEGMENT_GLYPH(0x39), SEVEN_SEGMENT_GLYPH(0x5e), SEVEN_SEGMENT_GLYPH(0x79), SEVEN_SEGMENT_GLYPH(0x71),	// C d E F
+		SEVEN_SEGMENT_GLYPH(0x40), SEVEN_SEGMENT_GLYPH(0x00), SEVEN_SEGMENT_GLYPH(0x08), SEVEN_SEGMENT_GLYPH(0x63),	// - blank _ degree
+		SEVEN_SEGMENT_GLYPH(0x76), SEVEN_SEGMENT_GLYPH(0x38), SEVEN_SEGMENT_GLYPH(0x73), SEVEN_SEGMENT_GLYPH(0x50),	// H L P r
+		SEVEN_SEGMENT_GLYPH(0x5c), SEVEN_SEGMENT_GLYPH(0x54), SEVEN_SEGMENT_GLYPH(0x3e), SEVEN_SEGMENT_GLYPH(0x78)	// o n U t
+	};
+
+	SEVEN_SEGMENT_TEMPLATE_ARGS
+	typename Segments::DataType SEVEN_SEGMENT_CLASS::_buffer[Digits::Length];
+
+	SEVEN_SEGMENT_TEMPLATE_ARGS
+	volatile uint8_t SEVEN_SEGMENT_CLASS::_digit;
+
+	SEVEN_SEGMENT_TEMPLATE_ARGS
+	volatile uint8_t SEVEN_SEGMENT_CLASS::_tick;
+
+	SEVEN_SEGMENT_TEMPLATE_ARGS
+	volatile uint8_t SEVEN_SEGMENT_CLASS::_brightness;
+
+#undef SEVEN_SEGMENT_GLYPH
+#undef SEVEN_SEGMENT_CLASS
+#undef SEVEN_SEGMENT_TEMPLATE_ARGS
@@ -0,0 +1,552 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <static_assert.h>
+#include <ring_buffer.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// class template SpiFlash
+// Driver for W25Qxx style SPI NOR flash.
+// Spi is a class with static ReadWrite (HAL Spi, AVR Spi, SoftSpi), CsPin is
+// active low chip select.
+//
+// Program and erase commands return as soon as the command is sent; the
+// busy wait is done before the next command. So the caller's work between
+// calls (e.g. filling the next page in a stream) overlaps the page program
+// time of the chip. The chip copies page data into its own buffer, one page
+// buffer in RAM is enough for this pipelining.
+// Erases can be scheduled: Poll starts the next scheduled erase whenever
+// the chip is idle, so erase time goes to otherwise idle time.
+//
+// Reads shorter than a cache line go through a small LRU cache of
+// CACHE_LINES lines of LINE_SIZE bytes, longer reads are sent as one fast
+// read burst. Program and erase invalidate overlapping cache lines.
+//
+// Usage:
+//		typedef SpiFlash<Spi1, Pa4> Flash;
+//		Flash::Init();
+//		Flash::EraseSector(0);
+//		Flash::StreamStart(0);
+//		Flash::StreamWrite(data, size);
+//		Flash::StreamFlush();
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Spi, class CsPin, unsigned CACHE_LINES = 4, unsigned LINE_SIZE = 32>
+class SpiFlash
+{
+public:
+	static const uint32_t PageSize = 256;
+	static const uint32_t SectorSize = 4096;
+	static const uint32_t BlockSize = 65536;
+
+	enum Command
+	{
+		CmdWriteEnable = 0x06,
+		CmdReadStatus = 0x05,
+		CmdRead = 0x03,
+		CmdFastRead = 0x0b,
+		CmdPageProgram = 0x02,
+		CmdSectorErase = 0x20,
+		CmdBlockErase = 0xd8,
+		CmdChipErase = 0xc7,
+		CmdJedecId = 0x9f
+	};
+
+	enum
+	{
+		StatusBusy = 0x01,
+		StatusWriteEnable = 0x02
+	};
+
+	// Reads JEDEC id, returns false if there is no chip.
+	// A missing chip reads all ones or zeros and never gets ready, so the id
+	// is read before any busy wait. A chip still busy with a program or erase
+	// started before reset ignores the id command, so on a bad id the status
+	// is polled for up to InitReadyTimeout bytes and the id read again.
+	static bool Init()
+	{
+		CsPin::Set();
+		CsPin::SetDirWrite();
+		InvalidateCache();
+		_streamLength = 0;
+		_erases.Clear();
+		_busy = false;
+		_size = 0;
+		_jedecId = ReadJedecId();
+		if(!IsValidId(_jedecId))
+		{
+			if(!WaitReady(InitReadyTimeout))
+				return false;
+			_jedecId = ReadJedecId();
+			if(!IsValidId(_jedecId))
+				return false;
+		}
+		_busy = true;
+		WaitReady();
+		uint8_t capacity = uint8_t(_jedecId);
+		_size = capacity < 32 ? uint32_t(1) << capacity : 0;
+		return _size != 0;
+	}
+
+	static uint32_t JedecId()
+	{
+		return _jedecId;
+	}
+
+	// Size in bytes from JEDEC capacity code
+	static uint32_t Size()
+	{
+		return _size;
+	}
+
+	static bool IsBusy()
+	{
+		if(_busy)
+			_busy = (ReadStatus() & StatusBusy) != 0;
+		return _busy;
+	}
+
+	static void WaitReady()
+	{
+		if(!_busy)
+			return;
+		Select();
+		Spi::ReadWrite(CmdReadStatus);
+		while(Spi::ReadWrite(0xff) & StatusBusy)
+			;
+		Deselect();
+		_busy = false;
+	}
+
+	static void Read(uint32_t address, void *data, size_t length)
+	{
+		uint8_t *dest = static_cast<uint8_t *>(data);
+		if(length >= LINE_SIZE)
+		{
+			ReadBurst(address, dest, length);
+			return;
+		}
+		while(length)
+		{
+			uint32_t offset = address % LINE_SIZE;
+			size_t chunk = LINE_SIZE - offset;
+			if(chunk > length)
+				chunk = length;
+			const uint8_t *line = CacheLine(address - offset);
+			memcpy(dest, line + offset, chunk);
+			dest += chunk;
+			address += uint32_t(chunk);
+			length -= chunk;
+		}
+	}
+
+	// Programs data split at page boundaries, returns without waiting for
+	// the last page. Area must be erased.
+	static void Write(uint32_t address, const void *data, size_t length)
+	{
+		const uint8_t *src = static_cast<const uint8_t *>(data);
+		while(length)
+		{
+			size_t chunk = PageSize - address % PageSize;
+			if(chunk > length)
+				chunk = length;
+			ProgramPage(address, src, chunk);
+			src += chunk;
+			address += uint32_t(chunk);
+			length -= chunk;
+		}
+	}
+
+	// Starts page program, data must not cross page boundary
+	static void ProgramPage(uint32_t address, const uint8_t *data, size_t length)
+	{
+		StartCommand(CmdPageProgram, address);
+		for(size_t i = 0; i < length; i++)
+			Spi::ReadWrite(data[i]);
+		Deselect();
+		_busy = true;
+		Invalidate(address, uint32_t(length));
+	}
+
+	// Starts 4 KB sector erase
+	static void EraseSector(uint32_t address)
+	{
+		StartCommand(CmdSectorErase, address);
+		Deselect();
+		_busy = true;
+		Invalidate(address & ~(SectorSize - 1), SectorSize);
+	}
+
+	// Starts 64 KB block erase
+	static void EraseBlock(uint32_t address)
+	{
+		StartCommand(CmdBlockErase, address);
+		Deselect();
+		_busy = true;
+		Invalidate(address & ~(BlockSize - 1), BlockSize);
+	}
+
+	static void EraseChip()
+	{
+		WaitReady();
+		WriteEnable();
+		Select();
+		Spi::ReadWrite(CmdChipErase);
+		Deselect();
+		_busy = true;
+		InvalidateCache();
+	}
+
+	// Queues sector erase to be started by Poll, returns false if the queue is full
+	static bool ScheduleErase(uint32_t address)
+	{
+		return _erases.Write(uint16_t(address / SectorSize));
+	}
+
+	static bool HasScheduledErases()
+	{
+		return !_erases.IsEmpty();
+	}
+
+	// Call from main loop. Starts next scheduled erase if the chip is idle,
+	// returns true if there is nothing to do
+	static bool Poll()
+	{
+		if(IsBusy())
+			return false;
+		uint16_t sector;
+		if(!_erases.Read(sector))
+			return true;
+		EraseSector(uint32_t(sector) * SectorSize);
+		return false;
+	}
+
+	// Sequential writing through page buffer
+	static void StreamStart(uint32_t address)
+	{
+		_streamAddress = address;
+		_streamLength = 0;
+	}
+
+	static void StreamWrite(const void *data, size_t length)
+	{
+		const uint8_t *src = static_cast<const uint8_t *>(data);
+		while(length)
+		{
+			size_t space = PageSize - (_streamAddress + _streamLength) % PageSize;
+			size_t chunk = length < space ? length : space;
+			memcpy(_page + _streamLength, src, chunk);
+			_streamLength += chunk;
+			src += chunk;
+			length -= chunk;
+			if(chunk == space)
+				StreamFlush();
+		}
+	}
+
+	// Programs buffered data, returns without waiting
+	static void StreamFlush()
+	{
+		if(!_streamLength)
+			return;
+		ProgramPage(_streamAddress, _page, _streamLength);
+		_streamAddress += uint32_t(_streamLength);
+		_streamLength = 0;
+	}
+
+	static uint32_t StreamAddress()
+	{
+		return _streamAddress + uint32_t(_streamLength);
+	}
+
+	static void InvalidateCache()
+	{
+		for(unsigned i = 0; i < CACHE_LINES; i++)
+		{
+			_tags[i] = NoLine;
+			_age[i] = uint8_t(i);
+		}
+		_hits = 0;
+		_misses = 0;
+	}
+
+	static uint32_t CacheHits()
+	{
+		return _hits;
+	}
+
+	static uint32_t CacheMisses()
+	{
+		return _misses;
+	}
+
+private:
+	BOOST_STATIC_ASSERT(CACHE_LINES > 0 && CACHE_LINES < 256);
+	BOOST_STATIC_ASSERT((LINE_SIZE & (LINE_SIZE - 1)) == 0 && LINE_SIZE <= PageSize);
+
+	static const uint32_t NoLine = 0xffffffff;
+	// Status poll limit in transferred bytes, 0.5 s at 8 MHz SPI clock
+	static const uint32_t InitReadyTimeout = 0x80000;
+
+	static void Select()
+	{
+		CsPin::Clear();
+	}
+
+	static void Deselect()
+	{
+		CsPin::Set();
+	}
+
+	static uint32_t ReadJedecId()
+	{
+		Select();
+		Spi::ReadWrite(CmdJedecId);
+		uint32_t id = uint32_t(Spi::ReadWrite(0xff)) << 16;
+		id |= uint32_t(Spi::ReadWrite(0xff)) << 8;
+		id |= Spi::ReadWrite(0xff);
+		Deselect();
+		return id;
+	}
+
+	static bool IsValidId(uint32_t id)
+	{
+		return id != 0 && id != 0xffffff;
+	}
+
+	// Bounded busy wait, returns false on timeout
+	static bool WaitReady(uint32_t timeout)
+	{
+		Select();
+		Spi::ReadWrite(CmdReadStatus);
+		while(Spi::ReadWrite(0xff) & StatusBusy)
+		{
+			if(!--timeout)
+			{
+				Deselect();
+				return false;
+			}
+		}
+		Deselect();
+		return true;
+	}
+
+	static uint8_t ReadStatus()
+	{
+		Select();
+		Spi::ReadWrite(CmdReadStatus);
+		uint8_t status = Spi::ReadWrite(0xff);
+		Deselect();
+		return status;
+	}
+
+	static void WriteEnable()
+	{
+		Select();
+		Spi::ReadWrite(CmdWriteEnable);
+		Deselect();
+	}
+
+	static void SendAddress(uint32_t address)
+	{
+		Spi::ReadWrite(uint8_t(address >> 16));
+		Spi::ReadWrite(uint8_t(address >> 8));
+		Spi::ReadWrite(uint8_t(address));
+	}
+
+	// Waits for previous operation, sets write enable latch and sends command with address
+	static void StartCommand(uint8_t command, uint32_t address)
+	{
+		WaitReady();
+		WriteEnable();
+		Select();
+		Spi::ReadWrite(command);
+		SendAddress(address);
+	}
+
+	static void ReadBurst(uint32_t address, uint8_t *dest, size_t length)
+	{
+		WaitReady();
+		Select();
+		Spi::ReadWrite(CmdFastRead);
+		SendAddress(address);
+		Spi::ReadWrite(0xff);
+		for(size_t i = 0; i < length; i++)
+			dest[i] = Spi::ReadWrite(0xff);
+		Deselect();
+	}
+
+	// Returns cache line for aligned address, loads least recently used line on miss
+	static const uint8_t *CacheLine(uint32_t address)
+	{
+		unsigned victim = 0;
+		for(unsigned i = 0; i < CACHE_LINES; i++)
+		{
+			if(_tags[i] == address)
+			{
+				_hits++;
+				Touch(i);
+				return _lines[i];
+			}
+			if(_age[i] > _age[victim])
+				victim = i;
+		}
+		for(unsigned i = 0; i < CACHE_LINES; i++)
+		{
+			if(_tags[i] == NoLine)
+			{
+				victim = i;
+				break;
+			}
+		}
+		_misses++;
+		ReadBurst(address, _lines[victim], LINE_SIZE);
+		_tags[victim] = address;
+		Touch(victim);
+		return _lines[victim];
+	}
+
+	// Line becomes the most recently used one
+	static void Touch(unsigned line)
+	{
+		for(unsigned i = 0; i < CACHE_LINES; i++)
+			if(_age[i] < _age[line])
+				_age[i]++;
+		_age[line] = 0;
+	}
+
+	static void Invalidate(uint32_t address, uint32_t length)
+	{
+		for(unsigned i = 0; i < CACHE_LINES; i++)
+			if(_tags[i] != NoLine && _tags[i] + LINE_SIZE > address && _tags[i] < address + length)
+				_tags[i] = NoLine;
+	}
+
+	static uint32_t _jedecId;
+	static uint32_t _size;
+	static bool _busy;
+	static uint32_t _tags[CACHE_LINES];
+	static uint8_t _age[CACHE_LINES];
+	static uint8_t _lines[CACHE_LINES][LINE_SIZE];
+	static uint32_t _hits;
+	static uint32_t _misses;
+	static uint8_t _page[PageSize];
+	static uint32_t _streamAddress;
+	static size_t _streamLength;
+	static RingBuffer<8, uint16_t> _erases;
+};
+
+#define SPI_FLASH_TEMPLATE_ARGS template<class Spi, class CsPin, unsigned CACHE_LINES, unsigned LINE_SIZE>
+#define SPI_FLASH_CLASS SpiFlash<Spi, CsPin, CACHE_LINES, LINE_SIZE>
+
+	SPI_FLASH_TEMPLATE_ARGS
+	uint32_t SPI_FLASH_CLASS::_jedecId;
+
+	SPI_FLASH_TEMPLATE_ARGS
+	uint32_t SPI_FLASH_CLASS::_size;
+
+	SPI_FLASH_TEMPLATE_ARGS
+	bool SPI_FLASH_CLASS::_busy;
+
+	SPI_FLASH_TEMPLATE_ARGS
+	uint32_t SPI_FLASH_CLASS::_tags[CACHE_LINES];
+
+	SPI_FLASH_TEMPLATE_ARGS
+	uint8_t SPI_FLASH_CLASS::_age[CACHE_LINES];
+
+	SPI_FLASH_TEMPLATE_ARGS
+	uint8_t SPI_FLASH_CLASS::_lines[CACHE_LINES][LINE_SIZE];
+
+	SPI_FLASH_TEMPLATE_ARGS
+	uint32_t SPI_FLASH_CLASS::_hits;
+
+	SPI_FLASH_TEMPLATE_ARGS
+	uint32_t SPI_FLASH_CLASS::_misses;
+
+	SPI_FLASH_TEMPLATE_ARGS
+	uint8_t SPI_FLASH_CLASS::_page[SPI_FLASH_CLASS::PageSize];
+
+	SPI_FLASH_TEMPLATE_ARGS
+	uint32_t SPI_FLASH_CLASS::_streamAddress;
+
+	SPI_FLASH_TEMPLATE_ARGS
+	size_t SPI_FLASH_CLASS::_streamLength;
+
+	SPI_FLASH_TEMPLATE_ARGS
+	RingBuffer<8, uint16_t> SPI_FLASH_CLASS::_erases;
+
+#undef SPI_FLASH_CLASS
+#undef SPI_FLASH_TEMPLATE_ARGS
+
+////////////////////////////////////////////////////////////////////////////////
+// class template SpiFlashBlocks
+// Block device interface (see SdCard) over SpiFlash, for LogStore.
+// Writing the first block of a 4 KB sector erases the sector, so sectors
+// have to be written sequentially from their start.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Flash, unsigned BLOCK_SIZE = 512>
+class SpiFlashBlocks
+{
+public:
+	static const unsigned BlockSize = BLOCK_SIZE;
+
+	static uint32_t BlockCount()
+	{
+		return Flash::Size() / BlockSize;
+	}
+
+	static bool ReadBlocks(uint32_t block, void *data, size_t count)
+	{
+		if(block >= BlockCount() || count > BlockCount() - block)
+			return false;
+		Flash::Read(block * BlockSize, data, count * BlockSize);
+		return true;
+	}
+
+	static bool WriteBlocks(uint32_t block, const void *data, size_t count)
+	{
+		const uint8_t *src = static_cast<const uint8_t *>(data);
+		if(!WriteStart(block, count))
+			return false;
+		for(; count; count--, src += BlockSize)
+			WriteNext(src);
+		return true;
+	}
+
+	static bool WriteStart(uint32_t block, size_t count)
+	{
+		if(block >= BlockCount() || count > BlockCount() - block)
+			return false;
+		_block = block;
+		return true;
+	}
+
+	static bool WriteNext(const void *data)
+	{
+		uint32_t address = _block++ * BlockSize;
+		if(address % Flash::SectorSize == 0)
+			Flash::EraseSector(address);
+		Flash::Write(address, data, BlockSize);
+		return true;
+	}
+
+	static bool WriteStop()
+	{
+		return true;
+	}
+
+	static bool Sync()
+	{
+		Flash::WaitReady();
+		return true;
+	}
+
+private:
+	BOOST_STATIC_ASSERT(Flash::SectorSize % BLOCK_SIZE == 0);
+	static uint32_t _block;
+};
+
+	template<class Flash, unsigned BLOCK_SIZE>
+	uint32_t SpiFlashBlocks<Flash, BLOCK_SIZE>::_block;
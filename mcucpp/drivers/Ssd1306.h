@@ -0,0 +1,272 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <static_assert.h>
+#include <framebuffer.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Ssd1306 interfaces. Command sends controller commands, Data sends bytes to
+// display RAM; TransferOverhead is the number of extra bytes per transfer.
+////////////////////////////////////////////////////////////////////////////////
+
+// 4-wire SPI, Spi is a class with static ReadWrite (HAL Spi, SoftSpi).
+// D/C is low for commands.
+template<class Spi, class CsPin, class DcPin>
+class OledSpi
+{
+public:
+	enum { TransferOverhead = 0 };
+
+	static void Init()
+	{
+		CsPin::Set();
+		CsPin::SetDirWrite();
+		DcPin::SetDirWrite();
+	}
+
+	static void Command(const uint8_t *data, size_t count)
+	{
+		DcPin::Clear();
+		Transfer(data, count);
+	}
+
+	static void Data(const uint8_t *data, size_t count)
+	{
+		DcPin::Set();
+		Transfer(data, count);
+	}
+
+private:
+	static void Transfer(const uint8_t *data, size_t count)
+	{
+		CsPin::Clear();
+		while(count--)
+			Spi::ReadWrite(*data++);
+		CsPin::Set();
+	}
+};
+
+// I2C, I2c is a master class with static bool Start(address), Write(data, count)
+// and Stop(). Every transfer starts with a control byte: 0x00 for commands,
+// 0x40 for data.
+template<class I2c, uint8_t ADDRESS = 0x3c>
+class OledI2c
+{
+public:
+	enum { TransferOverhead = 2 };
+
+	static void Init()
+	{}
+
+	static void Command(const uint8_t *data, size_t count)
+	{
+		Transfer(0x00, data, count);
+	}
+
+	static void Data(const uint8_t *data, size_t count)
+	{
+		Transfer(0x40, data, count);
+	}
+
+private:
+	static void Transfer(uint8_t control, const uint8_t *data, size_t count)
+	{
+		if(I2c::Start(ADDRESS))
+		{
+			I2c::Write(&control, 1);
+			I2c::Write(data, count);
+		}
+		I2c::Stop();
+	}
+};
+
+enum OledController
+{
+	Ssd1306Controller,
+	Sh1106Controller	// 132 column RAM, page addressing only
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template Ssd1306
+// SSD1306/SH1106 OLED driver with partial updates of a MonoFrameBuffer.
+// The driver keeps a shadow copy of the panel RAM. Update compares the dirty
+// rectangle of the frame buffer with the shadow page by page and sends only
+// column ranges that changed, each as a window set with column/page address
+// commands. Unchanged gaps shorter than the window setup cost are sent along
+// with the changes instead of opening a new window.
+// The first Update after Init sends the whole buffer.
+//
+// Usage:
+//		typedef Ssd1306<OledSpi<Spi1, Pa4, Pa3> > Oled;
+//		Oled::FrameBuffer screen;
+//		Oled::Init();
+//		screen.DrawText(0, 0, "Hello", Fonts::Font5x7, MonoColor::White);
+//		Oled::Update(screen);
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Interface, unsigned WIDTH = 128, unsigned HEIGHT = 64, OledController CONTROLLER = Ssd1306Controller>
+class Ssd1306
+{
+public:
+	typedef MonoFrameBuffer<WIDTH, HEIGHT> FrameBuffer;
+	enum { Width = WIDTH, Height = HEIGHT, Pages = HEIGHT / 8 };
+
+	static void Init()
+	{
+		Interface::Init();
+		const uint8_t init[] =
+		{
+			0xae,					// display off
+			0xd5, 0x80,				// clock divider
+			0xa8, HEIGHT - 1,		// multiplex ratio
+			0xd3, 0x00,				// display offset
+			0x40,					// start line 0
+			CONTROLLER == Ssd1306Controller ? 0x8d : 0xad,
+			CONTROLLER == Ssd1306Controller ? 0x14 : 0x8b,	// charge pump / DC-DC on
+			0x20, 0x00,				// horizontal addressing, SSD1306 only
+			0xa1,					// segment remap
+			0xc8,					// COM scan direction
+			0xda, HEIGHT == 64 ? 0x12 : 0x02,	// COM pins
+			0x81, 0xcf,				// contrast
+			0xd9, 0xf1,				// precharge
+			0xdb, 0x40,				// VCOMH
+			0xa4,					// display RAM
+			0xa6,					// not inverted
+			0xaf					// display on
+		};
+		// SH1106 has no addressing mode command
+		if(CONTROLLER == Ssd1306Controller)
+			Interface::Command(init, sizeof(init));
+		else
+		{
+			Interface::Command(init, 10);
+			Interface::Command(init + 12, sizeof(init) - 12);
+		}
+		_valid = false;
+	}
+
+	static void SetContrast(uint8_t contrast)
+	{
+		const uint8_t command[] = {0x81, contrast};
+		Interface::Command(command, sizeof(command));
+	}
+
+	static void Invert(bool invert)
+	{
+		uint8_t command = invert ? 0xa7 : 0xa6;
+		Interface::Command(&command, 1);
+	}
+
+	static void Enable(bool enable)
+	{
+		uint8_t command = enable ? 0xaf : 0xae;
+		Interface::Command(&command, 1);
+	}
+
+	// Sends changes within the dirty rectangle and clears it.
+	// Returns number of windows sent.
+	static unsigned Update(FrameBuffer &buffer)
+	{
+		Rect area = _valid ? buffer.Dirty() : Rect(0, 0, WIDTH, HEIGHT);
+		buffer.ClearDirty();
+		return Send(buffer.Data(), area);
+	}
+
+	// Compares whole buffer with the panel, e.g. after writing to Data() directly
+	static unsigned UpdateAll(FrameBuffer &buffer)
+	{
+		buffer.ClearDirty();
+		return Send(buffer.Data(), Rect(0, 0, WIDTH, HEIGHT));
+	}
+
+	// Next Update sends the whole buffer
+	static void Invalidate()
+	{
+		_valid = false;
+	}
+
+private:
+	BOOST_STATIC_ASSERT(HEIGHT % 8 == 0 && HEIGHT <= 64 && WIDTH <= 128);
+
+	enum
+	{
+		// column offset of SH1106 132 column RAM
+		ColumnOffset = CONTROLLER == Sh1106Controller ? (132 - WIDTH) / 2 : 0,
+		WindowCommands = CONTROLLER == Sh1106Controller ? 3 : 6,
+		// sending an unchanged gap is cheaper than starting a new window
+		MaxGap = WindowCommands + 2 * Interface::TransferOverhead
+	};
+
+	static unsigned Send(const uint8_t *data, const Rect &area)
+	{
+		if(area.IsEmpty())
+			return 0;
+		bool all = !_valid;
+		_valid = true;
+		if(all && CONTROLLER == Ssd1306Controller)
+		{
+			// whole RAM in one window, pages follow each other
+			const uint8_t command[] = {0x21, 0, WIDTH - 1, 0x22, 0, Pages - 1};
+			Interface::Command(command, sizeof(command));
+			Interface::Data(data, sizeof(_shadow));
+			memcpy(_shadow, data, sizeof(_shadow));
+			return 1;
+		}
+		unsigned windows = 0;
+		for(int16_t page = int16_t(area.y0 >> 3); page * 8 < area.y1; page++)
+		{
+			const uint8_t *row = data + page * WIDTH;
+			uint8_t *shadow = _shadow + page * WIDTH;
+			int16_t x = area.x0;
+			for(;;)
+			{
+				while(x < area.x1 && !all && row[x] == shadow[x])
+					x++;
+				if(x == area.x1)
+					break;
+				int16_t start = x;
+				int16_t end = int16_t(x + 1);
+				for(x = end; x < area.x1 && x - end <= MaxGap; x++)
+					if(all || row[x] != shadow[x])
+						end = int16_t(x + 1);
+				SendWindow(uint8_t(page), uint8_t(start), uint8_t(end), row);
+				memcpy(shadow + start, row + start, size_t(end - start));
+				windows++;
+				x = end;
+			}
+		}
+		return windows;
+	}
+
+	static void SendWindow(uint8_t page, uint8_t start, uint8_t end, const uint8_t *row)
+	{
+		if(CONTROLLER == Ssd1306Controller)
+		{
+			const uint8_t command[] = {0x21, start, uint8_t(end - 1), 0x22, page, page};
+			Interface::Command(command, sizeof(command));
+		}
+		else
+		{
+			uint8_t column = uint8_t(start + ColumnOffset);
+			const uint8_t command[] = {uint8_t(0xb0 | page), uint8_t(column & 0x0f), uint8_t(0x10 | column >> 4)};
+			Interface::Command(command, sizeof(command));
+		}
+		Interface::Data(row + start, size_t(end - start));
+	}
+
+	static uint8_t _shadow[WIDTH * (HEIGHT / 8)];
+	static bool _valid;
+};
+
+#define SSD1306_TEMPLATE_ARGS template<class Interface, unsigned WIDTH, unsigned HEIGHT, OledController CONTROLLER>
+#define SSD1306_CLASS Ssd1306<Interface, WIDTH, HEIGHT, CONTROLLER>
+
+	SSD1306_TEMPLATE_ARGS
+	uint8_t SSD1306_CLASS::_shadow[WIDTH * (HEIGHT / 8)];
+
+	SSD1306_TEMPLATE_ARGS
+	bool SSD1306_CLASS::_valid;
+
+#undef SSD1306_CLASS
+#undef SSD1306_TEMPLATE_ARGS
@@ -0,0 +1,437 @@
+#pragma once
+#include <stdint.h>
+#include <static_assert.h>
+#include <atomic.h>
+#include <loki/Typelist.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// class template StepperRamp
+// Precomputed acceleration profile: timer intervals between consecutive
+// steps of constant acceleration ramp from standstill to max speed.
+// Intervals are generated with integer form of David Austin's recurrence
+//		c0 = 0.676 * F * sqrt(2 / a)
+//		cn = cn-1 - 2 * cn-1 / (4n + 1)
+// in fixed point, where F is timer frequency and a is acceleration in
+// steps/s^2. Build uses 64 bit arithmetic and is meant to run once per
+// profile at startup, the step ISR only loads intervals from the table,
+// so ramp generation costs no arithmetic in the ISR.
+// If c0 doesn't fit into IntervalT, the ramp starts from the first interval
+// that fits, so acceleration stays right from a non-zero start speed.
+////////////////////////////////////////////////////////////////////////////////
+
+template<unsigned SIZE, class IntervalT = uint16_t>
+class StepperRamp
+{
+public:
+	typedef IntervalT IntervalType;
+	static const IntervalT MaxInterval = IntervalT(~IntervalT(0));
+
+	StepperRamp()
+		:_length(0)
+	{}
+
+	// Returns false if parameters are invalid or table is too short to reach
+	// maxSpeed, in that case the ramp is truncated to SIZE steps.
+	bool Build(uint32_t timerFreq, uint32_t accel, uint32_t maxSpeed)
+	{
+		_length = 0;
+		if(accel == 0 || maxSpeed == 0 || maxSpeed > timerFreq)
+			return false;
+		// 59897 = 2 * 0.676^2 * 2^16, c0 is in 24.8 fixed point
+		uint64_t c0Square = uint64_t(timerFreq) * timerFreq / accel;
+		// recurrence runs in 16 fractional bits to keep the decrement exact at high speed
+		unsigned shift = 8;
+		// at low acceleration c0^2 is scaled down by 4 until it fits 64 bits,
+		// Sqrt halves the scale, which is shifted back
+		while(c0Square > ~uint64_t(0) / 59897u)
+		{
+			c0Square >>= 2;
+			shift++;
+		}
+		uint64_t c = Sqrt(c0Square * 59897u) << shift;
+		const uint64_t cmin = (uint64_t(timerFreq) << 16) / maxSpeed;
+		const uint64_t cmax = uint64_t(MaxInterval) << 16;
+		uint32_t n = 0;
+		while(c > cmax)
+		{
+			n++;
+			c -= 2 * c / (4 * n + 1);
+		}
+		for(;;)
+		{
+			if(c < cmin)
+				c = cmin;
+			_intervals[_length++] = IntervalT((c + 0x8000) >> 16);
+			if(c == cmin)
+				return true;
+			if(_length == SIZE)
+				return false;
+			n++;
+			c -= 2 * c / (4 * n + 1);
+		}
+	}
+
+	IntervalT Interval(unsigned index)const
+	{
+		return _intervals[index];
+	}
+
+	// Steps needed to accelerate to max speed
+	unsigned Length()const
+	{
+		return _length;
+	}
+
+	static unsigned Size()
+	{
+		return SIZE;
+	}
+
+private:
+	static uint64_t Sqrt(uint64_t value)
+	{
+		uint64_t result = 0;
+		uint64_t bit = uint64_t(1) << 62;
+		while(bit > value)
+			bit >>= 2;
+		while(bit)
+		{
+			if(value >= result + bit)
+			{
+				value -= result + bit;
+				result = (result >> 1) + bit;
+			}
+			else
+				result >>= 1;
+			bit >>= 2;
+		}
+		return result;
+	}
+
+	IntervalT _intervals[SIZE];
+	unsigned _length;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template StepDirAxis
+// Axis driven by step/direction driver (A4988, DRV8825, ...) via two TPins.
+// Step pulse starts in one ISR and ends at the beginning of the next one.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class StepPin, class DirPin, bool INVERT_DIR = false>
+class StepDirAxis
+{
+public:
+	static void Init()
+	{
+		StepPin::Clear();
+		StepPin::SetDirWrite();
+		DirPin::SetDirWrite();
+	}
+
+	static void SetDirection(bool forward)
+	{
+		DirPin::Set(forward != INVERT_DIR);
+	}
+
+	static void Step()
+	{
+		StepPin::Set();
+	}
+
+	static void EndStep()
+	{
+		StepPin::Clear();
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template CoilAxis
+// Axis driven directly through H-bridge or darlington inputs with a PinList
+// of 4 coil pins in order A+, B+, A-, B- (IN1 - IN4 of ULN2003).
+// HALF_STEP selects 8 phase half stepping, otherwise two phase full stepping.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Coils, bool HALF_STEP = true>
+class CoilAxis
+{
+	BOOST_STATIC_ASSERT(Coils::Length == 4);
+public:
+	static const uint8_t Phases = HALF_STEP ? 8 : 4;
+
+	static uint8_t Pattern(uint8_t phase)
+	{
+		static const uint8_t halfStep[8] = {0x01, 0x03, 0x02, 0x06, 0x04, 0x0c, 0x08, 0x09};
+		static const uint8_t fullStep[4] = {0x03, 0x06, 0x0c, 0x09};
+		return HALF_STEP ? halfStep[phase] : fullStep[phase];
+	}
+
+	static void Init()
+	{
+		_phase = 0;
+		_direction = 1;
+		Coils::Write(Pattern(0));
+		Coils::SetConfiguration(Coils::Out);
+	}
+
+	static void SetDirection(bool forward)
+	{
+		_direction = forward ? 1 : Phases - 1;
+	}
+
+	static void Step()
+	{
+		uint8_t phase = uint8_t((_phase + _direction) & (Phases - 1));
+		_phase = phase;
+		Coils::Write(Pattern(phase));
+	}
+
+	static void EndStep()
+	{}
+
+	// De-energizes coils
+	static void Release()
+	{
+		Coils::Write(0);
+	}
+
+	static uint8_t Phase()
+	{
+		return _phase;
+	}
+
+private:
+	static uint8_t _phase;
+	static uint8_t _direction;
+};
+
+	template<class Coils, bool HALF_STEP>
+	uint8_t CoilAxis<Coils, HALF_STEP>::_phase;
+
+	template<class Coils, bool HALF_STEP>
+	uint8_t CoilAxis<Coils, HALF_STEP>::_direction;
+
+namespace StepperPrivate
+{
+	template<class Axes, unsigned index = 0>
+	struct AxisIterator
+	{
+		static void Init(){}
+		static void SetDirection(const int32_t *){}
+		static void Step(uint32_t *, const uint32_t *, volatile int32_t *, const int8_t *, uint32_t){}
+		static void EndStep(){}
+	};
+
+	template<class Head, class Tail, unsigned index>
+	struct AxisIterator<Loki::Typelist<Head, Tail>, index>
+	{
+		typedef AxisIterator<Tail, index + 1> Next;
+
+		static void Init()
+		{
+			Head::Init();
+			Next::Init();
+		}
+
+		static void SetDirection(const int32_t *deltas)
+		{
+			Head::SetDirection(deltas[index] >= 0);
+			Next::SetDirection(deltas);
+		}
+
+		// Bresenham step of all axes along the lead one
+		static inline void Step(uint32_t *error, const uint32_t *delta, volatile int32_t *position, const int8_t *direction, uint32_t lead)
+		{
+			uint32_t e = error[index] + delta[index];
+			if(e >= lead)
+			{
+				e -= lead;
+				Head::Step();
+				position[index] += direction[index];
+			}
+			error[index] = e;
+			Next::Step(error, delta, position, direction, lead);
+		}
+
+		static void EndStep()
+		{
+			Head::EndStep();
+			Next::EndStep();
+		}
+	};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class template StepperMotion
+// Coordinated linear moves of several axes from one timer ISR.
+// Axes is a typelist of axis classes (StepDirAxis, CoilAxis or any class with
+// static Init, SetDirection, Step and EndStep). The axis with the longest
+// delta leads, others follow with Bresenham error accumulation.
+// Speed follows the ramp by index min(done, left - 1, ramp length - 1), so
+// deceleration mirrors acceleration and short moves get a triangle profile.
+//
+// Usage:
+//		uint16_t interval = Motion::Move(ramp, deltas);
+//		start timer with 'interval' ticks period
+//		timer compare ISR:
+//			interval = Motion::TimerHandler();
+//			if(interval)
+//				load next compare value
+//			else
+//				stop timer
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Axes, class Ramp>
+class StepperMotion
+{
+	typedef StepperPrivate::AxisIterator<Axes> Iterator;
+public:
+	typedef typename Ramp::IntervalType IntervalType;
+	static const unsigned AxisCount = Loki::TL::Length<Axes>::value;
+
+	static void Init()
+	{
+		Iterator::Init();
+		_steps = 0;
+		_done = 0;
+		_busy = false;
+		for(unsigned i = 0; i < AxisCount; i++)
+			_position[i] = 0;
+	}
+
+	// Starts relative move, returns interval to the first step,
+	// 0 if already moving or nothing to do.
+	static IntervalType Move(const Ramp &ramp, const int32_t *deltas)
+	{
+		if(_busy || ramp.Length() == 0)
+			return 0;
+		uint32_t lead = 0;
+		for(unsigned i = 0; i < AxisCount; i++)
+		{
+			_direction[i] = deltas[i] < 0 ? -1 : 1;
+			_delta[i] = deltas[i] < 0 ? 0u - uint32_t(deltas[i]) : uint32_t(deltas[i]);
+			if(_delta[i] > lead)
+				lead = _delta[i];
+		}
+		if(lead == 0)
+			return 0;
+		for(unsigned i = 0; i < AxisCount; i++)
+			_error[i] = lead / 2;
+		Iterator::SetDirection(deltas);
+		_ramp = &ramp;
+		_lead = lead;
+		_done = 0;
+		_steps = lead;
+		_busy = true;
+		return ramp.Interval(0);
+	}
+
+	// Makes next step, returns interval to the next call, 0 when move is over
+	static IntervalType TimerHandler()
+	{
+		Iterator::EndStep();
+		uint32_t done = _done;
+		uint32_t steps = _steps;
+		if(done >= steps)
+		{
+			_busy = false;
+			return 0;
+		}
+		Iterator::Step(_error, _delta, _position, _direction, _lead);
+		_done = ++done;
+		uint32_t index = steps - done;
+		// one more call ends the last step pulse
+		if(index)
+			index--;
+		if(done < index)
+			index = done;
+		if(index >= _ramp->Length())
+			index = _ramp->Length() - 1;
+		return _ramp->Interval(index);
+	}
+
+	// Decelerates to stop as fast as the ramp allows
+	static void Stop()
+	{
+		ATOMIC
+		{
+			if(!_busy)
+				return;
+			uint32_t done = _done;
+			uint32_t rampSteps = _ramp->Length() - 1;
+			uint32_t steps = done + (done < rampSteps ? done : rampSteps) + 1;
+			if(steps < _steps)
+				_steps = steps;
+		}
+	}
+
+	static bool IsBusy()
+	{
+		return _busy;
+	}
+
+	// Steps of lead axis made in current move
+	static uint32_t Done()
+	{
+		ATOMIC
+		{
+			return _done;
+		}
+		return 0;
+	}
+
+	static int32_t Position(unsigned axis)
+	{
+		ATOMIC
+		{
+			return _position[axis];
+		}
+		return 0;
+	}
+
+	static void SetPosition(unsigned axis, int32_t position)
+	{
+		ATOMIC
+		{
+			_position[axis] = position;
+		}
+	}
+
+private:
+	static const Ramp *_ramp;
+	static uint32_t _error[Loki::TL::Length<Axes>::value];
+	static uint32_t _delta[Loki::TL::Length<Axes>::value];
+	static int8_t _direction[Loki::TL::Length<Axes>::value];
+	static volatile int32_t _position[Loki::TL::Length<Axes>::value];
+	static uint32_t _lead;
+	static volatile uint32_t _steps;
+	static volatile uint32_t _done;
+	static volatile bool _busy;
+};
+
+	template<class Axes, class Ramp>
+	const Ramp *StepperMotion<Axes, Ramp>::_ramp;
+
+	template<class Axes, class Ramp>
+	uint32_t StepperMotion<Axes, Ramp>::_error[Loki::TL::Length<Axes>::value];
+
+	template<class Axes, class Ramp>
+	uint32_t StepperMotion<Axes, Ramp>::_delta[Loki::TL::Length<Axes>::value];
+
+	template<class Axes, class Ramp>
+	int8_t StepperMotion<Axes, Ramp>::_direction[Loki::TL::Length<Axes>::value];
+
+	template<class Axes, class Ramp>
+	volatile int32_t StepperMotion<Axes, Ramp>::_position[Loki::TL::Length<Axes>::value];
+
+	template<class Axes, class Ramp>
+	uint32_t StepperMotion<Axes, Ramp>::_lead;
+
+	template<class Axes, class Ramp>
+	volatile uint32_t StepperMotion<Axes, Ramp>::_steps;
+
+	template<class Axes, class Ramp>
+	volatile uint32_t StepperMotion<Axes, Ramp>::_done;
+
+	template<class Axes, class Ramp>
+	volatile bool StepperMotion<Axes, Ramp>::_busy;
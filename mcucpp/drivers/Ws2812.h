@@ -0,0 +1,203 @@
+#pragma once
+#include <stdint.h>
+#include <static_assert.h>
+#include <select_size.h>
+
+namespace Ws2812Private
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// class template Ws2812Code
+	// Encodes data bytes to SPI bit patterns, MSB first.
+	// 3 SPI bits per LED bit (SPI clock 2.4 MHz, 417 ns per bit):
+	//		0 -> 100, 1 -> 110
+	// 4 SPI bits per LED bit (SPI clock 3.2 MHz, 312 ns per bit):
+	//		0 -> 1000, 1 -> 1110
+	// Each nibble is looked up in a 16 entry table, so a byte costs two loads.
+	////////////////////////////////////////////////////////////////////////////////
+	template<unsigned SPI_BITS>
+	struct Ws2812Code;
+
+	template<>
+	struct Ws2812Code<3>
+	{
+		static uint16_t Nibble(uint8_t value)
+		{
+			static const uint16_t table[16] =
+			{
+				0x924, 0x926, 0x934, 0x936, 0x9a4, 0x9a6, 0x9b4, 0x9b6,
+				0xd24, 0xd26, 0xd34, 0xd36, 0xda4, 0xda6, 0xdb4, 0xdb6
+			};
+			return table[value];
+		}
+
+		static uint8_t *Encode(uint8_t value, uint8_t *dst)
+		{
+			uint16_t hi = Nibble(value >> 4);
+			uint16_t lo = Nibble(value & 0x0f);
+			dst[0] = uint8_t(hi >> 4);
+			dst[1] = uint8_t(hi << 4 | lo >> 8);
+			dst[2] = uint8_t(lo);
+			return dst + 3;
+		}
+	};
+
+	template<>
+	struct Ws2812Code<4>
+	{
+		static uint16_t Nibble(uint8_t value)
+		{
+			static const uint16_t table[16] =
+			{
+				0x8888, 0x888e, 0x88e8, 0x88ee, 0x8e88, 0x8e8e, 0x8ee8, 0x8eee,
+				0xe888, 0xe88e, 0xe8e8, 0xe8ee, 0xee88, 0xee8e, 0xeee8, 0xeeee
+			};
+			return table[value];
+		}
+
+		static uint8_t *Encode(uint8_t value, uint8_t *dst)
+		{
+			uint16_t hi = Nibble(value >> 4);
+			uint16_t lo = Nibble(value & 0x0f);
+			dst[0] = uint8_t(hi >> 8);
+			dst[1] = uint8_t(hi);
+			dst[2] = uint8_t(lo >> 8);
+			dst[3] = uint8_t(lo);
+			return dst + 4;
+		}
+	};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class template Ws2812
+// WS2812 (NeoPixel) LED strip driver over SPI MOSI.
+// Every LED bit is sent as SPI_BITS SPI bits, so the high pulse width is set
+// by the SPI clock instead of instruction timing and interrupts may stay enabled.
+// Pixels are kept in GRB order (3 bytes per LED). The frame is encoded on the
+// fly into two halves of a small buffer, CHUNK_LEDS LEDs per half, so the
+// encoded frame (SPI_BITS times larger) is never held in RAM.
+//
+// Usage with circular DMA over Buffer() of BufferSize bytes:
+//		Strip::Start();			// encodes the first two chunks
+//		start DMA: memory Strip::Buffer(), BufferSize bytes, circular, to SPI DR
+//		DMA half transfer and transfer complete interrupts:
+//			if(!Strip::TransferHandler())
+//				stop DMA, keep MOSI low for the reset time (>= 50 us)
+// TransferHandler refills the half that has just been sent while DMA reads
+// the other one. Show() sends a frame with blocking Spi::Write.
+// SPI must be master, MSB first, with MOSI low when idle.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Spi, unsigned LEDS, unsigned SPI_BITS = 3, unsigned CHUNK_LEDS = 4>
+class Ws2812
+{
+	typedef Ws2812Private::Ws2812Code<SPI_BITS> Code;
+public:
+	static const unsigned LedCount = LEDS;
+	static const unsigned FrameBytes = LEDS * 3;
+	// data bytes encoded per chunk
+	static const unsigned ChunkDataBytes = CHUNK_LEDS * 3;
+	// encoded bytes per chunk (one half of buffer)
+	static const unsigned ChunkBytes = ChunkDataBytes * SPI_BITS;
+	static const unsigned BufferSize = ChunkBytes * 2;
+	// chunks carrying frame data, the last one is padded with zeros
+	static const unsigned Chunks = (FrameBytes + ChunkDataBytes - 1) / ChunkDataBytes;
+	typedef typename SelectSizeForLength<Chunks + 2>::Result ChunkType;
+
+	static void SetPixel(unsigned index, uint8_t r, uint8_t g, uint8_t b)
+	{
+		uint8_t *ptr = _pixels + index * 3;
+		ptr[0] = g;
+		ptr[1] = r;
+		ptr[2] = b;
+	}
+
+	static void SetPixel(unsigned index, uint32_t rgb)
+	{
+		SetPixel(index, uint8_t(rgb >> 16), uint8_t(rgb >> 8), uint8_t(rgb));
+	}
+
+	static uint32_t GetPixel(unsigned index)
+	{
+		const uint8_t *ptr = _pixels + index * 3;
+		return uint32_t(ptr[1]) << 16 | uint32_t(ptr[0]) << 8 | ptr[2];
+	}
+
+	static void Clear()
+	{
+		for(unsigned i = 0; i < FrameBytes; i++)
+			_pixels[i] = 0;
+	}
+
+	// Raw pixel data in GRB order
+	static uint8_t *Pixels()
+	{
+		return _pixels;
+	}
+
+	static const uint8_t *Buffer()
+	{
+		return _buffer;
+	}
+
+	// Prepares frame transmission, both buffer halves are filled
+	static void Start()
+	{
+		_sent = 0;
+		EncodeChunk(0, _buffer);
+		EncodeChunk(1, _buffer + ChunkBytes);
+	}
+
+	// Call when one half of buffer has been sent.
+	// Returns false when the whole frame has been sent.
+	static bool TransferHandler()
+	{
+		ChunkType sent = _sent;
+		EncodeChunk(sent + 2, _buffer + (sent & 1) * ChunkBytes);
+		_sent = ++sent;
+		return sent < Chunks;
+	}
+
+	static void Show()
+	{
+		Start();
+		const uint8_t *ptr = _buffer;
+		do
+		{
+			for(unsigned i = 0; i < ChunkBytes; i++)
+				Spi::Write(ptr[i]);
+			ptr = ptr == _buffer ? _buffer + ChunkBytes : _buffer;
+		}while(TransferHandler());
+	}
+
+private:
+	BOOST_STATIC_ASSERT(SPI_BITS == 3 || SPI_BITS == 4);
+	BOOST_STATIC_ASSERT(LEDS > 0 && CHUNK_LEDS > 0);
+
+	static void EncodeChunk(unsigned chunk, uint8_t *dst)
+	{
+		unsigned offset = chunk * ChunkDataBytes;
+		unsigned count = 0;
+		if(offset < FrameBytes)
+			count = FrameBytes - offset < ChunkDataBytes ? FrameBytes - offset : ChunkDataBytes;
+		const uint8_t *src = _pixels + offset;
+		uint8_t *end = dst + ChunkBytes;
+		for(unsigned i = 0; i < count; i++)
+			dst = Code::Encode(src[i], dst);
+		// keep line low after the frame
+		while(dst != end)
+			*dst++ = 0;
+	}
+
+	static uint8_t _pixels[LEDS * 3];
+	static uint8_t _buffer[CHUNK_LEDS * 3 * SPI_BITS * 2];
+	static volatile ChunkType _sent;
+};
+
+	template<class Spi, unsigned LEDS, unsigned SPI_BITS, unsigned CHUNK_LEDS>
+	uint8_t Ws2812<Spi, LEDS, SPI_BITS, CHUNK_LEDS>::_pixels[LEDS * 3];
+
+	template<class Spi, unsigned LEDS, unsigned SPI_BITS, unsigned CHUNK_LEDS>
+	uint8_t Ws2812<Spi, LEDS, SPI_BITS, CHUNK_LEDS>::_buffer[CHUNK_LEDS * 3 * SPI_BITS * 2];
+
+	template<class Spi, unsigned LEDS, unsigned SPI_BITS, unsigned CHUNK_LEDS>
+	volatile typename Ws2812<Spi, LEDS, SPI_BITS, CHUNK_LEDS>::ChunkType Ws2812<Spi, LEDS, SPI_BITS, CHUNK_LEDS>::_sent;
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stdint.h>
+#include "containers.h"
+#include "atomic.h"
+#include "loki/Typelist.h"
+#include "loki/TypeManip.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// class template Route
+// Routing table entry of EventBus: events of type Topic go to each class of
+// Subscribers typelist, in list order, through its static
+// void Handle(const Topic &) member. A topic may appear in several routes,
+// their subscribers are joined in table order.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class TopicT, class SubscribersT>
+struct Route
+{
+	typedef TopicT Topic;
+	typedef SubscribersT Subscribers;
+};
+
+namespace EventBusPrivate
+{
+	// Subscribers of Event joined from all routes of Routes
+	template<class Routes, class Event>
+	struct Subscribers;
+
+	template<class Event>
+	struct Subscribers<Loki::NullType, Event>
+	{
+		typedef Loki::NullType Result;
+	};
+
+	template<class Topic, class List, class Tail, class Event>
+	struct Subscribers<Loki::Typelist<Route<Topic, List>, Tail>, Event>
+	{
+		typedef typename Subscribers<Tail, Event>::Result Rest;
+		typedef typename Loki::Select<Loki::IsSameType<Topic, Event>::value,
+			typename Loki::TL::Append<List, Rest>::Result, Rest>::Result Result;
+	};
+
+	// Unrolled call list
+	template<class List>
+	struct Deliver;
+
+	template<>
+	struct Deliver<Loki::NullType>
+	{
+		template<class Event>
+		static void Call(const Event &)
+		{}
+	};
+
+	template<class Head, class Tail>
+	struct Deliver<Loki::Typelist<Head, Tail> >
+	{
+		template<class Event>
+		static void Call(const Event &event)
+		{
+			Head::Handle(event);
+			Deliver<Tail>::Call(event);
+		}
+	};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class template EventBus
+// Publish/subscribe with topics being event types and subscribers bound at
+// compile time by Routes, a typelist of Route. Publish calls the subscribers
+// of the topic directly, there is no lookup, no callback table and no
+// allocation; with inline handlers it costs as much as calling them by hand.
+// Publishing a topic without subscribers compiles to nothing.
+// Handlers run in the publisher's context, see DeferredEventBus for
+// publishing from interrupts.
+//
+// Usage:
+//		struct Temperature { int16_t value; };
+//		struct Logger { static void Handle(const Temperature &t); };
+//		...
+//		typedef EventBus<Loki::TL::MakeTypelist<
+//			Route<Temperature, Loki::TL::MakeTypelist<Logger, Control, Display>::Result>,
+//			Route<KeyPress, Loki::TL::MakeTypelist<Display>::Result>
+//			>::Result> Bus;
+//		Temperature t = {215};
+//		Bus::Publish(t);
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Routes>
+class EventBus
+{
+public:
+	template<class Event>
+	struct SubscriberCount
+	{
+		static const int value =
+			Loki::TL::Length<typename EventBusPrivate::Subscribers<Routes, Event>::Result>::value;
+	};
+
+	template<class Event>
+	static void Publish(const Event &event)
+	{
+		EventBusPrivate::Deliver<typename EventBusPrivate::Subscribers<Routes, Event>::Result>::Call(event);
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template DeferredEventBus
+// EventBus publishing through Dispatcher: Post copies the event to a queue of
+// SIZE events of its topic and schedules a dispatcher task delivering it, so
+// it may be called from interrupts and handlers run in the main loop.
+// As in HsmEventQueue each posted event schedules one task, so a burst of
+// events does not starve other tasks. Post returns false if the topic queue
+// or the dispatcher task queue is full. Events must be default constructible and assignable.
+// SIZE must be a power of 2.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Routes, class DispatcherT, int SIZE = 4>
+class DeferredEventBus
+{
+	typedef EventBus<Routes> Bus;
+public:
+	template<class Event>
+	static bool Post(const Event &event)
+	{
+		if(Bus::template SubscriberCount<Event>::value == 0)
+			return true;
+		ATOMIC
+		{
+			if(Mailbox<Event>::events.IsFull() || !DispatcherT::SetTask(&Process<Event>))
+				return false;
+			Mailbox<Event>::events.Write(event);
+		}
+		return true;
+	}
+
+	// Publishes one queued event of the topic
+	template<class Event>
+	static void Process()
+	{
+		Event event;
+		bool result;
+		ATOMIC
+		{
+			result = Mailbox<Event>::events.Read(event);
+		}
+		if(result)
+			Bus::Publish(event);
+	}
+
+	template<class Event>
+	static bool IsEmpty()
+	{
+		return Mailbox<Event>::events.IsEmpty();
+	}
+
+private:
+	template<class Event>
+	struct Mailbox
+	{
+		static Queue<SIZE, Event> events;
+	};
+};
+
+template<class Routes, class DispatcherT, int SIZE>
+template<class Event>
+Queue<SIZE, Event> DeferredEventBus<Routes, DispatcherT, SIZE>::Mailbox<Event>::events;
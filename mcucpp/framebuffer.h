@@ -0,0 +1,592 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "static_assert.h"
+
+#if defined(__AVR__)
+#include <flashptr.h>
+#define GRAPHICS_FLASH PROGMEM
+#else
+#define GRAPHICS_FLASH
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// 1bpp bitmaps and fonts
+// Bitmaps are stored by columns in pages of 8 rows, like SSD1306 display RAM:
+// byte holds 8 vertical pixels with bit 0 on top, page p of a w pixels wide
+// bitmap starts at offset p * w.
+// Font glyph is such a bitmap of width x height pixels, glyphs of characters
+// first .. first + count - 1 follow each other. Glyph tables are declared with
+// GRAPHICS_FLASH to be placed in flash (see font5x7.h).
+////////////////////////////////////////////////////////////////////////////////
+
+struct Font
+{
+	uint8_t width;
+	uint8_t height;
+	uint8_t first;
+	uint8_t count;
+	const uint8_t *glyphs;
+};
+
+// Rectangle from (x0, y0) to (x1, y1), excluding x1 and y1
+struct Rect
+{
+	Rect()
+		:x0(0), y0(0), x1(0), y1(0)
+	{}
+
+	Rect(int16_t left, int16_t top, int16_t right, int16_t bottom)
+		:x0(left), y0(top), x1(right), y1(bottom)
+	{}
+
+	bool IsEmpty() const
+	{
+		return x0 >= x1 || y0 >= y1;
+	}
+
+	int16_t Width() const
+	{
+		return int16_t(x1 - x0);
+	}
+
+	int16_t Height() const
+	{
+		return int16_t(y1 - y0);
+	}
+
+	// Extends the rectangle to cover other one
+	void Add(const Rect &other)
+	{
+		if(other.IsEmpty())
+			return;
+		if(IsEmpty())
+		{
+			*this = other;
+			return;
+		}
+		if(other.x0 < x0) x0 = other.x0;
+		if(other.y0 < y0) y0 = other.y0;
+		if(other.x1 > x1) x1 = other.x1;
+		if(other.y1 > y1) y1 = other.y1;
+	}
+
+	int16_t x0, y0, x1, y1;
+};
+
+namespace GraphicsPrivate
+{
+	struct RamReader
+	{
+		static uint8_t Read(const uint8_t *ptr)
+		{
+			return *ptr;
+		}
+	};
+
+	struct FlashReader
+	{
+		static uint8_t Read(const uint8_t *ptr)
+		{
+#if defined(__AVR__)
+			return *ProgmemPtr<uint8_t>(const_cast<uint8_t *>(ptr));
+#else
+			return *ptr;
+#endif
+		}
+	};
+
+	// 8 pixels of a bitmap column starting from row (may be negative),
+	// rows out of the column are zero
+	template<class Reader>
+	inline uint8_t ColumnBits(const uint8_t *column, int16_t stride, int16_t pages, int16_t row)
+	{
+		if(row <= -8)
+			return 0;
+		if(row < 0)
+			return uint8_t(Reader::Read(column) << -row);
+		int16_t page = int16_t(row >> 3);
+		uint8_t shift = uint8_t(row & 7);
+		if(page >= pages)
+			return 0;
+		uint8_t bits = uint8_t(Reader::Read(column + page * stride) >> shift);
+		if(shift && page + 1 < pages)
+			bits |= uint8_t(Reader::Read(column + (page + 1) * stride) << (8 - shift));
+		return bits;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class template Canvas
+// Drawing functions common for frame buffers. Everything is clipped to the
+// WIDTH x HEIGHT area and the bounding box of changed pixels is collected in
+// the dirty rectangle, so a display driver can transfer only that part.
+// Derived class implements:
+//		Put(x, y, color)			- pixel, coordinates are valid
+//		Fill(rect, color)			- rectangle within the area
+//		PutBitmap<Reader>(x, y, bitmap, width, height, clip, color)
+//									- set pixels of 1bpp bitmap within clip
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Derived, class ColorT, unsigned WIDTH, unsigned HEIGHT>
+class Canvas
+{
+public:
+	typedef ColorT Color;
+	enum { Width = WIDTH, Height = HEIGHT };
+
+	void SetPixel(int16_t x, int16_t y, Color color)
+	{
+		if(uint16_t(x) >= WIDTH || uint16_t(y) >= HEIGHT)
+			return;
+		Self().Put(x, y, color);
+		Invalidate(Rect(x, y, int16_t(x + 1), int16_t(y + 1)));
+	}
+
+	void FillRect(int16_t x, int16_t y, int16_t width, int16_t height, Color color)
+	{
+		Rect clip = Clip(x, y, width, height);
+		if(clip.IsEmpty())
+			return;
+		Self().Fill(clip, color);
+		Invalidate(clip);
+	}
+
+	void Clear(Color color)
+	{
+		FillRect(0, 0, WIDTH, HEIGHT, color);
+	}
+
+	void DrawHLine(int16_t x, int16_t y, int16_t width, Color color)
+	{
+		FillRect(x, y, width, 1, color);
+	}
+
+	void DrawVLine(int16_t x, int16_t y, int16_t height, Color color)
+	{
+		FillRect(x, y, 1, height, color);
+	}
+
+	// Outline, pixels are drawn once (matters for inverting colors)
+	void DrawRect(int16_t x, int16_t y, int16_t width, int16_t height, Color color)
+	{
+		if(width <= 0 || height <= 0)
+			return;
+		DrawHLine(x, y, width, color);
+		if(height > 1)
+			DrawHLine(x, int16_t(y + height - 1), width, color);
+		if(height > 2)
+		{
+			DrawVLine(x, int16_t(y + 1), int16_t(height - 2), color);
+			if(width > 1)
+				DrawVLine(int16_t(x + width - 1), int16_t(y + 1), int16_t(height - 2), color);
+		}
+	}
+
+	// Line including both ends, Bresenham's algorithm
+	void DrawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, Color color)
+	{
+		if(y0 == y1)
+		{
+			DrawHLine(x0 < x1 ? x0 : x1, y0, int16_t(Abs(x1 - x0) + 1), color);
+			return;
+		}
+		if(x0 == x1)
+		{
+			DrawVLine(x0, y0 < y1 ? y0 : y1, int16_t(Abs(y1 - y0) + 1), color);
+			return;
+		}
+		int32_t dx = Abs(x1 - x0);
+		int32_t dy = -Abs(y1 - y0);
+		Rect box = Clip(x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, int16_t(dx + 1), int16_t(1 - dy));
+		if(box.IsEmpty())
+			return;
+		int16_t sx = x0 < x1 ? 1 : -1;
+		int16_t sy = y0 < y1 ? 1 : -1;
+		int32_t error = dx + dy;
+		for(;;)
+		{
+			if(x0 >= box.x0 && x0 < box.x1 && y0 >= box.y0 && y0 < box.y1)
+				Self().Put(x0, y0, color);
+			if(x0 == x1 && y0 == y1)
+				break;
+			int32_t error2 = 2 * error;
+			if(error2 >= dy)
+			{
+				error += dy;
+				x0 = int16_t(x0 + sx);
+			}
+			if(error2 <= dx)
+			{
+				error += dx;
+				y0 = int16_t(y0 + sy);
+			}
+		}
+		Invalidate(box);
+	}
+
+	// Draws set pixels of 1bpp bitmap in RAM, others are left as is
+	void DrawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t width, int16_t height, Color color)
+	{
+		DrawBits<GraphicsPrivate::RamReader>(x, y, bitmap, width, height, color);
+	}
+
+	// Returns x position of the next character
+	int16_t DrawChar(int16_t x, int16_t y, char c, const Font &font, Color color)
+	{
+		uint8_t index = uint8_t(uint8_t(c) - font.first);
+		if(index < font.count)
+		{
+			const uint8_t *glyph = font.glyphs + unsigned(index) * font.width * ((font.height + 7) / 8);
+			DrawBits<GraphicsPrivate::FlashReader>(x, y, glyph, font.width, font.height, color);
+		}
+		return int16_t(x + font.width + 1);
+	}
+
+	int16_t DrawText(int16_t x, int16_t y, const char *text, const Font &font, Color color)
+	{
+		while(*text)
+			x = DrawChar(x, y, *text++, font, color);
+		return x;
+	}
+
+	static int16_t TextWidth(const char *text, const Font &font)
+	{
+		size_t length = strlen(text);
+		return length ? int16_t(length * (font.width + 1) - 1) : 0;
+	}
+
+	// Bounding box of pixels changed since ClearDirty
+	const Rect &Dirty() const
+	{
+		return _dirty;
+	}
+
+	bool IsDirty() const
+	{
+		return !_dirty.IsEmpty();
+	}
+
+	void ClearDirty()
+	{
+		_dirty = Rect();
+	}
+
+	// Marks area as changed, for direct writes to the buffer
+	void Invalidate(const Rect &rect)
+	{
+		_dirty.Add(rect);
+	}
+
+protected:
+	BOOST_STATIC_ASSERT(WIDTH > 0 && WIDTH < 0x4000 && HEIGHT > 0 && HEIGHT < 0x4000);
+
+	static int32_t Abs(int32_t value)
+	{
+		return value < 0 ? -value : value;
+	}
+
+	static Rect Clip(int16_t x, int16_t y, int16_t width, int16_t height)
+	{
+		if(width <= 0 || height <= 0)
+			return Rect();
+		int32_t x1 = int32_t(x) + width;
+		int32_t y1 = int32_t(y) + height;
+		return Rect(x < 0 ? 0 : x, y < 0 ? 0 : y,
+			int16_t(x1 > int32_t(WIDTH) ? int32_t(WIDTH) : x1),
+			int16_t(y1 > int32_t(HEIGHT) ? int32_t(HEIGHT) : y1));
+	}
+
+	template<class Reader>
+	void DrawBits(int16_t x, int16_t y, const uint8_t *bitmap, int16_t width, int16_t height, Color color)
+	{
+		Rect clip = Clip(x, y, width, height);
+		if(clip.IsEmpty())
+			return;
+		Self().template PutBitmap<Reader>(x, y, bitmap, width, height, clip, color);
+		Invalidate(clip);
+	}
+
+	Derived &Self()
+	{
+		return static_cast<Derived &>(*this);
+	}
+
+	Rect _dirty;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template MonoFrameBuffer
+// 1bpp frame buffer in the page layout of SSD1306/SH1106 and similar
+// controllers, Data() can be sent to the display as is, page by page.
+// Fills modify whole bytes of a page with a mask, four bytes at a time.
+////////////////////////////////////////////////////////////////////////////////
+
+struct MonoColor
+{
+	enum Type { Black, White, Invert };
+};
+
+template<unsigned WIDTH, unsigned HEIGHT>
+class MonoFrameBuffer :public Canvas<MonoFrameBuffer<WIDTH, HEIGHT>, MonoColor::Type, WIDTH, HEIGHT>
+{
+	typedef Canvas<MonoFrameBuffer<WIDTH, HEIGHT>, MonoColor::Type, WIDTH, HEIGHT> Base;
+	friend class Canvas<MonoFrameBuffer<WIDTH, HEIGHT>, MonoColor::Type, WIDTH, HEIGHT>;
+public:
+	typedef MonoColor::Type Color;
+	enum { Pages = (HEIGHT + 7) / 8 };
+
+	MonoFrameBuffer()
+	{
+		memset(_data, 0, sizeof(_data));
+	}
+
+	uint8_t *Data()
+	{
+		return _data;
+	}
+
+	const uint8_t *Data() const
+	{
+		return _data;
+	}
+
+	static size_t Size()
+	{
+		return WIDTH * Pages;
+	}
+
+	const uint8_t *Page(unsigned page) const
+	{
+		return _data + page * WIDTH;
+	}
+
+	bool GetPixel(int16_t x, int16_t y) const
+	{
+		if(uint16_t(x) >= WIDTH || uint16_t(y) >= HEIGHT)
+			return false;
+		return (_data[(y >> 3) * WIDTH + x] >> (y & 7)) & 1;
+	}
+
+	// Copies 1bpp bitmap in RAM, clear pixels are drawn too
+	void Blit(int16_t x, int16_t y, const uint8_t *bitmap, int16_t width, int16_t height)
+	{
+		Rect clip = Base::Clip(x, y, width, height);
+		if(clip.IsEmpty())
+			return;
+		int16_t pages = int16_t((height + 7) / 8);
+		for(int16_t page = int16_t(clip.y0 >> 3); page * 8 < clip.y1; page++)
+		{
+			uint8_t mask = PageMask(page, clip);
+			uint8_t *dest = _data + page * WIDTH;
+			int16_t row = int16_t(page * 8 - y);
+			if(mask == 0xff && (row & 7) == 0)
+			{
+				// aligned to pages
+				memcpy(dest + clip.x0, bitmap + (row >> 3) * width + (clip.x0 - x), size_t(clip.Width()));
+				continue;
+			}
+			for(int16_t column = clip.x0; column < clip.x1; column++)
+			{
+				uint8_t bits = GraphicsPrivate::ColumnBits<GraphicsPrivate::RamReader>(
+					bitmap + (column - x), width, pages, row);
+				dest[column] = uint8_t((dest[column] & ~mask) | (bits & mask));
+			}
+		}
+		Base::Invalidate(clip);
+	}
+
+private:
+	static uint8_t PageMask(int16_t page, const Rect &rect)
+	{
+		int16_t top = int16_t(page * 8);
+		uint8_t mask = 0xff;
+		if(rect.y0 > top)
+			mask = uint8_t(mask << (rect.y0 - top));
+		if(rect.y1 < top + 8)
+			mask &= uint8_t(0xff >> (top + 8 - rect.y1));
+		return mask;
+	}
+
+	template<class T>
+	static T Apply(T value, T mask, Color color)
+	{
+		switch(color)
+		{
+		case MonoColor::White:
+			return T(value | mask);
+		case MonoColor::Black:
+			return T(value & ~mask);
+		default:
+			return T(value ^ mask);
+		}
+	}
+
+	// Applies mask to count bytes of a page
+	static void FillSpan(uint8_t *dest, int16_t count, uint8_t mask, Color color)
+	{
+		if(mask == 0xff && color != MonoColor::Invert)
+		{
+			memset(dest, color == MonoColor::White ? 0xff : 0, size_t(count));
+			return;
+		}
+		for(; count && (uintptr_t(dest) & 3); count--, dest++)
+			*dest = Apply(*dest, mask, color);
+		uint32_t mask32 = mask * 0x01010101ul;
+		for(; count >= 4; count -= 4, dest += 4)
+		{
+			uint32_t word;
+			memcpy(&word, dest, 4);
+			word = Apply(word, mask32, color);
+			memcpy(dest, &word, 4);
+		}
+		for(; count; count--, dest++)
+			*dest = Apply(*dest, mask, color);
+	}
+
+	void Put(int16_t x, int16_t y, Color color)
+	{
+		uint8_t &byte = _data[(y >> 3) * WIDTH + x];
+		byte = Apply(byte, uint8_t(1 << (y & 7)), color);
+	}
+
+	void Fill(const Rect &rect, Color color)
+	{
+		for(int16_t page = int16_t(rect.y0 >> 3); page * 8 < rect.y1; page++)
+			FillSpan(_data + page * WIDTH + rect.x0, rect.Width(), PageMask(page, rect), color);
+	}
+
+	template<class Reader>
+	void PutBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t width, int16_t height,
+		const Rect &clip, Color color)
+	{
+		int16_t pages = int16_t((height + 7) / 8);
+		for(int16_t page = int16_t(clip.y0 >> 3); page * 8 < clip.y1; page++)
+		{
+			uint8_t mask = PageMask(page, clip);
+			uint8_t *dest = _data + page * WIDTH;
+			int16_t row = int16_t(page * 8 - y);
+			for(int16_t column = clip.x0; column < clip.x1; column++)
+			{
+				uint8_t bits = GraphicsPrivate::ColumnBits<Reader>(bitmap + (column - x), width, pages, row);
+				dest[column] = Apply(dest[column], uint8_t(bits & mask), color);
+			}
+		}
+	}
+
+	uint8_t _data[WIDTH * ((HEIGHT + 7) / 8)];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template Rgb565FrameBuffer
+// 16bpp frame buffer, rows of RGB565 pixels in native byte order (display
+// drivers send the high byte first). Horizontal fills store two pixels
+// at a time, blits copy whole rows.
+////////////////////////////////////////////////////////////////////////////////
+
+template<unsigned WIDTH, unsigned HEIGHT>
+class Rgb565FrameBuffer :public Canvas<Rgb565FrameBuffer<WIDTH, HEIGHT>, uint16_t, WIDTH, HEIGHT>
+{
+	typedef Canvas<Rgb565FrameBuffer<WIDTH, HEIGHT>, uint16_t, WIDTH, HEIGHT> Base;
+	friend class Canvas<Rgb565FrameBuffer<WIDTH, HEIGHT>, uint16_t, WIDTH, HEIGHT>;
+public:
+	typedef uint16_t Color;
+
+	static Color Rgb(uint8_t red, uint8_t green, uint8_t blue)
+	{
+		return Color((red & 0xf8) << 8 | (green & 0xfc) << 3 | blue >> 3);
+	}
+
+	Rgb565FrameBuffer()
+	{
+		memset(_pixels, 0, sizeof(_pixels));
+	}
+
+	uint16_t *Data()
+	{
+		return _pixels;
+	}
+
+	const uint16_t *Data() const
+	{
+		return _pixels;
+	}
+
+	static size_t Size()
+	{
+		return WIDTH * HEIGHT;
+	}
+
+	const uint16_t *Row(unsigned y) const
+	{
+		return _pixels + y * WIDTH;
+	}
+
+	Color GetPixel(int16_t x, int16_t y) const
+	{
+		if(uint16_t(x) >= WIDTH || uint16_t(y) >= HEIGHT)
+			return 0;
+		return _pixels[y * WIDTH + x];
+	}
+
+	// Copies image of width x height pixels
+	void Blit(int16_t x, int16_t y, const uint16_t *image, int16_t width, int16_t height)
+	{
+		Rect clip = Base::Clip(x, y, width, height);
+		if(clip.IsEmpty())
+			return;
+		const uint16_t *src = image + (clip.y0 - y) * width + (clip.x0 - x);
+		for(int16_t row = clip.y0; row < clip.y1; row++, src += width)
+			memcpy(_pixels + row * WIDTH + clip.x0, src, size_t(clip.Width()) * sizeof(uint16_t));
+		Base::Invalidate(clip);
+	}
+
+private:
+	static void FillSpan(uint16_t *dest, int16_t count, Color color)
+	{
+		if(count && (uintptr_t(dest) & 2))
+		{
+			*dest++ = color;
+			count--;
+		}
+		uint32_t pair = color | uint32_t(color) << 16;
+		for(; count >= 2; count -= 2, dest += 2)
+			memcpy(dest, &pair, 4);
+		if(count)
+			*dest = color;
+	}
+
+	void Put(int16_t x, int16_t y, Color color)
+	{
+		_pixels[y * WIDTH + x] = color;
+	}
+
+	void Fill(const Rect &rect, Color color)
+	{
+		for(int16_t row = rect.y0; row < rect.y1; row++)
+			FillSpan(_pixels + row * WIDTH + rect.x0, rect.Width(), color);
+	}
+
+	template<class Reader>
+	void PutBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t width, int16_t height,
+		const Rect &clip, Color color)
+	{
+		int16_t pages = int16_t((height + 7) / 8);
+		for(int16_t column = clip.x0; column < clip.x1; column++)
+		{
+			const uint8_t *src = bitmap + (column - x);
+			uint16_t *dest = _pixels + column;
+			for(int16_t row = clip.y0; row < clip.y1; )
+			{
+				uint8_t bits = GraphicsPrivate::ColumnBits<Reader>(src, width, pages, int16_t(row - y));
+				for(uint8_t i = 0; i < 8 && row < clip.y1; i++, row++, bits >>= 1)
+					if(bits & 1)
+						dest[row * WIDTH] = color;
+			}
+		}
+	}
+
+	uint16_t _pixels[WIDTH * HEIGHT];
+};
@@ -0,0 +1,248 @@
+#pragma once
+#include <stdint.h>
+#include "ring_buffer.h"
+#include "atomic.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// class template CaptureMeter
+// Frequency, period and duty measurement on top of 16 bit timer input capture.
+// Interrupt side only timestamps edges: captures are extended to 32 bits with
+// software overflow counter and put to a ring buffer of SIZE edges.
+// Main loop calls Process, which drains the buffer and accumulates cycles
+// (rising to rising edge) into a measurement window. The window closes on the
+// first rising edge after 'gate' ticks, so:
+//	- slow signals (period >= gate) are measured by one period (reciprocal
+//	  method) and update every cycle;
+//	- fast signals are averaged over all cycles that fit the gate time, so
+//	  resolution grows with the number of cycles (gate time method), while
+//	  both window ends are still synchronized to signal edges.
+// Results are computed lazily when requested.
+//
+// Usage:
+//		CaptureMeter<16> meter(100000);		// 0.1 s gate at 1 MHz timer
+//		timer overflow ISR:		meter.OverflowHandler();
+//		timer capture ISR:		meter.CaptureHandler(CCR, pinIsHigh, overflowFlagIsSet);
+//		main loop:
+//			meter.Process();
+//			if(meter.IsUpdated())
+//				hz = meter.Frequency(TimerFreq);
+// Capture both edges to get duty, rising edges only are enough for frequency.
+////////////////////////////////////////////////////////////////////////////////
+
+template<int SIZE = 16>
+class CaptureMeter
+{
+public:
+	struct Edge
+	{
+		uint32_t time;
+		bool rising;
+		// edges were lost before this one
+		bool gap;
+	};
+
+	CaptureMeter(uint32_t gate)
+		:_gate(gate)
+	{
+		Reset();
+	}
+
+	void Reset()
+	{
+		ATOMIC
+		{
+			_overflows = 0;
+			_overrun = false;
+			_gapPending = false;
+			_edges.Clear();
+		}
+		_started = false;
+		_high = false;
+		_ready = false;
+		_updated = false;
+		_windowCycles = 0;
+		_windowHigh = 0;
+		_cycles = 0;
+		_span = 0;
+		_highTime = 0;
+	}
+
+	void SetGate(uint32_t gate)
+	{
+		_gate = gate;
+	}
+
+	// Call from timer overflow interrupt
+	void OverflowHandler()
+	{
+		_overflows++;
+	}
+
+	// Call from capture interrupt. 'overflowPending' is the timer overflow
+	// flag at the moment of capture interrupt: if it is set, the timer has
+	// wrapped but the overflow interrupt hasn't run yet, so captures from
+	// the lower half of the range belong to the next overflow period.
+	bool CaptureHandler(uint16_t capture, bool rising, bool overflowPending = false)
+	{
+		uint16_t overflows = _overflows;
+		if(overflowPending && capture < 0x8000)
+			overflows++;
+		Edge edge = {uint32_t(overflows) << 16 | capture, rising, _gapPending};
+		if(!_edges.Write(edge))
+		{
+			_overrun = true;
+			_gapPending = true;
+			return false;
+		}
+		_gapPending = false;
+		return true;
+	}
+
+	// Extended 32 bit timestamp of current counter value
+	uint32_t Now(uint16_t counter, bool overflowPending = false)
+	{
+		uint16_t overflows;
+		ATOMIC
+		{
+			overflows = _overflows;
+		}
+		if(overflowPending && counter < 0x8000)
+			overflows++;
+		return uint32_t(overflows) << 16 | counter;
+	}
+
+	// Call from main loop, processes captured edges. Edges queued before a
+	// ring overrun are accumulated, the first edge queued after it restarts
+	// the window, so no measurement spans lost edges.
+	void Process()
+	{
+		Edge edge;
+		while(_edges.Read(edge))
+			Accumulate(edge);
+	}
+
+	bool HasMeasurement()const
+	{
+		return _ready;
+	}
+
+	// Returns true once after each new measurement
+	bool IsUpdated()
+	{
+		bool updated = _updated;
+		_updated = false;
+		return updated;
+	}
+
+	// True if no rising edge came during last 'timeout' ticks
+	bool IsSignalLost(uint32_t now, uint32_t timeout)const
+	{
+		return !_started || now - _lastRising > timeout;
+	}
+
+	// Number of cycles in the last measurement window
+	uint32_t Cycles()const
+	{
+		return _cycles;
+	}
+
+	// Average period in timer ticks multiplied by 'scale'
+	uint32_t Period(uint32_t scale = 1)const
+	{
+		if(!_cycles)
+			return 0;
+		return uint32_t((uint64_t(_span) * scale + _cycles / 2) / _cycles);
+	}
+
+	// Frequency in Hz multiplied by 'scale', e.g. scale 1000 gives mHz
+	uint32_t Frequency(uint32_t timerFreq, uint32_t scale = 1)const
+	{
+		if(!_span)
+			return 0;
+		return uint32_t((uint64_t(timerFreq) * scale * _cycles + _span / 2) / _span);
+	}
+
+	// High time part of the period multiplied by 'scale', e.g. scale 1000 gives per mille
+	uint32_t Duty(uint32_t scale = 1000)const
+	{
+		if(!_span)
+			return 0;
+		return uint32_t((uint64_t(_highTime) * scale + _span / 2) / _span);
+	}
+
+	// True if edges were lost since the last ClearOverrun
+	bool IsOverrun()const
+	{
+		return _overrun;
+	}
+
+	void ClearOverrun()
+	{
+		_overrun = false;
+	}
+
+private:
+	void Accumulate(const Edge &edge)
+	{
+		if(edge.gap)
+		{
+			_started = false;
+			_high = false;
+		}
+		if(!edge.rising)
+		{
+			if(_high && _started)
+				_windowHigh += edge.time - _riseTime;
+			_high = false;
+			return;
+		}
+		if(!_started)
+		{
+			_started = true;
+			_windowStart = edge.time;
+			_windowCycles = 0;
+			_windowHigh = 0;
+		}
+		else
+		{
+			_windowCycles++;
+			uint32_t span = edge.time - _windowStart;
+			if(span >= _gate)
+			{
+				_cycles = _windowCycles;
+				_span = span;
+				_highTime = _windowHigh;
+				_ready = true;
+				_updated = true;
+				_windowStart = edge.time;
+				_windowCycles = 0;
+				_windowHigh = 0;
+			}
+		}
+		_lastRising = edge.time;
+		_riseTime = edge.time;
+		_high = true;
+	}
+
+	RingBuffer<SIZE, Edge> _edges;
+	volatile uint16_t _overflows;
+	volatile bool _overrun;
+	volatile bool _gapPending;
+	uint32_t _gate;
+
+	// window being accumulated
+	bool _started;
+	bool _high;
+	uint32_t _windowStart;
+	uint32_t _windowCycles;
+	uint32_t _windowHigh;
+	uint32_t _riseTime;
+	uint32_t _lastRising;
+
+	// last complete window
+	bool _ready;
+	bool _updated;
+	uint32_t _cycles;
+	uint32_t _span;
+	uint32_t _highTime;
+};
@@ -0,0 +1,289 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Intrusive linked lists.
+// Link fields live inside the objects themselves, so putting an object to a
+// queue never allocates and never copies. An object can be a member of several
+// lists at once if it derives from several nodes with different Tag types:
+//
+//		struct Rx; struct Tx;
+//		class Transfer :public ListNode<Transfer, Rx>, public ListNode<Transfer, Tx>
+//		{ ... };
+//		IntrusiveList<Transfer, Rx> rxQueue;
+//		IntrusiveList<Transfer, Tx> txQueue;
+//
+// Lists do not own their elements. An element must be removed from the list
+// before it is destroyed.
+////////////////////////////////////////////////////////////////////////////////
+
+struct DefaultListTag;
+
+template<class T, class Tag = DefaultListTag>
+class SListNode
+{
+	template<class, class> friend class IntrusiveSList;
+public:
+	SListNode()
+		:_next(0)
+	{}
+	inline T* Next()const
+	{
+		return _next;
+	}
+private:
+	T *_next;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template IntrusiveSList
+// Singly linked FIFO/LIFO list with O(1) PushFront, PushBack and PopFront.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T, class Tag = DefaultListTag>
+class IntrusiveSList
+{
+	typedef SListNode<T, Tag> Node;
+public:
+	IntrusiveSList()
+		:_head(0), _tail(0)
+	{}
+
+	void PushFront(T *item)
+	{
+		NodeOf(item)->_next = _head;
+		_head = item;
+		if(_tail == 0)
+			_tail = item;
+	}
+
+	void PushBack(T *item)
+	{
+		NodeOf(item)->_next = 0;
+		if(_tail)
+			NodeOf(_tail)->_next = item;
+		else
+			_head = item;
+		_tail = item;
+	}
+
+	T* PopFront()
+	{
+		T *item = _head;
+		if(item)
+		{
+			_head = NodeOf(item)->_next;
+			if(_head == 0)
+				_tail = 0;
+			NodeOf(item)->_next = 0;
+		}
+		return item;
+	}
+
+	// O(n), list is searched for previous element
+	bool Remove(T *item)
+	{
+		T *prev = 0;
+		for(T *current = _head; current; prev = current, current = NodeOf(current)->_next)
+		{
+			if(current == item)
+			{
+				T *next = NodeOf(item)->_next;
+				if(prev)
+					NodeOf(prev)->_next = next;
+				else
+					_head = next;
+				if(_tail == item)
+					_tail = prev;
+				NodeOf(item)->_next = 0;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline T* Front()const
+	{	return _head;	}
+
+	inline T* Back()const
+	{	return _tail;	}
+
+	static inline T* Next(const T *item)
+	{	return NodeOf(item)->_next;	}
+
+	inline bool IsEmpty()const
+	{	return _head == 0;	}
+
+	unsigned Count()const
+	{
+		unsigned result = 0;
+		for(T *current = _head; current; current = NodeOf(current)->_next)
+			result++;
+		return result;
+	}
+
+	inline void Clear()
+	{
+		_head = _tail = 0;
+	}
+
+private:
+	static inline Node* NodeOf(T *item)
+	{	return static_cast<Node*>(item);	}
+	static inline const Node* NodeOf(const T *item)
+	{	return static_cast<const Node*>(item);	}
+
+	T *_head;
+	T *_tail;
+};
+
+template<class T, class Tag = DefaultListTag>
+class ListNode
+{
+	template<class, class> friend class IntrusiveList;
+public:
+	ListNode()
+		:_next(0), _prev(0)
+	{}
+	inline T* Next()const
+	{	return _next;	}
+	inline T* Prev()const
+	{	return _prev;	}
+private:
+	T *_next;
+	T *_prev;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template IntrusiveList
+// Doubly linked list with O(1) insertion and removal at any position.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T, class Tag = DefaultListTag>
+class IntrusiveList
+{
+	typedef ListNode<T, Tag> Node;
+public:
+	IntrusiveList()
+		:_head(0), _tail(0)
+	{}
+
+	void PushFront(T *item)
+	{
+		Node *node = NodeOf(item);
+		node->_prev = 0;
+		node->_next = _head;
+		if(_head)
+			NodeOf(_head)->_prev = item;
+		else
+			_tail = item;
+		_head = item;
+	}
+
+	void PushBack(T *item)
+	{
+		Node *node = NodeOf(item);
+		node->_next = 0;
+		node->_prev = _tail;
+		if(_tail)
+			NodeOf(_tail)->_next = item;
+		else
+			_head = item;
+		_tail = item;
+	}
+
+	// Inserts item after position. Inserts to front if position is null.
+	void InsertAfter(T *position, T *item)
+	{
+		if(position == 0)
+		{
+			PushFront(item);
+			return;
+		}
+		Node *node = NodeOf(item);
+		Node *posNode = NodeOf(position);
+		node->_prev = position;
+		node->_next = posNode->_next;
+		if(posNode->_next)
+			NodeOf(posNode->_next)->_prev = item;
+		else
+			_tail = item;
+		posNode->_next = item;
+	}
+
+	// Inserts item before position. Inserts to back if position is null.
+	void InsertBefore(T *position, T *item)
+	{
+		if(position == 0)
+			PushBack(item);
+		else
+			InsertAfter(NodeOf(position)->_prev, item);
+	}
+
+	T* PopFront()
+	{
+		T *item = _head;
+		if(item)
+			Remove(item);
+		return item;
+	}
+
+	T* PopBack()
+	{
+		T *item = _tail;
+		if(item)
+			Remove(item);
+		return item;
+	}
+
+	// Item must be a member of this list.
+	void Remove(T *item)
+	{
+		Node *node = NodeOf(item);
+		if(node->_prev)
+			NodeOf(node->_prev)->_next = node->_next;
+		else
+			_head = node->_next;
+		if(node->_next)
+			NodeOf(node->_next)->_prev = node->_prev;
+		else
+			_tail = node->_prev;
+		node->_next = node->_prev = 0;
+	}
+
+	inline T* Front()const
+	{	return _head;	}
+
+	inline T* Back()const
+	{	return _tail;	}
+
+	static inline T* Next(const T *item)
+	{	return NodeOf(item)->_next;	}
+
+	static inline T* Prev(const T *item)
+	{	return NodeOf(item)->_prev;	}
+
+	inline bool IsEmpty()const
+	{	return _head == 0;	}
+
+	unsigned Count()const
+	{
+		unsigned result = 0;
+		for(T *current = _head; current; current = NodeOf(current)->_next)
+			result++;
+		return result;
+	}
+
+	inline void Clear()
+	{
+		_head = _tail = 0;
+	}
+
+private:
+	static inline Node* NodeOf(T *item)
+	{	return static_cast<Node*>(item);	}
+	static inline const Node* NodeOf(const T *item)
+	{	return static_cast<const Node*>(item);	}
+
+	T *_head;
+	T *_tail;
+};
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "static_assert.h"
+#include "ring_buffer.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// class template LogStore
+// Append-only log in BLOCKS blocks of a block device (SdCard, BlockCache,
+// SpiFlashBlocks) starting at FIRST_BLOCK, without a file system.
+//
+// Every block carries a 12 byte header: magic, payload length, sequence
+// number and a checksum of header and payload. Block with sequence number
+// N is stored at position N % BLOCKS, so the region is a circle of segments
+// of SEGMENT_BLOCKS blocks. When writing enters a segment, the old blocks in
+// it are dropped; at least BLOCKS - SEGMENT_BLOCKS newest blocks stay
+// readable. On NOR flash SEGMENT_BLOCKS should be a multiple of the sector.
+//
+// Segments are always written from their first block, and segments from 0
+// up to the newest one start with consecutive sequence numbers, later ones
+// hold older or invalid blocks. Within a segment the same holds for blocks.
+// So Mount finds the newest block by binary search over segments and then
+// over blocks of the newest segment, with O(log BLOCKS) block reads. A block
+// torn by power loss fails the checksum and the log ends before it.
+// As the rest of the newest segment may be damaged (and NOR flash can not be
+// rewritten without erase), writing after Mount continues from the next
+// segment; the skipped blocks are missing from the log.
+//
+// Append copies data into a ring buffer of BUFFER bytes (it is safe to call
+// from an interrupt handler while main loop calls Poll). Poll writes full
+// blocks, once there are at least BATCH_BLOCKS of them, in one multi-block
+// write. Flush writes the rest, including a partly filled block, and waits
+// for the device. Data still in RAM is lost on power loss; the first block
+// written after Mount is marked as restart, so readers know that the byte
+// stream is not continuous before it.
+// After a write error Poll and Flush fail until the log is mounted again.
+//
+// Usage:
+//		typedef LogStore<Card, 2048, 65536> Log;
+//		Log::Format();			// once
+//		Log::Mount();
+//		Log::Append(text, length);
+//		Log::Poll();			// from main loop
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Device, uint32_t FIRST_BLOCK, uint32_t BLOCKS, unsigned SEGMENT_BLOCKS = 8,
+	unsigned BUFFER = 2048, unsigned BATCH_BLOCKS = 2>
+class LogStore
+{
+public:
+	static const unsigned BlockSize = Device::BlockSize;
+	static const unsigned HeaderSize = 12;
+	static const unsigned PayloadSize = BlockSize - HeaderSize;
+
+	// Invalidates all blocks of the region
+	static bool Format()
+	{
+		memset(_block, 0, BlockSize);
+		for(uint32_t block = 0; block < BLOCKS; block += SEGMENT_BLOCKS)
+		{
+			if(!Device::WriteStart(FIRST_BLOCK + block, SEGMENT_BLOCKS))
+				return false;
+			for(unsigned i = 0; i < SEGMENT_BLOCKS; i++)
+				if(!Device::WriteNext(_block))
+					return false;
+			if(!Device::WriteStop())
+				return false;
+		}
+		_mounted = false;
+		return Device::Sync();
+	}
+
+	// Finds the newest block, buffered data is dropped
+	static bool Mount()
+	{
+		_buffer.Clear();
+		_mounted = false;
+		_restart = true;
+		_next = 0;
+		_oldest = 0;
+		_mountReads = 0;
+		bool valid;
+		uint32_t first;
+		uint32_t segment = 0;
+		if(!Probe(0, valid, first))
+			return false;
+		if(!valid)
+		{
+			// empty, or writing has wrapped and the first segment is damaged
+			segment = Segments - 1;
+			if(!Probe(segment * SEGMENT_BLOCKS, valid, first))
+				return false;
+			if(!valid)
+			{
+				_mounted = true;
+				return true;
+			}
+			first -= segment * SEGMENT_BLOCKS;
+		}
+		else if(!Search(0, Segments, SEGMENT_BLOCKS, first, segment))
+			return false;
+		uint32_t base = first + segment * SEGMENT_BLOCKS;
+		uint32_t block;
+		if(!Search(segment * SEGMENT_BLOCKS, SEGMENT_BLOCKS, 1, base, block))
+			return false;
+		SetNewest(base + block);
+		// continue from the next segment
+		_next = (_next + SEGMENT_BLOCKS - 1) / SEGMENT_BLOCKS * SEGMENT_BLOCKS;
+		_mounted = true;
+		return true;
+	}
+
+	// Returns number of bytes accepted
+	static size_t Append(const void *data, size_t length)
+	{
+		const uint8_t *src = static_cast<const uint8_t *>(data);
+		size_t i = 0;
+		while(i < length && _buffer.Write(src[i]))
+			i++;
+		return i;
+	}
+
+	static size_t Buffered()
+	{
+		return _buffer.IsFull() ? BUFFER : _buffer.Count();
+	}
+
+	// Writes full blocks when there are enough for a batch
+	static bool Poll()
+	{
+		uint32_t blocks = uint32_t(Buffered() / PayloadSize);
+		if(blocks < BATCH_BLOCKS)
+			return _mounted;
+		return WriteBlocks(blocks);
+	}
+
+	// Writes all buffered data and waits for the device
+	static bool Flush()
+	{
+		size_t buffered = Buffered();
+		uint32_t blocks = uint32_t((buffered + PayloadSize - 1) / PayloadSize);
+		return WriteBlocks(blocks) && Device::Sync();
+	}
+
+	// Sequence number of the oldest readable block
+	static uint32_t OldestSequence()
+	{
+		return _oldest;
+	}
+
+	// Sequence number the next block is written with
+	static uint32_t NextSequence()
+	{
+		return _next;
+	}
+
+	static bool IsEmpty()
+	{
+		return _next == _oldest;
+	}
+
+	// Reads payload (up to PayloadSize bytes) of a block.
+	// Returns false if the block is out of log or is damaged.
+	static bool ReadBlock(uint32_t sequence, void *payload, unsigned &length, bool &restart)
+	{
+		if(sequence - _oldest >= _next - _oldest)
+			return false;
+		bool valid;
+		uint32_t stored;
+		if(!Load(sequence % BLOCKS, valid, stored) || !valid || stored != sequence)
+			return false;
+		uint16_t word = Get16(_block + 2);
+		length = word & LengthMask;
+		restart = (word & RestartFlag) != 0;
+		memcpy(payload, _block + HeaderSize, length);
+		return true;
+	}
+
+	// Block reads done by the last Mount
+	static unsigned MountReads()
+	{
+		return _mountReads;
+	}
+
+private:
+	BOOST_STATIC_ASSERT(BLOCKS % SEGMENT_BLOCKS == 0 && BLOCKS >= 2 * SEGMENT_BLOCKS);
+	BOOST_STATIC_ASSERT(BUFFER >= BATCH_BLOCKS * (Device::BlockSize - 12));
+
+	static const uint32_t Segments = BLOCKS / SEGMENT_BLOCKS;
+	static const uint16_t RestartFlag = 0x8000;
+	static const uint16_t LengthMask = 0x7fff;
+
+	static void Put16(uint8_t *ptr, uint16_t value)
+	{
+		ptr[0] = uint8_t(value);
+		ptr[1] = uint8_t(value >> 8);
+	}
+
+	static uint16_t Get16(const uint8_t *ptr)
+	{
+		return uint16_t(ptr[0] | ptr[1] << 8);
+	}
+
+	static void Put32(uint8_t *ptr, uint32_t value)
+	{
+		Put16(ptr, uint16_t(value));
+		Put16(ptr + 2, uint16_t(value >> 16));
+	}
+
+	static uint32_t Get32(const uint8_t *ptr)
+	{
+		return Get16(ptr) | uint32_t(Get16(ptr + 2)) << 16;
+	}
+
+	// FNV-1a of header fields and used payload
+	static uint32_t Checksum(const uint8_t *block, unsigned length)
+	{
+		uint32_t hash = 2166136261u;
+		for(unsigned i = 0; i < 8; i++)
+			hash = (hash ^ block[i]) * 16777619u;
+		for(unsigned i = 0; i < length; i++)
+			hash = (hash ^ block[HeaderSize + i]) * 16777619u;
+		return hash;
+	}
+
+	static bool Probe(uint32_t position, bool &valid, uint32_t &sequence)
+	{
+		_mountReads++;
+		return Load(position, valid, sequence);
+	}
+
+	// Reads block at position into _block, returns false on device error
+	static bool Load(uint32_t position, bool &valid, uint32_t &sequence)
+	{
+		if(!Device::ReadBlocks(FIRST_BLOCK + position, _block, 1))
+			return false;
+		unsigned length = Get16(_block + 2) & LengthMask;
+		sequence = Get32(_block + 4);
+		valid = _block[0] == 'L' && _block[1] == 'g' && length <= PayloadSize &&
+			sequence % BLOCKS == position && Get32(_block + 8) == Checksum(_block, length);
+		return true;
+	}
+
+	// Finds the last of 'count' positions (start + index * step) holding
+	// sequence number base + index * step. Position 'start' is known to hold 'base'.
+	static bool Search(uint32_t start, uint32_t count, uint32_t step, uint32_t base, uint32_t &last)
+	{
+		uint32_t low = 0;
+		uint32_t high = count;
+		while(high - low > 1)
+		{
+			uint32_t middle = low + (high - low) / 2;
+			bool valid;
+			uint32_t sequence;
+			if(!Probe(start + middle * step, valid, sequence))
+				return false;
+			if(valid && sequence == base + middle * step)
+				low = middle;
+			else
+				high = middle;
+		}
+		last = low;
+		return true;
+	}
+
+	static void SetNewest(uint32_t sequence)
+	{
+		_next = sequence + 1;
+		// the segment after the newest block's one is the next to be dropped
+		uint32_t kept = sequence % BLOCKS % SEGMENT_BLOCKS + 1 + BLOCKS - SEGMENT_BLOCKS;
+		_oldest = _next > kept ? _next - kept : 0;
+	}
+
+	static void BuildBlock()
+	{
+		unsigned length = 0;
+		uint8_t value;
+		while(length < PayloadSize && _buffer.Read(value))
+			_block[HeaderSize + length++] = value;
+		memset(_block + HeaderSize + length, 0xff, PayloadSize - length);
+		_block[0] = 'L';
+		_block[1] = 'g';
+		Put16(_block + 2, uint16_t(length | (_restart ? RestartFlag : 0)));
+		Put32(_block + 4, _next);
+		Put32(_block + 8, Checksum(_block, length));
+		_restart = false;
+	}
+
+	static bool WriteBlocks(uint32_t count)
+	{
+		if(!_mounted)
+			return false;
+		while(count)
+		{
+			uint32_t position = _next % BLOCKS;
+			uint32_t run = count < BLOCKS - position ? count : BLOCKS - position;
+			if(!Device::WriteStart(FIRST_BLOCK + position, run))
+				return Fail();
+			for(uint32_t i = 0; i < run; i++)
+			{
+				BuildBlock();
+				if(!Device::WriteNext(_block))
+					return Fail();
+				SetNewest(_next);
+			}
+			if(!Device::WriteStop())
+				return Fail();
+			count -= run;
+		}
+		return true;
+	}
+
+	static bool Fail()
+	{
+		_mounted = false;
+		return false;
+	}
+
+	static RingBuffer<BUFFER, uint8_t> _buffer;
+	static uint8_t _block[Device::BlockSize];
+	static uint32_t _next;
+	static uint32_t _oldest;
+	static bool _restart;
+	static bool _mounted;
+	static unsigned _mountReads;
+};
+
+#define LOG_STORE_TEMPLATE_ARGS template<class Device, uint32_t FIRST_BLOCK, uint32_t BLOCKS, unsigned SEGMENT_BLOCKS, unsigned BUFFER, unsigned BATCH_BLOCKS>
+#define LOG_STORE_CLASS LogStore<Device, FIRST_BLOCK, BLOCKS, SEGMENT_BLOCKS, BUFFER, BATCH_BLOCKS>
+
+	LOG_STORE_TEMPLATE_ARGS
+	RingBuffer<BUFFER, uint8_t> LOG_STORE_CLASS::_buffer;
+
+	LOG_STORE_TEMPLATE_ARGS
+	uint8_t LOG_STORE_CLASS::_block[Device::BlockSize];
+
+	LOG_STORE_TEMPLATE_ARGS
+	uint32_t LOG_STORE_CLASS::_next;
+
+	LOG_STORE_TEMPLATE_ARGS
+	uint32_t LOG_STORE_CLASS::_oldest;
+
+	LOG_STORE_TEMPLATE_ARGS
+	bool LOG_STORE_CLASS::_restart;
+
+	LOG_STORE_TEMPLATE_ARGS
+	bool LOG_STORE_CLASS::_mounted;
+
+	LOG_STORE_TEMPLATE_ARGS
+	unsigned LOG_STORE_CLASS::_mountReads;
+
+#undef LOG_STORE_CLASS
+#undef LOG_STORE_TEMPLATE_ARGS
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic.h>
+#include <power.h>
+#include "loki/Typelist.h"
+
+namespace Power
+{
+	// Time source for LowPowerIdle that does not count sleep time
+	struct NoSleepClock
+	{
+		static uint32_t Counter()
+		{
+			return 0;
+		}
+	};
+
+	namespace Private
+	{
+		template<class Blockers>
+		struct SleepLimit;
+
+		template<>
+		struct SleepLimit<Loki::NullType>
+		{
+			static SleepMode Get(SleepMode mode)
+			{
+				return mode;
+			}
+		};
+
+		template<class Head, class Tail>
+		struct SleepLimit<Loki::Typelist<Head, Tail> >
+		{
+			static SleepMode Get(SleepMode mode)
+			{
+				SleepMode limit = Head::SleepLimit();
+				return SleepLimit<Tail>::Get(limit < mode ? limit : mode);
+			}
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// class template LowPowerIdle
+	// Idle policy for Dispatcher: puts the part to the deepest sleep mode the
+	// sleep blockers allow when there is no task ready.
+	// Blockers is a typelist of classes with static SleepMode SleepLimit()
+	// returning the deepest mode usable right now (Deepest when not blocking),
+	// e.g. Idle while USART transmits or ADC converts. Runtime blockers are
+	// taken with Block(mode) and released with Unblock(mode), they nest.
+	// Clock is a class with static uint32_t Counter() (TickCounter, HAL::Rtc)
+	// used to account time spent sleeping; it has to keep running in the
+	// modes used. On Cortex-M the waking interrupt is serviced after Sleep
+	// returns, so a counter advanced by it misses the last tick.
+	//
+	// Usage:
+	//		struct UsartBlocker
+	//		{
+	//			static Power::SleepMode SleepLimit()
+	//			{ return Usart::TxBusy() ? Power::Idle : Power::Deepest; }
+	//		};
+	//		typedef Power::LowPowerIdle<Loki::TL::MakeTypelist<UsartBlocker>::Result, Ticks> Idle;
+	//		typedef Dispatcher<8, 4, Idle> Disp;
+	//		for(;;) Disp::Poll();
+	////////////////////////////////////////////////////////////////////////////////
+
+	template<class Blockers = Loki::NullType, class Clock = NoSleepClock>
+	class LowPowerIdle
+	{
+	public:
+		static const bool Enabled = true;
+
+		// Limits sleep to mode or lighter until Unblock(mode)
+		static void Block(SleepMode mode)
+		{
+			ATOMIC
+			{
+				_blocks[mode]++;
+			}
+		}
+
+		static void Unblock(SleepMode mode)
+		{
+			ATOMIC
+			{
+				_blocks[mode]--;
+			}
+		}
+
+		// Deepest mode allowed by runtime and compile time blockers
+		static SleepMode AllowedMode()
+		{
+			SleepMode mode = Deepest;
+			for(unsigned i = 0; i < Deepest; i++)
+			{
+				if(_blocks[i])
+				{
+					mode = SleepMode(i);
+					break;
+				}
+			}
+			return Private::SleepLimit<Blockers>::Get(mode);
+		}
+
+		// Called by Dispatcher with interrupts disabled and no task ready
+		static void Sleep()
+		{
+			SleepMode mode = AllowedMode();
+			if(mode == NoSleep)
+				return;
+			uint32_t start = Clock::Counter();
+			Power::Sleep::Enter(mode);
+			_sleepTime += Clock::Counter() - start;
+			_sleeps++;
+		}
+
+		// Clock counts spent sleeping
+		static uint32_t SleepTime()
+		{
+			uint32_t time;
+			ATOMIC
+			{
+				time = _sleepTime;
+			}
+			return time;
+		}
+
+		static uint32_t Sleeps()
+		{
+			uint32_t sleeps;
+			ATOMIC
+			{
+				sleeps = _sleeps;
+			}
+			return sleeps;
+		}
+
+		static void ResetStatistics()
+		{
+			ATOMIC
+			{
+				_sleepTime = 0;
+				_sleeps = 0;
+			}
+		}
+
+	private:
+		static uint8_t _blocks[Deepest + 1];
+		static uint32_t _sleepTime;
+		static uint32_t _sleeps;
+	};
+
+	template<class Blockers, class Clock>
+	uint8_t LowPowerIdle<Blockers, Clock>::_blocks[Deepest + 1];
+
+	template<class Blockers, class Clock>
+	uint32_t LowPowerIdle<Blockers, Clock>::_sleepTime;
+
+	template<class Blockers, class Clock>
+	uint32_t LowPowerIdle<Blockers, Clock>::_sleeps;
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "static_assert.h"
+#include "select_size.h"
+
+template<class T>
+struct Less
+{
+	inline bool operator()(const T &a, const T &b)const
+	{
+		return a < b;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template PriorityQueue
+// Fixed capacity binary min-heap. Top is the element for which Compare returns
+// true against all the others, i.e. the smallest one with default Less.
+// Push and Pop are O(log n), Top is O(1).
+// For deadline scheduling on free running tick counters use Timers::TickLess
+// (timer_utils.h) or a functor built on Timers::TickBefore as Compare.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T, unsigned SIZE, class Compare = Less<T> >
+class PriorityQueue
+{
+public:
+	typedef typename SelectSizeForLength<SIZE>::Result INDEX_T;
+
+	PriorityQueue()
+		:_count(0)
+	{}
+
+	bool Push(const T &value)
+	{
+		if(IsFull())
+			return false;
+		INDEX_T i = _count++;
+		while(i > 0)
+		{
+			INDEX_T parent = (i - 1) / 2;
+			if(!_compare(value, _data[parent]))
+				break;
+			_data[i] = _data[parent];
+			i = parent;
+		}
+		_data[i] = value;
+		return true;
+	}
+
+	bool Pop(T &value)
+	{
+		if(IsEmpty())
+			return false;
+		value = _data[0];
+		Pop();
+		return true;
+	}
+
+	void Pop()
+	{
+		if(IsEmpty())
+			return;
+		--_count;
+		if(_count)
+			SiftDown(0, _data[_count]);
+	}
+
+	inline const T& Top()const
+	{
+		return _data[0];
+	}
+
+	inline bool IsEmpty()const
+	{	return _count == 0;	}
+
+	inline bool IsFull()const
+	{	return _count == SIZE;	}
+
+	inline INDEX_T Count()const
+	{	return _count;	}
+
+	inline void Clear()
+	{	_count = 0;	}
+
+	inline unsigned Size()const
+	{return SIZE;}
+
+private:
+	void SiftDown(INDEX_T i, const T value)
+	{
+		INDEX_T half = _count / 2;
+		while(i < half)
+		{
+			INDEX_T child = 2 * i + 1;
+			if(child + 1 < _count && _compare(_data[child + 1], _data[child]))
+				child++;
+			if(!_compare(_data[child], value))
+				break;
+			_data[i] = _data[child];
+			i = child;
+		}
+		_data[i] = value;
+	}
+
+	BOOST_STATIC_ASSERT(SIZE > 0);
+	T _data[SIZE];
+	INDEX_T _count;
+	Compare _compare;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class template IndexedPriorityQueue
+// Binary min-heap where each element is addressed by a handle returned from
+// Push. Handles stay valid while the element is in the queue, so the element
+// can be updated (decrease or increase key) or removed in O(log n).
+// This is what timer services need to reschedule or cancel timers.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T, unsigned SIZE, class Compare = Less<T> >
+class IndexedPriorityQueue
+{
+public:
+	typedef typename SelectSizeForLength<SIZE + 1>::Result Handle;
+	static const Handle InvalidHandle = SIZE;
+
+	IndexedPriorityQueue()
+	{
+		Clear();
+	}
+
+	void Clear()
+	{
+		_count = 0;
+		for(Handle i = 0; i < SIZE; i++)
+		{
+			_position[i] = InvalidHandle;
+			_freeHandles[i] = Handle(SIZE - 1 - i);
+		}
+	}
+
+	// Returns handle of inserted element or InvalidHandle if queue is full
+	Handle Push(const T &value)
+	{
+		if(IsFull())
+			return InvalidHandle;
+		Handle handle = _freeHandles[SIZE - 1 - _count];
+		_values[handle] = value;
+		Handle i = _count++;
+		_heap[i] = handle;
+		_position[handle] = i;
+		SiftUp(i);
+		return handle;
+	}
+
+	bool Pop(T &value)
+	{
+		if(IsEmpty())
+			return false;
+		value = _values[_heap[0]];
+		RemoveAt(0);
+		return true;
+	}
+
+	void Pop()
+	{
+		if(!IsEmpty())
+			RemoveAt(0);
+	}
+
+	inline const T& Top()const
+	{
+		return _values[_heap[0]];
+	}
+
+	inline Handle TopHandle()const
+	{
+		return IsEmpty() ? InvalidHandle : _heap[0];
+	}
+
+	inline bool Contains(Handle handle)const
+	{
+		return handle < SIZE && _position[handle] != InvalidHandle;
+	}
+
+	inline const T& Get(Handle handle)const
+	{
+		return _values[handle];
+	}
+
+	// Changes element value and restores heap order.
+	bool Update(Handle handle, const T &value)
+	{
+		if(!Contains(handle))
+			return false;
+		Handle i = _position[handle];
+		bool up = _compare(value, _values[handle]);
+		_values[handle] = value;
+		if(up)
+			SiftUp(i);
+		else
+			SiftDown(i);
+		return true;
+	}
+
+	bool Remove(Handle handle)
+	{
+		if(!Contains(handle))
+			return false;
+		RemoveAt(_position[handle]);
+		return true;
+	}
+
+	inline bool IsEmpty()const
+	{	return _count == 0;	}
+
+	inline bool IsFull()const
+	{	return _count == SIZE;	}
+
+	inline Handle Count()const
+	{	return _count;	}
+
+	inline unsigned Size()const
+	{return SIZE;}
+
+private:
+	void RemoveAt(Handle i)
+	{
+		Handle handle = _heap[i];
+		_position[handle] = InvalidHandle;
+		_freeHandles[SIZE - _count] = handle;
+		--_count;
+		if(i == _count)
+			return;
+		Place(i, _heap[_count]);
+		if(i > 0 && _compare(_values[_heap[i]], _values[_heap[(i - 1) / 2]]))
+			SiftUp(i);
+		else
+			SiftDown(i);
+	}
+
+	inline void Place(Handle i, Handle handle)
+	{
+		_heap[i] = handle;
+		_position[handle] = i;
+	}
+
+	void SiftUp(Handle i)
+	{
+		Handle handle = _heap[i];
+		while(i > 0)
+		{
+			Handle parent = (i - 1) / 2;
+			if(!_compare(_values[handle], _values[_heap[parent]]))
+				break;
+			Place(i, _heap[parent]);
+			i = parent;
+		}
+		Place(i, handle);
+	}
+
+	void SiftDown(Handle i)
+	{
+		Handle handle = _heap[i];
+		Handle half = _count / 2;
+		while(i < half)
+		{
+			Handle child = 2 * i + 1;
+			if(child + 1 < _count && _compare(_values[_heap[child + 1]], _values[_heap[child]]))
+				child++;
+			if(!_compare(_values[_heap[child]], _values[handle]))
+				break;
+			Place(i, _heap[child]);
+			i = child;
+		}
+		Place(i, handle);
+	}
+
+	BOOST_STATIC_ASSERT(SIZE > 0);
+	T _values[SIZE];
+	Handle _heap[SIZE];
+	Handle _position[SIZE];
+	// stack of unused handles, top is at SIZE - 1 - _count
+	Handle _freeHandles[SIZE];
+	Handle _count;
+	Compare _compare;
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "static_assert.h"
+#include "select_size.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// class template RecordRing
+// Ring buffer of variable length records. Every record is stored contiguously
+// behind a LENGTH_T length prefix, so it can be filled and processed in place:
+//   producer: Reserve -> fill -> Commit  (or Write to copy)
+//   consumer: Peek -> process -> Release (or Read to copy)
+// When a record does not fit into the space left before the end of buffer,
+// the tail is marked as padding and the record is placed at the beginning.
+// Safe for a single producer and a single consumer running in different
+// contexts (e.g. ISR and main loop) without locking: the producer only writes
+// _write, the consumer only writes _read.
+// SIZE must be a power of 2. On 8-bit targets keep SIZE <= 128, so that
+// indices are single byte and are read atomically.
+////////////////////////////////////////////////////////////////////////////////
+
+template<unsigned SIZE, class LENGTH_T = uint8_t>
+class RecordRing
+{
+public:
+	typedef typename SelectSizeForLength<SIZE>::Result INDEX_T;
+	typedef LENGTH_T LengthType;
+
+	static const unsigned HeaderSize = sizeof(LENGTH_T);
+private:
+	static const LENGTH_T PadMarker = LENGTH_T(~LENGTH_T(0));
+	static const unsigned HalfSizeLimit = SIZE / 2 - HeaderSize;
+public:
+	// Any record up to this length can be written to empty buffer
+	static const unsigned MaxRecordLength = HalfSizeLimit < PadMarker ? HalfSizeLimit : PadMarker - 1;
+
+	RecordRing()
+	{
+		Clear();
+	}
+
+	// Producer side.
+	// Returns pointer to 'length' bytes of contiguous space for a new record,
+	// or null pointer if there is not enough free space.
+	uint8_t* Reserve(LENGTH_T length)
+	{
+		if(length > MaxRecordLength)
+			return 0;
+		INDEX_T write = _write;
+		unsigned used = INDEX_T(write - _read);
+		unsigned offset = write & Mask;
+		unsigned tail = SIZE - offset;
+		unsigned need = Align(HeaderSize + length);
+		_pad = 0;
+		if(need > tail)
+		{
+			_pad = INDEX_T(tail);
+			offset = 0;
+		}
+		if(used + _pad + need > SIZE)
+			return 0;
+		_reserved = length;
+		_reserving = true;
+		return &_data.bytes[offset + HeaderSize];
+	}
+
+	// Publishes the record obtained by Reserve. 'length' may be less than reserved.
+	bool Commit(LENGTH_T length)
+	{
+		if(!_reserving || length > _reserved)
+			return false;
+		INDEX_T write = _write;
+		if(_pad)
+		{
+			Header(write & Mask) = PadMarker;
+			write += _pad;
+		}
+		Header(write & Mask) = length;
+		_reserving = false;
+		Barrier();
+		_write = INDEX_T(write + Align(HeaderSize + length));
+		return true;
+	}
+
+	bool Write(const void *data, LENGTH_T length)
+	{
+		uint8_t *ptr = Reserve(length);
+		if(!ptr)
+			return false;
+		if(length)
+			memcpy(ptr, data, length);
+		return Commit(length);
+	}
+
+	// Consumer side.
+	// Returns pointer to the oldest record and its length, or null pointer
+	// if the buffer is empty. The record stays in buffer until Release.
+	const uint8_t* Peek(LENGTH_T &length)
+	{
+		INDEX_T read = _read;
+		if(read == _write)
+			return 0;
+		Barrier();
+		unsigned offset = read & Mask;
+		length = Header(offset);
+		if(length == PadMarker)
+		{
+			_read = INDEX_T(read + SIZE - offset);
+			offset = 0;
+			length = Header(0);
+		}
+		return &_data.bytes[offset + HeaderSize];
+	}
+
+	// Removes the record returned by the last successful Peek.
+	void Release()
+	{
+		INDEX_T read = _read;
+		LENGTH_T length = Header(read & Mask);
+		Barrier();
+		_read = INDEX_T(read + Align(HeaderSize + length));
+	}
+
+	// Copies the oldest record to buffer. 'length' holds the buffer size on input
+	// and the record length on output. If the record does not fit into buffer
+	// it is left in the ring and false is returned.
+	bool Read(void *buffer, LENGTH_T &length)
+	{
+		LENGTH_T recordLength;
+		const uint8_t *ptr = Peek(recordLength);
+		if(!ptr || recordLength > length)
+			return false;
+		memcpy(buffer, ptr, recordLength);
+		length = recordLength;
+		Release();
+		return true;
+	}
+
+	inline bool IsEmpty()const
+	{
+		return _read == _write;
+	}
+
+	// Number of bytes occupied by records including headers and padding
+	inline unsigned BytesUsed()const
+	{
+		return INDEX_T(_write - _read);
+	}
+
+	// Must not be called while producer or consumer are active
+	inline void Clear()
+	{
+		_read = 0;
+		_write = 0;
+		_pad = 0;
+		_reserving = false;
+	}
+
+	inline unsigned Size()const
+	{return SIZE;}
+
+private:
+	static const unsigned Mask = SIZE - 1;
+
+	static inline unsigned Align(unsigned size)
+	{
+		return (size + HeaderSize - 1) & ~(HeaderSize - 1);
+	}
+
+	// keeps compiler from moving data accesses across index updates
+	static inline void Barrier()
+	{
+#if defined(__GNUC__)
+		__asm__ __volatile__("" ::: "memory");
+#endif
+	}
+
+	inline LENGTH_T& Header(unsigned offset)
+	{
+		return *reinterpret_cast<LENGTH_T*>(&_data.bytes[offset]);
+	}
+
+	BOOST_STATIC_ASSERT((SIZE & (SIZE - 1)) == 0);//SIZE must be a power of 2
+	BOOST_STATIC_ASSERT(SIZE >= 4 * sizeof(LENGTH_T));
+	union
+	{
+		uint8_t bytes[SIZE];
+		LENGTH_T align;
+	} _data;
+	volatile INDEX_T _read;
+	volatile INDEX_T _write;
+	// producer private state between Reserve and Commit
+	INDEX_T _pad;
+	LENGTH_T _reserved;
+	bool _reserving;
+};
@@ -0,0 +1,468 @@
+#pragma once
+
+#include <stdint.h>
+#include "loki/Typelist.h"
+#include "loki/TypeManip.h"
+#include "static_assert.h"
+#include "containers.h"
+#include "atomic.h"
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define HSM_FLASH PROGMEM
+#else
+#define HSM_FLASH
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Hierarchical state machine with compile time transition tables.
+//
+// States are types derived from Hsm::State<Parent, Initial>. Composite states
+// name their initial substate, leaf states leave it NullType. Entry and exit
+// actions are optional static functions taking the machine by reference:
+//
+//   struct Off;
+//   struct Powered : Hsm::State<Hsm::TopState, Off>
+//   {	static void Entry(Radio &radio);	};
+//   struct Off : Hsm::State<Powered> {};
+//   struct Rx : Hsm::State<Powered>
+//   {	static void Exit(Radio &radio);	};
+//
+// Transitions form a typelist:
+//   typedef Loki::Typelist<Hsm::Transition<Off, EvStart, Rx, StartAction>,
+//           Loki::Typelist<Hsm::Transition<Powered, EvReset, Off>,
+//           NullType> > Table;
+//
+// The machine derives from StateMachine:
+//   class Radio :public Hsm::StateMachine<Radio, Table, Powered> {...};
+//
+// For every state a row of MaxEvents handlers is generated at compile time
+// and placed in flash. Each handler already knows the current state, the
+// state owning the transition, the target and the initial substates to enter,
+// so the exit/entry sequence is fully inlined. Events not handled by a state
+// are passed to its parent at compile time, so Dispatch is a single table
+// lookup and indirect call. Guarded transitions whose guard fails fall back
+// to the parent state's transition for the same event.
+// Transition semantics:
+//  - external (default): exit up to the lowest common proper ancestor of
+//    source and target, run action, enter down to target and its initial
+//    substates. Self transitions exit and re-enter the source, transitions
+//    to own substates do not exit the source.
+//  - internal (target is Hsm::Internal): only the action runs.
+////////////////////////////////////////////////////////////////////////////////
+
+namespace Hsm
+{
+	using Loki::NullType;
+
+	// Event ids must be less than MaxEvents
+	enum {MaxEvents = 16};
+
+	struct TopState
+	{
+		typedef NullType Parent;
+		typedef NullType Initial;
+	};
+
+	template<class ParentT = TopState, class InitialT = NullType>
+	struct State
+	{
+		typedef ParentT Parent;
+		typedef InitialT Initial;
+
+		template<class Machine>
+		static void Entry(Machine &)
+		{}
+
+		template<class Machine>
+		static void Exit(Machine &)
+		{}
+	};
+
+	// Transition target meaning internal transition
+	struct Internal {};
+
+	struct NoAction
+	{
+		template<class Machine>
+		static void Run(Machine &)
+		{}
+	};
+
+	struct NoGuard
+	{
+		template<class Machine>
+		static bool Check(Machine &)
+		{return true;}
+	};
+
+	template<class SourceT, unsigned EventId, class TargetT, class ActionT = NoAction, class GuardT = NoGuard>
+	struct Transition
+	{
+		typedef SourceT Source;
+		typedef TargetT Target;
+		typedef ActionT Action;
+		typedef GuardT Guard;
+		static const unsigned Event = EventId;
+		BOOST_STATIC_ASSERT(EventId < MaxEvents);
+	};
+
+	template<class Machine>
+	struct StateDescriptor
+	{
+		typedef bool (*Handler)(Machine &machine);
+		typedef const StateDescriptor* (*ParentFunc)();
+		Handler handlers[MaxEvents];
+		ParentFunc parent;
+	};
+
+	namespace Private
+	{
+		template<class A, class S>
+		struct IsProperAncestor
+		{
+			static const bool value = Loki::IsSameType<A, typename S::Parent>::value ||
+				IsProperAncestor<A, typename S::Parent>::value;
+		};
+
+		template<class A>
+		struct IsProperAncestor<A, NullType>
+		{
+			static const bool value = false;
+		};
+
+		// Lowest of Source and its ancestors that is a proper ancestor of Target
+		template<class A, class Target>
+		struct Domain
+		{
+			typedef typename Loki::Select<IsProperAncestor<A, Target>::value,
+				A,
+				typename Domain<typename A::Parent, Target>::Result>::Result Result;
+		};
+
+		template<class Target>
+		struct Domain<NullType, Target>
+		{
+			typedef NullType Result;
+		};
+
+		// Leaf state reached by following initial substates
+		template<class S, class Initial = typename S::Initial>
+		struct Leaf
+		{
+			typedef typename Leaf<Initial>::Result Result;
+		};
+
+		template<class S>
+		struct Leaf<S, NullType>
+		{
+			typedef S Result;
+		};
+
+		// Exits states from S up to Domain, not including Domain
+		template<class S, class DomainT>
+		struct ExitTo
+		{
+			template<class Machine>
+			static void Run(Machine &machine)
+			{
+				S::Exit(machine);
+				ExitTo<typename S::Parent, DomainT>::Run(machine);
+			}
+		};
+
+		template<class DomainT>
+		struct ExitTo<DomainT, DomainT>
+		{
+			template<class Machine>
+			static void Run(Machine &)
+			{}
+		};
+
+		// Enters states from Domain down to S, not including Domain
+		template<class DomainT, class S>
+		struct EnterFrom
+		{
+			template<class Machine>
+			static void Run(Machine &machine)
+			{
+				EnterFrom<DomainT, typename S::Parent>::Run(machine);
+				S::Entry(machine);
+			}
+		};
+
+		template<class DomainT>
+		struct EnterFrom<DomainT, DomainT>
+		{
+			template<class Machine>
+			static void Run(Machine &)
+			{}
+		};
+
+		// Enters initial substates of S down to its leaf
+		template<class S, class Initial = typename S::Initial>
+		struct EnterInitial
+		{
+			template<class Machine>
+			static void Run(Machine &machine)
+			{
+				Initial::Entry(machine);
+				EnterInitial<Initial>::Run(machine);
+			}
+		};
+
+		template<class S>
+		struct EnterInitial<S, NullType>
+		{
+			template<class Machine>
+			static void Run(Machine &)
+			{}
+		};
+
+		template<class Table, class S, unsigned Event>
+		struct FindTransition;
+
+		template<class S, unsigned Event>
+		struct FindTransition<NullType, S, Event>
+		{
+			typedef NullType Result;
+		};
+
+		template<class Head, class Tail, class S, unsigned Event>
+		struct FindTransition<Loki::Typelist<Head, Tail>, S, Event>
+		{
+			static const bool Match = Loki::IsSameType<typename Head::Source, S>::value && Head::Event == Event;
+			typedef typename Loki::Select<Match,
+				Head,
+				typename FindTransition<Tail, S, Event>::Result>::Result Result;
+		};
+
+		template<class Machine, class Current, class Trans, class Target = typename Trans::Target>
+		struct Execute
+		{
+			typedef typename Domain<typename Trans::Source, Target>::Result DomainT;
+			typedef typename Leaf<Target>::Result NewState;
+
+			static void Run(Machine &machine)
+			{
+				ExitTo<Current, DomainT>::Run(machine);
+				Trans::Action::Run(machine);
+				EnterFrom<DomainT, Target>::Run(machine);
+				EnterInitial<Target>::Run(machine);
+				machine.template SetState<NewState>();
+			}
+		};
+
+		template<class Machine, class Current, class Trans>
+		struct Execute<Machine, Current, Trans, Internal>
+		{
+			static void Run(Machine &machine)
+			{
+				Trans::Action::Run(machine);
+			}
+		};
+
+		// Handles Event in state Current looking for transition in S and its parents
+		template<class Machine, class Table, class Current, class S, unsigned Event,
+			class Trans = typename FindTransition<Table, S, Event>::Result>
+		struct EventHandler
+		{
+			typedef EventHandler<Machine, Table, Current, typename S::Parent, Event> ParentHandler;
+			static const bool Handled = true;
+
+			static bool Run(Machine &machine)
+			{
+				if(!Trans::Guard::Check(machine))
+					return ParentHandler::Run(machine);
+				Execute<Machine, Current, Trans>::Run(machine);
+				return true;
+			}
+		};
+
+		template<class Machine, class Table, class Current, class S, unsigned Event>
+		struct EventHandler<Machine, Table, Current, S, Event, NullType>
+		{
+			typedef EventHandler<Machine, Table, Current, typename S::Parent, Event> ParentHandler;
+			static const bool Handled = ParentHandler::Handled;
+
+			static bool Run(Machine &machine)
+			{
+				return ParentHandler::Run(machine);
+			}
+		};
+
+		template<class Machine, class Table, class Current, unsigned Event>
+		struct EventHandler<Machine, Table, Current, NullType, Event, NullType>
+		{
+			static const bool Handled = false;
+
+			static bool Run(Machine &)
+			{
+				return false;
+			}
+		};
+
+		template<class Machine, class Table, class S>
+		struct StateInfo
+		{
+			static const StateDescriptor<Machine> descriptor;
+
+			static const StateDescriptor<Machine>* Parent()
+			{
+				return StateInfo<Machine, Table, typename S::Parent>::Self();
+			}
+
+			static const StateDescriptor<Machine>* Self()
+			{
+				return &descriptor;
+			}
+		};
+
+		template<class Machine, class Table>
+		struct StateInfo<Machine, Table, TopState>
+		{
+			static const StateDescriptor<Machine>* Self()
+			{
+				return 0;
+			}
+		};
+
+#define HSM_HANDLER(EVENT) EventHandler<Machine, Table, S, S, EVENT>::Handled ? \
+			&EventHandler<Machine, Table, S, S, EVENT>::Run : 0
+
+		template<class Machine, class Table, class S>
+		const StateDescriptor<Machine> StateInfo<Machine, Table, S>::descriptor HSM_FLASH =
+		{
+			{
+				HSM_HANDLER(0), HSM_HANDLER(1), HSM_HANDLER(2), HSM_HANDLER(3),
+				HSM_HANDLER(4), HSM_HANDLER(5), HSM_HANDLER(6), HSM_HANDLER(7),
+				HSM_HANDLER(8), HSM_HANDLER(9), HSM_HANDLER(10), HSM_HANDLER(11),
+				HSM_HANDLER(12), HSM_HANDLER(13), HSM_HANDLER(14), HSM_HANDLER(15)
+			},
+			&StateInfo<Machine, Table, S>::Parent
+		};
+
+#undef HSM_HANDLER
+
+#if defined(__AVR__)
+		template<class T>
+		inline T ReadFlashPtr(const T *ptr)
+		{
+			return (T)pgm_read_word(ptr);
+		}
+#else
+		template<class T>
+		inline T ReadFlashPtr(const T *ptr)
+		{
+			return *ptr;
+		}
+#endif
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// class template StateMachine
+	// Base class for state machines. Derived is the machine class itself,
+	// Table is a typelist of Transition, InitialState is entered by Start.
+	////////////////////////////////////////////////////////////////////////////////
+	template<class Derived, class Table, class InitialState>
+	class StateMachine
+	{
+		typedef StateDescriptor<Derived> Descriptor;
+		typedef typename Descriptor::Handler Handler;
+	public:
+		StateMachine()
+			:_state(0)
+		{}
+
+		// Enters initial state and its initial substates
+		void Start()
+		{
+			Derived &machine = static_cast<Derived&>(*this);
+			Private::EnterFrom<TopState, InitialState>::Run(machine);
+			Private::EnterInitial<InitialState>::Run(machine);
+			SetState<typename Private::Leaf<InitialState>::Result>();
+		}
+
+		// Returns false if the event was not handled in current state
+		bool Dispatch(unsigned event)
+		{
+			if(!_state || event >= MaxEvents)
+				return false;
+			Handler handler = Private::ReadFlashPtr(&_state->handlers[event]);
+			if(!handler)
+				return false;
+			return handler(static_cast<Derived&>(*this));
+		}
+
+		// True if current state is S or its substate
+		template<class S>
+		bool IsIn()const
+		{
+			const Descriptor *target = Private::StateInfo<Derived, Table, S>::Self();
+			for(const Descriptor *state = _state; state; state = Private::ReadFlashPtr(&state->parent)())
+			{
+				if(state == target)
+					return true;
+			}
+			return false;
+		}
+
+		// Transitions use this to set the new leaf state
+		template<class S>
+		void SetState()
+		{
+			_state = Private::StateInfo<Derived, Table, S>::Self();
+		}
+	private:
+		const Descriptor *_state;
+	};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class template HsmEventQueue
+// Delivers events to a statically allocated state machine through Dispatcher.
+// Post may be called from interrupts: each posted event schedules one
+// dispatcher task, which dispatches one event, so machines run to completion
+// and other tasks are not starved by event bursts.
+// SIZE must be a power of 2.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Machine, Machine &machine, class DispatcherT, int SIZE = 8>
+class HsmEventQueue
+{
+public:
+	// Returns false if the event queue or the dispatcher task queue is full
+	static bool Post(uint8_t event)
+	{
+		ATOMIC
+		{
+			if(_events.IsFull() || !DispatcherT::SetTask(&Process))
+				return false;
+			_events.Write(event);
+		}
+		return true;
+	}
+
+	static void Process()
+	{
+		uint8_t event;
+		bool result;
+		ATOMIC
+		{
+			result = _events.Read(event);
+		}
+		if(result)
+			machine.Dispatch(event);
+	}
+
+	static bool IsEmpty()
+	{
+		return _events.IsEmpty();
+	}
+
+private:
+	static Queue<SIZE, uint8_t> _events;
+};
+
+template<class Machine, Machine &machine, class DispatcherT, int SIZE>
+Queue<SIZE, uint8_t> HsmEventQueue<Machine, machine, DispatcherT, SIZE>::_events;
@@ -0,0 +1,458 @@
+#pragma once
+
+#include <stdint.h>
+#include "static_assert.h"
+#include "template_utils.h"
+#include "bitset.h"
+#include "loki/Typelist.h"
+#include "loki/TypeManip.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Default hash policy for integral keys.
+// Returns the key itself, StaticHashMap spreads it with multiplicative hashing.
+// Provide your own policy with static Hash(key) member for other key types.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class K>
+struct DefaultHash
+{
+	static inline uint32_t Hash(const K &key)
+	{
+		return (uint32_t)key;
+	}
+};
+
+namespace HashPrivate
+{
+	// Knuth's multiplicative constant, 2^32 / golden ratio
+	static const uint32_t FibonacciMultiplier = 0x9E3779B1ul;
+
+	// Number of address bits for table with at least 'slots' entries
+	template<unsigned long slots>
+	struct SlotBits
+	{
+		static const unsigned value = Util::Log<slots - 1, 2>::value + 1;
+	};
+
+	template<>
+	struct SlotBits<1>
+	{
+		static const unsigned value = 1;
+	};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class template StaticHashMap
+// Fixed capacity open addressing hash map with linear probing.
+// Up to SIZE elements can be stored. Table has a power of 2 slots with load
+// factor not exceeding 0.8, so there is always an empty slot to stop probing.
+// Removal uses backward shift of the following cluster members, so there are no
+// tombstones and lookup cost does not degrade after many insert/remove cycles.
+// K and V must be default constructible and assignable.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class K, class V, unsigned SIZE, class HashPolicy = DefaultHash<K> >
+class StaticHashMap
+{
+public:
+	static const unsigned Bits = HashPrivate::SlotBits<SIZE + SIZE / 4 + 1>::value;
+	static const unsigned Slots = 1u << Bits;
+	typedef typename SelectSizeForLength<Slots>::Result INDEX_T;
+
+	StaticHashMap()
+		:_count(0)
+	{}
+
+	// Inserts new or updates existing value.
+	// Returns false if map is full and key is not present.
+	bool Insert(const K &key, const V &value)
+	{
+		INDEX_T slot = Home(key);
+		while(_used.Test(slot))
+		{
+			if(_keys[slot] == key)
+			{
+				_values[slot] = value;
+				return true;
+			}
+			slot = Next(slot);
+		}
+		if(_count >= SIZE)
+			return false;
+		_used.Set(slot);
+		_keys[slot] = key;
+		_values[slot] = value;
+		_count++;
+		return true;
+	}
+
+	// Returns pointer to value or null if key is not present
+	V* Find(const K &key)
+	{
+		INDEX_T slot = Lookup(key);
+		return slot != NotFound ? &_values[slot] : 0;
+	}
+
+	const V* Find(const K &key)const
+	{
+		INDEX_T slot = Lookup(key);
+		return slot != NotFound ? &_values[slot] : 0;
+	}
+
+	inline bool Contains(const K &key)const
+	{
+		return Lookup(key) != NotFound;
+	}
+
+	bool Remove(const K &key)
+	{
+		INDEX_T hole = Lookup(key);
+		if(hole == NotFound)
+			return false;
+
+		// shift back following elements of the cluster that are allowed to move
+		for(INDEX_T slot = Next(hole); _used.Test(slot); slot = Next(slot))
+		{
+			INDEX_T home = Home(_keys[slot]);
+			// element can fill the hole if its home is not between hole and slot
+			if(INDEX_T((slot - home) & Mask) >= INDEX_T((slot - hole) & Mask))
+			{
+				_keys[hole] = _keys[slot];
+				_values[hole] = _values[slot];
+				hole = slot;
+			}
+		}
+		_used.Clear(hole);
+		_count--;
+		return true;
+	}
+
+	void Clear()
+	{
+		_used.ClearAll();
+		_count = 0;
+	}
+
+	// Calls func(key, value) for each element
+	template<class Func>
+	void ForEach(Func &func)
+	{
+		for(INDEX_T slot = _used.FindFirst(); slot != _used.NotFound; slot = _used.FindNext(slot))
+			func(_keys[slot], _values[slot]);
+	}
+
+	inline INDEX_T Count()const
+	{	return _count;	}
+
+	inline bool IsEmpty()const
+	{	return _count == 0;	}
+
+	inline bool IsFull()const
+	{	return _count >= SIZE;	}
+
+	inline unsigned Size()const
+	{return SIZE;}
+
+	// Number of probes needed to find the key. For diagnostics.
+	unsigned ProbeLength(const K &key)const
+	{
+		unsigned probes = 1;
+		for(INDEX_T slot = Home(key); _used.Test(slot) && !(_keys[slot] == key); slot = Next(slot))
+			probes++;
+		return probes;
+	}
+
+private:
+	static const INDEX_T Mask = Slots - 1;
+	static const INDEX_T NotFound = INDEX_T(~INDEX_T(0));
+	BOOST_STATIC_ASSERT(Slots > SIZE && Slots - 1 < NotFound);
+
+	static inline INDEX_T Home(const K &key)
+	{
+		return INDEX_T((uint32_t)(HashPolicy::Hash(key) * HashPrivate::FibonacciMultiplier) >> (32 - Bits));
+	}
+
+	static inline INDEX_T Next(INDEX_T slot)
+	{
+		return (slot + 1) & Mask;
+	}
+
+	INDEX_T Lookup(const K &key)const
+	{
+		for(INDEX_T slot = Home(key); _used.Test(slot); slot = Next(slot))
+		{
+			if(_keys[slot] == key)
+				return slot;
+		}
+		return NotFound;
+	}
+
+	BitSet<Slots, uint8_t> _used;
+	K _keys[Slots];
+	V _values[Slots];
+	INDEX_T _count;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Perfect hashing for keys known at compile time.
+//
+//		typedef StaticKeys<0x1001, 0x1002, 0x2010, 40001> RegisterKeys;
+//		PerfectHashMap<RegisterKeys, uint16_t> registers;
+//		uint16_t *reg = registers.Find(address);
+//
+// Multiplier of hash function is searched at compile time so that all the keys
+// land in distinct slots of a table with up to 32 entries. Lookup is then one
+// multiplication, one table load and one key compare, regardless of key count.
+// Slot and key tables are constant. 0xffffffff can not be used as a key.
+////////////////////////////////////////////////////////////////////////////////
+
+namespace HashPrivate
+{
+	static const uint32_t NoKey = 0xfffffffful;
+	static const unsigned MaxPerfectHashKeys = 16;
+	static const unsigned MaxMultiplierSearch = 128;
+
+	template<uint32_t K>
+	struct KeyHolder
+	{
+		static const uint32_t value = K;
+	};
+
+	template
+	<
+		uint32_t K1  = NoKey, uint32_t K2  = NoKey, uint32_t K3  = NoKey, uint32_t K4  = NoKey,
+		uint32_t K5  = NoKey, uint32_t K6  = NoKey, uint32_t K7  = NoKey, uint32_t K8  = NoKey,
+		uint32_t K9  = NoKey, uint32_t K10 = NoKey, uint32_t K11 = NoKey, uint32_t K12 = NoKey,
+		uint32_t K13 = NoKey, uint32_t K14 = NoKey, uint32_t K15 = NoKey, uint32_t K16 = NoKey
+	>
+	struct MakeKeyList
+	{
+		typedef Loki::Typelist<KeyHolder<K1>,
+			typename MakeKeyList<K2, K3, K4, K5, K6, K7, K8, K9, K10, K11, K12, K13, K14, K15, K16>::Result>
+			Result;
+	};
+
+	template<>
+	struct MakeKeyList<>
+	{
+		typedef Loki::NullType Result;
+	};
+
+	template<uint32_t Key, uint32_t Multiplier, unsigned Bits>
+	struct PerfectSlot
+	{
+		static const unsigned value = uint32_t(Key * Multiplier) >> (32 - Bits);
+	};
+
+	// Bit mask of slots occupied by keys
+	template<class KeyList, uint32_t Multiplier, unsigned Bits>
+	struct OccupiedSlots;
+
+	template<uint32_t Multiplier, unsigned Bits>
+	struct OccupiedSlots<Loki::NullType, Multiplier, Bits>
+	{
+		static const uint32_t value = 0;
+	};
+
+	template<class Head, class Tail, uint32_t Multiplier, unsigned Bits>
+	struct OccupiedSlots<Loki::Typelist<Head, Tail>, Multiplier, Bits>
+	{
+		static const uint32_t value = (1ul << PerfectSlot<Head::value, Multiplier, Bits>::value) |
+			OccupiedSlots<Tail, Multiplier, Bits>::value;
+	};
+
+	template<uint32_t x>
+	struct PopulatedBits32
+	{
+		static const uint32_t x1 = (x & 0x55555555ul) + ((x >> 1) & 0x55555555ul);
+		static const uint32_t x2 = (x1 & 0x33333333ul) + ((x1 >> 2) & 0x33333333ul);
+		static const uint32_t x3 = (x2 & 0x0f0f0f0ful) + ((x2 >> 4) & 0x0f0f0f0ful);
+		static const uint32_t x4 = (x3 & 0x00ff00fful) + ((x3 >> 8) & 0x00ff00fful);
+		static const uint32_t value = (x4 & 0x0000fffful) + ((x4 >> 16) & 0x0000fffful);
+	};
+
+	template<uint32_t M>
+	struct MultiplierFound
+	{
+		static const uint32_t value = M;
+		static const bool found = true;
+	};
+
+	struct MultiplierNotFound
+	{
+		static const uint32_t value = 0;
+		static const bool found = false;
+	};
+
+	template<class KeyList, unsigned Bits, unsigned Attempt = 0>
+	struct SearchMultiplier
+	{
+		// odd multipliers spread along the golden ratio sequence
+		static const uint32_t Candidate = uint32_t(FibonacciMultiplier + Attempt * 0x3C6EF372ul);
+		static const bool Perfect =
+			PopulatedBits32<OccupiedSlots<KeyList, Candidate, Bits>::value>::value ==
+			(uint32_t)Loki::TL::Length<KeyList>::value;
+
+		typedef typename Loki::Select<Perfect,
+			MultiplierFound<Candidate>,
+			SearchMultiplier<KeyList, Bits, Attempt + 1> >::Result Result;
+
+		static const uint32_t value = Result::value;
+		static const bool found = Result::found;
+	};
+
+	template<class KeyList, unsigned Bits>
+	struct SearchMultiplier<KeyList, Bits, MaxMultiplierSearch>
+	{
+		static const uint32_t value = MultiplierNotFound::value;
+		static const bool found = MultiplierNotFound::found;
+	};
+
+	// index of the key occupying slot, 0xff for free slot
+	template<class KeyList, unsigned Slot, uint32_t Multiplier, unsigned Bits, unsigned Index = 0>
+	struct KeyIndexForSlot;
+
+	template<unsigned Slot, uint32_t Multiplier, unsigned Bits, unsigned Index>
+	struct KeyIndexForSlot<Loki::NullType, Slot, Multiplier, Bits, Index>
+	{
+		static const uint8_t value = 0xff;
+	};
+
+	template<class Head, class Tail, unsigned Slot, uint32_t Multiplier, unsigned Bits, unsigned Index>
+	struct KeyIndexForSlot<Loki::Typelist<Head, Tail>, Slot, Multiplier, Bits, Index>
+	{
+		static const uint8_t value = PerfectSlot<Head::value, Multiplier, Bits>::value == Slot ?
+			Index : KeyIndexForSlot<Tail, Slot, Multiplier, Bits, Index + 1>::value;
+	};
+
+	template<class KeyList, unsigned Index>
+	struct KeyAt
+	{
+		static const uint32_t value = Loki::TL::TypeAtNonStrict<KeyList, Index, KeyHolder<NoKey> >::Result::value;
+	};
+
+	// Index of Key known to be in the key set; other keys fail to compile
+	// even if they hash to an occupied slot
+	template<class KeyList, uint32_t Key, uint32_t Multiplier, unsigned Bits>
+	struct MemberKeyIndex
+	{
+		static const uint8_t value = KeyIndexForSlot<KeyList,
+			PerfectSlot<Key, Multiplier, Bits>::value, Multiplier, Bits>::value;
+		BOOST_STATIC_ASSERT(value != 0xff);
+		BOOST_STATIC_ASSERT((KeyAt<KeyList, value>::value == Key));
+	};
+}
+
+template
+<
+	uint32_t K1,                           uint32_t K2  = HashPrivate::NoKey,
+	uint32_t K3  = HashPrivate::NoKey, uint32_t K4  = HashPrivate::NoKey,
+	uint32_t K5  = HashPrivate::NoKey, uint32_t K6  = HashPrivate::NoKey,
+	uint32_t K7  = HashPrivate::NoKey, uint32_t K8  = HashPrivate::NoKey,
+	uint32_t K9  = HashPrivate::NoKey, uint32_t K10 = HashPrivate::NoKey,
+	uint32_t K11 = HashPrivate::NoKey, uint32_t K12 = HashPrivate::NoKey,
+	uint32_t K13 = HashPrivate::NoKey, uint32_t K14 = HashPrivate::NoKey,
+	uint32_t K15 = HashPrivate::NoKey, uint32_t K16 = HashPrivate::NoKey
+>
+struct StaticKeys
+{
+	typedef typename HashPrivate::MakeKeyList<K1, K2, K3, K4, K5, K6, K7, K8,
+			K9, K10, K11, K12, K13, K14, K15, K16>::Result KeyList;
+	static const unsigned Length = Loki::TL::Length<KeyList>::value;
+};
+
+template<class Keys, class V>
+class PerfectHashMap
+{
+	typedef typename Keys::KeyList KeyList;
+public:
+	static const unsigned Count = Keys::Length;
+	static const unsigned Bits = HashPrivate::SlotBits<Count * 2 < 32 ? Count * 2 : 32>::value;
+	static const unsigned Slots = 1u << Bits;
+	static const uint32_t Multiplier = HashPrivate::SearchMultiplier<KeyList, Bits>::value;
+
+	// Returns pointer to value or null if key is not in the key set
+	inline V* Find(uint32_t key)
+	{
+		uint8_t index = IndexOf(key);
+		return index != NotFound ? &_values[index] : 0;
+	}
+
+	inline const V* Find(uint32_t key)const
+	{
+		uint8_t index = IndexOf(key);
+		return index != NotFound ? &_values[index] : 0;
+	}
+
+	inline bool Contains(uint32_t key)const
+	{
+		return IndexOf(key) != NotFound;
+	}
+
+	// Compile time key access, no lookup at all
+	template<uint32_t Key>
+	inline V& Get()
+	{
+		return _values[HashPrivate::MemberKeyIndex<KeyList, Key, Multiplier, Bits>::value];
+	}
+
+	// Dense index of the key in key set, or NotFound
+	static inline uint8_t IndexOf(uint32_t key)
+	{
+		uint8_t index = _slotToIndex[uint32_t(key * Multiplier) >> (32 - Bits)];
+		if(index != NotFound && _keys[index] == key)
+			return index;
+		return NotFound;
+	}
+
+	static inline uint32_t KeyAt(uint8_t index)
+	{
+		return _keys[index];
+	}
+
+	inline V& ValueAt(uint8_t index)
+	{
+		return _values[index];
+	}
+
+	static const uint8_t NotFound = 0xff;
+private:
+	BOOST_STATIC_ASSERT(Count <= HashPrivate::MaxPerfectHashKeys);
+	// Increase table size or change key set if this fails
+	BOOST_STATIC_ASSERT((HashPrivate::SearchMultiplier<KeyList, Bits>::found));
+
+	static const uint8_t _slotToIndex[32];
+	static const uint32_t _keys[HashPrivate::MaxPerfectHashKeys];
+	V _values[Count];
+};
+
+#define PERFECT_HASH_SLOT(I) HashPrivate::KeyIndexForSlot<typename Keys::KeyList, (I), \
+	PerfectHashMap<Keys, V>::Multiplier, PerfectHashMap<Keys, V>::Bits>::value
+
+template<class Keys, class V>
+const uint8_t PerfectHashMap<Keys, V>::_slotToIndex[32] =
+{
+	PERFECT_HASH_SLOT(0),  PERFECT_HASH_SLOT(1),  PERFECT_HASH_SLOT(2),  PERFECT_HASH_SLOT(3),
+	PERFECT_HASH_SLOT(4),  PERFECT_HASH_SLOT(5),  PERFECT_HASH_SLOT(6),  PERFECT_HASH_SLOT(7),
+	PERFECT_HASH_SLOT(8),  PERFECT_HASH_SLOT(9),  PERFECT_HASH_SLOT(10), PERFECT_HASH_SLOT(11),
+	PERFECT_HASH_SLOT(12), PERFECT_HASH_SLOT(13), PERFECT_HASH_SLOT(14), PERFECT_HASH_SLOT(15),
+	PERFECT_HASH_SLOT(16), PERFECT_HASH_SLOT(17), PERFECT_HASH_SLOT(18), PERFECT_HASH_SLOT(19),
+	PERFECT_HASH_SLOT(20), PERFECT_HASH_SLOT(21), PERFECT_HASH_SLOT(22), PERFECT_HASH_SLOT(23),
+	PERFECT_HASH_SLOT(24), PERFECT_HASH_SLOT(25), PERFECT_HASH_SLOT(26), PERFECT_HASH_SLOT(27),
+	PERFECT_HASH_SLOT(28), PERFECT_HASH_SLOT(29), PERFECT_HASH_SLOT(30), PERFECT_HASH_SLOT(31)
+};
+
+#undef PERFECT_HASH_SLOT
+
+#define PERFECT_HASH_KEY(I) HashPrivate::KeyAt<typename Keys::KeyList, (I)>::value
+
+template<class Keys, class V>
+const uint32_t PerfectHashMap<Keys, V>::_keys[HashPrivate::MaxPerfectHashKeys] =
+{
+	PERFECT_HASH_KEY(0),  PERFECT_HASH_KEY(1),  PERFECT_HASH_KEY(2),  PERFECT_HASH_KEY(3),
+	PERFECT_HASH_KEY(4),  PERFECT_HASH_KEY(5),  PERFECT_HASH_KEY(6),  PERFECT_HASH_KEY(7),
+	PERFECT_HASH_KEY(8),  PERFECT_HASH_KEY(9),  PERFECT_HASH_KEY(10), PERFECT_HASH_KEY(11),
+	PERFECT_HASH_KEY(12), PERFECT_HASH_KEY(13), PERFECT_HASH_KEY(14), PERFECT_HASH_KEY(15)
+};
+
+#undef PERFECT_HASH_KEY
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <stddef.h>
+#include "static_assert.h"
+#include "select_size.h"
+
+#if defined(__AVR__) && !defined(__ICCAVR__)
+// avr-libc does not provide <new>
+inline void * operator new(size_t, void *ptr) { return ptr; }
+#else
+#include <new>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// class template StaticVector
+// Fixed capacity vector with in-place storage. Unlike Array, elements are
+// constructed on PushBack and destroyed on PopBack/Erase/Clear, so it can hold
+// non-trivial types. No dynamic memory is used.
+////////////////////////////////////////////////////////////////////////////////
+
+template<class T, unsigned SIZE>
+class StaticVector
+{
+public:
+	typedef typename SelectSizeForLength<SIZE>::Result INDEX_T;
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+	StaticVector()
+		:_count(0)
+	{}
+
+	StaticVector(const StaticVector &other)
+		:_count(0)
+	{
+		for(INDEX_T i = 0; i < other._count; ++i)
+			PushBack(other[i]);
+	}
+
+	StaticVector& operator=(const StaticVector &other)
+	{
+		if(this != &other)
+		{
+			Clear();
+			for(INDEX_T i = 0; i < other._count; ++i)
+				PushBack(other[i]);
+		}
+		return *this;
+	}
+
+	~StaticVector()
+	{
+		Clear();
+	}
+
+	inline bool PushBack(const T &value)
+	{
+		if(IsFull())
+			return false;
+		new (Data() + _count) T(value);
+		_count++;
+		return true;
+	}
+
+	inline bool PopBack()
+	{
+		if(IsEmpty())
+			return false;
+		Data()[--_count].~T();
+		return true;
+	}
+
+	// Inserts value before position index, shifting the tail up.
+	bool Insert(INDEX_T index, const T &value)
+	{
+		if(IsFull() || index > _count)
+			return false;
+		if(index == _count)
+			return PushBack(value);
+		T *data = Data();
+		new (data + _count) T(data[_count - 1]);
+		for(INDEX_T i = _count - 1; i > index; --i)
+			data[i] = data[i - 1];
+		data[index] = value;
+		_count++;
+		return true;
+	}
+
+	// Removes element at index preserving order of the rest.
+	bool Erase(INDEX_T index)
+	{
+		if(index >= _count)
+			return false;
+		T *data = Data();
+		for(INDEX_T i = index + 1; i < _count; ++i)
+			data[i - 1] = data[i];
+		data[--_count].~T();
+		return true;
+	}
+
+	// Removes element at index by moving the last element into its place.
+	// O(1), but does not preserve order.
+	bool EraseUnordered(INDEX_T index)
+	{
+		if(index >= _count)
+			return false;
+		T *data = Data();
+		if(index != _count - 1)
+			data[index] = data[_count - 1];
+		data[--_count].~T();
+		return true;
+	}
+
+	void Clear()
+	{
+		while(_count)
+			Data()[--_count].~T();
+	}
+
+	inline T& operator[](INDEX_T i)
+	{
+		return Data()[i];
+	}
+
+	inline const T& operator[](INDEX_T i)const
+	{
+		return Data()[i];
+	}
+
+	inline T& Front()
+	{	return Data()[0];	}
+
+	inline const T& Front()const
+	{	return Data()[0];	}
+
+	inline T& Back()
+	{	return Data()[_count - 1];	}
+
+	inline const T& Back()const
+	{	return Data()[_count - 1];	}
+
+	inline iterator Begin()
+	{	return Data();	}
+
+	inline iterator End()
+	{	return Data() + _count;	}
+
+	inline const_iterator Begin()const
+	{	return Data();	}
+
+	inline const_iterator End()const
+	{	return Data() + _count;	}
+
+	inline bool IsEmpty()const
+	{
+		return _count == 0;
+	}
+
+	inline bool IsFull()const
+	{
+		return _count == SIZE;
+	}
+
+	inline INDEX_T Count()const
+	{
+		return _count;
+	}
+
+	inline unsigned Size()const
+	{return SIZE;}
+
+private:
+	inline T* Data()
+	{
+		return reinterpret_cast<T*>(_storage.bytes);
+	}
+
+	inline const T* Data()const
+	{
+		return reinterpret_cast<const T*>(_storage.bytes);
+	}
+
+	BOOST_STATIC_ASSERT(SIZE > 0);
+	union
+	{
+		unsigned char bytes[SIZE * sizeof(T)];
+		// alignment guards
+		long longAlign;
+		double doubleAlign;
+		void *ptrAlign;
+	} _storage;
+	INDEX_T _count;
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic.h>
+#include "calendar.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// class template TickCounter
+// Time source counting timer interrupts, for parts without RTC (AVR).
+// Tick is called from a timer ISR running at TICKS_PER_SECOND. The epoch base
+// is kept in RAM, so the time has to be set after every reset.
+//
+// Usage:
+//		typedef TickCounter<1000> Ticks;
+//		typedef TimeService<Ticks> Time;
+//		timer compare ISR at 1 kHz:		Ticks::Tick();
+////////////////////////////////////////////////////////////////////////////////
+
+template<unsigned long TICKS_PER_SECOND, unsigned ID = 0>
+class TickCounter
+{
+public:
+	static const unsigned long TicksPerSecond = TICKS_PER_SECOND;
+
+	static void Tick()
+	{
+		_counter++;
+	}
+
+	static uint32_t Counter()
+	{
+		uint32_t counter;
+		ATOMIC
+		{
+			counter = _counter;
+		}
+		return counter;
+	}
+
+	static bool LoadBase(int64_t &)
+	{
+		return false;
+	}
+
+	static void StoreBase(int64_t)
+	{}
+
+private:
+	static volatile uint32_t _counter;
+};
+
+template<unsigned long TICKS_PER_SECOND, unsigned ID>
+volatile uint32_t TickCounter<TICKS_PER_SECOND, ID>::_counter;
+
+////////////////////////////////////////////////////////////////////////////////
+// class template TimeService
+// Monotonic 64 bit tick and wall clock time over a time source: a class with
+// TicksPerSecond, static uint32_t Counter() (free running, wraps at 2^32),
+// bool LoadBase(int64_t &) and StoreBase(int64_t) keeping the epoch base where
+// it survives resets as long as the counter does (HAL::Rtc keeps it in
+// backup registers, TickCounter nowhere).
+//
+// Ticks extends the counter to 64 bits, it has to be called at least once
+// per counter period (48 days at 1024 Hz). The base is the Unix time in
+// ticks at counter 0; counter wraps are added to the stored base, so after a
+// reset wall time stays right unless the counter wrapped while the device
+// was off. Setting the time moves the base only, Ticks stays monotonic.
+// Power of 2 tick rates make Time a shift.
+//
+// Usage:
+//		typedef TimeService<HAL::Rtc<> > Time;
+//		Time::Init();
+//		if(!Time::IsSet())
+//			Time::SetTime(dateFromGps);
+//		DateTime now;
+//		Time::Now(now);
+////////////////////////////////////////////////////////////////////////////////
+
+template<class Source>
+class TimeService
+{
+public:
+	static const unsigned long TicksPerSecond = Source::TicksPerSecond;
+
+	static void Init()
+	{
+		_last = Source::Counter();
+		_high = 0;
+		_set = Source::LoadBase(_base);
+		if(!_set)
+			_base = 0;
+	}
+
+	// Ticks since counter start, never goes back
+	static uint64_t Ticks()
+	{
+		uint64_t ticks;
+		ATOMIC
+		{
+			uint32_t counter = Source::Counter();
+			if(counter < _last)
+			{
+				_high++;
+				if(_set)
+					Source::StoreBase(_base + (int64_t(_high) << 32));
+			}
+			_last = counter;
+			ticks = uint64_t(_high) << 32 | counter;
+		}
+		return ticks;
+	}
+
+	// True if time was set, now or before reset
+	static bool IsSet()
+	{
+		return _set;
+	}
+
+	// Sets Unix time
+	static void SetTime(int64_t seconds)
+	{
+		ATOMIC
+		{
+			uint64_t ticks = Ticks();
+			_base = seconds * int64_t(TicksPerSecond) - int64_t(ticks);
+			_set = true;
+			Source::StoreBase(_base + (int64_t(_high) << 32));
+		}
+	}
+
+	static void SetTime(const DateTime &time)
+	{
+		SetTime(Calendar::ToSeconds(time));
+	}
+
+	// Unix time in ticks
+	static int64_t TimeTicks()
+	{
+		int64_t time;
+		ATOMIC
+		{
+			time = _base + int64_t(Ticks());
+		}
+		return time;
+	}
+
+	// Unix time, times before 1970 are not supported
+	static int64_t Time()
+	{
+		return int64_t(uint64_t(TimeTicks()) / TicksPerSecond);
+	}
+
+	// Unix time in milliseconds
+	static uint64_t TimeMilliseconds()
+	{
+		uint64_t ticks = uint64_t(TimeTicks());
+		uint64_t seconds = ticks / TicksPerSecond;
+		return seconds * 1000 + (ticks - seconds * TicksPerSecond) * 1000 / TicksPerSecond;
+	}
+
+	static void Now(DateTime &time)
+	{
+		Calendar::FromSeconds(Time(), time);
+	}
+
+private:
+	static int64_t _base;
+	static uint32_t _last;
+	static uint32_t _high;
+	static bool _set;
+};
+
+template<class Source>
+int64_t TimeService<Source>::_base;
+
+template<class Source>
+uint32_t TimeService<Source>::_last;
+
+template<class Source>
+uint32_t TimeService<Source>::_high;
+
+template<class Source>
+bool TimeService<Source>::_set;
@@ -54,6 +54,32 @@ namespace Timers
 		};
 	}
 
+	// Wraparound safe tick counter comparison.
+	// Returns true if tick 'a' happens before tick 'b', assuming they are less
+	// than half of counter range apart. Works for free running 8/16/32-bit counters.
+	template<class T>
+	inline bool TickBefore(T a, T b)
+	{
+		return (T(a - b) & T(T(1) << (sizeof(T) * 8 - 1))) != 0;
+	}
+
+	// Number of ticks from 'from' to 'to' modulo counter range
+	template<class T>
+	inline T TicksElapsed(T from, T to)
+	{
+		return T(to - from);
+	}
+
+	// Comparison functor for ordering deadlines in priority queues
+	template<class T>
+	struct TickLess
+	{
+		inline bool operator()(T a, T b)const
+		{
+			return TickBefore(a, b);
+		}
+	};
+
 	enum {MinTimerClockCycles = 50};
 
 	template<class Timer, unsigned long Freq, unsigned long Fcpu DEFAULT_TIMER_CLOCK_FREQ>
@@ -0,0 +1,377 @@
+#include <iostream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "asserts.h"
+#include "calendar.h"
+#include "time_service.h"
+
+using namespace std;
+
+// Steps the date one day forward the obvious way
+void NextDay(DateTime &date)
+{
+	date.weekday = (date.weekday + 1) % 7;
+	if(date.day < Calendar::DaysInMonth(date.year, date.month))
+	{
+		date.day++;
+		return;
+	}
+	date.day = 1;
+	if(date.month < 12)
+	{
+		date.month++;
+		return;
+	}
+	date.month = 1;
+	date.year++;
+}
+
+// Loop based reference
+int32_t NaiveDaysFromCivil(int32_t year, unsigned month, unsigned day)
+{
+	int32_t days = 0;
+	for(int32_t y = 1970; y < year; y++)
+		days += Calendar::IsLeapYear(y) ? 366 : 365;
+	for(int32_t y = year; y < 1970; y++)
+		days -= Calendar::IsLeapYear(y) ? 366 : 365;
+	for(unsigned m = 1; m < month; m++)
+		days += Calendar::DaysInMonth(year, m);
+	return days + int32_t(day) - 1;
+}
+
+void EpochTest()
+{
+	cout << __FUNCTION__;
+	ASSERT_EQUAL(Calendar::DaysFromCivil(1970, 1, 1), 0);
+	ASSERT_EQUAL(Calendar::DaysFromCivil(2000, 3, 1), 11017);
+	ASSERT_EQUAL(Calendar::DaysFromCivil(1969, 12, 31), -1);
+	ASSERT_EQUAL(Calendar::DaysFromCivil(0, 3, 1), -719468);
+
+	DateTime date;
+	Calendar::CivilFromDays(0, date);
+	ASSERT_EQUAL(date.year, 1970);
+	ASSERT_EQUAL(date.month, 1);
+	ASSERT_EQUAL(date.day, 1);
+	ASSERT_EQUAL(date.weekday, 4);
+	Calendar::CivilFromDays(11016, date);
+	ASSERT_EQUAL(date.year, 2000);
+	ASSERT_EQUAL(date.month, 2);
+	ASSERT_EQUAL(date.day, 29);
+	ASSERT_EQUAL(date.weekday, 2);
+
+	ASSERT_EQUAL(NaiveDaysFromCivil(2024, 7, 14), Calendar::DaysFromCivil(2024, 7, 14));
+	cout << "\tOK" << endl;
+}
+
+// Every day of years -32767..32767 against the day stepping reference
+void DayConversionTest()
+{
+	cout << __FUNCTION__;
+	DateTime expected;
+	expected.year = -32767;
+	expected.month = 1;
+	expected.day = 1;
+	int32_t first = Calendar::DaysFromCivil(-32767, 1, 1);
+	ASSERT_EQUAL(first, NaiveDaysFromCivil(-32767, 1, 1));
+	expected.weekday = uint8_t(Calendar::Weekday(first));
+
+	int32_t days = first;
+	unsigned long errors = 0;
+	while(!(expected.year == 32767 && expected.month == 12 && expected.day == 31))
+	{
+		DateTime date;
+		Calendar::CivilFromDays(days, date);
+		if(date.year != expected.year || date.month != expected.month ||
+			date.day != expected.day || date.weekday != expected.weekday ||
+			Calendar::DaysFromCivil(expected.year, expected.month, expected.day) != days ||
+			Calendar::Weekday(days) != expected.weekday)
+		{
+			errors++;
+		}
+		NextDay(expected);
+		days++;
+	}
+	ASSERT_EQUAL(errors, 0ul);
+	ASSERT_EQUAL(days, NaiveDaysFromCivil(32767, 12, 31));
+	// 1970-01-01 was Thursday
+	ASSERT_EQUAL(Calendar::Weekday(0), 4u);
+	cout << "\tOK" << endl;
+}
+
+void SecondsTest()
+{
+	cout << __FUNCTION__;
+	DateTime time;
+	Calendar::FromSeconds(0, time);
+	ASSERT_EQUAL(time.year, 1970);
+	ASSERT_EQUAL(time.hour, 0);
+	ASSERT_EQUAL(time.second, 0);
+
+	Calendar::FromSeconds(-1, time);
+	ASSERT_EQUAL(time.year, 1969);
+	ASSERT_EQUAL(time.month, 12);
+	ASSERT_EQUAL(time.day, 31);
+	ASSERT_EQUAL(time.hour, 23);
+	ASSERT_EQUAL(time.minute, 59);
+	ASSERT_EQUAL(time.second, 59);
+
+	// 32 bit time_t overflow
+	Calendar::FromSeconds(0x80000000ll, time);
+	ASSERT_EQUAL(time.year, 2038);
+	ASSERT_EQUAL(time.month, 1);
+	ASSERT_EQUAL(time.day, 19);
+	ASSERT_EQUAL(time.hour, 3);
+	ASSERT_EQUAL(time.minute, 14);
+	ASSERT_EQUAL(time.second, 8);
+	ASSERT_EQUAL(time.weekday, 2);
+
+	// range ends
+	time.year = 0;
+	time.month = 1;
+	time.day = 1;
+	time.hour = 0;
+	time.minute = 0;
+	time.second = 0;
+	int64_t first = Calendar::ToSeconds(time);
+	Calendar::FromSeconds(first, time);
+	ASSERT_EQUAL(time.year, 0);
+	ASSERT_EQUAL(time.month, 1);
+	ASSERT_EQUAL(time.day, 1);
+	ASSERT_EQUAL(time.weekday, 6);
+	time.year = 9999;
+	time.month = 12;
+	time.day = 31;
+	time.hour = 23;
+	time.minute = 59;
+	time.second = 59;
+	int64_t last = Calendar::ToSeconds(time);
+	ASSERT_EQUAL(last, 253402300799ll);
+	Calendar::FromSeconds(last, time);
+	ASSERT_EQUAL(time.year, 9999);
+	ASSERT_EQUAL(time.second, 59);
+
+	// every second of a leap day
+	int64_t day = int64_t(Calendar::DaysFromCivil(2024, 2, 29)) * 86400;
+	unsigned long errors = 0;
+	for(uint32_t s = 0; s < 86400; s++)
+	{
+		Calendar::FromSeconds(day + s, time);
+		if(time.month != 2 || time.day != 29 ||
+			time.hour * 3600u + time.minute * 60u + time.second != s ||
+			Calendar::ToSeconds(time) != day + s)
+		{
+			errors++;
+		}
+	}
+	ASSERT_EQUAL(errors, 0ul);
+	cout << "\tOK" << endl;
+}
+
+// Random times against gmtime and back
+void GmtimeTest()
+{
+	cout << __FUNCTION__;
+	srand(1);
+	unsigned long errors = 0;
+	bool wideTime = sizeof(time_t) > 4;
+	int64_t range = wideTime ? 4102444800ll : 0x7fffffffll;
+	for(unsigned i = 0; i < 100000; i++)
+	{
+		int64_t seconds = (int64_t(rand()) << 16 ^ rand()) % range;
+		time_t t = time_t(seconds);
+		struct tm *expected = gmtime(&t);
+		DateTime time;
+		Calendar::FromSeconds(seconds, time);
+		if(time.year != expected->tm_year + 1900 || time.month != expected->tm_mon + 1 ||
+			time.day != expected->tm_mday || time.hour != expected->tm_hour ||
+			time.minute != expected->tm_min || time.second != expected->tm_sec ||
+			time.weekday != expected->tm_wday || Calendar::ToSeconds(time) != seconds)
+		{
+			errors++;
+		}
+	}
+	ASSERT_EQUAL(errors, 0ul);
+	cout << "\tOK" << endl;
+}
+
+// Settable counter and base storage in place of RTC
+struct FakeRtc
+{
+	static const unsigned long TicksPerSecond = 1024;
+	static uint32_t counter;
+	static int64_t stored;
+	static bool valid;
+	static unsigned stores;
+
+	static uint32_t Counter()
+	{
+		return counter;
+	}
+
+	static bool LoadBase(int64_t &base)
+	{
+		base = stored;
+		return valid;
+	}
+
+	static void StoreBase(int64_t base)
+	{
+		stored = base;
+		valid = true;
+		stores++;
+	}
+};
+
+uint32_t FakeRtc::counter;
+int64_t FakeRtc::stored;
+bool FakeRtc::valid;
+unsigned FakeRtc::stores;
+
+typedef TimeService<FakeRtc> Time;
+
+void TimeServiceTest()
+{
+	cout << __FUNCTION__;
+	FakeRtc::counter = 5000;
+	FakeRtc::valid = false;
+	Time::Init();
+	ASSERT_FALSE(Time::IsSet());
+	ASSERT_EQUAL(Time::Ticks(), 5000u);
+
+	DateTime time;
+	time.year = 2024;
+	time.month = 7;
+	time.day = 14;
+	time.hour = 12;
+	time.minute = 30;
+	time.second = 15;
+	Time::SetTime(time);
+	ASSERT_TRUE(Time::IsSet());
+	ASSERT_EQUAL(FakeRtc::stores, 1u);
+	int64_t seconds = Calendar::ToSeconds(time);
+	ASSERT_EQUAL(Time::Time(), seconds);
+	ASSERT_EQUAL(Time::TimeMilliseconds(), uint64_t(seconds) * 1000);
+
+	// a second and a half later
+	FakeRtc::counter += 1536;
+	ASSERT_EQUAL(Time::Time(), seconds + 1);
+	ASSERT_EQUAL(Time::TimeMilliseconds(), uint64_t(seconds) * 1000 + 1500);
+	DateTime now;
+	Time::Now(now);
+	ASSERT_EQUAL(now.second, 16);
+	ASSERT_EQUAL(now.weekday, 0);
+
+	// counter wrap extends ticks and moves the stored base
+	uint64_t ticks = Time::Ticks();
+	FakeRtc::counter = 0xfffffc00u;
+	ASSERT_EQUAL(Time::Ticks(), 0xfffffc00u);
+	FakeRtc::counter = 0x400;
+	ASSERT_EQUAL(Time::Ticks(), 0x100000400ull);
+	ASSERT_TRUE(Time::Ticks() > ticks);
+	ASSERT_EQUAL(FakeRtc::stores, 2u);
+	int64_t beforeReset = Time::TimeTicks();
+	ASSERT_EQUAL(beforeReset, seconds * 1024 - 5000 + 0x100000400ll);
+
+	// reset: counter keeps running, time is restored from the stored base
+	FakeRtc::counter += 2048;
+	Time::Init();
+	ASSERT_TRUE(Time::IsSet());
+	ASSERT_EQUAL(Time::TimeTicks(), beforeReset + 2048);
+
+	// setting time moves the base, ticks stay
+	ticks = Time::Ticks();
+	Time::SetTime(0);
+	ASSERT_EQUAL(Time::Time(), 0);
+	ASSERT_EQUAL(Time::Ticks(), ticks);
+	cout << "\tOK" << endl;
+}
+
+typedef TickCounter<1000> Ticks;
+
+void TickCounterTest()
+{
+	cout << __FUNCTION__;
+	typedef TimeService<Ticks> TickTime;
+	TickTime::Init();
+	ASSERT_FALSE(TickTime::IsSet());
+	TickTime::SetTime(1000000);
+	for(unsigned i = 0; i < 2500; i++)
+		Ticks::Tick();
+	ASSERT_EQUAL(Ticks::Counter(), 2500u);
+	ASSERT_EQUAL(TickTime::Time(), 1000002);
+	ASSERT_EQUAL(TickTime::TimeMilliseconds(), 1000002500ull);
+	cout << "\tOK" << endl;
+}
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	const unsigned long iterations = 2000000;
+	{
+		BenchmarkTimer timer("CivilFromDays", iterations);
+		DateTime date;
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			Calendar::CivilFromDays(int32_t(i * 7), date);
+			DoNotOptimize(date.day);
+		}
+		timer.Report();
+	}
+	{
+		BenchmarkTimer timer("DaysFromCivil", iterations);
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			int32_t days = Calendar::DaysFromCivil(int32_t(1900 + (i & 255)), 1 + i % 12, 1 + (i & 15));
+			DoNotOptimize(days);
+		}
+		timer.Report();
+	}
+	{
+		const unsigned long naiveIterations = iterations / 100;
+		BenchmarkTimer timer("DaysFromCivil, year loop reference", naiveIterations);
+		for(unsigned long i = 0; i < naiveIterations; i++)
+		{
+			int32_t days = NaiveDaysFromCivil(int32_t(1900 + (i & 255)), 1 + i % 12, 1 + (i & 15));
+			DoNotOptimize(days);
+		}
+		timer.Report();
+	}
+	{
+		BenchmarkTimer timer("FromSeconds", iterations);
+		DateTime time;
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			Calendar::FromSeconds(int64_t(i) * 1237, time);
+			DoNotOptimize(time.second);
+		}
+		timer.Report();
+	}
+	{
+		BenchmarkTimer timer("gmtime_r", iterations);
+		struct tm time;
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			time_t t = time_t(i * 1237);
+			gmtime_r(&t, &time);
+			DoNotOptimize(time.tm_sec);
+		}
+		timer.Report();
+	}
+}
+
+int main()
+{
+	EpochTest();
+	DayConversionTest();
+	SecondsTest();
+	GmtimeTest();
+	TimeServiceTest();
+	TickCounterTest();
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
@@ -0,0 +1,366 @@
+#define STM32F10X_MD
+#define F_CPU 72000000
+
+#include <iostream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "asserts.h"
+#include "can_sim.h"
+#include "ARM/Stm32/can.h"
+
+using namespace std;
+using namespace IO::Test;
+using namespace HAL;
+
+typedef CanSim<> Sim;
+IO_STRUCT_WRAPPER(Sim::Registers(), SimCanRegs, Sim::RegisterBlock);
+
+struct NoClock
+{
+	static void Enable()
+	{}
+};
+
+// CANopen node 5 and a J1939 PGN
+enum { Node = 5 };
+typedef CanMask32<0x080, 0x7ff> SyncFilter;
+typedef CanList16<0x000, 0x700 | Node, 0x200 | Node, 0x300 | Node, 1> NmtFilter;
+typedef CanMask16<0x600 | Node, 0x7ff, 0x580, 0x780 | CanFrame::Remote> SdoFilter;
+typedef CanList32<0x18fef100 | CanFrame::Extended, 0x080 | CanFrame::Remote> ListFilter;
+typedef Loki::TL::MakeTypelist<SyncFilter, NmtFilter, SdoFilter, ListFilter>::Result Filters;
+typedef Private::BxCan<SimCanRegs, NoClock, Filters, 16, 16> Can;
+
+CanFrame MakeFrame(uint32_t id, uint8_t length, uint8_t seed)
+{
+	CanFrame frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.id = id;
+	frame.length = length;
+	for(unsigned i = 0; i < 8; i++)
+		frame.data[i] = i < length ? uint8_t(seed + i * 17) : 0;
+	return frame;
+}
+
+void CanInitTest()
+{
+	cout << __FUNCTION__;
+	ASSERT_EQUAL(CanBase::BitTiming(36000000, 500000), 1ul << 20 | 8ul << 16 | 5);
+	ASSERT_EQUAL(CanBase::BitTiming(36000000, 1000000), 1ul << 20 | 8ul << 16 | 2);
+	ASSERT_EQUAL(CanBase::BitTiming(8000000, 125000), 1ul << 20 | 12ul << 16 | 3);
+	ASSERT_EQUAL(CanBase::BitTiming(36000000, 470000), 0);
+
+	Sim::Reset();
+	ASSERT_TRUE(Can::Init(CanBase::BitTiming(36000000, 500000), CanBase::Loopback));
+	Sim::RegisterBlock &regs = *Sim::Registers();
+	ASSERT_EQUAL(regs.MSR & 3, 0);
+	ASSERT_EQUAL(regs.BTR, CAN_BTR_LBKM | 1ul << 20 | 8ul << 16 | 5);
+	ASSERT_EQUAL(regs.FA1R, 0x0f);
+	ASSERT_EQUAL(regs.FM1R, 0x0a);
+	ASSERT_EQUAL(regs.FS1R, 0x09);
+	ASSERT_EQUAL(regs.FFA1R, 0x02);
+	ASSERT_EQUAL(regs.FMR & CAN_FMR_FINIT, 0);
+	ASSERT_EQUAL(regs.sFilterRegister[0].FR1, 0x080ul << 21);
+	ASSERT_EQUAL(regs.sFilterRegister[0].FR2, 0x7fful << 21 | CAN_TI0R_IDE);
+	ASSERT_EQUAL(regs.sFilterRegister[1].FR1, (0x705ul << 5) << 16);
+	ASSERT_EQUAL(regs.sFilterRegister[2].FR2, 0x580ul << 5 | (0x780ul << 5 | 0x18) << 16);
+	ASSERT_EQUAL(regs.sFilterRegister[3].FR1, 0x18fef100ul << 3 | CAN_TI0R_IDE);
+	ASSERT_EQUAL(regs.sFilterRegister[3].FR2, 0x080ul << 21 | CAN_TI0R_RTR);
+
+	ASSERT_EQUAL(Can::FilterIndex<SyncFilter>::value, 0);
+	ASSERT_EQUAL(Can::FilterIndex<NmtFilter>::value, 0);
+	ASSERT_EQUAL(Can::FilterIndex<SdoFilter>::value, 1);
+	ASSERT_EQUAL(Can::FilterIndex<ListFilter>::value, 3);
+	ASSERT_EQUAL(Sim::Violations(), 0);
+
+	Sim::SetErrorCounters(96, 5, true);
+	ASSERT_EQUAL(Can::TxErrorCounter(), 96);
+	ASSERT_EQUAL(Can::RxErrorCounter(), 5);
+	ASSERT_TRUE(Can::IsBusOff());
+	cout << "\tOK" << endl;
+}
+
+void CanLoopbackTest()
+{
+	cout << __FUNCTION__;
+	Sim::Reset();
+	ASSERT_TRUE(Can::Init(CanBase::BitTiming(36000000, 500000), CanBase::Loopback));
+	const struct
+	{
+		uint32_t id;
+		int filter;		// match index, -1 if rejected
+		int fifo;
+	} cases[] =
+	{
+		{0x080, 0, 0},								// SYNC
+		{0x000, 0, 1},								// NMT
+		{0x705, 1, 1},								// heartbeat
+		{0x205, 2, 1},
+		{0x305, 3, 1},
+		{0x605, 1, 0},								// SDO request
+		{0x5a5, 2, 0},								// any SDO response
+		{0x5a5 | CanFrame::Remote, -1, 0},			// remote frames do not pass 0x780 | Remote mask
+		{0x18fef100 | CanFrame::Extended, 3, 0},
+		{0x080 | CanFrame::Remote, 4, 0},			// SYNC mask too, list goes first
+		{0x081, -1, 0},
+		{0x206, -1, 0},
+		{0x080 | CanFrame::Extended, -1, 0},		// same bits, other format
+	};
+	unsigned count = sizeof(cases) / sizeof(cases[0]);
+	unsigned accepted = 0;
+	for(unsigned i = 0; i < count; i++)
+	{
+		CanFrame frame = MakeFrame(cases[i].id, uint8_t(i % 9), uint8_t(i));
+		ASSERT_TRUE(Can::Send(frame));
+		ASSERT_EQUAL(Sim::Run<Can>(), 1);
+		if(cases[i].filter < 0)
+		{
+			ASSERT_EQUAL(Can::RxCount(), 0);
+			continue;
+		}
+		accepted++;
+		CanFrame received;
+		ASSERT_TRUE(Can::Receive(received));
+		ASSERT_EQUAL(received.id, cases[i].id);
+		ASSERT_EQUAL(received.length, i % 9);
+		ASSERT_EQUAL(received.filter, cases[i].filter);
+		ASSERT_TRUE(memcmp(received.data, frame.data, received.length) == 0);
+	}
+	ASSERT_EQUAL(Sim::Bus().size(), count);
+	ASSERT_EQUAL(Sim::Filtered(), count - accepted);
+
+	// length is limited to 8
+	CanFrame frame = MakeFrame(0x080, 8, 1);
+	frame.length = 12;
+	ASSERT_TRUE(Can::Send(frame));
+	Sim::Run<Can>();
+	ASSERT_EQUAL(Sim::Bus().back().length, 8);
+	ASSERT_TRUE(Can::Receive(frame));
+	ASSERT_EQUAL(frame.length, 8);
+	ASSERT_EQUAL(Can::TxPending(), 0);
+	ASSERT_EQUAL(Can::TxErrors(), 0);
+	ASSERT_EQUAL(Sim::Violations(), 0);
+	cout << "\tOK" << endl;
+}
+
+void CanPriorityTest()
+{
+	cout << __FUNCTION__;
+	Sim::Reset();
+	ASSERT_TRUE(Can::Init(CanBase::BitTiming(36000000, 500000), CanBase::Loopback));
+	// low priority frames take all mailboxes, the bus is busy
+	Can::Send(MakeFrame(0x300, 1, 0));
+	Can::Send(MakeFrame(0x301, 1, 0));
+	Can::Send(MakeFrame(0x302, 1, 0));
+	ASSERT_EQUAL(Sim::Registers()->TSR & CAN_TSR_TME, 0);
+	// urgent frames displace them
+	Can::Send(MakeFrame(0x100, 1, 0));
+	Can::Send(MakeFrame(0x18fef100 | CanFrame::Extended, 1, 0));
+	Can::Send(MakeFrame(0x200, 1, 0));
+	ASSERT_EQUAL(Can::TxPending(), 6);
+	ASSERT_EQUAL(Sim::Run<Can>(), 6);
+	// extended frames lose to standard ones with lower base identifier
+	const uint32_t expected[] = {0x100, 0x200, 0x300, 0x301, 0x302, 0x18fef100};
+	for(unsigned i = 0; i < 6; i++)
+		ASSERT_EQUAL(Sim::Bus()[i].id, expected[i]);
+	ASSERT_TRUE(Sim::Bus()[5].extended);
+
+	// frames with the same identifier keep their order
+	Sim::ClearBus();
+	for(uint8_t i = 0; i < 12; i++)
+		ASSERT_TRUE(Can::Send(MakeFrame(i % 3 ? 0x185 : 0x100, 1, i)));
+	Sim::Run<Can>();
+	ASSERT_EQUAL(Sim::Bus().size(), 12);
+	int last[2] = {-1, -1};
+	for(unsigned i = 0; i < 12; i++)
+	{
+		const Sim::Message &message = Sim::Bus()[i];
+		ASSERT_TRUE(message.id == (i < 4 ? 0x100u : 0x185u));
+		int &previous = last[message.id == 0x185];
+		ASSERT_TRUE(message.data[0] > previous);
+		previous = message.data[0];
+	}
+
+	// queue overflow
+	for(unsigned i = 0; i < 3 + 16; i++)
+		ASSERT_TRUE(Can::Send(MakeFrame(0x400 + i, 0, 0)));
+	ASSERT_FALSE(Can::Send(MakeFrame(0x001, 0, 0)));
+	ASSERT_EQUAL(Sim::Run<Can>(), 19);
+	while(Can::RxCount())
+	{
+		CanFrame frame;
+		Can::Receive(frame);
+	}
+
+	// queue fills up before the abort completes, the aborted frame keeps its entry
+	Sim::ClearBus();
+	for(unsigned i = 0; i < 3; i++)
+		ASSERT_TRUE(Can::Send(MakeFrame(0x500 + i, 0, 0)));
+	ASSERT_TRUE(Can::Send(MakeFrame(0x100, 0, 0)));
+	for(unsigned i = 0; i < 14; i++)
+		ASSERT_TRUE(Can::Send(MakeFrame(0x600 + i, 0, 0)));
+	ASSERT_FALSE(Can::Send(MakeFrame(0x001, 0, 0)));
+	ASSERT_EQUAL(Can::TxPending(), 18);
+	ASSERT_EQUAL(Sim::Run<Can>(), 18);
+	ASSERT_EQUAL(Sim::Bus()[0].id, 0x100);
+	for(unsigned i = 0; i < 3; i++)
+		ASSERT_EQUAL(Sim::Bus()[1 + i].id, 0x500 + i);
+	while(Can::RxCount())
+	{
+		CanFrame frame;
+		Can::Receive(frame);
+	}
+	ASSERT_EQUAL(Can::TxErrors(), 0);
+	ASSERT_EQUAL(Sim::Violations(), 0);
+	cout << "\tOK" << endl;
+}
+
+struct SentFrame
+{
+	uint32_t key;
+	uint32_t id;
+	uint8_t sequence;
+};
+
+// Every frame on the bus has to be the highest priority one sent and not yet
+// transmitted, frames with equal identifiers in order of sending.
+void CanSchedulingModelTest()
+{
+	cout << __FUNCTION__;
+	Sim::Reset();
+	ASSERT_TRUE(Can::Init(CanBase::BitTiming(36000000, 500000), CanBase::Loopback));
+	srand(7);
+	std::vector<SentFrame> pending;
+	uint8_t sequence = 0;
+	unsigned transmitted = 0;
+	for(unsigned step = 0; step < 20000; step++)
+	{
+		if(rand() % 2 && pending.size() < 16)
+		{
+			static const uint32_t ids[] = {0x080, 0x185, 0x185 | CanFrame::Remote, 0x1ff, 0x700, 0x185 | CanFrame::Extended, 0x7ff, 0x000};
+			uint32_t id = ids[rand() % 8];
+			ASSERT_TRUE(Can::Send(MakeFrame(id, 1, sequence)));
+			SentFrame sent = {CanPrivate::EncodeId(id), id, sequence++};
+			pending.push_back(sent);
+			continue;
+		}
+		Sim::ServiceInterrupts<Can>();
+		if(!Sim::Transmit())
+		{
+			ASSERT_TRUE(pending.empty());
+			continue;
+		}
+		const Sim::Message &message = Sim::Bus().back();
+		uint32_t id = message.id | (message.extended ? uint32_t(CanFrame::Extended) : 0) | (message.remote ? uint32_t(CanFrame::Remote) : 0);
+		unsigned best = 0;
+		for(unsigned i = 1; i < pending.size(); i++)
+			if(pending[i].key < pending[best].key)
+				best = i;
+		ASSERT_EQUAL(id, pending[best].id);
+		ASSERT_EQUAL(message.data[0], pending[best].sequence);
+		pending.erase(pending.begin() + best);
+		transmitted++;
+		CanFrame frame;
+		while(Can::Receive(frame))
+			;
+	}
+	Sim::Run<Can>();
+	ASSERT_EQUAL(Sim::Bus().size(), transmitted + pending.size());
+	ASSERT_EQUAL(Can::TxErrors(), 0);
+	ASSERT_EQUAL(Sim::Violations(), 0);
+	cout << "\t" << transmitted << " frames\tOK" << endl;
+}
+
+void CanReceiveOverrunTest()
+{
+	cout << __FUNCTION__;
+	Sim::Reset();
+	ASSERT_TRUE(Can::Init(CanBase::BitTiming(36000000, 500000)));
+	// interrupts are late: the hardware FIFO keeps 3 frames, the newest overwrites the last
+	Sim::Message message = {0x605, false, false, 1, {0}};
+	for(uint8_t i = 0; i < 5; i++)
+	{
+		message.data[0] = i;
+		Sim::Inject(message);
+	}
+	Sim::ServiceInterrupts<Can>();
+	ASSERT_EQUAL(Can::FifoOverruns(), 1);
+	ASSERT_EQUAL(Can::RxCount(), 3);
+	const uint8_t expected[] = {0, 1, 4};
+	for(unsigned i = 0; i < 3; i++)
+	{
+		CanFrame frame;
+		ASSERT_TRUE(Can::Receive(frame));
+		ASSERT_EQUAL(frame.data[0], expected[i]);
+		ASSERT_EQUAL(frame.filter, Can::FilterIndex<SdoFilter>::value);
+	}
+	// the main loop is late: ring of 16 frames overflows
+	for(uint8_t i = 0; i < 20; i++)
+	{
+		message.data[0] = i;
+		Sim::Inject(message);
+		Sim::ServiceInterrupts<Can>();
+	}
+	ASSERT_EQUAL(Can::RxCount(), 16);
+	ASSERT_EQUAL(Can::RxOverruns(), 4);
+	CanFrame frame;
+	ASSERT_TRUE(Can::Receive(frame));
+	ASSERT_EQUAL(frame.data[0], 0);
+	// loopback mode ignores the bus
+	ASSERT_TRUE(Can::Init(CanBase::BitTiming(36000000, 500000), CanBase::Loopback));
+	Sim::Inject(message);
+	Sim::ServiceInterrupts<Can>();
+	ASSERT_EQUAL(Can::RxCount(), 0);
+	ASSERT_EQUAL(Sim::Violations(), 0);
+	cout << "\tOK" << endl;
+}
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	const unsigned long iterations = 200000;
+	Sim::Reset();
+	Can::Init(CanBase::BitTiming(36000000, 500000), CanBase::Loopback);
+	CanFrame frame = MakeFrame(0x185, 8, 1);
+	{
+		BenchmarkTimer timer("CAN send, loopback, receive", iterations);
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			frame.id = 0x080 + (i & 1);
+			Can::Send(frame);
+			Sim::Run<Can>();
+			Can::Receive(frame);
+			Sim::ClearBus();
+		}
+		timer.Report();
+	}
+	{
+		BenchmarkTimer timer("CAN send to full mailboxes, 16 queued", iterations);
+		for(unsigned long i = 0; i < iterations; i += 16 + 3)
+		{
+			for(unsigned j = 0; j < 16 + 3; j++)
+				Can::Send(MakeFrame(0x700 - (j * 37 & 0xff), 0, 0));
+			Sim::Run<Can>();
+			Sim::ClearBus();
+			while(Can::Receive(frame))
+				;
+		}
+		timer.Report();
+	}
+}
+
+int main()
+{
+	CanInitTest();
+	CanLoopbackTest();
+	CanPriorityTest();
+	CanSchedulingModelTest();
+	CanReceiveOverrunTest();
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
@@ -0,0 +1,784 @@
+#include <iostream>
+#include <vector>
+#include <bitset>
+#include <list>
+#include <queue>
+#include <deque>
+#include <stdint.h>
+#include "asserts.h"
+#include "bit_utils.h"
+#include "static_vector.h"
+#include "bitset.h"
+#include "intrusive_list.h"
+#include "containers.h"
+#include "static_hash_map.h"
+#include "priority_queue.h"
+#include "timer_utils.h"
+#include "record_ring.h"
+#if __cplusplus >= 201103L
+#include <unordered_map>
+#else
+#include <map>
+#endif
+
+using namespace std;
+
+// counts live instances to check construction/destruction
+struct Tracked
+{
+	static int Alive;
+	int value;
+	Tracked(int v = 0) :value(v) { Alive++; }
+	Tracked(const Tracked &other) :value(other.value) { Alive++; }
+	Tracked &operator=(const Tracked &other) { value = other.value; return *this; }
+	~Tracked() { Alive--; }
+};
+int Tracked::Alive = 0;
+
+void BitUtilsTest()
+{
+	cout << __FUNCTION__;
+	ASSERT_EQUAL(Util::PopCount(uint8_t(0xff)), 8);
+	ASSERT_EQUAL(Util::PopCount(uint16_t(0x8001)), 2);
+	ASSERT_EQUAL(Util::PopCount(uint32_t(0xffffffff)), 32);
+	ASSERT_EQUAL(Util::CountTrailingZeros(uint8_t(0x80)), 7);
+	ASSERT_EQUAL(Util::CountTrailingZeros(uint32_t(0x80000000)), 31);
+	ASSERT_EQUAL(Util::FindFirstSet(0u), 0);
+	ASSERT_EQUAL(Util::FindFirstSet(0x10u), 5);
+	uint16_t v = 0x0110;
+	ASSERT_EQUAL(Util::ExtractLowestBit(v), 4);
+	ASSERT_EQUAL(v, 0x0100);
+	cout << "\tOK" << endl;
+}
+
+void StaticVectorTest()
+{
+	cout << __FUNCTION__;
+	{
+		StaticVector<Tracked, 4> vec;
+		ASSERT_TRUE(vec.IsEmpty());
+		ASSERT_EQUAL(Tracked::Alive, 0);
+		ASSERT_TRUE(vec.PushBack(Tracked(1)));
+		ASSERT_TRUE(vec.PushBack(Tracked(2)));
+		ASSERT_TRUE(vec.PushBack(Tracked(4)));
+		ASSERT_EQUAL(Tracked::Alive, 3);
+		ASSERT_TRUE(vec.Insert(2, Tracked(3)));
+		ASSERT_TRUE(vec.IsFull());
+		ASSERT_FALSE(vec.PushBack(Tracked(5)));
+		ASSERT_EQUAL(Tracked::Alive, 4);
+		for(int i = 0; i < 4; i++)
+			ASSERT_EQUAL(vec[i].value, i + 1);
+
+		ASSERT_TRUE(vec.Erase(0));
+		ASSERT_EQUAL(vec.Front().value, 2);
+		ASSERT_EQUAL(vec.Back().value, 4);
+		ASSERT_EQUAL(Tracked::Alive, 3);
+
+		ASSERT_TRUE(vec.EraseUnordered(0));
+		ASSERT_EQUAL(vec.Front().value, 4);
+		ASSERT_EQUAL(vec.Count(), 2);
+
+		StaticVector<Tracked, 4> copy(vec);
+		ASSERT_EQUAL(Tracked::Alive, 4);
+		ASSERT_EQUAL(copy[1].value, 3);
+		ASSERT_TRUE(copy.PopBack());
+		ASSERT_EQUAL(Tracked::Alive, 3);
+		copy = vec;
+		ASSERT_EQUAL(copy.Count(), 2);
+
+		int sum = 0;
+		for(StaticVector<Tracked, 4>::iterator i = vec.Begin(); i != vec.End(); ++i)
+			sum += i->value;
+		ASSERT_EQUAL(sum, 7);
+	}
+	ASSERT_EQUAL(Tracked::Alive, 0);
+	cout << "\tOK" << endl;
+}
+
+template<class WordT>
+void BitSetTest()
+{
+	cout << __FUNCTION__ << "\tword size: " << sizeof(WordT);
+	BitSet<70, WordT> bits;
+	ASSERT_TRUE(bits.None());
+	ASSERT_EQUAL(bits.FindFirst(), bits.NotFound);
+	bits.Set(0);
+	bits.Set(9);
+	bits.Set(33);
+	bits.Set(69);
+	ASSERT_EQUAL(bits.Count(), 4);
+	ASSERT_TRUE(bits.Test(33));
+	ASSERT_FALSE(bits.Test(32));
+
+	unsigned expected[] = {0, 9, 33, 69};
+	unsigned n = 0;
+	for(unsigned i = bits.FindFirst(); i != bits.NotFound; i = bits.FindNext(i))
+		ASSERT_EQUAL(i, expected[n++]);
+	ASSERT_EQUAL(n, 4);
+
+	bits.Clear(0);
+	ASSERT_EQUAL(bits.FindFirst(), 9);
+	bits.Toggle(9);
+	ASSERT_EQUAL(bits.FindFirst(), 33);
+
+	bits.SetAll();
+	ASSERT_EQUAL(bits.Count(), 70);
+	BitSet<70, WordT> other;
+	other.Set(5);
+	bits &= other;
+	ASSERT_TRUE(bits == other);
+	bits.ClearAll();
+	ASSERT_TRUE(bits.None());
+	cout << "\tOK" << endl;
+}
+
+struct Rx;
+struct Tx;
+
+struct Transfer :public ListNode<Transfer, Rx>, public ListNode<Transfer, Tx>, public SListNode<Transfer>
+{
+	Transfer(int i) :id(i) {}
+	int id;
+};
+
+void IntrusiveListTest()
+{
+	cout << __FUNCTION__;
+	Transfer t1(1), t2(2), t3(3);
+
+	IntrusiveSList<Transfer> queue;
+	ASSERT_TRUE(queue.IsEmpty());
+	queue.PushBack(&t1);
+	queue.PushBack(&t2);
+	queue.PushFront(&t3);
+	ASSERT_EQUAL(queue.Count(), 3);
+	ASSERT_TRUE(queue.Remove(&t1));
+	ASSERT_EQUAL(queue.Back(), &t2);
+	ASSERT_EQUAL(queue.PopFront(), &t3);
+	ASSERT_EQUAL(queue.PopFront(), &t2);
+	ASSERT_TRUE(queue.PopFront() == 0);
+	ASSERT_TRUE(queue.IsEmpty());
+
+	IntrusiveList<Transfer, Rx> rx;
+	IntrusiveList<Transfer, Tx> tx;
+	rx.PushBack(&t1);
+	rx.PushBack(&t3);
+	rx.InsertBefore(&t3, &t2);
+	tx.PushFront(&t3);
+	tx.PushFront(&t1);
+
+	int id = 1;
+	for(Transfer *t = rx.Front(); t; t = rx.Next(t))
+		ASSERT_EQUAL(t->id, id++);
+
+	rx.Remove(&t2);
+	ASSERT_EQUAL(rx.Next(&t1), &t3);
+	ASSERT_EQUAL(rx.Prev(&t3), &t1);
+	ASSERT_EQUAL(rx.PopBack(), &t3);
+	ASSERT_EQUAL(rx.Count(), 1);
+	// membership in tx list is independent
+	ASSERT_EQUAL(tx.Front(), &t1);
+	ASSERT_EQUAL(tx.Back(), &t3);
+	ASSERT_EQUAL(tx.PopFront(), &t1);
+	ASSERT_EQUAL(tx.PopFront(), &t3);
+	ASSERT_TRUE(tx.IsEmpty());
+	cout << "\tOK" << endl;
+}
+
+void StackTest()
+{
+	cout << __FUNCTION__;
+	Stack<2, int> stack;
+	ASSERT_TRUE(stack.Push(1));
+	ASSERT_TRUE(stack.Push(2));
+	ASSERT_FALSE(stack.Push(3));
+	ASSERT_EQUAL(stack.Pop(), 2);
+	cout << "\tOK" << endl;
+}
+
+void StaticHashMapTest()
+{
+	cout << __FUNCTION__;
+	StaticHashMap<uint16_t, int, 20> map;
+	ASSERT_EQUAL(map.Slots, 32);
+	ASSERT_TRUE(map.IsEmpty());
+	for(int i = 0; i < 20; i++)
+		ASSERT_TRUE(map.Insert(uint16_t(i * 32), i));
+	ASSERT_TRUE(map.IsFull());
+	ASSERT_FALSE(map.Insert(1000, 1));
+	// updating existing key works when full
+	ASSERT_TRUE(map.Insert(64, 200));
+	ASSERT_EQUAL(*map.Find(64), 200);
+	ASSERT_TRUE(map.Find(33) == 0);
+
+	// remove every other key and check all the rest are still reachable
+	for(int i = 0; i < 20; i += 2)
+		ASSERT_TRUE(map.Remove(uint16_t(i * 32)));
+	ASSERT_FALSE(map.Remove(0));
+	ASSERT_EQUAL(map.Count(), 10);
+	for(int i = 1; i < 20; i += 2)
+	{
+		ASSERT_TRUE(map.Find(uint16_t(i * 32)) != 0);
+		ASSERT_EQUAL(*map.Find(uint16_t(i * 32)), i);
+	}
+	for(int i = 0; i < 20; i += 2)
+		ASSERT_FALSE(map.Contains(uint16_t(i * 32)));
+
+	// many insert/remove cycles must not degrade probing (no tombstones)
+	for(unsigned n = 0; n < 10000; n++)
+	{
+		uint16_t key = uint16_t(rand());
+		if(!map.Contains(key) && map.Insert(key, 1))
+			ASSERT_TRUE(map.Remove(key));
+	}
+	ASSERT_EQUAL(map.Count(), 10);
+	for(int i = 1; i < 20; i += 2)
+		ASSERT_TRUE(map.ProbeLength(uint16_t(i * 32)) <= 10);
+
+	map.Clear();
+	ASSERT_TRUE(map.IsEmpty());
+	ASSERT_FALSE(map.Contains(32));
+	cout << "\tOK" << endl;
+}
+
+struct SumValues
+{
+	int sum;
+	SumValues():sum(0){}
+	void operator()(uint16_t, int value){ sum += value; }
+};
+
+void StaticHashMapRandomTest()
+{
+	cout << __FUNCTION__;
+	StaticHashMap<uint32_t, uint32_t, 100> map;
+	uint32_t keys[100];
+	bool present[100] = {false};
+	for(int i = 0; i < 100; i++)
+		keys[i] = uint32_t(rand()) * 7919u;
+	for(unsigned n = 0; n < 20000; n++)
+	{
+		int i = rand() % 100;
+		if(present[i])
+		{
+			ASSERT_EQUAL(*map.Find(keys[i]), keys[i] + 1);
+			ASSERT_TRUE(map.Remove(keys[i]));
+		}
+		else
+			ASSERT_TRUE(map.Insert(keys[i], keys[i] + 1));
+		present[i] = !present[i];
+	}
+	unsigned count = 0;
+	for(int i = 0; i < 100; i++)
+	{
+		ASSERT_EQUAL(map.Contains(keys[i]), present[i]);
+		count += present[i];
+	}
+	ASSERT_EQUAL(map.Count(), count);
+
+	StaticHashMap<uint16_t, int, 8> small;
+	small.Insert(1, 10);
+	small.Insert(2, 20);
+	SumValues sum;
+	small.ForEach(sum);
+	ASSERT_EQUAL(sum.sum, 30);
+	cout << "\tOK" << endl;
+}
+
+typedef StaticKeys<0x1001, 0x1002, 0x2010, 40001, 7, 9, 1000, 0x10000> ModbusKeys;
+
+void PerfectHashMapTest()
+{
+	cout << __FUNCTION__;
+	typedef PerfectHashMap<ModbusKeys, uint16_t> Map;
+	Map map;
+	ASSERT_EQUAL(Map::Count, 8);
+	ASSERT_EQUAL(Map::Slots, 16);
+	const uint32_t keys[] = {0x1001, 0x1002, 0x2010, 40001, 7, 9, 1000, 0x10000};
+	for(int i = 0; i < 8; i++)
+	{
+		ASSERT_TRUE(map.Find(keys[i]) != 0);
+		*map.Find(keys[i]) = uint16_t(i);
+		ASSERT_EQUAL(Map::KeyAt(Map::IndexOf(keys[i])), keys[i]);
+	}
+	for(int i = 0; i < 8; i++)
+		ASSERT_EQUAL(*map.Find(keys[i]), i);
+	ASSERT_EQUAL(map.Get<40001>(), 3);
+	for(uint32_t k = 0; k < 70000; k++)
+	{
+		bool expected = false;
+		for(int i = 0; i < 8; i++)
+			expected |= keys[i] == k;
+		ASSERT_EQUAL(map.Contains(k), expected);
+	}
+	cout << "\tOK" << endl;
+}
+
+void PriorityQueueTest()
+{
+	cout << __FUNCTION__;
+	PriorityQueue<int, 64> queue;
+	std::priority_queue<int> reference;
+	for(unsigned n = 0; n < 20000; n++)
+	{
+		if(!queue.IsFull() && (rand() & 1))
+		{
+			int value = rand() % 1000;
+			ASSERT_TRUE(queue.Push(value));
+			reference.push(-value);
+		}
+		else
+		{
+			int value;
+			ASSERT_EQUAL(queue.Pop(value), !reference.empty());
+			if(!reference.empty())
+			{
+				ASSERT_EQUAL(value, -reference.top());
+				reference.pop();
+			}
+		}
+		ASSERT_EQUAL(queue.Count(), reference.size());
+	}
+	cout << "\tOK" << endl;
+}
+
+void TickCompareTest()
+{
+	cout << __FUNCTION__;
+	using Timers::TickBefore;
+	ASSERT_TRUE(TickBefore<uint16_t>(10, 20));
+	ASSERT_FALSE(TickBefore<uint16_t>(20, 10));
+	ASSERT_FALSE(TickBefore<uint16_t>(10, 10));
+	// across counter overflow
+	ASSERT_TRUE(TickBefore<uint16_t>(0xfff0, 0x0010));
+	ASSERT_FALSE(TickBefore<uint16_t>(0x0010, 0xfff0));
+	ASSERT_TRUE(TickBefore<uint32_t>(0xfffffff0ul, 5));
+	ASSERT_TRUE(TickBefore<uint8_t>(250, 4));
+	ASSERT_EQUAL(Timers::TicksElapsed<uint16_t>(0xfff0, 0x0010), 0x20);
+
+	// deadlines that wrap around still come out in time order
+	PriorityQueue<uint16_t, 8, Timers::TickLess<uint16_t> > deadlines;
+	deadlines.Push(0x0005);
+	deadlines.Push(0xfffe);
+	deadlines.Push(0x0100);
+	deadlines.Push(0xff00);
+	uint16_t expected[] = {0xff00, 0xfffe, 0x0005, 0x0100};
+	for(int i = 0; i < 4; i++)
+	{
+		uint16_t value = 0;
+		ASSERT_TRUE(deadlines.Pop(value));
+		ASSERT_EQUAL(value, expected[i]);
+	}
+	cout << "\tOK" << endl;
+}
+
+void IndexedPriorityQueueTest()
+{
+	cout << __FUNCTION__;
+	typedef IndexedPriorityQueue<uint32_t, 32> Queue;
+	Queue queue;
+	Queue::Handle handles[32];
+	uint32_t values[32];
+	bool present[32];
+	for(int i = 0; i < 32; i++)
+	{
+		values[i] = uint32_t(rand() % 10000);
+		handles[i] = queue.Push(values[i]);
+		ASSERT_TRUE(handles[i] != Queue::InvalidHandle);
+		present[i] = true;
+	}
+	ASSERT_EQUAL(queue.Push(1), Queue::InvalidHandle);
+
+	for(unsigned n = 0; n < 5000; n++)
+	{
+		int i = rand() % 32;
+		switch(rand() % 3)
+		{
+		case 0:
+			if(present[i])
+			{
+				values[i] = uint32_t(rand() % 10000);
+				ASSERT_TRUE(queue.Update(handles[i], values[i]));
+			}
+			break;
+		case 1:
+			if(present[i])
+			{
+				ASSERT_TRUE(queue.Remove(handles[i]));
+				ASSERT_FALSE(queue.Contains(handles[i]));
+				ASSERT_FALSE(queue.Remove(handles[i]));
+				present[i] = false;
+			}
+			break;
+		default:
+			if(!present[i])
+			{
+				handles[i] = queue.Push(values[i]);
+				ASSERT_TRUE(handles[i] != Queue::InvalidHandle);
+				present[i] = true;
+			}
+		}
+		// top is the minimum of present values
+		uint32_t minimum = 0xffffffff;
+		for(int j = 0; j < 32; j++)
+			if(present[j] && values[j] < minimum)
+				minimum = values[j];
+		if(!queue.IsEmpty())
+			ASSERT_EQUAL(queue.Top(), minimum);
+		for(int j = 0; j < 32; j++)
+			if(present[j])
+				ASSERT_EQUAL(queue.Get(handles[j]), values[j]);
+	}
+
+	uint32_t prev = 0, value;
+	while(queue.Pop(value))
+	{
+		ASSERT_TRUE(prev <= value);
+		prev = value;
+	}
+	ASSERT_FALSE(queue.Contains(handles[0]));
+	cout << "\tOK" << endl;
+}
+
+template<class LENGTH_T>
+void RecordRingTest()
+{
+	cout << __FUNCTION__ << "\tlength size: " << sizeof(LENGTH_T);
+	typedef RecordRing<64, LENGTH_T> Ring;
+	Ring ring;
+	LENGTH_T length;
+	ASSERT_TRUE(ring.IsEmpty());
+	ASSERT_TRUE(ring.Peek(length) == 0);
+	ASSERT_TRUE(ring.Reserve(Ring::MaxRecordLength + 1) == 0);
+
+	// zero copy path, commit less than reserved
+	uint8_t *ptr = ring.Reserve(10);
+	ASSERT_TRUE(ptr != 0);
+	ASSERT_TRUE(ring.IsEmpty());
+	for(uint8_t i = 0; i < 6; i++)
+		ptr[i] = i;
+	ASSERT_FALSE(ring.Commit(11));
+	ASSERT_TRUE(ring.Commit(6));
+	ASSERT_FALSE(ring.Commit(6));
+	ASSERT_FALSE(ring.IsEmpty());
+	const uint8_t *record = ring.Peek(length);
+	ASSERT_TRUE(record == ptr);
+	ASSERT_EQUAL(length, 6);
+	ASSERT_EQUAL(record[5], 5);
+	ring.Release();
+	ASSERT_TRUE(ring.IsEmpty());
+
+	// random traffic against reference
+	std::deque<std::vector<uint8_t> > reference;
+	uint8_t counter = 0;
+	unsigned wrapped = 0;
+	for(unsigned n = 0; n < 20000; n++)
+	{
+		if(rand() & 1)
+		{
+			LENGTH_T size = LENGTH_T(rand() % (Ring::MaxRecordLength + 1));
+			std::vector<uint8_t> data(size);
+			for(unsigned i = 0; i < size; i++)
+				data[i] = counter++;
+			unsigned usedBefore = ring.BytesUsed();
+			unsigned need = (Ring::HeaderSize * 2 + size - 1) & ~(Ring::HeaderSize - 1);
+			// padding before wrap is always shorter than the record
+			bool fits = usedBefore + 2 * need <= ring.Size();
+			bool written = ring.Write(data.empty() ? 0 : &data[0], size);
+			if(fits)
+				ASSERT_TRUE(written);
+			if(written)
+			{
+				reference.push_back(data);
+				if(ring.BytesUsed() - usedBefore > need)
+					wrapped++;
+			}
+		}
+		else
+		{
+			const uint8_t *data = ring.Peek(length);
+			ASSERT_EQUAL(data == 0, reference.empty());
+			if(data)
+			{
+				ASSERT_EQUAL(length, reference.front().size());
+				ASSERT_TRUE(data + length <= (const uint8_t*)&ring + ring.Size());
+				for(unsigned i = 0; i < length; i++)
+					ASSERT_EQUAL(data[i], reference.front()[i]);
+				ring.Release();
+				reference.pop_front();
+			}
+		}
+	}
+	ASSERT_TRUE(wrapped > 0);
+
+	// copy read with too small buffer leaves record in place
+	ring.Clear();
+	uint8_t buffer[Ring::MaxRecordLength];
+	ASSERT_TRUE(ring.Write("hello", 5));
+	length = 3;
+	ASSERT_FALSE(ring.Read(buffer, length));
+	length = sizeof(buffer);
+	ASSERT_TRUE(ring.Read(buffer, length));
+	ASSERT_EQUAL(length, 5);
+	ASSERT_TRUE(memcmp(buffer, "hello", 5) == 0);
+	ASSERT_TRUE(ring.IsEmpty());
+	cout << "\tOK" << endl;
+}
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	const unsigned long iterations = 1000000;
+	{
+		BenchmarkTimer timer("StaticVector<int, 64> push/clear", iterations);
+		StaticVector<int, 64> vec;
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			if(!vec.PushBack(int(i)))
+				vec.Clear();
+		}
+		timer.Report();
+		DoNotOptimize(vec.Count());
+	}
+	{
+		BenchmarkTimer timer("std::vector<int> push/clear  ", iterations);
+		std::vector<int> vec;
+		vec.reserve(64);
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			if(vec.size() == 64)
+				vec.clear();
+			vec.push_back(int(i));
+		}
+		timer.Report();
+		DoNotOptimize(vec.size());
+	}
+
+	const unsigned scans = 20000;
+	BitSet<1024> bits;
+	std::bitset<1024> stdBits;
+	for(unsigned i = 0; i < 1024; i += 97)
+	{
+		bits.Set(i);
+		stdBits.set(i);
+	}
+	{
+		BenchmarkTimer timer("BitSet<1024> iterate set bits", scans);
+		unsigned sum = 0;
+		for(unsigned n = 0; n < scans; n++)
+			for(unsigned i = bits.FindFirst(); i != bits.NotFound; i = bits.FindNext(i))
+				sum += i;
+		timer.Report();
+		DoNotOptimize(sum);
+	}
+	{
+		BenchmarkTimer timer("std::bitset<1024> test loop ", scans);
+		unsigned sum = 0;
+		for(unsigned n = 0; n < scans; n++)
+			for(unsigned i = 0; i < 1024; i++)
+				if(stdBits.test(i))
+					sum += i;
+		timer.Report();
+		DoNotOptimize(sum);
+	}
+
+	{
+		Transfer t1(1);
+		BenchmarkTimer timer("IntrusiveList push/pop       ", iterations);
+		IntrusiveList<Transfer, Rx> list;
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			list.PushBack(&t1);
+			DoNotOptimize(list.PopFront()->id);
+		}
+		timer.Report();
+	}
+	{
+		BenchmarkTimer timer("std::list push/pop           ", iterations);
+		std::list<int> list;
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			list.push_back(int(i));
+			DoNotOptimize(list.front());
+			list.pop_front();
+		}
+		timer.Report();
+	}
+	{
+		const unsigned count = 64;
+		uint16_t keys[count];
+		StaticHashMap<uint16_t, uint16_t, count> map;
+		Array<count, uint16_t, uint16_t> scanKeys;
+		Array<count, uint16_t, uint16_t> scanValues;
+#if __cplusplus >= 201103L
+		std::unordered_map<uint16_t, uint16_t> stdMap;
+		const char *stdName = "std::unordered_map lookup   ";
+#else
+		std::map<uint16_t, uint16_t> stdMap;
+		const char *stdName = "std::map lookup             ";
+#endif
+		for(unsigned i = 0; i < count; i++)
+		{
+			keys[i] = uint16_t(rand());
+			map.Insert(keys[i], uint16_t(i));
+			scanKeys[i] = keys[i];
+			scanValues[i] = uint16_t(i);
+			stdMap[keys[i]] = uint16_t(i);
+		}
+		const unsigned long lookups = 2000000;
+		{
+			BenchmarkTimer timer("StaticHashMap<64> lookup    ", lookups);
+			unsigned sum = 0;
+			for(unsigned long n = 0; n < lookups; n++)
+				sum += *map.Find(keys[n % count]);
+			timer.Report();
+			DoNotOptimize(sum);
+		}
+		{
+			BenchmarkTimer timer("Array<64> linear scan       ", lookups);
+			unsigned sum = 0;
+			for(unsigned long n = 0; n < lookups; n++)
+			{
+				uint16_t key = keys[n % count];
+				for(unsigned i = 0; i < count; i++)
+					if(scanKeys[i] == key)
+					{
+						sum += scanValues[i];
+						break;
+					}
+			}
+			timer.Report();
+			DoNotOptimize(sum);
+		}
+		{
+			BenchmarkTimer timer(stdName, lookups);
+			unsigned sum = 0;
+			for(unsigned long n = 0; n < lookups; n++)
+				sum += stdMap.find(keys[n % count])->second;
+			timer.Report();
+			DoNotOptimize(sum);
+		}
+		{
+			const uint32_t perfectKeys[] = {0x1001, 0x1002, 0x2010, 40001, 7, 9, 1000, 0x10000};
+			PerfectHashMap<ModbusKeys, uint16_t> perfect;
+			for(unsigned i = 0; i < 8; i++)
+				*perfect.Find(perfectKeys[i]) = uint16_t(i);
+			BenchmarkTimer timer("PerfectHashMap<8> lookup    ", lookups);
+			unsigned sum = 0;
+			for(unsigned long n = 0; n < lookups; n++)
+				sum += *perfect.Find(perfectKeys[n & 7]);
+			timer.Report();
+			DoNotOptimize(sum);
+		}
+	}
+	{
+		const unsigned long operations = 1000000;
+		uint16_t keys[256];
+		for(unsigned i = 0; i < 256; i++)
+			keys[i] = uint16_t(rand());
+		{
+			PriorityQueue<uint16_t, 64> queue;
+			for(unsigned i = 0; i < 32; i++)
+				queue.Push(keys[i]);
+			BenchmarkTimer timer("PriorityQueue<64> push/pop  ", operations);
+			for(unsigned long n = 0; n < operations; n++)
+			{
+				queue.Push(keys[n & 255]);
+				queue.Pop();
+			}
+			timer.Report();
+			DoNotOptimize(queue.Top());
+		}
+		{
+			std::priority_queue<uint16_t> queue;
+			for(unsigned i = 0; i < 32; i++)
+				queue.push(keys[i]);
+			BenchmarkTimer timer("std::priority_queue push/pop", operations);
+			for(unsigned long n = 0; n < operations; n++)
+			{
+				queue.push(keys[n & 255]);
+				queue.pop();
+			}
+			timer.Report();
+			DoNotOptimize(queue.top());
+		}
+		{
+			IndexedPriorityQueue<uint16_t, 64> queue;
+			IndexedPriorityQueue<uint16_t, 64>::Handle handles[32];
+			for(unsigned i = 0; i < 32; i++)
+				handles[i] = queue.Push(keys[i]);
+			BenchmarkTimer timer("IndexedPriorityQueue update ", operations);
+			for(unsigned long n = 0; n < operations; n++)
+				queue.Update(handles[n & 31], keys[n & 255]);
+			timer.Report();
+			DoNotOptimize(queue.Top());
+		}
+	}
+	{
+		const unsigned long records = 200000;
+		uint8_t packet[32], buffer[32];
+		for(unsigned i = 0; i < sizeof(packet); i++)
+			packet[i] = uint8_t(i);
+		unsigned long sum = 0;
+		{
+			RecordRing<256> ring;
+			BenchmarkTimer timer("RecordRing<256> write/read ", records);
+			for(unsigned long n = 0; n < records; n++)
+			{
+				uint8_t length = uint8_t(n & 31);
+				uint8_t *ptr = ring.Reserve(length);
+				memcpy(ptr, packet, length);
+				ring.Commit(length);
+				const uint8_t *record = ring.Peek(length);
+				sum += length ? record[length - 1] : 0;
+				ring.Release();
+			}
+			timer.Report();
+		}
+		{
+			Queue<256> queue;
+			queue.Clear();
+			BenchmarkTimer timer("Queue<256> + length framing", records);
+			for(unsigned long n = 0; n < records; n++)
+			{
+				uint8_t length = uint8_t(n & 31);
+				queue.Write(length);
+				for(uint8_t i = 0; i < length; i++)
+					queue.Write(packet[i]);
+				queue.Read(length);
+				for(uint8_t i = 0; i < length; i++)
+					queue.Read(buffer[i]);
+				sum += length ? buffer[length - 1] : 0;
+			}
+			timer.Report();
+		}
+		DoNotOptimize(sum);
+	}
+}
+
+int main()
+{
+	BitUtilsTest();
+	StaticVectorTest();
+	BitSetTest<uint8_t>();
+	BitSetTest<uint16_t>();
+	BitSetTest<unsigned>();
+	BitSetTest<uint64_t>();
+	IntrusiveListTest();
+	StackTest();
+	StaticHashMapTest();
+	StaticHashMapRandomTest();
+	PerfectHashMapTest();
+	PriorityQueueTest();
+	TickCompareTest();
+	IndexedPriorityQueueTest();
+	RecordRingTest<uint8_t>();
+	RecordRingTest<uint16_t>();
+
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
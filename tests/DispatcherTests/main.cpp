@@ -0,0 +1,201 @@
+#include <iostream>
+#include <stdint.h>
+#include "asserts.h"
+#include "dispatcher.h"
+#include "low_power_idle.h"
+#include "time_service.h"
+
+using namespace std;
+using namespace Power;
+
+// Sleep blocker standing for a USART transmission in progress
+struct UsartBlocker
+{
+	static bool busy;
+	static SleepMode SleepLimit()
+	{
+		return busy ? Idle : Deepest;
+	}
+};
+
+bool UsartBlocker::busy;
+
+typedef TickCounter<1000> Ticks;
+typedef LowPowerIdle<Loki::TL::MakeTypelist<UsartBlocker>::Result, Ticks> SleepPolicy;
+typedef Dispatcher<8, 4, SleepPolicy> Disp;
+
+int runs;
+
+void Task()
+{
+	runs++;
+}
+
+// Timer interrupt waking the part: 1 ms tick for the clock and the dispatcher
+void TimerInterrupt()
+{
+	Ticks::Tick();
+	Disp::TimerHandler();
+}
+
+void SetupIdle()
+{
+	Sleep::Reset();
+	Disp::Init();
+	SleepPolicy::ResetStatistics();
+	UsartBlocker::busy = false;
+	runs = 0;
+}
+
+void NoIdleTest()
+{
+	cout << __FUNCTION__;
+	typedef Dispatcher<4, 2> Plain;
+	Sleep::Reset();
+	Plain::Init();
+	Plain::Poll();
+	ASSERT_EQUAL(Sleep::Count(PowerDown) + Sleep::Count(Idle), 0ul);
+	Plain::SetTask(Task);
+	runs = 0;
+	Plain::Poll();
+	ASSERT_EQUAL(runs, 1);
+	cout << "\tOK" << endl;
+}
+
+void SleepWhenIdleTest()
+{
+	cout << __FUNCTION__;
+	SetupIdle();
+	Sleep::SetWakeEvent(TimerInterrupt);
+
+	// a ready task runs, no sleep
+	Disp::SetTask(Task);
+	Disp::Poll();
+	ASSERT_EQUAL(runs, 1);
+	ASSERT_EQUAL(Sleep::Count(PowerDown), 0ul);
+
+	// nothing ready: sleeps in the deepest mode until the timer task is due
+	Disp::SetTimer(Task, 10);
+	while(runs == 1)
+		Disp::Poll();
+	ASSERT_EQUAL(Sleep::Count(PowerDown), 10ul);
+	ASSERT_EQUAL(Sleep::UnsafeEntries(), 0ul);
+	ASSERT_FALSE(Atomic::DisableInterrupts::IsActive());
+	ASSERT_EQUAL(SleepPolicy::Sleeps(), 10u);
+	ASSERT_EQUAL(SleepPolicy::SleepTime(), 10u);
+	cout << "\tOK" << endl;
+}
+
+void BlockersTest()
+{
+	cout << __FUNCTION__;
+	SetupIdle();
+	ASSERT_EQUAL(SleepPolicy::AllowedMode(), PowerDown);
+
+	// compile time blocker
+	UsartBlocker::busy = true;
+	ASSERT_EQUAL(SleepPolicy::AllowedMode(), Idle);
+	Disp::Poll();
+	ASSERT_EQUAL(Sleep::LastMode(), Idle);
+	UsartBlocker::busy = false;
+
+	// runtime blockers nest, the lightest wins
+	SleepPolicy::Block(Idle);
+	SleepPolicy::Block(Idle);
+	SleepPolicy::Block(NoSleep);
+	ASSERT_EQUAL(SleepPolicy::AllowedMode(), NoSleep);
+	Disp::Poll();
+	ASSERT_EQUAL(SleepPolicy::Sleeps(), 1u);
+	SleepPolicy::Unblock(NoSleep);
+	ASSERT_EQUAL(SleepPolicy::AllowedMode(), Idle);
+	SleepPolicy::Unblock(Idle);
+	ASSERT_EQUAL(SleepPolicy::AllowedMode(), Idle);
+	SleepPolicy::Unblock(Idle);
+	ASSERT_EQUAL(SleepPolicy::AllowedMode(), PowerDown);
+	Disp::Poll();
+	ASSERT_EQUAL(Sleep::LastMode(), PowerDown);
+	ASSERT_EQUAL(SleepPolicy::Sleeps(), 2u);
+	cout << "\tOK" << endl;
+}
+
+// Interrupt posting a task between the queue read and the sleep decision
+void PostTask()
+{
+	Disp::SetTask(Task);
+}
+
+void WakeAccountingTest()
+{
+	cout << __FUNCTION__;
+	SetupIdle();
+	// a task posted by the waking interrupt runs on the next Poll
+	Sleep::SetWakeEvent(PostTask);
+	Disp::Poll();
+	ASSERT_EQUAL(runs, 0);
+	ASSERT_EQUAL(SleepPolicy::Sleeps(), 1u);
+	Disp::Poll();
+	ASSERT_EQUAL(runs, 1);
+	ASSERT_EQUAL(SleepPolicy::Sleeps(), 1u);
+
+	// sleep time counts clock ticks passed while sleeping only
+	Sleep::SetWakeEvent(TimerInterrupt);
+	SleepPolicy::ResetStatistics();
+	Disp::SetTimer(Task, 3);
+	for(int i = 0; i < 5; i++)
+		TimerInterrupt();
+	Disp::Poll();
+	ASSERT_EQUAL(runs, 2);
+	ASSERT_EQUAL(SleepPolicy::SleepTime(), 0u);
+	for(int i = 0; i < 4; i++)
+		Disp::Poll();
+	ASSERT_EQUAL(SleepPolicy::SleepTime(), 4u);
+	ASSERT_EQUAL(SleepPolicy::Sleeps(), 4u);
+	cout << "\tOK" << endl;
+}
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	const unsigned long iterations = 2000000;
+	{
+		typedef Dispatcher<8, 4> Plain;
+		Plain::Init();
+		BenchmarkTimer timer("Dispatcher poll, empty, no idle", iterations);
+		for(unsigned long i = 0; i < iterations; i++)
+			Plain::Poll();
+		timer.Report();
+	}
+	{
+		SetupIdle();
+		BenchmarkTimer timer("Dispatcher poll, empty, idle policy", iterations);
+		for(unsigned long i = 0; i < iterations; i++)
+			Disp::Poll();
+		timer.Report();
+		DoNotOptimize(SleepPolicy::Sleeps());
+	}
+	{
+		SetupIdle();
+		BenchmarkTimer timer("Dispatcher post and poll, idle policy", iterations);
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			Disp::SetTask(Task);
+			Disp::Poll();
+		}
+		timer.Report();
+		DoNotOptimize(runs);
+	}
+}
+
+int main()
+{
+	NoIdleTest();
+	SleepWhenIdleTest();
+	BlockersTest();
+	WakeAccountingTest();
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
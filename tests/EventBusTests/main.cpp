@@ -0,0 +1,296 @@
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+#include "asserts.h"
+#include "dispatcher.h"
+#include "event_bus.h"
+
+using namespace std;
+using Loki::TL::MakeTypelist;
+
+struct Temperature
+{
+	int16_t value;
+};
+
+struct KeyPress
+{
+	uint8_t key;
+};
+
+// Topic nobody subscribes to
+struct Unrouted
+{
+	int value;
+};
+
+string trace;
+long sum;
+
+struct Logger
+{
+	static void Handle(const Temperature &t)
+	{
+		trace += "L" + Format(t.value) + " ";
+	}
+	static void Handle(const KeyPress &k)
+	{
+		trace += "Lk" + Format(k.key) + " ";
+	}
+
+	static string Format(int value)
+	{
+		char buffer[12];
+		sprintf(buffer, "%d", value);
+		return buffer;
+	}
+};
+
+struct Control
+{
+	static int16_t last;
+	static void Handle(const Temperature &t)
+	{
+		last = t.value;
+		trace += "C ";
+	}
+};
+
+int16_t Control::last;
+
+struct Display
+{
+	static void Handle(const Temperature &)
+	{
+		trace += "D ";
+	}
+	static void Handle(const KeyPress &)
+	{
+		trace += "Dk ";
+	}
+};
+
+typedef EventBus<MakeTypelist<
+	Route<Temperature, MakeTypelist<Logger, Control, Display>::Result>,
+	Route<KeyPress, MakeTypelist<Display>::Result>,
+	// routes of a topic are joined
+	Route<KeyPress, MakeTypelist<Logger>::Result>
+	>::Result> Bus;
+
+void PublishTest()
+{
+	cout << __FUNCTION__;
+	ASSERT_EQUAL((int)Bus::SubscriberCount<Temperature>::value, 3);
+	ASSERT_EQUAL((int)Bus::SubscriberCount<KeyPress>::value, 2);
+	ASSERT_EQUAL((int)Bus::SubscriberCount<Unrouted>::value, 0);
+
+	trace = "";
+	Temperature t = {215};
+	Bus::Publish(t);
+	ASSERT_TRUE(trace == "L215 C D ");
+	ASSERT_EQUAL(Control::last, 215);
+
+	trace = "";
+	KeyPress k = {3};
+	Bus::Publish(k);
+	ASSERT_TRUE(trace == "Dk Lk3 ");
+
+	trace = "";
+	Unrouted u = {1};
+	Bus::Publish(u);
+	ASSERT_TRUE(trace == "");
+	cout << "\tOK" << endl;
+}
+
+typedef Dispatcher<8, 2> Disp;
+typedef DeferredEventBus<MakeTypelist<
+	Route<Temperature, MakeTypelist<Logger, Control, Display>::Result>,
+	Route<KeyPress, MakeTypelist<Display>::Result>
+	>::Result, Disp, 4> Deferred;
+
+void DeferredTest()
+{
+	cout << __FUNCTION__;
+	Disp::Init();
+	trace = "";
+	Temperature t1 = {1}, t2 = {2};
+	KeyPress k = {7};
+	ASSERT_TRUE(Deferred::Post(t1));
+	ASSERT_TRUE(Deferred::Post(k));
+	ASSERT_TRUE(Deferred::Post(t2));
+	Unrouted u = {0};
+	ASSERT_TRUE(Deferred::Post(u));
+	// nothing is delivered until the main loop polls
+	ASSERT_TRUE(trace == "");
+	ASSERT_FALSE(Deferred::IsEmpty<Temperature>());
+	ASSERT_FALSE(Atomic::DisableInterrupts::IsActive());
+
+	// one event per task, in post order
+	Disp::Poll();
+	ASSERT_TRUE(trace == "L1 C D ");
+	Disp::Poll();
+	ASSERT_TRUE(trace == "L1 C D Dk ");
+	Disp::Poll();
+	ASSERT_TRUE(trace == "L1 C D Dk L2 C D ");
+	Disp::Poll();
+	ASSERT_TRUE(trace == "L1 C D Dk L2 C D ");
+	ASSERT_TRUE(Deferred::IsEmpty<Temperature>());
+	ASSERT_TRUE(Deferred::IsEmpty<KeyPress>());
+	cout << "\tOK" << endl;
+}
+
+void DeferredOverflowTest()
+{
+	cout << __FUNCTION__;
+	Disp::Init();
+	trace = "";
+	for(int16_t i = 0; i < 4; i++)
+	{
+		Temperature t = {i};
+		ASSERT_TRUE(Deferred::Post(t));
+	}
+	Temperature lost = {99};
+	ASSERT_FALSE(Deferred::Post(lost));
+	for(int i = 0; i < 8; i++)
+		Disp::Poll();
+	ASSERT_TRUE(trace == "L0 C D L1 C D L2 C D L3 C D ");
+	ASSERT_EQUAL(Control::last, 3);
+	cout << "\tOK" << endl;
+}
+
+void NoTask()
+{}
+
+// A post the dispatcher cannot schedule is refused, later posts are
+// delivered without lag
+void DispatcherFullTest()
+{
+	cout << __FUNCTION__;
+	Disp::Init();
+	trace = "";
+	for(int i = 0; i < 8; i++)
+		ASSERT_TRUE(Disp::SetTask(NoTask));
+	Temperature t1 = {1}, t2 = {2};
+	ASSERT_FALSE(Deferred::Post(t1));
+	ASSERT_TRUE(Deferred::IsEmpty<Temperature>());
+	for(int i = 0; i < 8; i++)
+		Disp::Poll();
+
+	ASSERT_TRUE(Deferred::Post(t2));
+	Disp::Poll();
+	ASSERT_TRUE(trace == "L2 C D ");
+	ASSERT_TRUE(Deferred::IsEmpty<Temperature>());
+	ASSERT_FALSE(Atomic::DisableInterrupts::IsActive());
+	cout << "\tOK" << endl;
+}
+
+// Handlers for benchmarks: inline and cheap, so dispatch overhead dominates
+struct Sample
+{
+	int32_t value;
+};
+
+struct SumA
+{
+	static void Handle(const Sample &s)
+	{
+		sum += s.value;
+	}
+};
+
+struct SumB
+{
+	static void Handle(const Sample &s)
+	{
+		sum ^= s.value;
+	}
+};
+
+struct SumC
+{
+	static void Handle(const Sample &s)
+	{
+		sum -= s.value >> 1;
+	}
+};
+
+typedef MakeTypelist<Route<Sample, MakeTypelist<SumA, SumB, SumC>::Result> >::Result SampleRoutes;
+typedef EventBus<SampleRoutes> SampleBus;
+typedef Dispatcher<16, 2> BenchDisp;
+typedef DeferredEventBus<SampleRoutes, BenchDisp, 8> DeferredSampleBus;
+
+// Runtime registered callbacks, the wiring the bus replaces
+typedef void (*SampleCallback)(const Sample &);
+SampleCallback callbacks[3] = {&SumA::Handle, &SumB::Handle, &SumC::Handle};
+volatile unsigned callbackCount = 3;
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	const unsigned long iterations = 10000000;
+	{
+		sum = 0;
+		BenchmarkTimer timer("Direct calls, 3 handlers", iterations);
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			Sample s = {int32_t(i)};
+			SumA::Handle(s);
+			SumB::Handle(s);
+			SumC::Handle(s);
+		}
+		timer.Report();
+		DoNotOptimize(sum);
+	}
+	{
+		sum = 0;
+		BenchmarkTimer timer("EventBus publish, 3 subscribers", iterations);
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			Sample s = {int32_t(i)};
+			SampleBus::Publish(s);
+		}
+		timer.Report();
+		DoNotOptimize(sum);
+	}
+	{
+		sum = 0;
+		BenchmarkTimer timer("Callback table, 3 callbacks", iterations);
+		for(unsigned long i = 0; i < iterations; i++)
+		{
+			Sample s = {int32_t(i)};
+			for(unsigned c = 0; c < callbackCount; c++)
+				callbacks[c](s);
+		}
+		timer.Report();
+		DoNotOptimize(sum);
+	}
+	{
+		sum = 0;
+		BenchDisp::Init();
+		const unsigned long deferredIterations = iterations / 10;
+		BenchmarkTimer timer("DeferredEventBus post and poll, 3 subscribers", deferredIterations);
+		for(unsigned long i = 0; i < deferredIterations; i++)
+		{
+			Sample s = {int32_t(i)};
+			DeferredSampleBus::Post(s);
+			BenchDisp::Poll();
+		}
+		timer.Report();
+		DoNotOptimize(sum);
+	}
+}
+
+int main()
+{
+	PublishTest();
+	DeferredTest();
+	DeferredOverflowTest();
+	DispatcherFullTest();
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
@@ -0,0 +1,751 @@
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "asserts.h"
+#include "iopins.h"
+#include "pinlist.h"
+#include "wave_recorder.h"
+#include "framebuffer.h"
+#include "font5x7.h"
+#include "drivers/Bus8080.h"
+#include "oled_sim.h"
+#include "drivers/Ssd1306.h"
+
+using namespace std;
+using namespace IO;
+using namespace IO::Test;
+
+typedef TestPort<uint8_t, 'A'> Porta;
+typedef TestPort<uint8_t, 'B'> Portb;
+typedef TestPort<uint8_t, 'C'> Portc;
+
+DECLARE_PORT_PINS(Porta, Pa)
+DECLARE_PORT_PINS(Portb, Pb)
+DECLARE_PORT_PINS(Portc, Pc)
+
+// 8 bit bus wired across two ports, 16 bit bus on two whole ports
+typedef PinList<Pa0, Pa1, Pa2, Pa3, Pb4, Pb5, Pb6, Pb7> Data8;
+typedef PinList<Pa0, Pa1, Pa2, Pa3, Pa4, Pa5, Pa6, Pa7,
+	Pb0, Pb1, Pb2, Pb3, Pb4, Pb5, Pb6, Pb7> Data16;
+typedef Bus8080<Data8, Pc0, Pc1, Pc2, Pc3> Bus8;
+typedef Bus8080<Data16, Pc0, Pc1, Pc2, Pc3> Bus16;
+typedef Bus8080<Data8, Pc0, Pc1, Pc2> WriteOnlyBus;
+
+typedef OledSim<false, 0> SpiPanel;
+typedef Ssd1306<OledSpi<SpiPanel, SpiPanel::Cs, SpiPanel::Dc> > SpiOled;
+typedef OledSim<true, 1> I2cPanel;
+typedef Ssd1306<OledI2c<I2cPanel>, 128, 64, Sh1106Controller> I2cOled;
+
+typedef MonoFrameBuffer<128, 64> Oled;
+typedef MonoFrameBuffer<32, 16> SmallMono;
+typedef Rgb565FrameBuffer<160, 128> Tft;
+typedef Rgb565FrameBuffer<16, 8> SmallTft;
+
+// Frame buffer as text, one line per row: '#' for set pixels, '.' for clear
+template<class Buffer>
+string MonoImage(const Buffer &buffer)
+{
+	string image;
+	for(int16_t y = 0; y < Buffer::Height; y++)
+	{
+		for(int16_t x = 0; x < Buffer::Width; x++)
+			image += buffer.GetPixel(x, y) ? '#' : '.';
+		image += '\n';
+	}
+	return image;
+}
+
+// Colors are shown by index in palette, '?' for others
+template<class Buffer>
+string ColorImage(const Buffer &buffer, const uint16_t *palette, unsigned colors)
+{
+	string image;
+	for(int16_t y = 0; y < Buffer::Height; y++)
+	{
+		for(int16_t x = 0; x < Buffer::Width; x++)
+		{
+			char c = '?';
+			for(unsigned i = 0; i < colors; i++)
+				if(buffer.GetPixel(x, y) == palette[i])
+					c = char('0' + i);
+			image += c;
+		}
+		image += '\n';
+	}
+	return image;
+}
+
+void CheckImage(const string &image, const char *golden)
+{
+	if(image != golden)
+		cout << "\nGot:\n" << image << "Expected:\n" << golden;
+	ASSERT_TRUE(image == golden);
+}
+
+void CheckDirty(const Rect &dirty, int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+	ASSERT_EQUAL(dirty.x0, x0);
+	ASSERT_EQUAL(dirty.y0, y0);
+	ASSERT_EQUAL(dirty.x1, x1);
+	ASSERT_EQUAL(dirty.y1, y1);
+}
+
+const char MonoShapesGolden[] =
+	"################................\n"
+	"#..............#......#.........\n"
+	"#..............#.....#.#........\n"
+	"#..#############....#...#.......\n"
+	"#..#########...#.#.#.....#......\n"
+	"#..............#.#........#.....\n"
+	"#..............#...#.....#......\n"
+	"################....##.##.......\n"
+	"......................#.........\n"
+	".......................#........\n"
+	"........................#.......\n"
+	".........................##.....\n"
+	"...........................##...\n"
+	".............................##.\n"
+	"...............................#\n"
+	"................................\n";
+
+void MonoShapesTest()
+{
+	SmallMono fb;
+	fb.DrawRect(0, 0, 16, 8, MonoColor::White);
+	fb.FillRect(3, 3, 12, 2, MonoColor::White);
+	fb.FillRect(12, 4, 3, 1, MonoColor::Invert);
+	fb.DrawLine(22, 1, 17, 6, MonoColor::White);
+	fb.DrawLine(22, 1, 26, 5, MonoColor::White);
+	fb.DrawLine(17, 4, 23, 9, MonoColor::White);
+	fb.DrawLine(26, 5, 22, 8, MonoColor::White);
+	fb.DrawLine(24, 10, 31, 14, MonoColor::White);
+	fb.SetPixel(17, 6, MonoColor::Invert);
+	fb.SetPixel(18, 5, MonoColor::Invert);
+	fb.SetPixel(17, 5, MonoColor::White);
+	CheckImage(MonoImage(fb), MonoShapesGolden);
+	CheckDirty(fb.Dirty(), 0, 0, 32, 15);
+}
+
+const char MonoTextGolden[] =
+	"................................\n"
+	".#...#...#......###.............\n"
+	".#...#.........#...#............\n"
+	".#...#..##.....#...#............\n"
+	".#####...#.....#...#............\n"
+	".#...#...#.....#####............\n"
+	".#...#...#.####....#............\n"
+	".#...#..###....#...#............\n"
+	"...........#####................\n"
+	"#.####################..........\n"
+	"#.####################..........\n"
+	"#.####################..........\n"
+	"#.#####.....##########..........\n"
+	"#.####################..........\n"
+	"#.....################..........\n"
+	"################################\n";
+
+void MonoTextTest()
+{
+	SmallMono fb;
+	ASSERT_EQUAL(fb.DrawText(1, 1, "Hi", Fonts::Font5x7, MonoColor::White), 13);
+	// a glyph crossing the page boundary and one cut by the right edge
+	fb.DrawChar(15, 1, 'A', Fonts::Font5x7, MonoColor::White);
+	fb.ClearDirty();
+	fb.FillRect(0, 9, 22, 7, MonoColor::White);
+	fb.DrawText(1, 8, "L", Fonts::Font5x7, MonoColor::Black);
+	fb.DrawText(7, 8, "=", Fonts::Font5x7, MonoColor::Invert);
+	fb.DrawText(7, 8, "=", Fonts::Font5x7, MonoColor::Invert);
+	fb.DrawText(7, 9, "-", Fonts::Font5x7, MonoColor::Black);
+	fb.DrawText(11, 4, "=", Fonts::Font5x7, MonoColor::Invert);
+	fb.DrawHLine(-5, 15, 100, MonoColor::White);
+	CheckImage(MonoImage(fb), MonoTextGolden);
+	CheckDirty(fb.Dirty(), 0, 4, 32, 16);
+	ASSERT_EQUAL(SmallMono::TextWidth("Hi", Fonts::Font5x7), 11);
+	ASSERT_EQUAL(SmallMono::TextWidth("", Fonts::Font5x7), 0);
+}
+
+// Fills, bitmaps and blits against a pixel by pixel model
+void MonoModelTest()
+{
+	static Oled fb;
+	static bool model[64][128];
+	memset(model, 0, sizeof(model));
+	uint8_t bitmap[3 * 21];
+	srand(5);
+	for(unsigned i = 0; i < sizeof(bitmap); i++)
+		bitmap[i] = uint8_t(rand());
+	for(int iteration = 0; iteration < 3000; iteration++)
+	{
+		int16_t x = int16_t(rand() % 170 - 20);
+		int16_t y = int16_t(rand() % 100 - 20);
+		int16_t w = int16_t(rand() % 70 - 2);
+		int16_t h = int16_t(rand() % 40 - 2);
+		MonoColor::Type color = MonoColor::Type(rand() % 3);
+		int operation = rand() % 3;
+		if(operation == 0)
+			fb.FillRect(x, y, w, h, color);
+		else if(operation == 1)
+			fb.DrawBitmap(x, y, bitmap, 21, 19, color);
+		else
+			fb.Blit(x, y, bitmap, 21, 19);
+		if(operation != 0)
+		{
+			w = 21;
+			h = 19;
+		}
+		for(int16_t row = y < 0 ? 0 : y; row < y + h && row < 64; row++)
+			for(int16_t column = x < 0 ? 0 : x; column < x + w && column < 128; column++)
+			{
+				bool bit = true;
+				if(operation != 0)
+				{
+					int16_t r = int16_t(row - y);
+					bit = (bitmap[(r >> 3) * 21 + column - x] >> (r & 7)) & 1;
+				}
+				bool &pixel = model[row][column];
+				if(operation == 2)
+					pixel = bit;
+				else if(bit)
+					pixel = color == MonoColor::White ? true : color == MonoColor::Black ? false : !pixel;
+			}
+	}
+	for(int16_t row = 0; row < 64; row++)
+		for(int16_t column = 0; column < 128; column++)
+			ASSERT_EQUAL(fb.GetPixel(column, row), model[row][column]);
+}
+
+void ClippingTest()
+{
+	SmallMono fb;
+	fb.FillRect(-10, -10, 5, 50, MonoColor::White);
+	fb.FillRect(32, 0, 5, 5, MonoColor::White);
+	fb.FillRect(0, 16, 5, 5, MonoColor::White);
+	fb.FillRect(2, 2, 0, 5, MonoColor::White);
+	fb.FillRect(2, 2, 5, -1, MonoColor::White);
+	fb.DrawLine(-100, -50, -1, 20, MonoColor::White);
+	fb.DrawLine(40, -3, 100, 30, MonoColor::White);
+	fb.DrawText(-20, 0, "ab", Fonts::Font5x7, MonoColor::White);
+	fb.DrawText(0, 16, "ab", Fonts::Font5x7, MonoColor::White);
+	fb.SetPixel(-1, 0, MonoColor::White);
+	fb.SetPixel(0, 16, MonoColor::White);
+	fb.Blit(32, 0, fb.Data(), 32, 16);
+	ASSERT_FALSE(fb.IsDirty());
+	for(size_t i = 0; i < SmallMono::Size(); i++)
+		ASSERT_EQUAL(fb.Data()[i], 0);
+
+	// a line through the corner is clipped to the visible part
+	fb.DrawLine(-4, -4, 35, 35, MonoColor::White);
+	for(int16_t i = 0; i < 16; i++)
+		ASSERT_TRUE(fb.GetPixel(i, i));
+	CheckDirty(fb.Dirty(), 0, 0, 32, 16);
+	fb.ClearDirty();
+	fb.DrawText(28, 12, "W", Fonts::Font5x7, MonoColor::White);
+	CheckDirty(fb.Dirty(), 28, 12, 32, 16);
+	ASSERT_TRUE(fb.GetPixel(28, 12));
+	ASSERT_FALSE(fb.GetPixel(29, 15));
+	ASSERT_TRUE(fb.GetPixel(30, 15));
+}
+
+void DirtyTest()
+{
+	static Oled fb;
+	fb.Clear(MonoColor::Black);
+	CheckDirty(fb.Dirty(), 0, 0, 128, 64);
+	fb.ClearDirty();
+	ASSERT_FALSE(fb.IsDirty());
+	// typical UI update: a value in a status line
+	fb.FillRect(90, 0, 38, 8, MonoColor::Black);
+	fb.DrawText(90, 0, "12:34", Fonts::Font5x7, MonoColor::White);
+	CheckDirty(fb.Dirty(), 90, 0, 128, 8);
+	// pages and columns to push: 1 page of 38 columns instead of 1 KB
+	unsigned pages = unsigned((fb.Dirty().y1 + 7) / 8 - fb.Dirty().y0 / 8);
+	ASSERT_EQUAL(pages * fb.Dirty().Width(), 38u);
+	fb.SetPixel(3, 40, MonoColor::White);
+	CheckDirty(fb.Dirty(), 3, 0, 128, 41);
+	fb.ClearDirty();
+	Rect rect(5, 6, 7, 8);
+	fb.Invalidate(rect);
+	CheckDirty(fb.Dirty(), 5, 6, 7, 8);
+	fb.Invalidate(Rect());
+	CheckDirty(fb.Dirty(), 5, 6, 7, 8);
+}
+
+const char ColorGolden[] =
+	"0000000000000000\n"
+	"0111111111111000\n"
+	"0122222222221000\n"
+	"0122233222221000\n"
+	"0111131111111000\n"
+	"0000300000000000\n"
+	"0003000000000000\n"
+	"0030000000000000\n";
+
+void ColorTest()
+{
+	SmallTft fb;
+	const uint16_t palette[] =
+	{
+		0,
+		Tft::Rgb(255, 255, 255),
+		Tft::Rgb(0, 0, 255),
+		Tft::Rgb(255, 0, 0)
+	};
+	ASSERT_EQUAL(palette[1], 0xffff);
+	ASSERT_EQUAL(palette[2], 0x001f);
+	ASSERT_EQUAL(palette[3], 0xf800);
+	fb.FillRect(1, 1, 12, 4, palette[1]);
+	fb.FillRect(2, 2, 10, 2, palette[2]);
+	fb.DrawLine(6, 3, 2, 7, palette[3]);
+	fb.SetPixel(5, 3, palette[3]);
+	CheckImage(ColorImage(fb, palette, 4), ColorGolden);
+	CheckDirty(fb.Dirty(), 1, 1, 13, 8);
+
+	// clipped blit of a 4x3 image at every position around the buffer
+	uint16_t image[12];
+	for(unsigned i = 0; i < 12; i++)
+		image[i] = uint16_t(0x100 + i);
+	for(int16_t y = -4; y < 10; y++)
+		for(int16_t x = -5; x < 18; x++)
+		{
+			fb.Clear(0);
+			fb.ClearDirty();
+			fb.Blit(x, y, image, 4, 3);
+			for(int16_t row = 0; row < SmallTft::Height; row++)
+				for(int16_t column = 0; column < SmallTft::Width; column++)
+				{
+					bool inside = column >= x && column < x + 4 && row >= y && row < y + 3;
+					ASSERT_EQUAL(fb.GetPixel(column, row), inside ? image[(row - y) * 4 + column - x] : 0);
+				}
+			ASSERT_EQUAL(fb.IsDirty(), x > -4 && x < 16 && y > -3 && y < 8);
+		}
+
+	// text over a background
+	fb.Clear(palette[2]);
+	fb.DrawText(-1, 1, "T", Fonts::Font5x7, palette[1]);
+	ASSERT_EQUAL(fb.GetPixel(-1, 1), 0);
+	ASSERT_EQUAL(fb.GetPixel(0, 1), palette[1]);
+	ASSERT_EQUAL(fb.GetPixel(1, 1), palette[1]);
+	ASSERT_EQUAL(fb.GetPixel(1, 7), palette[1]);
+	ASSERT_EQUAL(fb.GetPixel(0, 2), palette[2]);
+}
+
+// Spans of every length and alignment against a model
+void ColorFillTest()
+{
+	static Tft fb;
+	for(int16_t x = 0; x < 8; x++)
+		for(int16_t w = 0; w < 20; w++)
+		{
+			fb.Clear(1);
+			fb.FillRect(x, 1, w, 2, 2);
+			for(int16_t column = 0; column < 30; column++)
+			{
+				uint16_t expected = column >= x && column < x + w ? 2 : 1;
+				ASSERT_EQUAL(fb.GetPixel(column, 0), 1);
+				ASSERT_EQUAL(fb.GetPixel(column, 1), expected);
+				ASSERT_EQUAL(fb.GetPixel(column, 2), expected);
+				ASSERT_EQUAL(fb.GetPixel(column, 3), 1);
+			}
+		}
+}
+
+// one port access every 2 CPU cycles at 72 MHz
+const uint32_t AccessTime = 28;
+
+template<class Port>
+uint8_t PortAt(const WaveRecorder &recorder, uint64_t time)
+{
+	return uint8_t(recorder.Level<TPin<Port, 0> >(time) | recorder.Level<TPin<Port, 1> >(time) << 1 |
+		recorder.Level<TPin<Port, 2> >(time) << 2 | recorder.Level<TPin<Port, 3> >(time) << 3 |
+		recorder.Level<TPin<Port, 4> >(time) << 4 | recorder.Level<TPin<Port, 5> >(time) << 5 |
+		recorder.Level<TPin<Port, 6> >(time) << 6 | recorder.Level<TPin<Port, 7> >(time) << 7);
+}
+
+uint16_t DataAt(const WaveRecorder &recorder, uint64_t time, bool wide)
+{
+	uint8_t a = PortAt<Porta>(recorder, time);
+	uint8_t b = PortAt<Portb>(recorder, time);
+	return wide ? uint16_t(a | b << 8) : uint16_t((a & 0x0f) | (b & 0xf0));
+}
+
+// Bus write cycles as seen by the controller, D/C and data are latched on
+// the rising edge of WR and have to be stable since the falling one
+struct BusCycle
+{
+	bool data;
+	uint16_t value;
+};
+
+vector<BusCycle> DecodeCycles(const WaveRecorder &recorder, bool wide)
+{
+	vector<uint64_t> falls = recorder.Edges<Pc2>(false, true);
+	vector<uint64_t> rises = recorder.Edges<Pc2>(true);
+	ASSERT_EQUAL(falls.size(), rises.size());
+	vector<BusCycle> cycles;
+	for(unsigned i = 0; i < rises.size(); i++)
+	{
+		ASSERT_TRUE(falls[i] < rises[i]);
+		BusCycle cycle = {recorder.Level<Pc1>(rises[i]), DataAt(recorder, rises[i], wide)};
+		ASSERT_EQUAL(recorder.Level<Pc1>(falls[i]), cycle.data);
+		ASSERT_EQUAL(DataAt(recorder, falls[i], wide), cycle.value);
+		ASSERT_FALSE(recorder.Level<Pc0>(falls[i]));
+		cycles.push_back(cycle);
+	}
+	return cycles;
+}
+
+void CheckCycles(const vector<BusCycle> &cycles, const uint16_t *expected, const bool *data, unsigned count)
+{
+	ASSERT_EQUAL(cycles.size(), count);
+	for(unsigned i = 0; i < count; i++)
+	{
+		ASSERT_EQUAL(cycles[i].data, data[i]);
+		ASSERT_EQUAL(cycles[i].value, expected[i]);
+	}
+}
+
+void ResetPorts()
+{
+	SimClock::Reset();
+	SimClock::SetPortAccessTime(AccessTime);
+	Porta::OutReg = Portb::OutReg = Portc::OutReg = 0;
+	Porta::DirReg = Portb::DirReg = Portc::DirReg = 0;
+	Porta::InReg = Portb::InReg = 0;
+}
+
+void Bus8080CycleTest()
+{
+	ResetPorts();
+	Bus8::Init();
+	ASSERT_EQUAL(Portc::OutReg, 0x0f);
+	ASSERT_EQUAL(Portc::DirReg, 0x0f);
+	ASSERT_EQUAL(Porta::DirReg, 0x0f);
+	ASSERT_EQUAL(Portb::DirReg, 0xf0);
+
+	WaveRecorder recorder;
+	recorder.AddPort<Porta>("a");
+	recorder.AddPort<Portb>("b");
+	recorder.AddPin<Pc0>("cs");
+	recorder.AddPin<Pc1>("dc");
+	recorder.AddPin<Pc2>("wr");
+	recorder.Start();
+	Bus8::Select();
+	Bus8::WriteCommand(0x2a);
+	const uint8_t window[] = {0x00, 0x10, 0x00, 0x4f};
+	Bus8::WriteData(window, 4);
+	Bus8::WriteCommand(0x2c);
+	Bus8::FillPixels(0x1234, 3);
+	Bus8::FillPixels(0xa5a5, 2);
+	const uint16_t pixels[] = {0x0000, 0x00ff, 0xffff};
+	Bus8::WritePixels(pixels, 3);
+	Bus8::Deselect();
+	recorder.Stop();
+
+	const uint16_t expected[] = {0x2a, 0x00, 0x10, 0x00, 0x4f, 0x2c,
+		0x12, 0x34, 0x12, 0x34, 0x12, 0x34, 0xa5, 0xa5, 0xa5, 0xa5, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff};
+	bool data[sizeof(expected) / sizeof(expected[0])];
+	for(unsigned i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+		data[i] = i != 0 && i != 5;
+	CheckCycles(DecodeCycles(recorder, false), expected, data, sizeof(expected) / sizeof(expected[0]));
+	ASSERT_EQUAL(Portc::OutReg, 0x0f);
+
+	// reading switches data lines to input for the transfer
+	Porta::InReg = 0x05;
+	Portb::InReg = 0xa0;
+	uint8_t values[3];
+	recorder.Start();
+	Bus8::Select();
+	Bus8::ReadData(values, 3);
+	Bus8::Deselect();
+	recorder.Stop();
+	ASSERT_EQUAL(values[0], 0xa5);
+	ASSERT_EQUAL(values[2], 0xa5);
+	ASSERT_EQUAL(recorder.Edges<Pc3>(false, true).size(), 3);
+	ASSERT_EQUAL(recorder.Edges<Pc2>(false, true).size(), 0);
+	ASSERT_EQUAL(Porta::DirReg, 0x0f);
+	ASSERT_EQUAL(Portb::DirReg, 0xf0);
+
+	// Rd is optional
+	WriteOnlyBus::Init();
+	WriteOnlyBus::WriteCommand(0x01);
+	ASSERT_EQUAL(Portc::OutReg & 0x07, 0x07);
+}
+
+void Bus8080WideTest()
+{
+	ResetPorts();
+	Bus16::Init();
+	WaveRecorder recorder;
+	recorder.AddPort<Porta>("a");
+	recorder.AddPort<Portb>("b");
+	recorder.AddPin<Pc0>("cs");
+	recorder.AddPin<Pc1>("dc");
+	recorder.AddPin<Pc2>("wr");
+	recorder.Start();
+	Bus16::Select();
+	Bus16::WriteCommand(0x2c);
+	Bus16::FillPixels(0xf800, 3);
+	const uint16_t pixels[] = {0x1234, 0x1234, 0xabcd, 0x0000};
+	Bus16::WritePixels(pixels, 4);
+	Bus16::Deselect();
+	recorder.Stop();
+	const uint16_t expected[] = {0x2c, 0xf800, 0xf800, 0xf800, 0x1234, 0x1234, 0xabcd, 0x0000};
+	const bool data[] = {false, true, true, true, true, true, true, true};
+	CheckCycles(DecodeCycles(recorder, true), expected, data, 8);
+}
+
+// Bus time per word from TestPort access counts
+void Bus8080TimingTest()
+{
+	cout << __FUNCTION__;
+	ResetPorts();
+	Bus8::Init();
+	WaveRecorder recorder;
+	recorder.AddPort<Porta>("a");
+	recorder.Start();
+	const uint32_t count = 1000;
+	uint64_t start = SimClock::Now();
+	Data8::Write(0x55);
+	uint64_t dataTime = SimClock::Now() - start;
+	start = SimClock::Now();
+	Bus8::WriteRepeat(0x5a, count);
+	uint64_t repeatTime = SimClock::Now() - start;
+	// data lines are set once, then WR is pulled low and high per word
+	ASSERT_EQUAL(repeatTime, dataTime + count * 2 * AccessTime);
+
+	static uint8_t buffer[count];
+	for(uint32_t i = 0; i < count; i++)
+		buffer[i] = uint8_t(i);
+	start = SimClock::Now();
+	Bus8::WriteData(buffer, count);
+	uint64_t streamTime = SimClock::Now() - start;
+	ASSERT_EQUAL(streamTime, count * (dataTime + 2 * AccessTime));
+	// repeated words in a buffer do not touch data lines
+	memset(buffer, 0x33, count / 2);
+	start = SimClock::Now();
+	Bus8::WriteData(buffer, count);
+	ASSERT_EQUAL(SimClock::Now() - start, (count / 2 + 1) * dataTime + count * 2 * AccessTime);
+	SimClock::SetPortAccessTime(0);
+	recorder.Stop();
+	cout << "\tFill: " << 1000000000ull * count / repeatTime << " bytes/s, stream: "
+		<< 1000000000ull * count / streamTime << " bytes/s";
+	cout << "\tOK" << endl;
+}
+
+template<class Panel, class Buffer>
+void CheckPanel(const Buffer &buffer, unsigned offset)
+{
+	for(unsigned page = 0; page < Buffer::Pages; page++)
+		for(unsigned column = 0; column < Buffer::Width; column++)
+			ASSERT_EQUAL(Panel::Ram(column + offset, page), buffer.Page(page)[column]);
+}
+
+// Bytes on the bus for an update
+template<class Panel, class Oled>
+unsigned long UpdateBytes(typename Oled::FrameBuffer &buffer, unsigned offset)
+{
+	Panel::ResetStats();
+	Oled::Update(buffer);
+	CheckPanel<Panel>(buffer, offset);
+	return Panel::Statistics().bytes;
+}
+
+// Typical UI: status line with a clock, progress bar and a menu with selection
+template<class Buffer>
+void DrawScreen(Buffer &screen, const char *time, int16_t progress, int16_t selected)
+{
+	static const char *items[] = {"Start", "Settings", "Log", "About"};
+	screen.FillRect(0, 0, 128, 8, MonoColor::Black);
+	screen.DrawText(0, 0, "Pump 2", Fonts::Font5x7, MonoColor::White);
+	screen.DrawText(98, 0, time, Fonts::Font5x7, MonoColor::White);
+	screen.DrawRect(0, 10, 128, 6, MonoColor::White);
+	screen.FillRect(1, 11, 126, 4, MonoColor::Black);
+	screen.FillRect(1, 11, progress, 4, MonoColor::White);
+	screen.FillRect(0, 16, 128, 48, MonoColor::Black);
+	for(int16_t i = 0; i < 4; i++)
+		screen.DrawText(8, int16_t(24 + i * 10), items[i], Fonts::Font5x7, MonoColor::White);
+	screen.FillRect(6, int16_t(23 + selected * 10), 60, 9, MonoColor::Invert);
+}
+
+void OledSpiTest()
+{
+	cout << __FUNCTION__;
+	SpiPanel::Reset();
+	SpiOled::Init();
+	ASSERT_TRUE(SpiPanel::IsOn());
+	ASSERT_EQUAL(SpiPanel::UnknownCommands(), 0);
+	SpiOled::FrameBuffer screen;
+	DrawScreen(screen, "12:34", 30, 0);
+	// the first update sends all of the RAM in one window
+	unsigned long full = UpdateBytes<SpiPanel, SpiOled>(screen, 0);
+	ASSERT_EQUAL(full, 1024 + 6);
+	ASSERT_FALSE(screen.IsDirty());
+	unsigned long none = UpdateBytes<SpiPanel, SpiOled>(screen, 0);
+	ASSERT_EQUAL(none, 0);
+
+	// redrawing the same content sends nothing, though the buffer is dirty
+	DrawScreen(screen, "12:34", 30, 0);
+	ASSERT_TRUE(screen.IsDirty());
+	unsigned long same = UpdateBytes<SpiPanel, SpiOled>(screen, 0);
+	ASSERT_EQUAL(same, 0);
+
+	DrawScreen(screen, "12:35", 30, 0);
+	unsigned long clock = UpdateBytes<SpiPanel, SpiOled>(screen, 0);
+	ASSERT_TRUE(clock <= 6 + 5);
+	DrawScreen(screen, "12:35", 31, 0);
+	unsigned long progress = UpdateBytes<SpiPanel, SpiOled>(screen, 0);
+	ASSERT_EQUAL(progress, 6 + 1);
+	DrawScreen(screen, "12:35", 31, 1);
+	unsigned long menu = UpdateBytes<SpiPanel, SpiOled>(screen, 0);
+	// selection bar spans pages 2..5
+	ASSERT_EQUAL(menu, 4 * (6 + 60));
+
+	// changes closer than window setup cost go in one window
+	screen.SetPixel(40, 20, MonoColor::White);
+	screen.SetPixel(45, 20, MonoColor::White);
+	unsigned windows = SpiOled::Update(screen);
+	ASSERT_EQUAL(windows, 1);
+	screen.SetPixel(40, 20, MonoColor::Black);
+	screen.SetPixel(52, 20, MonoColor::Black);
+	screen.SetPixel(53, 20, MonoColor::White);
+	windows = SpiOled::Update(screen);
+	ASSERT_EQUAL(windows, 2);
+	CheckPanel<SpiPanel>(screen, 0);
+
+	// direct buffer writes are not tracked
+	screen.Data()[1023] ^= 0xff;
+	windows = SpiOled::Update(screen);
+	ASSERT_EQUAL(windows, 0);
+	windows = SpiOled::UpdateAll(screen);
+	ASSERT_EQUAL(windows, 1);
+	CheckPanel<SpiPanel>(screen, 0);
+
+	SpiOled::SetContrast(0x10);
+	SpiOled::Invert(true);
+	SpiOled::Enable(false);
+	ASSERT_EQUAL(SpiPanel::Contrast(), 0x10);
+	ASSERT_TRUE(SpiPanel::IsInverted());
+	ASSERT_FALSE(SpiPanel::IsOn());
+	ASSERT_EQUAL(SpiPanel::UnknownCommands(), 0);
+	cout << "\tBytes: full " << full << ", clock " << clock << ", progress " << progress << ", menu " << menu;
+	cout << "\tOK" << endl;
+}
+
+void OledI2cTest()
+{
+	cout << __FUNCTION__;
+	I2cPanel::Reset();
+	I2cOled::Init();
+	ASSERT_TRUE(I2cPanel::IsOn());
+	ASSERT_EQUAL(I2cPanel::UnknownCommands(), 0);
+	I2cOled::FrameBuffer screen;
+	DrawScreen(screen, "12:34", 30, 0);
+	// SH1106 is written page by page, visible columns start at 2
+	unsigned long full = UpdateBytes<I2cPanel, I2cOled>(screen, 2);
+	ASSERT_EQUAL(full, 8 * (2 + 3 + 2 + 128));
+	DrawScreen(screen, "12:35", 30, 0);
+	unsigned long clock = UpdateBytes<I2cPanel, I2cOled>(screen, 2);
+	ASSERT_TRUE(clock <= 2 + 3 + 2 + 5);
+	DrawScreen(screen, "12:35", 31, 1);
+	unsigned long update = UpdateBytes<I2cPanel, I2cOled>(screen, 2);
+	ASSERT_TRUE(update < full / 3);
+	I2cOled::Invalidate();
+	unsigned long again = UpdateBytes<I2cPanel, I2cOled>(screen, 2);
+	ASSERT_EQUAL(again, full);
+	ASSERT_EQUAL(I2cPanel::UnknownCommands(), 0);
+	cout << "\tBytes: full " << full << ", clock " << clock << ", progress and menu " << update;
+	cout << "\tOK" << endl;
+}
+
+void ReportPixels(BenchmarkTimer &timer)
+{
+	double ns = timer.Report();
+	cout << "\t\t" << 1000 / ns << " Mpixel/s" << endl;
+}
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	static Oled oled;
+	static Tft tft;
+	const unsigned long frames = 2000;
+
+	BenchmarkTimer monoClear("Mono 128x64 clear (per pixel)", frames * 128 * 64);
+	for(unsigned long n = 0; n < frames; n++)
+		oled.Clear(MonoColor::Type(n & 1));
+	ReportPixels(monoClear);
+
+	BenchmarkTimer monoFill("Mono unaligned rect invert (per pixel)", frames * 121 * 53);
+	for(unsigned long n = 0; n < frames; n++)
+		oled.FillRect(int16_t(n & 3), 3, 121, 53, MonoColor::Invert);
+	ReportPixels(monoFill);
+	DoNotOptimize(oled.Data()[100]);
+
+	unsigned long textPixels = 0;
+	BenchmarkTimer monoText("Mono 5x7 text (per glyph pixel)", frames * 8 * 21 * 35);
+	for(unsigned long n = 0; n < frames; n++)
+		for(int16_t line = 0; line < 8; line++)
+			textPixels += oled.DrawText(0, int16_t(line * 8 + (n & 1)), "The quick brown fox j", Fonts::Font5x7, MonoColor::White);
+	ReportPixels(monoText);
+	DoNotOptimize(textPixels);
+
+	BenchmarkTimer monoLine("Mono lines (per pixel)", frames * 64 * 128);
+	for(unsigned long n = 0; n < frames; n++)
+		for(int16_t y = 0; y < 64; y++)
+			oled.DrawLine(0, y, 127, int16_t(63 - y), MonoColor::Invert);
+	ReportPixels(monoLine);
+	DoNotOptimize(oled.Data()[200]);
+
+	BenchmarkTimer tftClear("RGB565 160x128 clear (per pixel)", frames * 160 * 128);
+	for(unsigned long n = 0; n < frames; n++)
+		tft.Clear(uint16_t(n));
+	ReportPixels(tftClear);
+
+	BenchmarkTimer tftFill("RGB565 unaligned rect (per pixel)", frames * 151 * 100);
+	for(unsigned long n = 0; n < frames; n++)
+		tft.FillRect(int16_t(n & 1), 5, 151, 100, uint16_t(n));
+	ReportPixels(tftFill);
+	DoNotOptimize(tft.Data()[500]);
+
+	static uint16_t sprite[32 * 32];
+	for(unsigned i = 0; i < 32 * 32; i++)
+		sprite[i] = uint16_t(i * 37);
+	BenchmarkTimer tftBlit("RGB565 32x32 clipped blit (per pixel)", frames * 20 * 32 * 32);
+	for(unsigned long n = 0; n < frames; n++)
+		for(int16_t i = 0; i < 20; i++)
+			tft.Blit(int16_t(i * 8 - 8), int16_t(i * 5), sprite, 32, 32);
+	ReportPixels(tftBlit);
+	DoNotOptimize(tft.Data()[700]);
+
+	BenchmarkTimer tftText("RGB565 5x7 text (per glyph pixel)", frames * 16 * 26 * 35);
+	for(unsigned long n = 0; n < frames; n++)
+		for(int16_t line = 0; line < 16; line++)
+			textPixels += tft.DrawText(0, int16_t(line * 8), "abcdefghijklmnopqrstuvwxyz", Fonts::Font5x7, uint16_t(n));
+	ReportPixels(tftText);
+	DoNotOptimize(textPixels);
+}
+
+int main()
+{
+	MonoShapesTest();
+	MonoTextTest();
+	MonoModelTest();
+	ClippingTest();
+	DirtyTest();
+	ColorTest();
+	ColorFillTest();
+	Bus8080CycleTest();
+	Bus8080WideTest();
+	Bus8080TimingTest();
+	OledSpiTest();
+	OledI2cTest();
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
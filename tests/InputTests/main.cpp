@@ -0,0 +1,317 @@
+#include <iostream>
+#include <stdint.h>
+#include <stdlib.h>
+#include "asserts.h"
+#include "iopins.h"
+#include "pinlist.h"
+#include "drivers/Debouncer.h"
+#include "drivers/EdgeDetector.h"
+
+using namespace std;
+using namespace IO;
+using namespace IO::Test;
+
+typedef TestPort<uint16_t, 'A'> Porta;
+typedef TestPort<uint16_t, 'B'> Portb;
+
+DECLARE_PORT_PINS(Porta, Pa)
+DECLARE_PORT_PINS(Portb, Pb)
+
+// 12 inputs on two ports
+typedef PinList<Pa0, Pa1, Pa2, Pa3, Pa4, Pa5, Pb8, Pb9, Pb10, Pb11, Pb12, Pb13> Inputs;
+const unsigned InputCount = 12;
+
+// Sets input pins, bit i of 'levels' is electrical level of input i
+void SetInputs(uint16_t levels)
+{
+	Porta::InReg = uint16_t(levels & 0x3f);
+	Portb::InReg = uint16_t((levels >> 6 & 0x3f) << 8);
+}
+
+// Noisy switch: after each transition and on random glitches the contact
+// bounces in runs of 1 - 3 ticks, which never last long enough to pass
+// the debouncer
+class NoisySwitch
+{
+public:
+	static const unsigned MaxBounce = 12;
+
+	NoisySwitch()
+		:level(false), bounce(0), run(0), noise(false), changed(0), quiet(0)
+	{}
+
+	bool Tick(unsigned now)
+	{
+		// transitions are at least MaxBounce + 4 ticks apart
+		if(bounce == 0 && now - changed > MaxBounce + 4 && rand() % 80 == 0)
+		{
+			level = !level;
+			changed = now;
+			quiet = now;
+			bounce = rand() % MaxBounce;
+			run = 0;
+		}
+		else if(bounce == 0 && now - quiet >= 4 && rand() % 50 == 0)
+		{
+			// glitch during stable state
+			bounce = 1 + rand() % 3;
+			run = 0;
+		}
+		if(bounce)
+		{
+			bounce--;
+			if(run == 0)
+			{
+				noise = !noise;
+				run = 1 + rand() % 3;
+			}
+			run--;
+			quiet = now + 1;
+			return noise;
+		}
+		return level;
+	}
+
+	bool level;
+	unsigned bounce;
+	unsigned run;
+	bool noise;
+	unsigned changed;
+	// first tick of the current stable level
+	unsigned quiet;
+};
+
+void DebouncerNoiseTest()
+{
+	cout << __FUNCTION__;
+	typedef Debouncer<Inputs, false> Buttons;
+	srand(12345);
+	SetInputs(0);
+	Buttons::Init();
+	ASSERT_EQUAL(Buttons::State(), 0);
+
+	NoisySwitch switches[InputCount];
+	bool debounced[InputCount] = {};
+	unsigned events = 0;
+	for(unsigned tick = 0; tick < 20000; tick++)
+	{
+		uint16_t levels = 0;
+		for(unsigned i = 0; i < InputCount; i++)
+			levels |= uint16_t(switches[i].Tick(tick)) << i;
+		SetInputs(levels);
+		Buttons::TimerHandler();
+		uint16_t pressed = Buttons::TakePressed();
+		uint16_t released = Buttons::TakeReleased();
+		ASSERT_FALSE(pressed & released);
+		for(unsigned i = 0; i < InputCount; i++)
+		{
+			NoisySwitch &sw = switches[i];
+			if((pressed | released) >> i & 1)
+			{
+				// one event per transition, after the bounce settles
+				ASSERT_EQUAL(sw.level, bool(pressed >> i & 1));
+				ASSERT_TRUE(debounced[i] != sw.level);
+				ASSERT_TRUE(tick - sw.changed <= NoisySwitch::MaxBounce + 4);
+				debounced[i] = sw.level;
+				events++;
+			}
+			// stable level for 4 ticks is always accepted
+			if(tick + 1 - sw.quiet >= 4)
+				ASSERT_EQUAL(debounced[i], sw.level);
+			ASSERT_EQUAL(Buttons::IsActive(i), debounced[i]);
+		}
+	}
+	ASSERT_TRUE(events > 2000);
+	cout << "\tOK" << endl;
+}
+
+void DebouncerEventsTest()
+{
+	cout << __FUNCTION__;
+	// active low with pull ups, long press after 50 ticks
+	typedef Debouncer<Inputs, true, 50> Buttons;
+	// input 3 is held at startup
+	SetInputs(uint16_t(~0x008));
+	Buttons::Init();
+	ASSERT_EQUAL(Buttons::State(), 0x008);
+	ASSERT_EQUAL(Porta::DirReg & 0x3f, 0);
+
+	// release of input 3 and press of input 7
+	SetInputs(uint16_t(~0x080));
+	for(unsigned i = 0; i < 3; i++)
+		Buttons::TimerHandler();
+	ASSERT_EQUAL(Buttons::TakeChanged(), 0);
+	Buttons::TimerHandler();
+	ASSERT_EQUAL(Buttons::State(), 0x080);
+	// events stay until taken
+	for(unsigned i = 0; i < 10; i++)
+		Buttons::TimerHandler();
+	ASSERT_EQUAL(Buttons::TakeReleased(0x0f0), 0);
+	ASSERT_EQUAL(Buttons::TakeReleased(), 0x008);
+	ASSERT_EQUAL(Buttons::TakeChanged(), 0x080);
+	ASSERT_EQUAL(Buttons::TakePressed(), 0);
+
+	// long press is reported once, 50 ticks after the press
+	for(unsigned i = 14; i < 53; i++)
+		Buttons::TimerHandler();
+	ASSERT_EQUAL(Buttons::TakeLongPressed(), 0);
+	Buttons::TimerHandler();
+	ASSERT_EQUAL(Buttons::TakeLongPressed(), 0x080);
+	for(unsigned i = 0; i < 200; i++)
+		Buttons::TimerHandler();
+	ASSERT_EQUAL(Buttons::TakeLongPressed(), 0);
+
+	// pressing another input restarts the hold time
+	SetInputs(uint16_t(~0x081));
+	for(unsigned i = 0; i < 4 + 49; i++)
+		Buttons::TimerHandler();
+	ASSERT_EQUAL(Buttons::TakePressed(), 0x001);
+	ASSERT_EQUAL(Buttons::TakeLongPressed(), 0);
+	Buttons::TimerHandler();
+	ASSERT_EQUAL(Buttons::TakeLongPressed(), 0x081);
+	cout << "\tOK" << endl;
+}
+
+void EdgeDetectorTest()
+{
+	cout << __FUNCTION__;
+	// rising edges of inputs 0 - 3, falling edges of inputs 2 - 5
+	typedef EdgeDetector<Inputs, 0x00f, 0x03c, 8> Edges;
+	ASSERT_EQUAL(Edges::Mask, 0x03f);
+	SetInputs(0x022);
+	Edges::Init();
+	ASSERT_EQUAL(Edges::Level(), 0x022);
+	// nothing changed
+	ASSERT_EQUAL(Edges::Handler(10), 0);
+	ASSERT_TRUE(Edges::IsEmpty());
+
+	// input 0 rises, input 5 falls, input 9 rises but is filtered out
+	SetInputs(0x203);
+	ASSERT_EQUAL(Edges::Handler(20), 0x021);
+	ASSERT_EQUAL(Edges::Level(), 0x203);
+	// input 1 falls and input 2 rises, only rising is reported
+	SetInputs(0x205);
+	ASSERT_EQUAL(Edges::Handler(30), 0x004);
+	// input 2 falls
+	SetInputs(0x201);
+	ASSERT_EQUAL(Edges::Handler(40), 0x004);
+
+	ASSERT_EQUAL(Edges::TakeRising(), 0x005);
+	ASSERT_EQUAL(Edges::TakeFalling(0x004), 0x004);
+	ASSERT_EQUAL(Edges::TakeFalling(), 0x020);
+	ASSERT_EQUAL(Edges::TakeRising() | Edges::TakeFalling(), 0);
+
+	const Edges::Event expected[] =
+	{
+		{20, 0, true}, {20, 5, false}, {30, 2, true}, {40, 2, false}
+	};
+	Edges::Event event;
+	for(unsigned i = 0; i < 4; i++)
+	{
+		ASSERT_TRUE(Edges::Read(event));
+		ASSERT_EQUAL(event.time, expected[i].time);
+		ASSERT_EQUAL(event.pin, expected[i].pin);
+		ASSERT_EQUAL(event.rising, expected[i].rising);
+	}
+	ASSERT_FALSE(Edges::Read(event));
+
+	// queue overflow keeps masks and counts lost events
+	for(unsigned i = 0; i < 6; i++)
+	{
+		SetInputs(0x03c);
+		Edges::Handler(uint16_t(100 + i * 2));
+		SetInputs(0x000);
+		Edges::Handler(uint16_t(101 + i * 2));
+	}
+	// 2 rising and 4 falling edges per period
+	ASSERT_EQUAL(Edges::Lost(), 6 * 6 - 8);
+	ASSERT_EQUAL(Edges::TakeRising(), 0x00c);
+	ASSERT_EQUAL(Edges::TakeFalling(), 0x03c);
+	// the oldest events are kept
+	ASSERT_TRUE(Edges::Read(event));
+	ASSERT_EQUAL(event.time, 100);
+	ASSERT_EQUAL(event.pin, 2);
+	ASSERT_TRUE(event.rising);
+	cout << "\tOK" << endl;
+}
+
+void EdgeTimingTest()
+{
+	cout << __FUNCTION__;
+	// polled pulse width measurement with 32 bit timestamps
+	typedef EdgeDetector<Inputs, 0xfff, 0xfff, 32, uint32_t> Edges;
+	SetInputs(0);
+	Edges::Init();
+	const uint32_t width[InputCount] = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41};
+	uint32_t start[InputCount] = {};
+	uint32_t measured[InputCount] = {};
+	for(uint32_t time = 100000; time < 100100; time++)
+	{
+		uint16_t levels = 0;
+		for(unsigned i = 0; i < InputCount; i++)
+			if(time >= 100000 + i && time < 100000 + i + width[i])
+				levels |= uint16_t(1 << i);
+		SetInputs(levels);
+		Edges::Handler(time);
+		Edges::Event event;
+		while(Edges::Read(event))
+		{
+			if(event.rising)
+				start[event.pin] = event.time;
+			else
+				measured[event.pin] = event.time - start[event.pin];
+		}
+	}
+	for(unsigned i = 0; i < InputCount; i++)
+	{
+		ASSERT_EQUAL(start[i], 100000 + i);
+		ASSERT_EQUAL(measured[i], width[i]);
+	}
+	ASSERT_EQUAL(Edges::Lost(), 0);
+	cout << "\tOK" << endl;
+}
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	typedef Debouncer<Inputs, true, 100> Buttons;
+	Buttons::Init();
+	const unsigned long iterations = 1000000;
+	BenchmarkTimer timer("Debouncer tick, 12 inputs", iterations);
+	for(unsigned long n = 0; n < iterations; n++)
+	{
+		Porta::InReg = uint16_t(n);
+		Buttons::TimerHandler();
+	}
+	timer.Report();
+	DoNotOptimize(Buttons::State());
+
+	typedef EdgeDetector<Inputs, 0x0ff, 0xf0f, 16> Edges;
+	Edges::Init();
+	Edges::Event event;
+	unsigned long events = 0;
+	BenchmarkTimer edgeTimer("Edge detector, sample and drain", iterations);
+	for(unsigned long n = 0; n < iterations; n++)
+	{
+		Porta::InReg = uint16_t(n & 0x11);
+		Edges::Handler(uint16_t(n));
+		while(Edges::Read(event))
+			events++;
+	}
+	edgeTimer.Report();
+	DoNotOptimize(events);
+}
+
+int main()
+{
+	DebouncerNoiseTest();
+	DebouncerEventsTest();
+	EdgeDetectorTest();
+	EdgeTimingTest();
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
@@ -0,0 +1,503 @@
+#include <iostream>
+#include <stdint.h>
+#include <stdio.h>
+#include "asserts.h"
+#include "iopins.h"
+#include "pinlist.h"
+#include "bit_utils.h"
+#include "drivers/LedMatrix.h"
+#include "drivers/Charlieplex.h"
+#include "drivers/Ws2812.h"
+#include "drivers/SevenSegment.h"
+
+using namespace std;
+using namespace IO;
+using namespace IO::Test;
+
+typedef TestPort<uint16_t, 'A'> Porta;
+typedef TestPort<uint16_t, 'B'> Portb;
+typedef TestPort<uint16_t, 'C'> Portc;
+
+DECLARE_PORT_PINS(Porta, Pa)
+DECLARE_PORT_PINS(Portb, Pb)
+DECLARE_PORT_PINS(Portc, Pc)
+
+// Runs matrix ISR for given number of frames and integrates on time of each LED
+template<class Matrix, class Rows, class Columns, bool ROWS_ACTIVE_LOW, bool COLUMNS_ACTIVE_LOW>
+unsigned RunFrames(unsigned frames, unsigned onTime[][Matrix::Width])
+{
+	unsigned totalTime = 0;
+	for(unsigned y = 0; y < Matrix::Height; y++)
+		for(unsigned x = 0; x < Matrix::Width; x++)
+			onTime[y][x] = 0;
+	uint16_t startFrame = Matrix::Frames();
+	for(unsigned step = 0; step < frames * Matrix::StepsPerFrame; step++)
+	{
+		unsigned duration = Matrix::TimerHandler();
+		totalTime += duration;
+		typename Rows::DataType rows = Rows::Read();
+		typename Columns::DataType columns = Columns::Read();
+		if(ROWS_ACTIVE_LOW)
+			rows = ~rows;
+		if(COLUMNS_ACTIVE_LOW)
+			columns = ~columns;
+		// exactly one row is selected
+		ASSERT_EQUAL(Util::PopCount(rows), 1);
+		for(unsigned y = 0; y < Matrix::Height; y++)
+			for(unsigned x = 0; x < Matrix::Width; x++)
+				if((rows & (1u << y)) && (columns & (1u << x)))
+					onTime[y][x] += duration;
+	}
+	ASSERT_EQUAL(uint16_t(Matrix::Frames() - startFrame), frames);
+	return totalTime;
+}
+
+template<class Matrix, class Rows, class Columns, bool ROWS_ACTIVE_LOW, bool COLUMNS_ACTIVE_LOW>
+void LedMatrixTest()
+{
+	cout << __FUNCTION__ << "\t" << Matrix::Width << "x" << Matrix::Height << "x" << Matrix::Bits;
+	const unsigned W = Matrix::Width, H = Matrix::Height;
+	Matrix::Init();
+	ASSERT_EQUAL(Rows::Read(), ROWS_ACTIVE_LOW ? typename Rows::DataType(~0) : 0);
+
+	uint8_t levels[H][W];
+	for(unsigned y = 0; y < H; y++)
+		for(unsigned x = 0; x < W; x++)
+		{
+			levels[y][x] = uint8_t(rand() % (Matrix::MaxLevel + 1));
+			Matrix::SetPixel(x, y, levels[y][x]);
+			ASSERT_EQUAL(Matrix::GetPixel(x, y), levels[y][x]);
+		}
+	Matrix::Swap();
+
+	// old (blank) frame is shown until the frame ends
+	unsigned isrCount = 0;
+	while(Matrix::IsSwapPending())
+	{
+		Matrix::TimerHandler();
+		isrCount++;
+		typename Columns::DataType columns = Columns::Read();
+		if(COLUMNS_ACTIVE_LOW)
+			columns = ~columns;
+		ASSERT_EQUAL(columns, 0);
+	}
+	ASSERT_EQUAL(isrCount, Matrix::StepsPerFrame);
+
+	const unsigned frames = 3;
+	unsigned onTime[H][W];
+	unsigned totalTime = RunFrames<Matrix, Rows, Columns, ROWS_ACTIVE_LOW, COLUMNS_ACTIVE_LOW>(frames, onTime);
+	ASSERT_EQUAL(totalTime, frames * Matrix::PeriodsPerFrame);
+	for(unsigned y = 0; y < H; y++)
+		for(unsigned x = 0; x < W; x++)
+			ASSERT_EQUAL(onTime[y][x], frames * levels[y][x]);
+
+	// drawing into back buffer doesn't affect displayed frame until swap
+	Matrix::Clear();
+	Matrix::SetRow(0, typename Columns::DataType(~0));
+	ASSERT_EQUAL(Matrix::GetPixel(W - 1, 0), Matrix::MaxLevel);
+	RunFrames<Matrix, Rows, Columns, ROWS_ACTIVE_LOW, COLUMNS_ACTIVE_LOW>(1, onTime);
+	for(unsigned x = 0; x < W; x++)
+		ASSERT_EQUAL(onTime[0][x], levels[0][x]);
+
+	Matrix::Swap();
+	RunFrames<Matrix, Rows, Columns, ROWS_ACTIVE_LOW, COLUMNS_ACTIVE_LOW>(1, onTime);
+	RunFrames<Matrix, Rows, Columns, ROWS_ACTIVE_LOW, COLUMNS_ACTIVE_LOW>(1, onTime);
+	for(unsigned y = 0; y < H; y++)
+		for(unsigned x = 0; x < W; x++)
+			ASSERT_EQUAL(onTime[y][x], y == 0 ? Matrix::MaxLevel : 0);
+	cout << "\tOK" << endl;
+}
+
+template<class Pins, unsigned index>
+struct PinStateReader
+{
+	static unsigned Read(unsigned i, bool direction)
+	{
+		if(i == index)
+		{
+			typedef typename Pins::template Pin<index> Pin;
+			unsigned reg = direction ? Pin::Port::DirReg : Pin::Port::OutReg;
+			return (reg >> Pin::Number) & 1;
+		}
+		return PinStateReader<Pins, index - 1>::Read(i, direction);
+	}
+};
+
+template<class Pins>
+struct PinStateReader<Pins, unsigned(-1)>
+{
+	static unsigned Read(unsigned, bool)
+	{	return 0;	}
+};
+
+// Direction or output state of pin 'index' of a PinList on TestPorts
+template<class Pins>
+unsigned PinState(unsigned index, bool direction)
+{
+	return PinStateReader<Pins, Pins::Length - 1>::Read(index, direction);
+}
+
+template<class Pins>
+void CharlieplexTest()
+{
+	cout << __FUNCTION__ << "\tpins: " << Pins::Length;
+	typedef Charlieplex<Pins> Leds;
+	// pins not in the list must not be touched
+	Porta::DirReg = 0x8000;
+	Porta::OutReg = 0x8000;
+	Portb::DirReg = 0x0001;
+	Portb::OutReg = 0x0000;
+	Leds::Init();
+	ASSERT_EQUAL(Pins::Length * (Pins::Length - 1), Leds::LedCount);
+
+	for(unsigned led = 0; led < Leds::LedCount; led += 3)
+		Leds::Set(led);
+	Leds::Set(Leds::LedIndex(Pins::Length - 1, 0));
+
+	for(unsigned frame = 0; frame < 2; frame++)
+	{
+		unsigned step = 0;
+		for(unsigned anode = 0; anode < Pins::Length; anode++)
+			for(unsigned cathode = 0; cathode < Pins::Length; cathode++)
+			{
+				if(anode == cathode)
+					continue;
+				unsigned led = Leds::LedIndex(anode, cathode);
+				ASSERT_EQUAL(led, step);
+				Leds::TimerHandler();
+				step++;
+
+				ASSERT_EQUAL(Porta::DirReg & 0x8000, 0x8000);
+				ASSERT_EQUAL(Porta::OutReg & 0x8000, 0x8000);
+				ASSERT_EQUAL(Portb::DirReg & 0x0001, 0x0001);
+				// PinList view of direction and output of charlieplexed pins
+				unsigned dir = 0, out = 0;
+				for(unsigned i = 0; i < Pins::Length; i++)
+				{
+					dir |= PinState<Pins>(i, true) << i;
+					out |= PinState<Pins>(i, false) << i;
+				}
+				if(Leds::Test(led))
+				{
+					ASSERT_EQUAL(dir, (1u << anode) | (1u << cathode));
+					ASSERT_EQUAL(out & dir, 1u << anode);
+				}
+				else
+					ASSERT_EQUAL(dir, 0);
+			}
+	}
+	Leds::Off();
+	for(unsigned i = 0; i < Pins::Length; i++)
+		ASSERT_EQUAL(PinState<Pins>(i, true), 0);
+	cout << "\tOK" << endl;
+}
+
+// Records bytes written to SPI
+struct SpiRecorder
+{
+	static void Write(uint8_t value)
+	{
+		if(count < sizeof(data))
+			data[count] = value;
+		count++;
+	}
+	static uint8_t data[1024];
+	static unsigned count;
+};
+
+uint8_t SpiRecorder::data[1024];
+unsigned SpiRecorder::count;
+
+// Decodes LED bitstream back to data bytes, checks pulse shapes
+template<unsigned SPI_BITS>
+unsigned DecodeWs2812(const uint8_t *stream, unsigned bytes, uint8_t *result)
+{
+	unsigned count = 0;
+	uint8_t value = 0;
+	for(unsigned bit = 0; bit + SPI_BITS <= bytes * 8; bit += SPI_BITS)
+	{
+		unsigned code = 0;
+		for(unsigned i = 0; i < SPI_BITS; i++)
+		{
+			unsigned pos = bit + i;
+			code = code << 1 | ((stream[pos / 8] >> (7 - pos % 8)) & 1);
+		}
+		// trailing padding keeps the line low
+		if(code == 0)
+			break;
+		unsigned one = SPI_BITS == 3 ? 6 : 14;
+		unsigned zero = SPI_BITS == 3 ? 4 : 8;
+		ASSERT_TRUE(code == one || code == zero);
+		value = uint8_t(value << 1 | (code == one));
+		if(bit / SPI_BITS % 8 == 7)
+			result[count++] = value;
+	}
+	return count;
+}
+
+template<class Strip, unsigned SPI_BITS>
+void Ws2812Test()
+{
+	cout << __FUNCTION__ << "\tleds: " << Strip::LedCount << "\tbits: " << SPI_BITS;
+	BOOST_STATIC_ASSERT(Strip::BufferSize < Strip::FrameBytes * SPI_BITS || Strip::LedCount <= 8);
+
+	// known pattern
+	Strip::Clear();
+	Strip::SetPixel(0, 0x00, 0xff, 0x0f);
+	Strip::SetPixel(1, 0xa55a01);
+	ASSERT_EQUAL(Strip::GetPixel(1), 0xa55a01);
+	SpiRecorder::count = 0;
+	Strip::Show();
+	ASSERT_EQUAL(SpiRecorder::count, Strip::Chunks * Strip::ChunkBytes);
+	static const uint8_t expected3[] =
+	{
+		0xdb, 0x6d, 0xb6,	0x92, 0x49, 0x24,	0x92, 0x4d, 0xb6,	// G=ff R=00 B=0f
+		0x9a, 0x6d, 0x34,	0xd3, 0x49, 0xa6,	0x92, 0x49, 0x26	// G=5a R=a5 B=01
+	};
+	static const uint8_t expected4[] =
+	{
+		0xee, 0xee, 0xee, 0xee,	0x88, 0x88, 0x88, 0x88,	0x88, 0x88, 0xee, 0xee,
+		0x8e, 0x8e, 0xe8, 0xe8,	0xe8, 0xe8, 0x8e, 0x8e,	0x88, 0x88, 0x88, 0x8e
+	};
+	const uint8_t *expected = SPI_BITS == 3 ? expected3 : expected4;
+	for(unsigned i = 0; i < 6 * SPI_BITS; i++)
+		ASSERT_EQUAL(SpiRecorder::data[i], expected[i]);
+	// unlit LEDs, then zero padding up to the chunk end
+	static const uint8_t blank3[] = {0x92, 0x49, 0x24};
+	for(unsigned i = 6 * SPI_BITS; i < Strip::FrameBytes * SPI_BITS; i++)
+		ASSERT_EQUAL(SpiRecorder::data[i], SPI_BITS == 3 ? blank3[i % 3] : 0x88);
+	for(unsigned i = Strip::FrameBytes * SPI_BITS; i < SpiRecorder::count; i++)
+		ASSERT_EQUAL(SpiRecorder::data[i], 0);
+
+	// random frame round trip
+	for(unsigned i = 0; i < Strip::LedCount; i++)
+		Strip::SetPixel(i, uint32_t(rand()) << 8 ^ uint32_t(rand()));
+	SpiRecorder::count = 0;
+	Strip::Show();
+	ASSERT_EQUAL(SpiRecorder::count, Strip::Chunks * Strip::ChunkBytes);
+	uint8_t decoded[Strip::FrameBytes];
+	ASSERT_EQUAL(DecodeWs2812<SPI_BITS>(SpiRecorder::data, SpiRecorder::count, decoded), Strip::FrameBytes);
+	for(unsigned i = 0; i < Strip::FrameBytes; i++)
+		ASSERT_EQUAL(decoded[i], Strip::Pixels()[i]);
+
+	// circular DMA model: handler only refills the half that has been sent
+	uint8_t dma[1024];
+	unsigned dmaCount = 0;
+	Strip::Start();
+	unsigned half = 0;
+	bool more;
+	do
+	{
+		const uint8_t *sent = Strip::Buffer() + half * Strip::ChunkBytes;
+		const uint8_t *pending = Strip::Buffer() + (half ^ 1) * Strip::ChunkBytes;
+		uint8_t pendingCopy[Strip::ChunkBytes];
+		for(unsigned i = 0; i < Strip::ChunkBytes; i++)
+		{
+			dma[dmaCount++] = sent[i];
+			pendingCopy[i] = pending[i];
+		}
+		more = Strip::TransferHandler();
+		for(unsigned i = 0; i < Strip::ChunkBytes; i++)
+			ASSERT_EQUAL(pending[i], pendingCopy[i]);
+		half ^= 1;
+	}while(more);
+	ASSERT_EQUAL(dmaCount, SpiRecorder::count);
+	for(unsigned i = 0; i < dmaCount; i++)
+		ASSERT_EQUAL(dma[i], SpiRecorder::data[i]);
+	cout << "\tOK" << endl;
+}
+
+// Standard gfedcba segments of a character
+uint8_t CanonicalGlyph(char c)
+{
+	static const uint8_t digits[16] =
+	{
+		0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07,
+		0x7f, 0x6f, 0x77, 0x7c, 0x39, 0x5e, 0x79, 0x71
+	};
+	if(c >= '0' && c <= '9')
+		return digits[c - '0'];
+	if(c >= 'A' && c <= 'F')
+		return digits[c - 'A' + 10];
+	switch(c)
+	{
+		case '-': return 0x40;
+		case 'H': return 0x76;
+		case 'L': return 0x38;
+		case 'P': return 0x73;
+	}
+	return 0;
+}
+
+// Expected segments per digit for text, '.' adds decimal point to previous digit
+void ExpectedGlyphs(const char *text, uint8_t *glyphs, unsigned digits)
+{
+	unsigned position = 0;
+	for(; *text; text++)
+	{
+		if(*text == '.')
+			glyphs[position - 1] |= 0x80;
+		else
+			glyphs[position++] = CanonicalGlyph(*text);
+	}
+	ASSERT_EQUAL(position, digits);
+}
+
+// Runs one display scan, checks digit selects and decodes segment lines
+// back to gfedcba layout through the wiring in 'order'
+template<class Display, class Segments, class Digits, bool SEGMENTS_ACTIVE_LOW, bool DIGITS_ACTIVE_LOW>
+void ScanDisplay(const unsigned *order, uint8_t *glyphs, unsigned *onTicks)
+{
+	for(unsigned digit = 0; digit < Display::DigitCount; digit++)
+	{
+		onTicks[digit] = 0;
+		glyphs[digit] = 0;
+		for(unsigned tick = 0; tick < Display::Levels; tick++)
+		{
+			Display::TimerHandler();
+			unsigned select = Digits::Read();
+			if(DIGITS_ACTIVE_LOW)
+				select = ~select & ((1u << Display::DigitCount) - 1);
+			if(select == 0)
+				continue;
+			ASSERT_EQUAL(select, 1u << digit);
+			onTicks[digit]++;
+			uint8_t glyph = 0;
+			for(unsigned segment = 0; segment < Segments::Length; segment++)
+				if(PinState<Segments>(order[segment], false) != SEGMENTS_ACTIVE_LOW)
+					glyph |= 1 << segment;
+			if(tick)
+				ASSERT_EQUAL(glyph, glyphs[digit]);
+			glyphs[digit] = glyph;
+		}
+	}
+}
+
+template<class Display, class Segments, class Digits, bool SEGMENTS_ACTIVE_LOW, bool DIGITS_ACTIVE_LOW>
+void CheckDisplay(const unsigned *order, const char *text)
+{
+	const unsigned N = Display::DigitCount;
+	uint8_t expected[N], glyphs[N];
+	unsigned onTicks[N];
+	ExpectedGlyphs(text, expected, N);
+	ScanDisplay<Display, Segments, Digits, SEGMENTS_ACTIVE_LOW, DIGITS_ACTIVE_LOW>(order, glyphs, onTicks);
+	for(unsigned i = 0; i < N; i++)
+	{
+		ASSERT_EQUAL(onTicks[i], Display::Brightness());
+		if(onTicks[i])
+			ASSERT_EQUAL(glyphs[i], expected[i]);
+	}
+}
+
+template<class Display, class Segments, class Digits, bool SEGMENTS_ACTIVE_LOW, bool DIGITS_ACTIVE_LOW>
+void SevenSegmentTest(const unsigned *order)
+{
+	cout << __FUNCTION__ << "\tdigits: " << Display::DigitCount;
+	const unsigned N = Display::DigitCount;
+	// pin not used by display must not be touched
+	Porta::OutReg = 0x0004;
+	Display::Init();
+	ASSERT_EQUAL(Porta::OutReg & 0x0004, 0x0004);
+	void (*check)(const unsigned *, const char *) = CheckDisplay<Display, Segments, Digits, SEGMENTS_ACTIVE_LOW, DIGITS_ACTIVE_LOW>;
+
+	check(order, N == 4 ? "    " : "        ");
+	ASSERT_TRUE(Display::WriteNumber(-12, 1));
+	check(order, N == 4 ? " -1.2" : "     -1.2");
+	ASSERT_TRUE(Display::WriteNumber(5, 2));
+	check(order, N == 4 ? " 0.05" : "     0.05");
+	ASSERT_TRUE(Display::WriteNumber(-999));
+	check(order, N == 4 ? "-999" : "    -999");
+	ASSERT_FALSE(Display::WriteNumber(N == 4 ? 10000 : 100000000));
+	check(order, N == 4 ? "----" : "--------");
+	ASSERT_FALSE(Display::WriteNumber(N == 4 ? -1000 : -10000000));
+	ASSERT_FALSE(Display::WriteNumber(1, uint8_t(N)));
+	Display::WriteHex(0x1234beef);
+	check(order, N == 4 ? "BEEF" : "1234BEEF");
+	Display::WriteText("HELP.");
+	check(order, N == 4 ? "HELP." : "HELP.    ");
+	Display::WriteText("HEL.P.");
+	check(order, N == 4 ? "HEL.P." : "HEL.P.    ");
+
+	// number rendering against library conversion
+	char text[16], expected[20];
+	for(unsigned n = 0; n < 2000; n++)
+	{
+		long value = (long)(rand() % (N == 4 ? 19999 : 19999999)) - (N == 4 ? 9999 : 9999999);
+		if(value < 0 && -value >= (N == 4 ? 1000 : 10000000))
+			continue;
+		ASSERT_TRUE(Display::WriteNumber(value));
+		sprintf(text, "%*ld", int(N), value);
+		ExpectedGlyphs(text, (uint8_t*)expected, N);
+		for(unsigned i = 0; i < N; i++)
+		{
+			uint8_t glyph = 0;
+			for(unsigned segment = 0; segment < 8; segment++)
+				if(Display::GetSegments(i) & (1u << order[segment]))
+					glyph |= 1 << segment;
+			ASSERT_EQUAL(glyph, (uint8_t)expected[i]);
+		}
+	}
+
+	// brightness by duty
+	Display::WriteNumber(N == 4 ? 1234 : 12345678);
+	for(unsigned level = 0; level <= Display::Levels; level++)
+	{
+		Display::SetBrightness(uint8_t(level));
+		check(order, N == 4 ? "1234" : "12345678");
+	}
+	Display::SetBrightness(0);
+	check(order, N == 4 ? "1234" : "12345678");
+	ASSERT_EQUAL(Porta::OutReg & 0x0004, 0x0004);
+	cout << "\tOK" << endl;
+}
+
+int main()
+{
+	{
+		typedef PinList<Pa0, Pa1, Pa2, Pa3, Pa4, Pa5, Pa6, Pa7> Rows;
+		// columns spread over two ports
+		typedef PinList<Pb0, Pb1, Pb2, Pb3, Pc12, Pc13, Pc14, Pc15> Columns;
+		typedef LedMatrix<Rows, Columns, 4> Matrix;
+		LedMatrixTest<Matrix, Rows, Columns, false, false>();
+	}
+	{
+		typedef PinList<Pa0, Pa1, Pa2, Pa3, Pa4, Pa5, Pa6, Pa7,
+			Pa8, Pa9, Pa10, Pa11, Pa12, Pa13, Pa14, Pa15> Rows;
+		typedef PinList<Pb15, Pb14, Pb13, Pb12, Pb11, Pb10, Pb9, Pb8,
+			Pb7, Pb6, Pb5, Pb4, Pb3, Pb2, Pb1, Pb0> Columns;
+		typedef LedMatrix<Rows, Columns, 6, true, true> Matrix;
+		LedMatrixTest<Matrix, Rows, Columns, true, true>();
+	}
+
+	CharlieplexTest<PinList<Pa0, Pa1> >();
+	CharlieplexTest<PinList<Pa0, Pa1, Pa2, Pb5, Pb6> >();
+	CharlieplexTest<PinList<Pb3, Pa4, Pb1, Pa3, Pa2, Pb8, Pb9, Pa10, Pa11, Pa12, Pa13, Pb14> >();
+
+	Ws2812Test<Ws2812<SpiRecorder, 2, 3, 2>, 3>();
+	Ws2812Test<Ws2812<SpiRecorder, 2, 4, 1>, 4>();
+	Ws2812Test<Ws2812<SpiRecorder, 30, 3, 4>, 3>();
+	Ws2812Test<Ws2812<SpiRecorder, 31, 4, 3>, 4>();
+	Ws2812Test<Ws2812<SpiRecorder, 5>, 3>();
+
+	{
+		// scrambled segment wiring
+		typedef PinList<Pa3, Pa9, Pa1, Pa12, Pa0, Pa7, Pa5, Pa14> Segments;
+		typedef SegmentOrder<4, 2, 7, 0, 6, 1, 3, 5> Order;
+		static const unsigned order[] = {4, 2, 7, 0, 6, 1, 3, 5};
+		typedef PinList<Pb0, Pb1, Pb2, Pb3> Digits;
+		typedef SevenSegment<Segments, Digits, Order> Display;
+		SevenSegmentTest<Display, Segments, Digits, false, false>(order);
+	}
+	{
+		typedef PinList<Pa8, Pa9, Pa10, Pa11, Pa12, Pa13, Pa14, Pa15> Segments;
+		static const unsigned order[] = {0, 1, 2, 3, 4, 5, 6, 7};
+		typedef PinList<Pc8, Pc9, Pc10, Pc11, Pc12, Pc13, Pc14, Pc15> Digits;
+		typedef SevenSegment<Segments, Digits, StandardSegmentOrder, 4, true, true> Display;
+		SevenSegmentTest<Display, Segments, Digits, true, true>(order);
+	}
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
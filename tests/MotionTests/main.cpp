@@ -0,0 +1,272 @@
+#include <iostream>
+#include <stdint.h>
+#include <stdlib.h>
+#include "asserts.h"
+#include "iopins.h"
+#include "pinlist.h"
+#include "drivers/Stepper.h"
+
+using namespace std;
+using namespace IO;
+using namespace IO::Test;
+
+typedef TestPort<uint16_t, 'A'> Porta;
+typedef TestPort<uint16_t, 'B'> Portb;
+
+DECLARE_PORT_PINS(Porta, Pa)
+DECLARE_PORT_PINS(Portb, Pb)
+
+const uint32_t TimerFreq = 1000000;
+
+typedef StepDirAxis<Pa0, Pa1> AxisX;
+typedef StepDirAxis<Pa2, Pa3, true> AxisY;
+typedef CoilAxis<PinList<Pb0, Pb1, Pb2, Pb3> > AxisZ;
+typedef StepperRamp<8192> Ramp;
+typedef StepperMotion<Loki::TL::MakeTypelist<AxisX, AxisY, AxisZ>::Result, Ramp> Motion;
+
+const unsigned MaxSteps = 20000;
+// timestamps of lead axis steps, times[k] is time of step k + 1
+uint32_t times[MaxSteps];
+
+// Runs move to the end emulating timer, returns lead axis steps made.
+// 'stopAt' requests deceleration after given number of steps.
+uint32_t RunMove(const Ramp &ramp, const int32_t *deltas, uint32_t stopAt = 0)
+{
+	uint32_t time = Motion::Move(ramp, deltas);
+	ASSERT_TRUE(time != 0);
+	ASSERT_TRUE(Motion::IsBusy());
+	ASSERT_EQUAL(Motion::Move(ramp, deltas), 0);
+	for(;;)
+	{
+		uint32_t done = Motion::Done();
+		uint16_t interval = Motion::TimerHandler();
+		if(Motion::Done() != done)
+		{
+			ASSERT_TRUE(done < MaxSteps);
+			times[done] = time;
+			if(done + 1 == stopAt)
+				Motion::Stop();
+		}
+		if(interval == 0)
+			break;
+		time += interval;
+	}
+	ASSERT_FALSE(Motion::IsBusy());
+	return Motion::Done();
+}
+
+// Output register state of a pin
+template<class Pin>
+bool OutputState()
+{
+	return (Pin::Port::OutReg >> Pin::Number) & 1;
+}
+
+// Time from step j (step 0 is move start) to step j + 1
+uint32_t Gap(unsigned j)
+{
+	return times[j] - (j ? times[j - 1] : 0);
+}
+
+// Average speed in steps/s around step k
+double Speed(unsigned k, unsigned window)
+{
+	return double(2 * window) * TimerFreq / (times[k + window] - times[k - window]);
+}
+
+void RampTest()
+{
+	cout << __FUNCTION__;
+	static Ramp ramp;
+	const uint32_t accel = 2000, maxSpeed = 4000;
+	ASSERT_TRUE(ramp.Build(TimerFreq, accel, maxSpeed));
+	// v^2 / 2a steps to reach max speed
+	ASSERT_TRUE(ramp.Length() > 3960 && ramp.Length() < 4040);
+	ASSERT_EQUAL(ramp.Interval(ramp.Length() - 1), TimerFreq / maxSpeed);
+	for(unsigned i = 1; i < ramp.Length(); i++)
+		ASSERT_TRUE(ramp.Interval(i) <= ramp.Interval(i - 1));
+
+	Motion::Init();
+	int32_t deltas[3] = {int32_t(MaxSteps), 0, 0};
+	ASSERT_EQUAL(RunMove(ramp, deltas), MaxSteps);
+	ASSERT_EQUAL(Motion::Position(0), int32_t(MaxSteps));
+	ASSERT_EQUAL(Motion::Position(1), 0);
+
+	// acceleration measured from step timestamps
+	const unsigned window = 50, distance = 200;
+	for(unsigned k = 100; k + distance + window < ramp.Length(); k += distance)
+	{
+		double v1 = Speed(k, window);
+		double v2 = Speed(k + distance, window);
+		// average speed over interval equals speed at its middle time
+		double t1 = (double(times[k - window]) + times[k + window]) / 2;
+		double t2 = (double(times[k + distance - window]) + times[k + distance + window]) / 2;
+		double dt = (t2 - t1) / TimerFreq;
+		double a = (v2 - v1) / dt;
+		ASSERT_TRUE(a > accel * 0.99 && a < accel * 1.01);
+	}
+	// cruise
+	ASSERT_EQUAL(times[MaxSteps / 2 + 1] - times[MaxSteps / 2], TimerFreq / maxSpeed);
+	// deceleration mirrors acceleration
+	for(unsigned k = 0; k < ramp.Length(); k++)
+		ASSERT_EQUAL(Gap(k), Gap(MaxSteps - 1 - k));
+	// trapezoid move time: N / v + v / a
+	double ideal = (double(MaxSteps) / maxSpeed + double(maxSpeed) / accel) * TimerFreq;
+	double total = times[MaxSteps - 1];
+	ASSERT_TRUE(total > ideal * 0.995 && total < ideal * 1.005);
+
+	// short move gets triangle profile
+	deltas[0] = -1001;
+	ASSERT_EQUAL(RunMove(ramp, deltas), 1001);
+	ASSERT_EQUAL(Motion::Position(0), int32_t(MaxSteps - 1001));
+	ASSERT_EQUAL(OutputState<Pa1>(), false);
+	for(unsigned k = 0; k <= 1000; k++)
+		ASSERT_EQUAL(Gap(k), Gap(1000 - k));
+	ASSERT_EQUAL(Gap(500), ramp.Interval(500));
+	cout << "\tOK" << endl;
+}
+
+void SlowStartTest()
+{
+	cout << __FUNCTION__;
+	// c0 = 95600 doesn't fit 16 bit timer, ramp starts at the first fitting interval
+	static Ramp ramp;
+	ASSERT_TRUE(ramp.Build(TimerFreq, 100, 1000));
+	ASSERT_TRUE(ramp.Interval(0) > 50000);
+	ASSERT_TRUE(ramp.Length() > 4950 && ramp.Length() < 5050);
+
+	// table too short for max speed
+	StepperRamp<100> shortRamp;
+	ASSERT_FALSE(shortRamp.Build(TimerFreq, 100, 1000));
+	ASSERT_EQUAL(shortRamp.Length(), 100);
+	ASSERT_FALSE(shortRamp.Build(TimerFreq, 0, 1000));
+	ASSERT_EQUAL(shortRamp.Length(), 0);
+	cout << "\tOK" << endl;
+}
+
+void LowAccelTest()
+{
+	cout << __FUNCTION__;
+	// at 72 MHz c0^2 overflows 64 bits for acceleration below 17 steps/s^2
+	const uint32_t freq = 72000000, accel = 4, maxSpeed = 100;
+	static StepperRamp<2000, uint32_t> ramp;
+	ASSERT_TRUE(ramp.Build(freq, accel, maxSpeed));
+	// c0 = 0.676 * F * sqrt(2 / a)
+	ASSERT_TRUE(ramp.Interval(0) > 34416300 - 3500 && ramp.Interval(0) < 34416300 + 3500);
+	ASSERT_TRUE(ramp.Length() > 1240 && ramp.Length() < 1260);
+	ASSERT_EQUAL(ramp.Interval(ramp.Length() - 1), freq / maxSpeed);
+	uint64_t total = 0;
+	for(unsigned i = 0; i < ramp.Length(); i++)
+	{
+		if(i > 0)
+			ASSERT_TRUE(ramp.Interval(i) <= ramp.Interval(i - 1));
+		total += ramp.Interval(i);
+	}
+	// v / a to reach max speed
+	double ideal = double(maxSpeed) / accel * freq;
+	ASSERT_TRUE(total > ideal * 0.99 && total < ideal * 1.01);
+	cout << "\tOK" << endl;
+}
+
+void MultiAxisTest()
+{
+	cout << __FUNCTION__;
+	static Ramp ramp;
+	ramp.Build(TimerFreq, 20000, 10000);
+	Motion::Init();
+	Porta::OutReg = 0;
+	const int32_t deltas[3] = {1000, -373, 77};
+	const int32_t lead = 1000;
+
+	ASSERT_TRUE(Motion::Move(ramp, deltas) != 0);
+	ASSERT_TRUE(OutputState<Pa1>());
+	// inverted direction pin
+	ASSERT_TRUE(OutputState<Pa3>());
+	int32_t lastX = 0, lastY = 0;
+	while(Motion::TimerHandler())
+	{
+		int32_t done = int32_t(Motion::Done());
+		for(unsigned axis = 0; axis < 3; axis++)
+		{
+			// Bresenham keeps every axis within half a step of the line
+			int32_t error = Motion::Position(axis) * lead - done * deltas[axis];
+			ASSERT_TRUE(error <= lead / 2 && error >= -lead / 2);
+		}
+		// step pins pulse once per step
+		ASSERT_EQUAL(OutputState<Pa0>(), Motion::Position(0) != lastX);
+		ASSERT_EQUAL(OutputState<Pa2>(), Motion::Position(1) != lastY);
+		lastX = Motion::Position(0);
+		lastY = Motion::Position(1);
+		ASSERT_EQUAL(Portb::OutReg & 0x0f, AxisZ::Pattern(uint8_t(Motion::Position(2) & 7)));
+	}
+	ASSERT_FALSE(OutputState<Pa0>());
+	ASSERT_FALSE(OutputState<Pa2>());
+	for(unsigned axis = 0; axis < 3; axis++)
+		ASSERT_EQUAL(Motion::Position(axis), deltas[axis]);
+	ASSERT_EQUAL(AxisZ::Phase(), 77 % 8);
+
+	// and back
+	const int32_t back[3] = {-1000, 373, -77};
+	RunMove(ramp, back);
+	for(unsigned axis = 0; axis < 3; axis++)
+		ASSERT_EQUAL(Motion::Position(axis), 0);
+	ASSERT_EQUAL(Portb::OutReg & 0x0f, AxisZ::Pattern(0));
+
+	// nothing to do
+	const int32_t none[3] = {0, 0, 0};
+	ASSERT_EQUAL(Motion::Move(ramp, none), 0);
+	ASSERT_FALSE(Motion::IsBusy());
+	cout << "\tOK" << endl;
+}
+
+void StopTest()
+{
+	cout << __FUNCTION__;
+	static Ramp ramp;
+	ramp.Build(TimerFreq, 2000, 4000);
+	Motion::Init();
+	const int32_t deltas[3] = {int32_t(MaxSteps), 100, 0};
+	const uint32_t stopAt = 6000;
+	uint32_t done = RunMove(ramp, deltas, stopAt);
+	ASSERT_EQUAL(done, stopAt + ramp.Length());
+	// decelerates down the ramp to the first interval
+	for(unsigned k = 0; k < ramp.Length() - 1; k++)
+		ASSERT_EQUAL(Gap(done - 1 - k), ramp.Interval(k));
+	// stopping during acceleration
+	Motion::Init();
+	done = RunMove(ramp, deltas, 100);
+	ASSERT_EQUAL(done, 201);
+	cout << "\tOK" << endl;
+}
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	static Ramp ramp;
+	ramp.Build(TimerFreq, 2000, 4000);
+	Motion::Init();
+	const int32_t deltas[3] = {1000000, -370000, 77000};
+	const unsigned long iterations = 1000000;
+	Motion::Move(ramp, deltas);
+	unsigned long sum = 0;
+	BenchmarkTimer timer("Stepper ISR (3 axes)", iterations);
+	for(unsigned long n = 0; n < iterations; n++)
+		sum += Motion::TimerHandler();
+	timer.Report();
+	DoNotOptimize(sum);
+}
+
+int main()
+{
+	RampTest();
+	SlowStartTest();
+	LowAccelTest();
+	MultiAxisTest();
+	StopTest();
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
@@ -0,0 +1,231 @@
+#define F_CPU 8000000ul
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "asserts.h"
+#include "iopins.h"
+#include "pinlist.h"
+#include "wave_recorder.h"
+#include "drivers/latch.h"
+#include "drivers/HD44780.h"
+
+using namespace std;
+using namespace IO;
+using namespace IO::Test;
+
+typedef TestPort<uint8_t, 'A'> Porta;
+typedef TestPort<uint8_t, 'B'> Portb;
+
+DECLARE_PORT_PINS(Porta, Pa)
+DECLARE_PORT_PINS(Portb, Pb)
+
+// one CPU cycle per port access
+const uint32_t AccessTime = 1000000000ul / F_CPU;
+
+void VcdTest()
+{
+	cout << __FUNCTION__;
+	SimClock::Reset();
+	SimClock::SetPortAccessTime(10);
+	Porta::OutReg = 0;
+	Porta::DirReg = 0;
+	Portb::OutReg = 0;
+	WaveRecorder recorder;
+	recorder.AddPin<Pa0>("clk");
+	recorder.AddPort<Porta>("porta");
+	recorder.Start();
+	Pa0::SetConfiguration(Pa0::Port::Out);
+	Pa0::Set();
+	// not recorded port still takes time
+	Portb::Write(0xff);
+	Pa1::Set();
+	SimClock::Advance(100);
+	Pa0::Clear();
+	// writing the same value records nothing
+	Pa0::Clear();
+	recorder.Stop();
+	Pa0::Set();
+	ASSERT_EQUAL(recorder.Changes().size(), 4);
+
+	ostringstream vcd;
+	recorder.WriteVcd(vcd);
+	const char *expected =
+		"$timescale 1ns $end\n"
+		"$scope module mcucpp $end\n"
+		"$var wire 1 ! clk $end\n"
+		"$var wire 8 \" porta $end\n"
+		"$var wire 8 # porta_dir $end\n"
+		"$upscope $end\n"
+		"$enddefinitions $end\n"
+		"#0\n"
+		"$dumpvars\n"
+		"0!\n"
+		"b00000000 \"\n"
+		"b00000000 #\n"
+		"$end\n"
+		"#10\n"
+		"b00000001 #\n"
+		"#20\n"
+		"1!\n"
+		"b00000001 \"\n"
+		"#40\n"
+		"b00000011 \"\n"
+		"#150\n"
+		"0!\n"
+		"b00000010 \"\n";
+	ASSERT_TRUE(vcd.str() == expected);
+	SimClock::SetPortAccessTime(0);
+	cout << "\tOK" << endl;
+}
+
+// Pins written while not recording keep their level as initial state
+void InitialStateTest()
+{
+	cout << __FUNCTION__;
+	SimClock::Reset();
+	Porta::OutReg = 0;
+	Porta::DirReg = 0;
+	WaveRecorder recorder;
+	recorder.AddPin<Pa0>("clk");
+	Pa0::SetConfiguration(Pa0::Port::Out);
+	Pa0::Set();
+	recorder.Start();
+	ASSERT_TRUE(recorder.Level<Pa0>(0));
+	SimClock::Advance(10);
+	Pa0::Clear();
+	std::vector<uint64_t> falling = recorder.Edges<Pa0>(false, true);
+	ASSERT_EQUAL(falling.size(), 1);
+	ASSERT_EQUAL(falling[0], 10);
+
+	// and between Stop and the next Start
+	recorder.Stop();
+	Pa0::Set();
+	recorder.Start();
+	ASSERT_TRUE(recorder.Level<Pa0>(SimClock::Now()));
+	ASSERT_TRUE(recorder.Edges<Pa0>(true).empty());
+	Pa0::Clear();
+	ASSERT_EQUAL(recorder.Edges<Pa0>(false, true).size(), 1);
+	recorder.Stop();
+	cout << "\tOK" << endl;
+}
+
+void LatchTimingTest()
+{
+	cout << __FUNCTION__;
+	typedef ThreePinLatch<Pa0, Pa1, Pa2, 'L'> Latch;
+	SimClock::Reset();
+	SimClock::SetPortAccessTime(AccessTime);
+	Porta::OutReg = 0;
+	WaveRecorder recorder;
+	recorder.AddPin<Pa0>("clock");
+	recorder.AddPin<Pa1>("data");
+	recorder.AddPin<Pa2>("latch");
+	recorder.Start();
+	Latch::Write(0xa5);
+	Latch::Write(0x3c);
+	recorder.Stop();
+
+	// shift register samples data on rising clock edges, LSB first
+	vector<uint64_t> clocks = recorder.Edges<Pa0>(true);
+	vector<uint64_t> latches = recorder.Edges<Pa2>(true);
+	ASSERT_EQUAL(clocks.size(), 16);
+	ASSERT_EQUAL(latches.size(), 2);
+	uint8_t values[2] = {0, 0};
+	for(unsigned i = 0; i < 16; i++)
+	{
+		uint8_t bit = recorder.Level<Pa1>(clocks[i]);
+		values[i / 8] |= uint8_t(bit << (i % 8));
+		// data is set up one access before the clock
+		ASSERT_TRUE(recorder.Level<Pa1>(clocks[i] - AccessTime) == bit);
+		if(i % 8 == 7)
+			ASSERT_TRUE(latches[i / 8] > clocks[i]);
+	}
+	ASSERT_EQUAL(values[0], 0xa5);
+	ASSERT_EQUAL(values[1], 0x3c);
+
+	// 3 accesses per bit and 2 for latch pulse
+	uint64_t byteTime = 26 * AccessTime;
+	ASSERT_EQUAL(SimClock::Now(), 2 * byteTime);
+	ASSERT_EQUAL(clocks[1] - clocks[0], 3 * AccessTime);
+	// clock high for one access
+	vector<uint64_t> clockFalls = recorder.Edges<Pa0>(false, true);
+	ASSERT_EQUAL(clockFalls[0] - clocks[0], AccessTime);
+	cout << "\tThroughput: " << 1000000000ull / byteTime << " bytes/s at " << F_CPU / 1000000 << " MHz";
+	SimClock::SetPortAccessTime(0);
+	cout << "\tOK" << endl;
+}
+
+void LcdTimingTest()
+{
+	cout << __FUNCTION__;
+	typedef Lcd<Pb0, Pb1, Pb2, Pb4, Pb5, Pb6, Pb7> Display;
+	SimClock::Reset();
+	Portb::OutReg = 0;
+	Portb::DirReg = 0;
+	WaveRecorder recorder;
+	recorder.AddPort<Portb>("lcd");
+	recorder.AddPin<Pb0>("rs");
+	recorder.AddPin<Pb2>("e");
+	recorder.Start();
+	Display::Init();
+	Display::Puts("Hi", 2);
+	recorder.Stop();
+	ASSERT_EQUAL(Portb::DirReg, 0xf7);
+
+	// controller latches data on falling edge of E
+	vector<uint64_t> rises = recorder.Edges<Pb2>(true);
+	vector<uint64_t> falls = recorder.Edges<Pb2>(false, true);
+	const uint8_t expected[] = {0x03, 0x03, 0x03, 0x02, 0x02, 0x08, 0x00, 0x08,
+		0x00, 0x0e, 0x00, 0x06, 0x14, 0x18, 0x16, 0x19};
+	const unsigned count = sizeof(expected);
+	ASSERT_EQUAL(falls.size(), count);
+	ASSERT_EQUAL(rises.size(), count);
+	for(unsigned i = 0; i < count; i++)
+	{
+		uint8_t nibble = uint8_t(recorder.Level<Pb4>(falls[i]) | recorder.Level<Pb5>(falls[i]) << 1 |
+			recorder.Level<Pb6>(falls[i]) << 2 | recorder.Level<Pb7>(falls[i]) << 3);
+		uint8_t rs = recorder.Level<Pb0>(falls[i]);
+		ASSERT_EQUAL(nibble | rs << 4, expected[i]);
+		// enable pulse width and cycle time
+		ASSERT_TRUE(falls[i] - rises[i] >= 200000);
+		if(i)
+			ASSERT_TRUE(rises[i] - falls[i - 1] >= 200000);
+	}
+	// power on wait before switching to 4 bit mode
+	ASSERT_TRUE(rises[3] - falls[2] >= 60000000);
+	cout << "\tInit + 2 chars: " << SimClock::Now() / 1000 << " us";
+	cout << "\tOK" << endl;
+}
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	typedef ThreePinLatch<Pa0, Pa1, Pa2, 'L'> Latch;
+	const unsigned long iterations = 100000;
+	WaveRecorder recorder;
+	recorder.AddPin<Pa0>("clock");
+	recorder.AddPin<Pa1>("data");
+	recorder.Start();
+	BenchmarkTimer timer("Recorded latch write (per byte)", iterations);
+	for(unsigned long n = 0; n < iterations; n++)
+		Latch::Write(uint8_t(n));
+	timer.Report();
+	recorder.Stop();
+	DoNotOptimize(recorder.Changes().size());
+}
+
+int main()
+{
+	VcdTest();
+	InitialStateTest();
+	LatchTimingTest();
+	LcdTimingTest();
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
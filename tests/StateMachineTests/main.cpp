@@ -0,0 +1,266 @@
+#include <iostream>
+#include <string>
+#include "asserts.h"
+#include "dispatcher.h"
+#include "state_machine.h"
+
+using namespace std;
+
+// Radio link model:
+//
+//  Off                 On [Idle]
+//                      +-- Idle
+//                      +-- Active [Rx]
+//                          +-- Rx
+//                          +-- Tx
+
+enum LinkEvents
+{
+	EvPowerOn,
+	EvPowerOff,
+	EvSend,
+	EvSent,
+	EvTimeout,
+	EvTick,
+	EvRestart,
+	EvStop,
+	EvUnused
+};
+
+class Link;
+
+struct Off;
+struct On;
+struct Idle;
+struct Active;
+struct Rx;
+struct Tx;
+
+#define TRACE_STATE(NAME) \
+	static void Entry(Link &link);\
+	static void Exit(Link &link);
+
+struct Off :Hsm::State<>
+{	TRACE_STATE(Off)	};
+
+struct On :Hsm::State<Hsm::TopState, Idle>
+{	TRACE_STATE(On)	};
+
+struct Idle :Hsm::State<On>
+{	TRACE_STATE(Idle)	};
+
+struct Active :Hsm::State<On, Rx>
+{	TRACE_STATE(Active)	};
+
+struct Rx :Hsm::State<Active>
+{	TRACE_STATE(Rx)	};
+
+// no entry/exit actions
+struct Tx :Hsm::State<Active>
+{};
+
+struct StartTx		{	static void Run(Link &link);	};
+struct CountTick	{	static void Run(Link &link);	};
+struct Retry		{	static void Run(Link &link);	};
+struct CanRetry		{	static bool Check(Link &link);	};
+
+typedef Loki::TL::MakeTypelist<
+	Hsm::Transition<Off,	EvPowerOn,	On>,
+	Hsm::Transition<On,		EvPowerOff,	Off>,
+	Hsm::Transition<Idle,	EvSend,		Tx,	StartTx>,
+	Hsm::Transition<Tx,		EvSent,		Rx>,
+	Hsm::Transition<Tx,		EvTimeout,	Tx,	Retry,	CanRetry>,
+	Hsm::Transition<Active,	EvTimeout,	Idle>,
+	Hsm::Transition<On,		EvTick,		Hsm::Internal,	CountTick>,
+	Hsm::Transition<Active,	EvRestart,	Active>,
+	Hsm::Transition<On,		EvStop,		On>
+>::Result LinkTable;
+
+class Link :public Hsm::StateMachine<Link, LinkTable, Off>
+{
+public:
+	Link()
+		:ticks(0), retries(0)
+	{}
+
+	std::string trace;
+	unsigned ticks;
+	unsigned retries;
+};
+
+#define TRACE_STATE_IMPL(NAME) \
+	void NAME::Entry(Link &link){link.trace += "+" #NAME " ";}\
+	void NAME::Exit(Link &link){link.trace += "-" #NAME " ";}
+
+TRACE_STATE_IMPL(Off)
+TRACE_STATE_IMPL(On)
+TRACE_STATE_IMPL(Idle)
+TRACE_STATE_IMPL(Active)
+TRACE_STATE_IMPL(Rx)
+
+void StartTx::Run(Link &link)
+{
+	link.trace += "StartTx ";
+	link.retries = 0;
+}
+
+void CountTick::Run(Link &link)
+{
+	link.ticks++;
+}
+
+void Retry::Run(Link &link)
+{
+	link.trace += "Retry ";
+	link.retries++;
+}
+
+bool CanRetry::Check(Link &link)
+{
+	return link.retries < 2;
+}
+
+// Dispatches event and returns trace of actions it caused
+std::string Step(Link &link, unsigned event, bool handled = true)
+{
+	link.trace.clear();
+	ASSERT_EQUAL(link.Dispatch(event), handled);
+	return link.trace;
+}
+
+void TransitionsTest()
+{
+	cout << __FUNCTION__;
+	Link link;
+	ASSERT_FALSE(link.Dispatch(EvPowerOn));
+	link.Start();
+	ASSERT_TRUE(link.trace == "+Off ");
+	ASSERT_TRUE(link.IsIn<Off>());
+	ASSERT_FALSE(link.IsIn<On>());
+
+	// entering composite state drills into initial substate
+	ASSERT_TRUE(Step(link, EvPowerOn) == "-Off +On +Idle ");
+	ASSERT_TRUE(link.IsIn<Idle>());
+	ASSERT_TRUE(link.IsIn<On>());
+
+	ASSERT_TRUE(Step(link, EvSent, false) == "");
+	ASSERT_TRUE(Step(link, EvUnused, false) == "");
+	ASSERT_FALSE(link.Dispatch(Hsm::MaxEvents));
+
+	// transition action runs between exits and entries
+	ASSERT_TRUE(Step(link, EvSend) == "-Idle StartTx +Active ");
+	ASSERT_TRUE(link.IsIn<Tx>());
+	ASSERT_TRUE(link.IsIn<Active>());
+	ASSERT_TRUE(link.IsIn<On>());
+	ASSERT_FALSE(link.IsIn<Idle>());
+
+	// internal transition inherited from On
+	ASSERT_TRUE(Step(link, EvTick) == "");
+	ASSERT_EQUAL(link.ticks, 1);
+	ASSERT_TRUE(link.IsIn<Tx>());
+
+	// guarded self transition on leaf without entry/exit actions
+	ASSERT_TRUE(Step(link, EvTimeout) == "Retry ");
+	ASSERT_TRUE(Step(link, EvTimeout) == "Retry ");
+	// guard fails, parent transition takes over
+	ASSERT_TRUE(Step(link, EvTimeout) == "-Active +Idle ");
+	ASSERT_TRUE(link.IsIn<Idle>());
+
+	ASSERT_TRUE(Step(link, EvSend) == "-Idle StartTx +Active ");
+	ASSERT_TRUE(Step(link, EvSent) == "+Rx ");
+	ASSERT_TRUE(link.IsIn<Rx>());
+
+	// self transition of composite state exits and re-enters it
+	ASSERT_TRUE(Step(link, EvRestart) == "-Rx -Active +Active +Rx ");
+	ASSERT_TRUE(Step(link, EvStop) == "-Rx -Active -On +On +Idle ");
+
+	// transition inherited from root state exits the whole nesting
+	ASSERT_TRUE(Step(link, EvSend) == "-Idle StartTx +Active ");
+	ASSERT_TRUE(Step(link, EvPowerOff) == "-Active -On +Off ");
+	ASSERT_TRUE(link.IsIn<Off>());
+	ASSERT_TRUE(Step(link, EvTick, false) == "");
+	cout << "\tOK" << endl;
+}
+
+// Event delivery through Dispatcher
+typedef Dispatcher<8, 4> Disp;
+Link globalLink;
+typedef HsmEventQueue<Link, globalLink, Disp, 4> LinkEventQueue;
+
+void DispatcherTest()
+{
+	cout << __FUNCTION__;
+	Disp::Init();
+	globalLink.Start();
+	ASSERT_TRUE(LinkEventQueue::Post(EvPowerOn));
+	ASSERT_TRUE(LinkEventQueue::Post(EvSend));
+	ASSERT_TRUE(LinkEventQueue::Post(EvSent));
+	ASSERT_TRUE(LinkEventQueue::Post(EvTick));
+	ASSERT_FALSE(LinkEventQueue::Post(EvTick));
+	// nothing is dispatched until the main loop polls
+	ASSERT_TRUE(globalLink.trace == "+Off ");
+	ASSERT_FALSE(Atomic::DisableInterrupts::IsActive());
+
+	for(int i = 0; i < 8; i++)
+		Disp::Poll();
+	ASSERT_TRUE(LinkEventQueue::IsEmpty());
+	ASSERT_TRUE(globalLink.trace == "+Off -Off +On +Idle -Idle StartTx +Active +Rx ");
+	ASSERT_EQUAL(globalLink.ticks, 1);
+	ASSERT_TRUE(globalLink.IsIn<Rx>());
+	cout << "\tOK" << endl;
+}
+
+void NoTask()
+{}
+
+// Posts are refused while the dispatcher queue is full, so no event is left
+// queued without a task to deliver it
+void DispatcherFullTest()
+{
+	cout << __FUNCTION__;
+	Disp::Init();
+	globalLink.Start();
+	for(int i = 0; i < 8; i++)
+		ASSERT_TRUE(Disp::SetTask(NoTask));
+	ASSERT_FALSE(Disp::SetTask(NoTask));
+	ASSERT_FALSE(LinkEventQueue::Post(EvPowerOn));
+	ASSERT_TRUE(LinkEventQueue::IsEmpty());
+	for(int i = 0; i < 8; i++)
+		Disp::Poll();
+
+	ASSERT_TRUE(LinkEventQueue::Post(EvPowerOn));
+	Disp::Poll();
+	ASSERT_TRUE(LinkEventQueue::IsEmpty());
+	ASSERT_TRUE(globalLink.IsIn<Idle>());
+	ASSERT_FALSE(Atomic::DisableInterrupts::IsActive());
+	cout << "\tOK" << endl;
+}
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	const unsigned long iterations = 1000000;
+	Link link;
+	link.Start();
+	link.Dispatch(EvPowerOn);
+	link.Dispatch(EvSend);
+	link.Dispatch(EvSent);
+	BenchmarkTimer timer("Hsm dispatch (internal)", iterations);
+	for(unsigned long n = 0; n < iterations; n++)
+		link.Dispatch(EvTick);
+	timer.Report();
+	DoNotOptimize(link.ticks);
+}
+
+int main()
+{
+	TransitionsTest();
+	DispatcherTest();
+	DispatcherFullTest();
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
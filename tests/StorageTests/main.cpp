@@ -0,0 +1,736 @@
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asserts.h"
+#include "spi_flash_sim.h"
+#include "sd_card_sim.h"
+#include "drivers/SpiFlash.h"
+#include "drivers/SdCard.h"
+#include "block_cache.h"
+#include "log_store.h"
+
+using namespace std;
+using namespace IO::Test;
+
+typedef SpiFlashSim<4ul * 1024 * 1024> FlashChip;
+typedef SpiFlash<FlashChip, FlashChip::Cs, 4, 32> Flash;
+
+typedef SdCardSim<8192> Card;
+typedef SdCard<Card, Card::Cs> Sd;
+typedef BlockCache<Sd, 4> Cache;
+typedef LogStore<Sd, 1000, 64, 8, 2048, 2> Log;
+typedef SpiFlashBlocks<Flash> FlashBlocks;
+typedef LogStore<FlashBlocks, 64, 64, 8, 2048, 2> FlashLog;
+typedef SdCardSim<4096, false, 1> SmallCard;
+typedef SdCard<SmallCard, SmallCard::Cs> SmallSd;
+
+const char FlashImage[] = "flash_test.bin";
+const char CardImage[] = "card_test.bin";
+
+// Fills buffer with data depending on address
+void Pattern(uint32_t address, uint8_t *data, size_t length)
+{
+	for(size_t i = 0; i < length; i++)
+	{
+		uint32_t a = address + uint32_t(i);
+		data[i] = uint8_t(a ^ (a >> 8) ^ (a >> 16) * 7);
+	}
+}
+
+bool CheckPattern(uint32_t address, const uint8_t *data, size_t length)
+{
+	for(size_t i = 0; i < length; i++)
+	{
+		uint32_t a = address + uint32_t(i);
+		if(data[i] != uint8_t(a ^ (a >> 8) ^ (a >> 16) * 7))
+			return false;
+	}
+	return true;
+}
+
+void FlashBasicTest()
+{
+	cout << __FUNCTION__;
+	remove(FlashImage);
+	ASSERT_TRUE(FlashChip::Open(FlashImage));
+	ASSERT_TRUE(Flash::Init());
+	ASSERT_EQUAL(Flash::JedecId(), 0xef4016);
+	ASSERT_EQUAL(Flash::Size(), 4ul * 1024 * 1024);
+
+	// unaligned write across pages and sectors
+	static uint8_t data[3000];
+	const uint32_t address = 0x1f00 + 17;
+	Pattern(address, data, sizeof(data));
+	Flash::EraseSector(0x1000);
+	Flash::EraseSector(0x2000);
+	Flash::Write(address, data, sizeof(data));
+	ASSERT_TRUE(Flash::IsBusy());
+	ASSERT_TRUE(CheckPattern(address, FlashChip::Memory() + address, sizeof(data)) == false);
+	Flash::WaitReady();
+	ASSERT_TRUE(CheckPattern(address, FlashChip::Memory() + address, sizeof(data)));
+	ASSERT_EQUAL(FlashChip::Memory()[address - 1], 0xff);
+	ASSERT_EQUAL(FlashChip::Memory()[address + sizeof(data)], 0xff);
+	// 12 pages touched
+	ASSERT_EQUAL(FlashChip::Statistics().programs, 12);
+
+	// burst and cached reads
+	static uint8_t readBack[3000];
+	Flash::Read(address, readBack, sizeof(readBack));
+	ASSERT_TRUE(CheckPattern(address, readBack, sizeof(readBack)));
+	for(uint32_t i = 0; i < 200; i += 5)
+	{
+		uint8_t small[5];
+		Flash::Read(address + i, small, sizeof(small));
+		ASSERT_TRUE(CheckPattern(address + i, small, sizeof(small)));
+	}
+	ASSERT_EQUAL(FlashChip::Statistics().violations, 0);
+
+	// image file keeps the content
+	FlashChip::Close();
+	ASSERT_TRUE(FlashChip::Open(FlashImage));
+	ASSERT_TRUE(Flash::Init());
+	Flash::Read(address, readBack, sizeof(readBack));
+	ASSERT_TRUE(CheckPattern(address, readBack, sizeof(readBack)));
+	cout << "\tOK" << endl;
+}
+
+// No chip on the bus: MISO pulled up reads all ones
+struct NoChipSpi
+{
+	static uint8_t ReadWrite(uint8_t)
+	{
+		return 0xff;
+	}
+};
+
+struct NoChipCs
+{
+	static void Set()
+	{}
+	static void Clear()
+	{}
+	static void SetDirWrite()
+	{}
+};
+
+void FlashInitTest()
+{
+	cout << __FUNCTION__;
+	typedef SpiFlash<NoChipSpi, NoChipCs> NoFlash;
+	ASSERT_FALSE(NoFlash::Init());
+	ASSERT_EQUAL(NoFlash::Size(), 0);
+
+	// chip busy with an erase started before reset
+	ASSERT_TRUE(FlashChip::Open(FlashImage));
+	ASSERT_TRUE(Flash::Init());
+	Flash::EraseSector(0);
+	ASSERT_TRUE(FlashChip::IsBusy());
+	ASSERT_TRUE(Flash::Init());
+	ASSERT_FALSE(FlashChip::IsBusy());
+	ASSERT_EQUAL(Flash::JedecId(), 0xef4016);
+	FlashChip::Close();
+	cout << "\tOK" << endl;
+}
+
+void FlashCacheTest()
+{
+	cout << __FUNCTION__;
+	ASSERT_TRUE(FlashChip::Open(FlashImage));
+	Flash::Init();
+	uint8_t value;
+	// lines A B C D fill the cache
+	for(uint32_t line = 0; line < 4; line++)
+		Flash::Read(0x2000 + line * 32, &value, 1);
+	ASSERT_EQUAL(Flash::CacheMisses(), 4);
+	// A becomes the most recent, E evicts B
+	Flash::Read(0x2000 + 5, &value, 1);
+	Flash::Read(0x2000 + 4 * 32, &value, 1);
+	ASSERT_EQUAL(Flash::CacheHits(), 1);
+	ASSERT_EQUAL(Flash::CacheMisses(), 5);
+	Flash::Read(0x2000 + 2 * 32, &value, 1);
+	Flash::Read(0x2000 + 3 * 32, &value, 1);
+	Flash::Read(0x2000, &value, 1);
+	ASSERT_EQUAL(Flash::CacheHits(), 4);
+	Flash::Read(0x2000 + 32, &value, 1);
+	ASSERT_EQUAL(Flash::CacheMisses(), 6);
+
+	// cache hits don't wait for busy chip, reads across line boundary
+	unsigned long bytes = FlashChip::Statistics().bytes;
+	uint8_t pair[2];
+	Flash::Read(0x2000 + 31, pair, 2);
+	ASSERT_EQUAL(FlashChip::Statistics().bytes, bytes);
+	ASSERT_TRUE(CheckPattern(0x2000 + 31, pair, 2));
+
+	// program and erase invalidate cached lines
+	Flash::EraseSector(0x3000);
+	Flash::Read(0x3000, &value, 1);
+	ASSERT_EQUAL(value, 0xff);
+	uint8_t zero = 0;
+	Flash::Write(0x3010, &zero, 1);
+	Flash::Read(0x3010, &value, 1);
+	ASSERT_EQUAL(value, 0);
+	Flash::EraseSector(0x3000);
+	Flash::Read(0x3010, &value, 1);
+	ASSERT_EQUAL(value, 0xff);
+	ASSERT_EQUAL(FlashChip::Statistics().violations, 0);
+	cout << "\tOK" << endl;
+}
+
+// Streams 'pages' pages, producing each page takes 'fillTime' ns.
+// Returns simulated time taken.
+uint64_t StreamPages(uint32_t address, unsigned pages, uint32_t fillTime, bool pipelined)
+{
+	uint64_t start = SimClock::Now();
+	uint8_t data[64];
+	Flash::StreamStart(address);
+	for(unsigned page = 0; page < pages; page++)
+	{
+		for(unsigned part = 0; part < 4; part++)
+		{
+			SimClock::Advance(fillTime / 4);
+			uint32_t chunk = address + page * 256 + part * 64;
+			Pattern(chunk, data, sizeof(data));
+			Flash::StreamWrite(data, sizeof(data));
+		}
+		if(!pipelined)
+			Flash::WaitReady();
+	}
+	Flash::StreamFlush();
+	Flash::WaitReady();
+	return SimClock::Now() - start;
+}
+
+void FlashPipelineTest()
+{
+	cout << __FUNCTION__;
+	ASSERT_TRUE(FlashChip::Open(FlashImage));
+	Flash::Init();
+	const unsigned pages = 64;
+	const uint32_t fillTime = 600000;
+	for(uint32_t sector = 0; sector < 8; sector++)
+		ASSERT_TRUE(Flash::ScheduleErase(0x10000 + sector * 4096));
+	ASSERT_FALSE(Flash::ScheduleErase(0));
+	// erases run while the main loop waits for data
+	while(!Flash::Poll())
+		SimClock::Advance(1000000);
+	ASSERT_EQUAL(FlashChip::Statistics().erases, 8);
+
+	uint64_t sequential = StreamPages(0x10000, pages / 2, fillTime, false);
+	uint64_t pipelined = StreamPages(0x10000 + pages / 2 * 256, pages / 2, fillTime, true);
+	static uint8_t readBack[pages * 256];
+	Flash::Read(0x10000, readBack, sizeof(readBack));
+	ASSERT_TRUE(CheckPattern(0x10000, readBack, sizeof(readBack)));
+	// page program (0.7 ms) overlaps filling the next page (0.6 ms)
+	ASSERT_TRUE(pipelined * 4 < sequential * 3);
+	ASSERT_EQUAL(FlashChip::Statistics().violations, 0);
+	cout << "\tWrite: " << pages / 2 * 256 * 1000000ull / sequential << " KB/s sequential, "
+		<< pages / 2 * 256 * 1000000ull / pipelined << " KB/s pipelined";
+	cout << "\tOK" << endl;
+}
+
+// Fills block with data depending on block number and version
+void FillBlock(uint8_t *data, uint32_t block, unsigned version)
+{
+	for(unsigned i = 0; i < 512; i++)
+		data[i] = uint8_t(block * 13 + version * 101 + i + (i >> 8));
+}
+
+bool CheckBlock(const uint8_t *data, uint32_t block, unsigned version)
+{
+	uint8_t expected[512];
+	FillBlock(expected, block, version);
+	return memcmp(data, expected, sizeof(expected)) == 0;
+}
+
+void SdInitTest()
+{
+	cout << __FUNCTION__;
+	remove(CardImage);
+	ASSERT_TRUE(Card::Open(CardImage));
+	ASSERT_TRUE(Sd::Init());
+	ASSERT_EQUAL(Sd::Type(), Sd::Sdhc);
+	ASSERT_EQUAL(Sd::BlockCount(), 8192);
+	ASSERT_EQUAL(Sd::LastError(), Sd::Ok);
+
+	uint8_t block[512];
+	FillBlock(block, 100, 1);
+	ASSERT_TRUE(Sd::WriteBlocks(100, block, 1));
+	memset(block, 0, sizeof(block));
+	ASSERT_TRUE(Sd::ReadBlocks(100, block, 1));
+	ASSERT_TRUE(CheckBlock(block, 100, 1));
+	ASSERT_TRUE(CheckBlock(Card::Memory() + 100 * 512, 100, 1));
+	ASSERT_FALSE(Sd::ReadBlocks(8191, block, 2));
+	ASSERT_EQUAL(Sd::LastError(), Sd::OutOfRange);
+	ASSERT_FALSE(Sd::WriteBlocks(8192, block, 1));
+	ASSERT_EQUAL(Card::Statistics().violations, 0);
+
+	// standard capacity card uses byte addresses
+	remove("small_card.bin");
+	ASSERT_TRUE(SmallCard::Open("small_card.bin"));
+	ASSERT_TRUE(SmallSd::Init());
+	ASSERT_EQUAL(SmallSd::Type(), SmallSd::SdV2);
+	ASSERT_EQUAL(SmallSd::BlockCount(), 4096);
+	FillBlock(block, 4095, 2);
+	ASSERT_TRUE(SmallSd::WriteBlocks(4095, block, 1));
+	ASSERT_TRUE(SmallSd::Sync());
+	ASSERT_TRUE(CheckBlock(SmallCard::Memory() + 4095 * 512, 4095, 2));
+	SmallCard::Close();
+	remove("small_card.bin");
+	cout << "\tOK" << endl;
+}
+
+void SdMultiBlockTest()
+{
+	cout << __FUNCTION__;
+	ASSERT_TRUE(Card::Open(CardImage));
+	ASSERT_TRUE(Sd::Init());
+	const unsigned count = 16;
+	static uint8_t data[count * 512];
+	for(unsigned i = 0; i < count; i++)
+		FillBlock(data + i * 512, 200 + i, 3);
+
+	uint64_t start = SimClock::Now();
+	for(unsigned i = 0; i < count; i++)
+		ASSERT_TRUE(Sd::WriteBlocks(300 + i, data + i * 512, 1));
+	ASSERT_TRUE(Sd::Sync());
+	uint64_t singleTime = SimClock::Now() - start;
+
+	Card::ResetStats();
+	start = SimClock::Now();
+	ASSERT_TRUE(Sd::WriteBlocks(200, data, count));
+	ASSERT_TRUE(Sd::Sync());
+	uint64_t multipleTime = SimClock::Now() - start;
+	ASSERT_EQUAL(Card::Statistics().multipleWrites, 1);
+	ASSERT_EQUAL(Card::Statistics().eraseHints, 1);
+	ASSERT_EQUAL(Card::Statistics().blocksWritten, count);
+	for(unsigned i = 0; i < count; i++)
+		ASSERT_TRUE(CheckBlock(Card::Memory() + (200 + i) * 512, 200 + i, 3));
+	ASSERT_TRUE(multipleTime * 2 < singleTime);
+
+	memset(data, 0, sizeof(data));
+	ASSERT_TRUE(Sd::ReadBlocks(200, data, count));
+	ASSERT_EQUAL(Card::Statistics().multipleReads, 1);
+	ASSERT_EQUAL(Card::Statistics().blocksRead, count);
+	for(unsigned i = 0; i < count; i++)
+		ASSERT_TRUE(CheckBlock(data + i * 512, 200 + i, 3));
+
+	// streamed write of blocks produced one at a time
+	ASSERT_TRUE(Sd::WriteStart(400, 3));
+	for(unsigned i = 0; i < 3; i++)
+	{
+		uint8_t block[512];
+		FillBlock(block, 400 + i, 4);
+		ASSERT_TRUE(Sd::WriteNext(block));
+	}
+	ASSERT_TRUE(Sd::WriteStop());
+	ASSERT_TRUE(Sd::ReadBlocks(400, data, 3));
+	for(unsigned i = 0; i < 3; i++)
+		ASSERT_TRUE(CheckBlock(data + i * 512, 400 + i, 4));
+
+	// rejected block stops the transfer, the card stays usable
+	Card::InjectWriteError();
+	FillBlock(data, 500, 5);
+	ASSERT_FALSE(Sd::WriteBlocks(500, data, 2));
+	ASSERT_EQUAL(Sd::LastError(), Sd::WriteError);
+	ASSERT_TRUE(Sd::WriteBlocks(500, data, 2));
+	ASSERT_TRUE(Sd::ReadBlocks(500, data, 1));
+	ASSERT_TRUE(CheckBlock(data, 500, 5));
+	ASSERT_EQUAL(Card::Statistics().violations, 0);
+	cout << "\tWrite: " << count * 512 * 1000000ull / singleTime << " KB/s single, "
+		<< count * 512 * 1000000ull / multipleTime << " KB/s multiple";
+	cout << "\tOK" << endl;
+}
+
+void BlockCacheTest()
+{
+	cout << __FUNCTION__;
+	ASSERT_TRUE(Card::Open(CardImage));
+	ASSERT_TRUE(Sd::Init());
+	Cache::Init();
+	uint8_t block[512];
+	// sequential single block writes stay in cache
+	for(uint32_t i = 0; i < 4; i++)
+	{
+		FillBlock(block, 1000 + i, 6);
+		ASSERT_TRUE(Cache::WriteBlocks(1000 + i, block, 1));
+	}
+	ASSERT_EQUAL(Card::Statistics().singleWrites + Card::Statistics().multipleWrites, 0);
+	ASSERT_TRUE(Cache::IsDirty());
+	ASSERT_TRUE(Cache::ReadBlocks(1002, block, 1));
+	ASSERT_TRUE(CheckBlock(block, 1002, 6));
+	ASSERT_EQUAL(Cache::Hits(), 1);
+
+	// evicting a dirty block writes all of them in one multi-block write
+	FillBlock(block, 1004, 6);
+	ASSERT_TRUE(Cache::WriteBlocks(1004, block, 1));
+	ASSERT_EQUAL(Card::Statistics().multipleWrites, 1);
+	ASSERT_EQUAL(Cache::WriteBacks(), 4);
+	ASSERT_TRUE(Cache::IsDirty());
+
+	// multi-block read sees dirty cached block
+	static uint8_t data[8 * 512];
+	ASSERT_TRUE(Cache::ReadBlocks(1000, data, 5));
+	for(uint32_t i = 0; i < 5; i++)
+		ASSERT_TRUE(CheckBlock(data + i * 512, 1000 + i, 6));
+	ASSERT_FALSE(CheckBlock(Card::Memory() + 1004 * 512, 1004, 6));
+
+	// multi-block write updates cached copies
+	for(uint32_t i = 0; i < 8; i++)
+		FillBlock(data + i * 512, 1000 + i, 7);
+	ASSERT_TRUE(Cache::WriteBlocks(1000, data, 8));
+	ASSERT_FALSE(Cache::IsDirty());
+	ASSERT_TRUE(Cache::ReadBlocks(1004, block, 1));
+	ASSERT_TRUE(CheckBlock(block, 1004, 7));
+
+	// non consecutive blocks are written in separate runs
+	unsigned writes = Card::Statistics().singleWrites + Card::Statistics().multipleWrites;
+	FillBlock(block, 2000, 8);
+	Cache::WriteBlocks(2000, block, 1);
+	FillBlock(block, 2001, 8);
+	Cache::WriteBlocks(2001, block, 1);
+	FillBlock(block, 1500, 8);
+	Cache::WriteBlocks(1500, block, 1);
+	ASSERT_TRUE(Cache::Sync());
+	ASSERT_EQUAL(Card::Statistics().singleWrites + Card::Statistics().multipleWrites, writes + 2);
+	ASSERT_TRUE(CheckBlock(Card::Memory() + 1500 * 512, 1500, 8));
+	ASSERT_TRUE(CheckBlock(Card::Memory() + 2001 * 512, 2001, 8));
+	ASSERT_EQUAL(Card::Statistics().violations, 0);
+	cout << "\tOK" << endl;
+}
+
+// Random reads and writes through cache and directly to the card, checked against a RAM model
+void SdFuzzTest()
+{
+	cout << __FUNCTION__;
+	ASSERT_TRUE(Card::Open(CardImage));
+	ASSERT_TRUE(Sd::Init());
+	Cache::Init();
+	const uint32_t first = 3000;
+	const uint32_t blocks = 48;
+	static unsigned versions[blocks];
+	static uint8_t data[8 * 512];
+	for(uint32_t i = 0; i < blocks; i++)
+	{
+		FillBlock(data, first + i, 0);
+		Sd::WriteBlocks(first + i, data, 1);
+		versions[i] = 0;
+	}
+	srand(12345);
+	for(unsigned n = 0; n < 3000; n++)
+	{
+		uint32_t count = rand() % 4 == 0 ? 1 + rand() % 8 : 1;
+		uint32_t block = rand() % (blocks - count + 1);
+		switch(rand() % 5)
+		{
+		case 0:
+		case 1:
+			ASSERT_TRUE(Cache::ReadBlocks(first + block, data, count));
+			for(uint32_t i = 0; i < count; i++)
+				ASSERT_TRUE(CheckBlock(data + i * 512, first + block + i, versions[block + i]));
+			break;
+		case 2:
+		case 3:
+			for(uint32_t i = 0; i < count; i++)
+			{
+				versions[block + i] = n + 1;
+				FillBlock(data + i * 512, first + block + i, n + 1);
+			}
+			ASSERT_TRUE(Cache::WriteBlocks(first + block, data, count));
+			break;
+		case 4:
+			ASSERT_TRUE(Cache::Sync());
+			for(uint32_t i = 0; i < blocks; i++)
+				ASSERT_TRUE(CheckBlock(Card::Memory() + (first + i) * 512, first + i, versions[i]));
+			break;
+		}
+	}
+	ASSERT_TRUE(Cache::Sync());
+	ASSERT_EQUAL(Card::Statistics().violations, 0);
+
+	// image file keeps the content
+	Card::Close();
+	ASSERT_TRUE(Card::Open(CardImage));
+	ASSERT_TRUE(Sd::Init());
+	for(uint32_t i = 0; i < blocks; i++)
+	{
+		ASSERT_TRUE(Sd::ReadBlocks(first + i, data, 1));
+		ASSERT_TRUE(CheckBlock(data, first + i, versions[i]));
+	}
+	cout << "\tOK" << endl;
+}
+
+// Appends "record NNNNNN" lines, returns false on write error
+template<class Store>
+bool AppendRecords(uint32_t &record, unsigned count)
+{
+	for(unsigned i = 0; i < count; i++)
+	{
+		char line[16];
+		sprintf(line, "record %06u\n", unsigned(record));
+		if(Store::Append(line, 14) != 14)
+			return false;
+		record++;
+		if(!Store::Poll())
+			return false;
+	}
+	return true;
+}
+
+// Checks that the log holds well formed records in increasing order.
+// The line before a restart block and the first line may be incomplete.
+template<class Store>
+bool CheckLog(unsigned &records, uint32_t &last)
+{
+	records = 0;
+	last = 0;
+	string line;
+	bool partial = true;
+	uint8_t payload[512];
+	for(uint32_t sequence = Store::OldestSequence(); sequence != Store::NextSequence(); sequence++)
+	{
+		unsigned length;
+		bool restart;
+		if(!Store::ReadBlock(sequence, payload, length, restart))
+		{
+			// skipped after mount
+			line.clear();
+			partial = true;
+			continue;
+		}
+		if(restart)
+		{
+			line.clear();
+			partial = false;
+		}
+		for(unsigned i = 0; i < length; i++)
+		{
+			if(payload[i] != '\n')
+			{
+				line += char(payload[i]);
+				continue;
+			}
+			if(!partial)
+			{
+				unsigned number;
+				if(line.size() != 13 || sscanf(line.c_str(), "record %6u", &number) != 1)
+					return false;
+				if(records && number <= last)
+					return false;
+				last = number;
+				records++;
+			}
+			partial = false;
+			line.clear();
+		}
+	}
+	return true;
+}
+
+void LogStoreTest()
+{
+	cout << __FUNCTION__;
+	ASSERT_TRUE(Card::Open(CardImage));
+	ASSERT_TRUE(Sd::Init());
+	ASSERT_TRUE(Log::Format());
+	ASSERT_TRUE(Log::Mount());
+	ASSERT_TRUE(Log::IsEmpty());
+	Card::ResetStats();
+	uint32_t record = 0;
+	ASSERT_TRUE(AppendRecords<Log>(record, 100));
+	// two full blocks are written together, the rest waits in buffer
+	ASSERT_EQUAL(Log::NextSequence(), 2);
+	ASSERT_EQUAL(Card::Statistics().multipleWrites, 1);
+	ASSERT_EQUAL(Card::Statistics().singleWrites, 0);
+	ASSERT_EQUAL(Log::Buffered(), 1400 - 2 * Log::PayloadSize);
+	ASSERT_TRUE(Log::Flush());
+	unsigned records;
+	uint32_t last;
+	ASSERT_TRUE(CheckLog<Log>(records, last));
+	ASSERT_EQUAL(records, 100);
+	ASSERT_EQUAL(last, 99);
+
+	// the log wraps around several times, oldest segments are dropped
+	ASSERT_TRUE(AppendRecords<Log>(record, 15000));
+	ASSERT_TRUE(Log::Flush());
+	uint32_t blocks = Log::NextSequence() - Log::OldestSequence();
+	ASSERT_TRUE(blocks > 64 - 8 && blocks <= 64);
+	ASSERT_TRUE(CheckLog<Log>(records, last));
+	ASSERT_EQUAL(last, record - 1);
+	ASSERT_TRUE(records > 56 * Log::PayloadSize / 14 - 2);
+
+	// mount finds the newest block at every position of a segment
+	for(unsigned i = 0; i < 20; i++)
+	{
+		ASSERT_TRUE(Log::Mount());
+		uint32_t next = Log::NextSequence();
+		ASSERT_EQUAL(next % 8, 0);
+		ASSERT_TRUE(Log::MountReads() <= 7);
+		ASSERT_TRUE(AppendRecords<Log>(record, 36 * (i % 8 + 1)));
+		ASSERT_TRUE(Log::Flush());
+		ASSERT_TRUE(CheckLog<Log>(records, last));
+		ASSERT_EQUAL(last, record - 1);
+		uint32_t expected = Log::NextSequence();
+		ASSERT_TRUE(Log::Mount());
+		ASSERT_EQUAL(Log::NextSequence(), (expected + 7) / 8 * 8);
+	}
+	ASSERT_EQUAL(Card::Statistics().violations, 0);
+	cout << "\tOK" << endl;
+}
+
+void LogPowerCutTest()
+{
+	cout << __FUNCTION__;
+	ASSERT_TRUE(Card::Open(CardImage));
+	ASSERT_TRUE(Sd::Init());
+	ASSERT_TRUE(Log::Format());
+	ASSERT_TRUE(Log::Mount());
+	srand(7);
+	uint32_t record = 0;
+	uint32_t durable = 0;
+	unsigned torn = 0;
+	for(unsigned cut = 0; cut < 60; cut++)
+	{
+		Card::PowerCutAt(Card::Statistics().bytes + 1000 + rand() % 30000, rand());
+		while(Card::IsPowered())
+		{
+			if(!AppendRecords<Log>(record, 1 + rand() % 50))
+				break;
+			if(rand() % 4 == 0 && Log::Flush() && Card::IsPowered())
+				durable = record;
+		}
+		ASSERT_FALSE(Card::IsPowered());
+		Card::PowerOn();
+		ASSERT_TRUE(Sd::Init());
+		ASSERT_TRUE(Log::Mount());
+		ASSERT_TRUE(Log::MountReads() <= 7);
+		unsigned records;
+		uint32_t last;
+		ASSERT_TRUE(CheckLog<Log>(records, last));
+		// flushed records survive
+		ASSERT_TRUE(durable == 0 || last + 1 >= durable);
+		torn += last + 1 < record;
+	}
+	ASSERT_TRUE(torn > 0);
+	cout << "\tOK" << endl;
+}
+
+void FlashLogTest()
+{
+	cout << __FUNCTION__;
+	remove(FlashImage);
+	ASSERT_TRUE(FlashChip::Open(FlashImage));
+	ASSERT_TRUE(Flash::Init());
+	ASSERT_TRUE(FlashLog::Format());
+	ASSERT_TRUE(FlashLog::Mount());
+	ASSERT_TRUE(FlashLog::IsEmpty());
+	uint32_t record = 0;
+	ASSERT_TRUE(AppendRecords<FlashLog>(record, 8000));
+	ASSERT_TRUE(FlashLog::Flush());
+	unsigned records;
+	uint32_t last;
+	ASSERT_TRUE(CheckLog<FlashLog>(records, last));
+	ASSERT_EQUAL(last, record - 1);
+	// every segment is erased when writing enters it
+	ASSERT_EQUAL(FlashChip::Statistics().erases, 8 + (FlashLog::NextSequence() + 7) / 8);
+
+	// power cuts during page programming
+	srand(3);
+	for(unsigned cut = 0; cut < 30; cut++)
+	{
+		ASSERT_TRUE(AppendRecords<FlashLog>(record, rand() % 100));
+		ASSERT_TRUE(FlashLog::Flush());
+		uint32_t durable = record;
+		ASSERT_TRUE(AppendRecords<FlashLog>(record, 1 + rand() % 200));
+		FlashChip::PowerCut(rand());
+		ASSERT_TRUE(Flash::Init());
+		ASSERT_TRUE(FlashLog::Mount());
+		ASSERT_TRUE(CheckLog<FlashLog>(records, last));
+		ASSERT_TRUE(last + 1 >= durable);
+	}
+	ASSERT_EQUAL(FlashChip::Statistics().violations, 0);
+	FlashChip::Close();
+	cout << "\tOK" << endl;
+}
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	ASSERT_TRUE(FlashChip::Open(FlashImage));
+	Flash::Init();
+	const unsigned long iterations = 200000;
+	uint8_t value = 0;
+	unsigned long sum = 0;
+	BenchmarkTimer timer("Flash random cached 1 byte reads", iterations);
+	for(unsigned long n = 0; n < iterations; n++)
+	{
+		Flash::Read(uint32_t(n * 7 % 128), &value, 1);
+		sum += value;
+	}
+	timer.Report();
+	DoNotOptimize(sum);
+	static uint8_t buffer[4096];
+	BenchmarkTimer burstTimer("Flash 4 KB burst read (per byte)", iterations);
+	for(unsigned long n = 0; n < iterations; n += sizeof(buffer))
+		Flash::Read(uint32_t(n % 0x100000), buffer, sizeof(buffer));
+	burstTimer.Report();
+	DoNotOptimize(buffer[10]);
+	FlashChip::Close();
+	remove(FlashImage);
+
+	ASSERT_TRUE(Card::Open(CardImage));
+	Sd::Init();
+	Cache::Init();
+	static uint8_t blocks[8 * 512];
+	const unsigned long cardIterations = 2000;
+	BenchmarkTimer readTimer("SD 8 block read (per block)", cardIterations * 8);
+	for(unsigned long n = 0; n < cardIterations; n++)
+		Sd::ReadBlocks(uint32_t(n * 8 % 8000), blocks, 8);
+	readTimer.Report();
+	BenchmarkTimer cacheTimer("SD cached block read", cardIterations * 8);
+	for(unsigned long n = 0; n < cardIterations * 8; n++)
+		Cache::ReadBlocks(uint32_t(n % 4), blocks, 1);
+	cacheTimer.Report();
+	DoNotOptimize(blocks[10]);
+	uint64_t start = SimClock::Now();
+	for(uint32_t n = 0; n < 256; n++)
+		Cache::WriteBlocks(4000 + n, blocks, 1);
+	Cache::Sync();
+	cout << "  SD sequential block writes through cache:\t" << 256 * 512 * 1000000ull / (SimClock::Now() - start) << " KB/s simulated" << endl;
+
+	Log::Format();
+	Log::Mount();
+	uint32_t record = 0;
+	const unsigned records = 20000;
+	start = SimClock::Now();
+	BenchmarkTimer logTimer("Log append and poll (per record)", records);
+	AppendRecords<Log>(record, records);
+	logTimer.Report();
+	Log::Flush();
+	cout << "  Log records to SD:\t" << records * 14 * 1000000ull / (SimClock::Now() - start) << " KB/s simulated" << endl;
+	Card::Close();
+	remove(CardImage);
+}
+
+int main()
+{
+	FlashBasicTest();
+	FlashInitTest();
+	FlashCacheTest();
+	FlashPipelineTest();
+	SdInitTest();
+	SdMultiBlockTest();
+	BlockCacheTest();
+	SdFuzzTest();
+	LogStoreTest();
+	LogPowerCutTest();
+	FlashLogTest();
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
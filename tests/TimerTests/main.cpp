@@ -0,0 +1,443 @@
+#include <iostream>
+#include <stdint.h>
+#include "asserts.h"
+#include <math.h>
+#include "input_capture.h"
+#include "iopins.h"
+#include "pinlist.h"
+#include "drivers/Dds.h"
+
+using namespace std;
+using namespace IO;
+using namespace IO::Test;
+
+typedef TestPort<uint16_t, 'A'> Porta;
+DECLARE_PORT_PINS(Porta, Pa)
+
+const uint32_t TimerFreq = 1000000;
+
+// Simulated 16 bit timer with input capture.
+// Time is kept in 1/256 tick to allow fractional signal periods.
+// Timer interrupt runs 'Latency' ticks after the first pending event and
+// handles capture before overflow, so captures near counter wrap see the
+// overflow flag set before overflow has been counted.
+class CaptureSim
+{
+public:
+	static const uint64_t Latency = 200;
+
+	CaptureSim()
+		:time(0), nextWrap(0x10000), pendingBefore(0), pendingAfter(0)
+	{}
+
+	// Runs overflow interrupts that happened before 'tick'
+	template<class Meter>
+	void Overflows(Meter &meter, uint64_t tick)
+	{
+		while(nextWrap + Latency < tick)
+		{
+			meter.OverflowHandler();
+			nextWrap += 0x10000;
+		}
+	}
+
+	// Main loop reading of the extended time
+	template<class Meter>
+	uint32_t Now(Meter &meter, uint64_t tick)
+	{
+		Overflows(meter, tick);
+		return meter.Now(uint16_t(tick), nextWrap <= tick);
+	}
+
+	template<class Meter>
+	void Edge(Meter &meter, uint64_t tick, bool rising)
+	{
+		Overflows(meter, tick);
+		bool pending = nextWrap <= tick + Latency;
+		if(pending)
+		{
+			if(nextWrap > tick)
+				pendingBefore++;
+			else
+				pendingAfter++;
+		}
+		meter.CaptureHandler(uint16_t(tick), rising, pending);
+	}
+
+	// Feeds 'cycles' of signal, calls Process every 'batch' cycles and checks
+	// period of every new measurement
+	template<class Meter>
+	void Feed(Meter &meter, uint64_t period, uint64_t high, unsigned cycles, unsigned batch = 4)
+	{
+		unsigned windows = 0;
+		meter.IsUpdated();
+		for(unsigned i = 0; i < cycles; i++)
+		{
+			Edge(meter, time >> 8, true);
+			Edge(meter, (time + high) >> 8, false);
+			time += period;
+			if(i % batch == batch - 1)
+			{
+				meter.Process();
+				// first window may hold cycles of previous signal
+				if(meter.IsUpdated() && ++windows > 1)
+				{
+					uint32_t measured = meter.Period(256);
+					ASSERT_TRUE(measured + 256 / meter.Cycles() + 1 >= period);
+					ASSERT_TRUE(measured <= period + 256 / meter.Cycles() + 1);
+				}
+			}
+		}
+		meter.Process();
+	}
+
+	uint64_t Tick()const
+	{
+		return time >> 8;
+	}
+
+	uint64_t time;
+	uint64_t nextWrap;
+	unsigned pendingBefore;
+	unsigned pendingAfter;
+};
+
+void GateTimeTest()
+{
+	cout << __FUNCTION__;
+	CaptureSim sim;
+	// 0.1 s gate
+	CaptureMeter<16> meter(100000);
+	ASSERT_FALSE(meter.HasMeasurement());
+	ASSERT_EQUAL(meter.Frequency(TimerFreq), 0);
+
+	// 1 kHz, 25% duty
+	sim.Feed(meter, 1000 * 256, 250 * 256, 1001);
+	ASSERT_TRUE(meter.HasMeasurement());
+	ASSERT_EQUAL(meter.Cycles(), 100);
+	ASSERT_EQUAL(meter.Period(), 1000);
+	ASSERT_EQUAL(meter.Frequency(TimerFreq, 1000), 1000000);
+	ASSERT_EQUAL(meter.Duty(), 250);
+	ASSERT_TRUE(sim.pendingBefore > 0 && sim.pendingAfter > 0);
+
+	// 3000.75 Hz, period 333.25 ticks is resolved by averaging
+	sim.Feed(meter, 333 * 256 + 64, 100 * 256, 3000);
+	ASSERT_EQUAL(meter.Cycles(), 301);
+	ASSERT_TRUE(meter.Frequency(TimerFreq, 1000) >= 3000750 - 40);
+	ASSERT_TRUE(meter.Frequency(TimerFreq, 1000) <= 3000750 + 40);
+	ASSERT_TRUE(meter.Period(256) >= 333 * 256 + 63 && meter.Period(256) <= 333 * 256 + 65);
+	ASSERT_TRUE(meter.Duty() >= 299 && meter.Duty() <= 301);
+	cout << "\tOK" << endl;
+}
+
+void ReciprocalTest()
+{
+	cout << __FUNCTION__;
+	CaptureSim sim;
+	CaptureMeter<16> meter(100000);
+	// 2 Hz, period spans several counter wraps, every period is a window
+	sim.Feed(meter, 500000 * 256, 50000 * 256, 10, 1);
+	ASSERT_EQUAL(meter.Cycles(), 1);
+	ASSERT_EQUAL(meter.Period(), 500000);
+	ASSERT_EQUAL(meter.Frequency(TimerFreq, 1000), 2000);
+	ASSERT_EQUAL(meter.Duty(), 100);
+
+	// 7.5 Hz
+	sim.Feed(meter, 133333 * 256 + 85, 66666 * 256, 10, 1);
+	ASSERT_EQUAL(meter.Cycles(), 1);
+	ASSERT_TRUE(meter.Frequency(TimerFreq, 1000) >= 7499 && meter.Frequency(TimerFreq, 1000) <= 7501);
+	ASSERT_EQUAL(meter.Duty(), 500);
+
+	// signal loss
+	uint64_t lastRising = (sim.time - (133333 * 256 + 85)) >> 8;
+	uint32_t now = sim.Now(meter, lastRising + 100000);
+	ASSERT_EQUAL(now, uint32_t(lastRising + 100000));
+	ASSERT_FALSE(meter.IsSignalLost(now, 200000));
+	ASSERT_TRUE(meter.IsSignalLost(now, 50000));
+	cout << "\tOK" << endl;
+}
+
+void OverrunTest()
+{
+	cout << __FUNCTION__;
+	CaptureSim sim;
+	CaptureMeter<8> meter(10000);
+	sim.Feed(meter, 1000 * 256, 500 * 256, 50, 2);
+	ASSERT_EQUAL(meter.Period(), 1000);
+	// main loop stalls, edges are lost
+	bool lost = false;
+	for(unsigned i = 0; i < 10; i++)
+	{
+		uint64_t tick = sim.Tick();
+		sim.time += 1000 * 256;
+		lost |= !meter.CaptureHandler(uint16_t(tick), true);
+	}
+	ASSERT_TRUE(lost);
+	ASSERT_TRUE(meter.IsOverrun());
+	meter.Process();
+	// overrun is kept until cleared
+	ASSERT_TRUE(meter.IsOverrun());
+	meter.ClearOverrun();
+	ASSERT_FALSE(meter.IsOverrun());
+	// measurement restarts without the gap
+	sim.Feed(meter, 800 * 256, 400 * 256, 50, 2);
+	ASSERT_EQUAL(meter.Period(), 800);
+	ASSERT_EQUAL(meter.Duty(), 500);
+	cout << "\tOK" << endl;
+}
+
+// Edges queued after lost ones are not accumulated into the window started
+// before them
+void OverrunGapTest()
+{
+	cout << __FUNCTION__;
+	CaptureSim sim;
+	CaptureMeter<8> meter(10000);
+	sim.Feed(meter, 1000 * 256, 500 * 256, 50, 2);
+	ASSERT_EQUAL(meter.Period(), 1000);
+	meter.IsUpdated();
+	// ring fills up, the following edges are lost
+	for(unsigned i = 0; i < 20; i++)
+	{
+		sim.Edge(meter, sim.Tick(), true);
+		sim.Edge(meter, (sim.time + 500 * 256) >> 8, false);
+		sim.time += 1000 * 256;
+	}
+	ASSERT_TRUE(meter.IsOverrun());
+	meter.Process();
+	// edges after the gap, processed as they come
+	unsigned windows = 0;
+	for(unsigned i = 0; i < 40; i++)
+	{
+		sim.Edge(meter, sim.Tick(), true);
+		sim.Edge(meter, (sim.time + 500 * 256) >> 8, false);
+		sim.time += 1000 * 256;
+		meter.Process();
+		if(meter.IsUpdated())
+		{
+			windows++;
+			ASSERT_EQUAL(meter.Period(), 1000);
+			ASSERT_EQUAL(meter.Cycles(), 10);
+		}
+	}
+	ASSERT_TRUE(windows >= 3);
+	ASSERT_TRUE(meter.IsOverrun());
+	cout << "\tOK" << endl;
+}
+
+typedef PinList<Pa0, Pa1, Pa2, Pa3, Pa4, Pa5, Pa6, Pa7> DacPins;
+typedef Dds<DdsPinListOutput<DacPins>, 3> Synth;
+
+const unsigned SpectrumSize = 1024;
+const uint32_t SampleRate = 32768;
+
+// Renders SpectrumSize samples, returns them in -1 .. 1 range
+void RenderSignal(double *signal)
+{
+	uint8_t block[Synth::BlockSize];
+	for(unsigned i = 0; i < SpectrumSize; i += Synth::BlockSize)
+	{
+		Synth::Render(block);
+		for(unsigned j = 0; j < Synth::BlockSize; j++)
+			signal[i + j] = (double(block[j]) - 128) / 128;
+	}
+}
+
+// Amplitude of DFT bin, full scale sine gives 1
+double BinAmplitude(const double *signal, unsigned bin)
+{
+	double re = 0, im = 0;
+	for(unsigned i = 0; i < SpectrumSize; i++)
+	{
+		double angle = 2 * M_PI * bin * i / SpectrumSize;
+		re += signal[i] * cos(angle);
+		im -= signal[i] * sin(angle);
+	}
+	return 2 * sqrt(re * re + im * im) / SpectrumSize;
+}
+
+// Largest amplitude over all bins except DC and listed ones
+double Spurious(const double *signal, const unsigned *skip, unsigned skipCount)
+{
+	double worst = 0;
+	for(unsigned bin = 1; bin < SpectrumSize / 2; bin++)
+	{
+		bool skipped = false;
+		for(unsigned i = 0; i < skipCount; i++)
+			skipped |= bin == skip[i];
+		if(!skipped)
+			worst = max(worst, BinAmplitude(signal, bin));
+	}
+	return worst;
+}
+
+void DdsSpectrumTest()
+{
+	cout << __FUNCTION__;
+	Synth::Init(SampleRate);
+	// sample rate / 2^32 resolution
+	ASSERT_EQUAL(Synth::Increment(1000), 131072000u);
+	ASSERT_EQUAL(Synth::Increment(100, 1000), 13107u);
+
+	static double signal[SpectrumSize];
+	// one voice, bin 32
+	Synth::SetFrequency(0, 32 * SampleRate / SpectrumSize);
+	Synth::SetAmplitude(0, 255);
+	Synth::SetAmplitude(1, 0);
+	Synth::SetAmplitude(2, 0);
+	RenderSignal(signal);
+	double fundamental = BinAmplitude(signal, 32);
+	ASSERT_TRUE(fundamental > 0.97 && fundamental < 1.0);
+	unsigned bins[3] = {32};
+	// 8 bit quantization keeps spurs below -40 dB
+	ASSERT_TRUE(Spurious(signal, bins, 1) < 0.01);
+
+	// three voices: sine, square and quiet sine, bins clear of square harmonics
+	Synth::Init(SampleRate);
+	Synth::SetFrequency(0, 44 * SampleRate / SpectrumSize);
+	Synth::SetAmplitude(0, 128);
+	Synth::SetFrequency(1, 8 * SampleRate / SpectrumSize);
+	Synth::SetWave(1, DdsWaves::Square);
+	Synth::SetAmplitude(1, 64);
+	Synth::SetFrequency(2, 100 * SampleRate / SpectrumSize);
+	Synth::SetAmplitude(2, 32);
+	RenderSignal(signal);
+	ASSERT_TRUE(fabs(BinAmplitude(signal, 44) - 0.5) < 0.02);
+	ASSERT_TRUE(fabs(BinAmplitude(signal, 100) - 0.125) < 0.02);
+	// square wave has odd harmonics 4 / (pi * k)
+	ASSERT_TRUE(fabs(BinAmplitude(signal, 8) - 0.25 * 4 / M_PI) < 0.02);
+	ASSERT_TRUE(fabs(BinAmplitude(signal, 24) - 0.25 * 4 / M_PI / 3) < 0.02);
+	ASSERT_TRUE(BinAmplitude(signal, 16) < 0.01);
+
+	// fractional frequency: 1000.5 Hz is 1000.5 periods in a second
+	Synth::Init(SampleRate);
+	Synth::SetFrequency(0, 100050, 100);
+	uint8_t block[Synth::BlockSize];
+	unsigned crossings = 0;
+	uint8_t previous = 128;
+	for(unsigned i = 0; i < SampleRate * 2; i += Synth::BlockSize)
+	{
+		Synth::Render(block);
+		for(unsigned j = 0; j < Synth::BlockSize; j++)
+		{
+			crossings += previous < 128 && block[j] >= 128;
+			previous = block[j];
+		}
+	}
+	ASSERT_TRUE(crossings >= 2000 && crossings <= 2002);
+	cout << "\tOK" << endl;
+}
+
+void DdsBufferTest()
+{
+	cout << __FUNCTION__;
+	typedef Dds<DdsPinListOutput<PinList<Pa8, Pa9, Pa10, Pa11> >, 1, 64, 16> Dac4;
+	Dac4::Init(8000);
+	// idle output is mid scale
+	ASSERT_EQUAL(Porta::OutReg >> 8 & 0x0f, 8);
+	ASSERT_EQUAL(Porta::DirReg >> 8 & 0x0f, 0x0f);
+	Dac4::SetFrequency(0, 500);
+	Dac4::SetAmplitude(0, 255);
+	ASSERT_EQUAL(Dac4::Fill(), 4);
+	ASSERT_EQUAL(Dac4::Fill(), 0);
+
+	// ISR output follows the rendered waveform
+	Dac4::SetPhase(0, 0);
+	uint8_t expected[16];
+	for(unsigned i = 0; i < 16; i++)
+		expected[i] = uint8_t(DdsWaves::Sine[(i * 16) & 0xff] + 128);
+	for(unsigned i = 0; i < 64; i++)
+	{
+		ASSERT_TRUE(Dac4::SampleHandler());
+		uint8_t sample = Dac4::LastSample();
+		ASSERT_EQUAL(Porta::OutReg >> 8 & 0x0f, sample >> 4);
+		int diff = int(sample) - expected[i & 15];
+		ASSERT_TRUE(diff >= -1 && diff <= 1);
+		if(i == 31)
+			ASSERT_EQUAL(Dac4::Fill(), 2);
+	}
+	ASSERT_EQUAL(Dac4::Underruns(), 0);
+	ASSERT_EQUAL(Dac4::Fill(), 2);
+	for(unsigned i = 0; i < 64; i++)
+		Dac4::SampleHandler();
+	// underrun keeps the last sample on the pins
+	uint16_t pins = Porta::OutReg;
+	ASSERT_FALSE(Dac4::SampleHandler());
+	ASSERT_EQUAL(Dac4::Underruns(), 1);
+	ASSERT_EQUAL(Porta::OutReg, pins);
+
+	// summed voices clip instead of wrapping around
+	typedef Dds<DdsPinListOutput<DacPins>, 2, 16, 16> Loud;
+	Loud::Init(8000);
+	Loud::SetWave(0, DdsWaves::Square);
+	Loud::SetWave(1, DdsWaves::Square);
+	Loud::SetAmplitude(0, 255);
+	Loud::SetAmplitude(1, 255);
+	Loud::SetFrequency(0, 1000);
+	Loud::SetFrequency(1, 1000);
+	uint8_t block[16];
+	Loud::Render(block);
+	ASSERT_EQUAL(block[0], 255);
+	ASSERT_EQUAL(block[5], 0);
+	cout << "\tOK" << endl;
+}
+
+void Benchmarks()
+{
+	cout << "Benchmarks:" << endl;
+	CaptureMeter<16> meter(100000);
+	const unsigned long iterations = 1000000;
+	uint16_t time = 0;
+	BenchmarkTimer timer("Capture ISR + Process (per edge)", iterations);
+	for(unsigned long n = 0; n < iterations; n += 8)
+	{
+		for(unsigned i = 0; i < 8; i++)
+		{
+			meter.CaptureHandler(time, (i & 1) == 0, false);
+			time += 123;
+		}
+		meter.Process();
+	}
+	timer.Report();
+	DoNotOptimize(meter.Cycles());
+
+	Synth::Init(SampleRate);
+	for(unsigned voice = 0; voice < Synth::Voices; voice++)
+		Synth::SetFrequency(voice, 1000 + voice * 333);
+	uint8_t block[Synth::BlockSize];
+	BenchmarkTimer ddsTimer("DDS render, 3 voices (per sample)", iterations);
+	for(unsigned long n = 0; n < iterations; n += Synth::BlockSize)
+	{
+		Synth::Render(block);
+		DoNotOptimize(block[0]);
+	}
+	ddsTimer.Report();
+
+	typedef Dds<DdsPinListOutput<DacPins>, 1, 64, 16> Tone;
+	Tone::Init(SampleRate);
+	Tone::SetFrequency(0, 1000);
+	BenchmarkTimer isrTimer("DDS 1 voice, Fill + ISR to R-2R pins (per sample)", iterations);
+	for(unsigned long n = 0; n < iterations; n += 64)
+	{
+		Tone::Fill();
+		while(Tone::SampleHandler())
+			;
+	}
+	isrTimer.Report();
+}
+
+int main()
+{
+	GateTimeTest();
+	ReciprocalTest();
+	OverrunTest();
+	OverrunGapTest();
+	DdsSpectrumTest();
+	DdsBufferTest();
+	Benchmarks();
+
+	std::cout << "=======================================================";
+	std::cout << "\n\t\tTests passed\n";
+	std::cout << "=======================================================";
+	return 0;
+}
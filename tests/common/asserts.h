@@ -0,0 +1,59 @@
+#pragma once
+
+#include <iostream>
+#include <stdlib.h>
+#include <time.h>
+
+// TODO: move to google test framework
+
+#define ASSERT_TRUE(value) if(!(value)){\
+    std::cout << "\nAssertion failed! "  << "\n\tFile: " << __FILE__ << std::endl << "\tfunction: " << __FUNCTION__ << "\n\tline: " << __LINE__ << std::endl;\
+    std::cout << std::hex << "\tExpacted: true" << std::boolalpha << "\tgot: " << (bool)(value);\
+    exit(1);\
+    }
+
+#define ASSERT_FALSE(value) if((value)){\
+    std::cout << "\nAssertion failed! "  << "\n\tFile: " << __FILE__ << std::endl << "\tfunction: " << __FUNCTION__ << "\n\tline: " << __LINE__ << std::endl;\
+    std::cout << std::hex << "\tExpacted: false" << std::boolalpha << "\tgot: " << (bool)(value);\
+    exit(1);\
+    }
+
+#define ASSERT_EQUAL(value, expected) if((value) != (expected)){\
+    std::cout << "\nAssertion failed! "  << "\n\tFile: " << __FILE__ << std::endl << "\tfunction: " << __FUNCTION__ << "\n\tline: " << __LINE__ << std::endl;\
+    std::cout << std::hex << "\tExpacted: 0x" << (unsigned long)(expected) << "\tgot: 0x" << (unsigned long)(value);\
+    exit(1);\
+    }
+
+// Measures wall time of a benchmark loop
+// Usage:
+//		BenchmarkTimer timer("StaticVector push", iterations);
+//		for(...) {...}
+//		timer.Report();
+class BenchmarkTimer
+{
+public:
+	BenchmarkTimer(const char *name, unsigned long iterations)
+		:_name(name), _iterations(iterations), _start(clock())
+	{}
+
+	double Report()
+	{
+		double seconds = double(clock() - _start) / CLOCKS_PER_SEC;
+		double ns = seconds * 1e9 / _iterations;
+		std::cout << std::dec << "  " << _name << ":\t" << ns << " ns/op" << std::endl;
+		return ns;
+	}
+private:
+	const char *_name;
+	unsigned long _iterations;
+	clock_t _start;
+};
+
+// Prevents compiler from optimizing away benchmark results
+template<class T>
+inline void DoNotOptimize(const T &value)
+{
+	static volatile T sink;
+	sink = value;
+	(void)sink;
+}